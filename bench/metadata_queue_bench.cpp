@@ -0,0 +1,88 @@
+// Compares metadata queue engines on synthetic steady-state workload: each input pushes one entry per frame (60 fps,
+// 90kHz clock) some time ahead of the output, and the output pops one frame window for the current input.
+//
+// Usage: metamix-queue-bench [frames]
+
+#include <chrono>
+#include <cstdlib>
+#include <iomanip>
+#include <iostream>
+#include <iterator>
+#include <memory>
+#include <vector>
+
+#include <src/metadata_kind.h>
+#include <src/metadata_queue.h>
+
+using namespace metamix;
+
+METAMIX_METADATA_KIND(BenchKind, bench, bench, "BENCH", "Benchmark")
+
+METAMIX_METADATA_KIND_MAP_TO_VALUE(BenchKind, int)
+
+namespace {
+
+constexpr TS FRAME = SYS_CLOCK_RATE / 60;
+
+/// How far ahead of the output inputs are, in frames.
+constexpr TS LEAD = 120;
+
+double
+run(MetadataQueueEngine engine, InputId inputs, TS frames)
+{
+  MetadataQueueVariant<BenchKind> q(engine);
+  auto value = std::make_shared<int>(0);
+
+  auto push_frame = [&](TS frame) {
+    for (InputId id = 0; id < inputs; id++) {
+      q.push(Metadata<BenchKind>(id, ClockTS(frame * FRAME), ClockTS(frame * FRAME), 0, value));
+    }
+  };
+
+  for (TS frame = 0; frame < LEAD; frame++) {
+    push_frame(frame);
+  }
+
+  std::vector<Metadata<BenchKind>> popped;
+  popped.reserve(1);
+
+  size_t total = 0;
+  auto start = std::chrono::steady_clock::now();
+
+  for (TS frame = 0; frame < frames; frame++) {
+    push_frame(frame + LEAD);
+
+    popped.clear();
+    total += q.pop_all(0, frame * FRAME, (frame + 1) * FRAME, std::back_inserter(popped));
+  }
+
+  auto elapsed = std::chrono::steady_clock::now() - start;
+
+  if (total != static_cast<size_t>(frames)) {
+    std::cerr << "engine " << engine << " popped " << total << " entries, expected " << frames << std::endl;
+    std::exit(EXIT_FAILURE);
+  }
+
+  return std::chrono::duration<double, std::nano>(elapsed).count() / frames;
+}
+}
+
+int
+main(int argc, char *argv[])
+{
+  TS frames = argc > 1 ? std::atoll(argv[1]) : 100'000;
+
+  std::cout << std::setw(10) << "engine" << std::setw(10) << "inputs" << std::setw(16) << "ns/frame" << std::endl;
+
+  for (InputId inputs : { 1u, 8u, 64u }) {
+    for (auto engine : { MetadataQueueEngine::HEAP,
+                         MetadataQueueEngine::RING,
+                         MetadataQueueEngine::CALENDAR,
+                         MetadataQueueEngine::LOG }) {
+      std::cout << std::setw(10) << engine << std::setw(10) << inputs << std::setw(16) << std::fixed
+                << std::setprecision(1) << run(engine, inputs, frames) << std::endl;
+    }
+  }
+
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,108 @@
+// Measures throughput of emulation prevention byte removal and insertion with each instruction set supported by the
+// CPU, on caption-sized SEI NALUs and on large NALUs, both with an escape every 100 bytes or so.
+//
+// Usage: metamix-rbsp-bench [megabytes]
+
+#include <chrono>
+#include <cstdlib>
+#include <iomanip>
+#include <iostream>
+#include <random>
+#include <vector>
+
+#include <src/h264/rbsp.h>
+
+using namespace metamix::h264;
+
+namespace {
+
+std::ostream &
+operator<<(std::ostream &os, SimdLevel level)
+{
+  switch (level) {
+  case SimdLevel::SCALAR:
+    return os << "scalar";
+  case SimdLevel::SSE2:
+    return os << "sse2";
+  case SimdLevel::AVX2:
+    return os << "avx2";
+  }
+  return os << "unknown";
+}
+
+std::vector<uint8_t>
+make_nalu(std::mt19937 &rng, size_t size)
+{
+  std::vector<uint8_t> nalu(size);
+  for (auto &byte : nalu) {
+    byte = static_cast<uint8_t>(rng() % 255 + 1);
+  }
+  for (size_t i = 50; i + 2 < size; i += 100) {
+    nalu[i] = 0x00;
+    nalu[i + 1] = 0x00;
+    nalu[i + 2] = 0x03;
+  }
+  return nalu;
+}
+
+enum class Operation
+{
+  REMOVE,
+  INSERT,
+};
+
+/// \return throughput in MB/s
+double
+run(Operation op, SimdLevel level, const std::vector<uint8_t> &nalu, size_t total_bytes)
+{
+  std::vector<uint8_t> out(nalu.size() * 3 / 2);
+  size_t iterations = total_bytes / nalu.size() + 1;
+  size_t checksum = 0;
+
+  auto start = std::chrono::steady_clock::now();
+  for (size_t i = 0; i < iterations; i++) {
+    auto end = op == Operation::REMOVE
+                 ? detail::copy_from_ebsp_bytes(nalu.data(), nalu.data() + nalu.size(), out.data(), level)
+                 : detail::copy_to_ebsp_bytes(nalu.data(), nalu.data() + nalu.size(), out.data(), level);
+    checksum += end - out.data();
+  }
+  auto elapsed = std::chrono::steady_clock::now() - start;
+
+  if (checksum == 0) {
+    std::exit(EXIT_FAILURE);
+  }
+
+  return static_cast<double>(iterations * nalu.size()) / std::chrono::duration<double, std::micro>(elapsed).count();
+}
+}
+
+int
+main(int argc, char *argv[])
+{
+  size_t total_bytes = (argc > 1 ? std::atoll(argv[1]) : 1000) * 1'000'000;
+  std::mt19937 rng(42);
+
+  std::vector<SimdLevel> levels{ SimdLevel::SCALAR };
+  if (simd_level() >= SimdLevel::SSE2) {
+    levels.push_back(SimdLevel::SSE2);
+  }
+  if (simd_level() >= SimdLevel::AVX2) {
+    levels.push_back(SimdLevel::AVX2);
+  }
+
+  std::cout << std::setw(10) << "operation" << std::setw(10) << "level" << std::setw(12) << "nalu size"
+            << std::setw(16) << "MB/s" << std::endl;
+
+  for (auto op : { Operation::REMOVE, Operation::INSERT }) {
+    for (size_t size : { 120, 64 * 1024 }) {
+      auto nalu = make_nalu(rng, size);
+      for (auto level : levels) {
+        std::cout << std::setw(10) << (op == Operation::REMOVE ? "remove" : "insert") << std::setw(10) << level
+                  << std::setw(12) << size << std::setw(16) << std::fixed << std::setprecision(1)
+                  << run(op, level, nalu, total_bytes) << std::endl;
+      }
+    }
+  }
+
+  return EXIT_SUCCESS;
+}
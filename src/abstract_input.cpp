@@ -6,26 +6,28 @@ using metamix::h264::build_empty_metadata;
 
 namespace metamix {
 
-std::optional<std::vector<Metadata<SeiKind>>>
-AbstractInput::run_query_sei(ClockTS, ClockTS, const ApplicationContext &)
+bool
+AbstractInput::run_query_sei(ClockTS, ClockTS, const ApplicationContext &, std::vector<Metadata<SeiKind>> &)
 {
-  return std::nullopt;
+  return false;
 }
 
-std::optional<std::vector<Metadata<ScteKind>>>
-AbstractInput::run_query_scte(ClockTS, ClockTS, const ApplicationContext &)
+bool
+AbstractInput::run_query_scte(ClockTS, ClockTS, const ApplicationContext &, std::vector<Metadata<ScteKind>> &)
 {
-  return std::nullopt;
+  return false;
 }
 
-std::vector<Metadata<SeiKind>>
-AbstractInput::build_empty_sei(ClockTS since_ts, ClockTS until_ts)
+void
+AbstractInput::build_empty_sei(ClockTS since_ts, ClockTS until_ts, std::vector<Metadata<SeiKind>> &found)
 {
-  return std::vector{ metamix::h264::build_empty_metadata(spec().id, std::max(since_ts, until_ts - 1_clock)) };
+  found.push_back(metamix::h264::build_empty_metadata(spec().id, std::max(since_ts, until_ts - 1_clock)));
 }
 
-std::vector<Metadata<ScteKind>> AbstractInput::build_empty_scte([[maybe_unused]] ClockTS since_ts,
-                                                                [[maybe_unused]] ClockTS until_ts)
+void
+AbstractInput::build_empty_scte([[maybe_unused]] ClockTS since_ts,
+                                [[maybe_unused]] ClockTS until_ts,
+                                [[maybe_unused]] std::vector<Metadata<ScteKind>> &found)
 {
   throw std::runtime_error("not implemented yet");
 }
@@ -1,7 +1,6 @@
 #pragma once
 
 #include <atomic>
-#include <optional>
 #include <ostream>
 #include <string>
 #include <vector>
@@ -85,27 +84,45 @@ public:
 
   virtual void schedule_restart() {}
 
+  /// Appends metadata found at pts in `[since_ts, until_ts)` to `found`, or metadata of an empty frame if there is
+  /// none and `fill_empty` is set. Callers reuse `found` across packets, so that querying does not allocate once it
+  /// has grown.
+  ///
+  /// \return whether any metadata has been found
   template<class K>
-  inline std::vector<Metadata<K>> query(ClockTS since_ts, ClockTS until_ts, const ApplicationContext &ctx)
+  inline bool query(ClockTS since_ts,
+                    ClockTS until_ts,
+                    const ApplicationContext &ctx,
+                    std::vector<Metadata<K>> &found,
+                    bool fill_empty = true)
   {
-    if (auto r = KindFuncs<K>::run_query(*this, since_ts, until_ts, ctx); r) {
-      LOG(trace) << "Found " << r->size() << " " << K::NAME << " at pts [" << since_ts << ", " << until_ts << ") "
-                 << ':' << spec().name;
-      return *r;
-    } else {
-      LOG(trace) << "No " << K::NAME << " at pts [" << since_ts << ", " << until_ts << ") :" << spec().name;
-      return KindFuncs<K>::build_empty_metadata(*this, since_ts, until_ts);
+    size_t size = found.size();
+    if (KindFuncs<K>::run_query(*this, since_ts, until_ts, ctx, found)) {
+      LOG(trace) << "Found " << found.size() - size << " " << K::NAME << " at pts [" << since_ts << ", " << until_ts
+                 << ") " << ':' << spec().name;
+      return true;
     }
+
+    LOG(trace) << "No " << K::NAME << " at pts [" << since_ts << ", " << until_ts << ") :" << spec().name;
+    if (fill_empty) {
+      KindFuncs<K>::build_empty_metadata(*this, since_ts, until_ts, found);
+    }
+    return false;
   }
 
 protected:
-  virtual std::optional<std::vector<Metadata<SeiKind>>> run_query_sei(ClockTS since_ts,
-                                                                      ClockTS until_ts,
-                                                                      const ApplicationContext &ctx);
-
-  virtual std::optional<std::vector<Metadata<ScteKind>>> run_query_scte(ClockTS since_ts,
-                                                                        ClockTS until_ts,
-                                                                        const ApplicationContext &ctx);
+  /// Appends found metadata to `found`.
+  ///
+  /// \return whether any metadata has been found
+  virtual bool run_query_sei(ClockTS since_ts,
+                             ClockTS until_ts,
+                             const ApplicationContext &ctx,
+                             std::vector<Metadata<SeiKind>> &found);
+
+  virtual bool run_query_scte(ClockTS since_ts,
+                              ClockTS until_ts,
+                              const ApplicationContext &ctx,
+                              std::vector<Metadata<ScteKind>> &found);
 
   template<class K>
   void declare_capability()
@@ -114,8 +131,8 @@ protected:
   }
 
 private:
-  std::vector<Metadata<SeiKind>> build_empty_sei(ClockTS since_ts, ClockTS until_ts);
-  std::vector<Metadata<ScteKind>> build_empty_scte(ClockTS since_ts, ClockTS until_ts);
+  void build_empty_sei(ClockTS since_ts, ClockTS until_ts, std::vector<Metadata<SeiKind>> &found);
+  void build_empty_scte(ClockTS since_ts, ClockTS until_ts, std::vector<Metadata<ScteKind>> &found);
 
   template<class K>
   struct KindFuncs
@@ -2,6 +2,7 @@
 
 #include "log.h"
 #include "program_options.h"
+#include "snapshot.h"
 
 namespace metamix {
 
@@ -13,6 +14,8 @@ ApplicationContext::ApplicationContext(std::shared_ptr<ApplicationMetadataQueueG
   , clock(std::move(clock))
   , input_manager(std::move(input_manager))
   , options(options)
+  , rescaler_states(std::make_shared<TSRescalerStates>())
+  , value_pools(std::make_shared<ApplicationValuePoolGroup>())
   , m_ts_adjustment(options->output.ts_adjustment)
 {}
 
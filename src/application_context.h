@@ -3,6 +3,7 @@
 #include <boost/signals2.hpp>
 
 #include "metadata_queue.h"
+#include "value_pool.h"
 
 namespace metamix {
 
@@ -12,8 +13,14 @@ class InputManager;
 
 class ProgramOptions;
 
+class SnapshotFile;
+
+class TSRescalerStates;
+
 using ApplicationMetadataQueueGroup = MetadataKindPack::Apply<MetadataQueueGroup>;
 
+using ApplicationValuePoolGroup = MetadataKindPack::Apply<ValuePoolGroup>;
+
 class ApplicationContext
 {
 public:
@@ -21,6 +28,13 @@ public:
   std::shared_ptr<Clock> clock;
   std::shared_ptr<InputManager> input_manager;
   std::shared_ptr<const ProgramOptions> options;
+  std::shared_ptr<TSRescalerStates> rescaler_states;
+
+  /// Memory of metadata values allocated by extractors.
+  std::shared_ptr<ApplicationValuePoolGroup> value_pools;
+
+  /// Set if metadata queues are snapshotted.
+  std::shared_ptr<SnapshotFile> snapshot_file{};
 
   boost::signals2::signal<void()> on_exit{};
 
@@ -103,4 +103,17 @@ write_48(uint64_t value, OutputIt out)
   *out++ = static_cast<uint8_t>((value & 0x0000000000ff));
   return out;
 }
+
+template<class OutputIt>
+inline OutputIt
+write_64(uint64_t value, OutputIt out)
+{
+  static_assert(
+    std::is_base_of<std::output_iterator_tag, typename std::iterator_traits<OutputIt>::iterator_category>::value,
+    "output iterator must be of output iterator category");
+
+  out = write_32(static_cast<uint32_t>(value >> 32), out);
+  out = write_32(static_cast<uint32_t>(value & 0xffffffff), out);
+  return out;
+}
 }
@@ -136,4 +136,19 @@ read_48(const uint8_t *&ptr, const uint8_t *endptr)
   ptr += 6;
   return val;
 }
+
+inline uint64_t
+scan_64(const uint8_t *ptr, const uint8_t *endptr)
+{
+  require_distance(ptr, endptr, 8);
+  return (static_cast<uint64_t>(scan_32(ptr, endptr)) << 32) + scan_32(ptr + 4, endptr);
+}
+
+inline uint64_t
+read_64(const uint8_t *&ptr, const uint8_t *endptr)
+{
+  auto val = scan_64(ptr, endptr);
+  ptr += 8;
+  return val;
+}
 }
@@ -0,0 +1,507 @@
+#pragma once
+
+#include <algorithm>
+#include <cassert>
+#include <cstdint>
+#include <iterator>
+#include <limits>
+#include <mutex>
+#include <optional>
+#include <stdexcept>
+#include <tuple>
+#include <type_traits>
+#include <vector>
+
+#include "input_generations.h"
+#include "metadata.h"
+#include "queue_budget.h"
+#include "queue_metrics.h"
+
+namespace metamix {
+
+/**
+ * @brief Metadata queue indexed by coarse time buckets (a calendar queue).
+ *
+ * Entries are hashed into buckets of fixed `bucket_width` clock ticks, stored in a circular array starting at the
+ * bucket of the oldest live entry. Each bucket is kept sorted, and since extractors push in (nearly) monotonic pts
+ * order, insertion almost always appends.
+ *
+ * A window query touches only buckets overlapping the window, and expiring everything before the window is a bump of
+ * the base bucket index. Bucket vectors keep their capacity when cleared, so steady state does not allocate.
+ *
+ * The bucket array grows up to `max_bucket_count` buckets. Entries beyond that window, as after a timestamp jump or
+ * wrap, are kept in a sorted overflow list, and move to buckets once the window reaches them. Window which runs out of
+ * entries skips right to the earliest overflow entry, instead of walking empty buckets on the way.
+ *
+ * Like MetadataQueue, dropping an input bumps its generation and its entries are skipped by later scans.
+ */
+template<class K>
+class CalendarMetadataQueue
+{
+public:
+  using Self = CalendarMetadataQueue<K>;
+  using Kind = K;
+  using MetaType = Metadata<K>;
+  using ValueType = typename MetaType::ValueType;
+
+  /// One frame at 60 fps in 90kHz clock.
+  static constexpr TS DEFAULT_BUCKET_WIDTH = 1500;
+  static constexpr size_t DEFAULT_BUCKET_COUNT = 256;
+
+  /// About a minute at default bucket width.
+  static constexpr size_t DEFAULT_MAX_BUCKET_COUNT = 4096;
+
+private:
+  struct Entry
+  {
+    MetaType meta;
+    InputGenerations::Generation generation;
+    size_t bytes;
+  };
+
+  using Bucket = std::vector<Entry>;
+
+  mutable std::mutex m{};
+
+  const TS m_bucket_width;
+
+  /// Limit of bucket array size, a power of two.
+  const size_t m_max_buckets;
+
+  /// Circular array of buckets, size is always a power of two.
+  std::vector<Bucket> m_buckets;
+
+  /// Sorted entries at least `m_max_buckets` buckets after base, which do not fit the bucket array.
+  std::vector<Entry> m_overflow{};
+
+  /// Absolute number of bucket at m_buckets[m_base & mask], every entry earlier than it has been expired.
+  TS m_base{ std::numeric_limits<TS>::min() };
+
+  /// Entries earlier than watermark have been passed by consumer, and are dropped instead of enqueued. It follows the
+  /// end of the latest lookup window, so that it goes back with the clock.
+  TS m_watermark{ std::numeric_limits<TS>::min() };
+
+  /// Count of stored entries, including stale ones.
+  size_t m_size{ 0 };
+
+  /// Count of stored entries in buckets, including stale ones.
+  size_t m_window_size{ 0 };
+
+  /// Footprint of stored entries, including stale ones.
+  size_t m_stored_bytes{ 0 };
+
+  InputGenerations m_generations{};
+
+  const QueueBudget m_budget;
+  size_t m_evicted_entries{ 0 };
+  size_t m_evicted_bytes{ 0 };
+
+  /// Count of entries dropped for being pushed behind watermark.
+  size_t m_late_entries{ 0 };
+
+public:
+  explicit CalendarMetadataQueue(TS bucket_width = DEFAULT_BUCKET_WIDTH,
+                                 size_t bucket_count = DEFAULT_BUCKET_COUNT,
+                                 QueueBudget budget = {},
+                                 size_t max_bucket_count = DEFAULT_MAX_BUCKET_COUNT)
+    : m_bucket_width{ bucket_width }
+    , m_max_buckets{ round_up_pow2(std::max(bucket_count, max_bucket_count)) }
+    , m_buckets(round_up_pow2(bucket_count))
+    , m_budget{ budget }
+  {
+    if (bucket_width <= 0) {
+      throw std::invalid_argument("bucket width must be positive");
+    }
+  }
+
+  CalendarMetadataQueue(const Self &) = delete;
+  Self &operator=(const Self &) = delete;
+
+  bool empty() const noexcept { return size() == 0; }
+
+  size_t size() const noexcept
+  {
+    std::lock_guard<std::mutex> guard(m);
+    return m_generations.live();
+  }
+
+  QueueStats stats() const
+  {
+    std::lock_guard<std::mutex> guard(m);
+    return QueueStats{
+      m_generations.live(), m_generations.live_bytes(), m_evicted_entries, m_evicted_bytes, m_late_entries
+    };
+  }
+
+  void push(MetaType value)
+  {
+    std::lock_guard<std::mutex> guard(m);
+    push_impl(std::move(value));
+  }
+
+  /// Pushes all values with single lock acquisition.
+  template<class InputIt>
+  void push_range(InputIt first, InputIt last)
+  {
+    std::lock_guard<std::mutex> guard(m);
+    for (; first != last; ++first) {
+      push_impl(*first);
+    }
+  }
+
+  /// Pops value earliest in given time frame, assigned to given input id from queue.
+  /// Drops all values which were earlier in queue, and values of other inputs colliding with popped one.
+  ///
+  /// \param id       input id, popped value must by assigned to it, other values will be dropped
+  /// \param since    start time for lookup, inclusive
+  /// \param until    end time for lookup, exclusive
+  /// \param on_drop  called with each dropped live value and DropReason
+  /// \return popped value or nothing if queue is empty
+  template<class OnDrop = IgnoreDrops>
+  std::optional<MetaType> pop(InputId id, TS since, TS until, OnDrop &&on_drop = {})
+  {
+    std::lock_guard<std::mutex> guard(m);
+
+    std::optional<MetaType> result{};
+    scan(until, [&](MetaType &value) {
+      if (result) {
+        // Drop colliding metadata of other inputs, stop on first later item. Further items of the same input and pts
+        // are ordered right after the popped one, keep them for subsequent pops, like MetadataQueue does.
+        if (value.pts != result->pts || value.input_id == result->input_id) {
+          return false;
+        }
+      } else if (value.pts >= since && value.input_id == id) {
+        result.emplace(std::move(value));
+        return true;
+      }
+
+      on_drop(value, passed_drop_reason(value, id, since));
+      return true;
+    });
+
+    if (!result) {
+      m_watermark = until;
+    }
+
+    return result;
+  }
+
+  /// Pops all values in given time frame, assigned to given input id from queue. Moves popped value to output iterator.
+  /// Drops all other values since queue begin to `until` time from queue.
+  ///
+  /// \tparam     OutputIt  output iterator type
+  /// \param      id        input id, popped value must by assigned to it, other values will be dropped
+  /// \param      since     start time for lookup, inclusive
+  /// \param      until     end time for lookup, exclusive
+  /// \param[out] out       output iterator, popped values will be moved here
+  /// \param      on_drop   called with each dropped live value and DropReason
+  /// \return               count of popped items
+  template<class OutputIt, class OnDrop = IgnoreDrops>
+  unsigned int pop_all(InputId id, TS since, TS until, OutputIt out, OnDrop &&on_drop = {})
+  {
+    static_assert(
+      std::is_base_of<std::output_iterator_tag, typename std::iterator_traits<OutputIt>::iterator_category>::value,
+      "output iterator must be of output iterator category");
+
+    std::lock_guard<std::mutex> guard(m);
+
+    unsigned int count = 0;
+    scan(until, [&](MetaType &value) {
+      if (value.pts >= since && value.input_id == id) {
+        *out++ = std::move(value);
+        count++;
+      } else {
+        on_drop(value, passed_drop_reason(value, id, since));
+      }
+      return true;
+    });
+
+    m_watermark = until;
+    return count;
+  }
+
+  /// Drops all entries of given input, in constant time.
+  ///
+  /// \return count of dropped entries
+  size_t drop_id(InputId id)
+  {
+    std::lock_guard<std::mutex> guard(m);
+    return m_generations.drop(id);
+  }
+
+  /// Copies all live entries to output iterator in queue order, payloads are shared. Queue is left intact.
+  template<class OutputIt>
+  void snapshot(OutputIt out) const
+  {
+    std::lock_guard<std::mutex> guard(m);
+
+    for (TS b = m_base; m_window_size > 0 && b < m_base + static_cast<TS>(m_buckets.size()); b++) {
+      for (const Entry &entry : m_buckets[static_cast<size_t>(b) & (m_buckets.size() - 1)]) {
+        if (m_generations.is_live(entry.meta.input_id, entry.generation)) {
+          *out++ = entry.meta;
+        }
+      }
+    }
+
+    for (const Entry &entry : m_overflow) {
+      if (m_generations.is_live(entry.meta.input_id, entry.generation)) {
+        *out++ = entry.meta;
+      }
+    }
+  }
+
+private:
+  void push_impl(MetaType value)
+  {
+    if (value.pts < m_watermark) {
+      m_late_entries++;
+      return;
+    }
+
+    size_t bytes = metadata_footprint(value);
+    if (!m_budget.make_room(
+          value.input_id,
+          bytes,
+          m_size,
+          m_stored_bytes,
+          m_generations,
+          [&]() { return evict_first([](const Entry &) { return true; }); },
+          [&](InputId id) { return evict_first([&](const Entry &e) { return e.meta.input_id == id; }); })) {
+      m_evicted_entries++;
+      m_evicted_bytes += bytes;
+      return;
+    }
+
+    TS b = bucket_of(value.pts);
+
+    // Window is empty only if overflow is, see refill().
+    assert(m_window_size > 0 || m_overflow.empty());
+    if (m_window_size == 0) {
+      m_base = b;
+    } else if (b < m_base) {
+      rebase(b);
+    }
+
+    auto generation = m_generations.acquire(value.input_id, bytes);
+    Entry entry{ std::move(value), generation, bytes };
+    if (b - m_base >= static_cast<TS>(m_max_buckets)) {
+      insert_sorted(m_overflow, std::move(entry));
+    } else {
+      if (b - m_base >= static_cast<TS>(m_buckets.size())) {
+        grow(b - m_base + 1);
+      }
+      insert_sorted(bucket_at(b), std::move(entry));
+      m_window_size++;
+    }
+    m_size++;
+    m_stored_bytes += bytes;
+  }
+
+  static bool less(const Entry &lhs_entry, const Entry &rhs_entry)
+  {
+    const MetaType &lhs = lhs_entry.meta;
+    const MetaType &rhs = rhs_entry.meta;
+    return std::tie(lhs.pts, lhs.input_id, lhs.order) < std::tie(rhs.pts, rhs.input_id, rhs.order);
+  }
+
+  static void insert_sorted(std::vector<Entry> &entries, Entry entry)
+  {
+    auto pos = std::upper_bound(entries.begin(), entries.end(), entry, less);
+    entries.insert(pos, std::move(entry));
+  }
+
+  static size_t round_up_pow2(size_t x)
+  {
+    size_t r = 1;
+    while (r < x) {
+      r <<= 1;
+    }
+    return r;
+  }
+
+  TS bucket_of(TS ts) const noexcept
+  {
+    // Floor division, timestamps may be negative.
+    TS q = ts / m_bucket_width;
+    return (ts % m_bucket_width < 0) ? q - 1 : q;
+  }
+
+  Bucket &bucket_at(TS b) noexcept { return m_buckets[static_cast<size_t>(b) & (m_buckets.size() - 1)]; }
+
+  /// Visits live entries earlier than `until` in queue order, removing each visited one, until visitor returns false.
+  /// Stale entries on the way are removed without visiting. Fully drained buckets are expired by moving base forward.
+  template<class Visitor>
+  void scan(TS until, Visitor &&vis)
+  {
+    scan_window(until, vis);
+    refill();
+  }
+
+  template<class Visitor>
+  void scan_window(TS until, Visitor &vis)
+  {
+    TS last = bucket_of(until - 1);
+
+    for (; m_base <= last && m_size > 0; m_base++) {
+      if (m_window_size == 0) {
+        // Skip empty buckets up to the earliest overflow entry.
+        refill();
+        if (m_base > last) {
+          return;
+        }
+      }
+
+      Bucket &bucket = bucket_at(m_base);
+
+      auto it = bucket.begin();
+      for (; it != bucket.end() && it->meta.pts < until; it++) {
+        if (!m_generations.is_live(it->meta.input_id, it->generation)) {
+          continue;
+        }
+        if (!vis(it->meta)) {
+          break;
+        }
+        m_generations.release(it->meta.input_id, it->generation, it->bytes);
+      }
+
+      m_size -= it - bucket.begin();
+      m_window_size -= it - bucket.begin();
+      for (auto e = bucket.begin(); e != it; e++) {
+        m_stored_bytes -= e->bytes;
+      }
+      bucket.erase(bucket.begin(), it);
+
+      if (!bucket.empty()) {
+        // Either visitor stopped or the rest is not earlier than `until`.
+        return;
+      }
+    }
+  }
+
+  /// Evicts earliest live entry matching predicate, removing stale entries before it on the way.
+  ///
+  /// \return false if there is no such entry
+  template<class Predicate>
+  bool evict_first(Predicate &&pred)
+  {
+    bool evicted = false;
+    for (TS b = m_base; !evicted && m_window_size > 0 && b < m_base + static_cast<TS>(m_buckets.size()); b++) {
+      size_t erased = 0;
+      evicted = evict_first(bucket_at(b), pred, erased);
+      m_window_size -= erased;
+    }
+
+    if (!evicted) {
+      size_t erased = 0;
+      evicted = evict_first(m_overflow, pred, erased);
+    }
+
+    refill();
+    return evicted;
+  }
+
+  /// Evicts earliest live entry of given entries matching predicate, removing stale entries before it.
+  template<class Predicate>
+  bool evict_first(std::vector<Entry> &entries, Predicate &pred, size_t &erased)
+  {
+    for (auto it = entries.begin(); it != entries.end();) {
+      bool live = m_generations.is_live(it->meta.input_id, it->generation);
+      if (live && !pred(*it)) {
+        it++;
+        continue;
+      }
+
+      if (live) {
+        m_generations.release(it->meta.input_id, it->generation, it->bytes);
+        m_evicted_entries++;
+        m_evicted_bytes += it->bytes;
+      }
+
+      m_size--;
+      m_stored_bytes -= it->bytes;
+      it = entries.erase(it);
+      erased++;
+
+      if (live) {
+        return true;
+      }
+    }
+    return false;
+  }
+
+  /// Moves overflow entries which fit the window into buckets. Empty window is moved to the earliest overflow entry
+  /// first, so that the window is empty only if overflow is.
+  void refill()
+  {
+    if (m_overflow.empty()) {
+      return;
+    }
+
+    if (m_window_size == 0) {
+      m_base = bucket_of(m_overflow.front().meta.pts);
+    }
+
+    auto it = m_overflow.begin();
+    for (; it != m_overflow.end(); it++) {
+      TS b = bucket_of(it->meta.pts);
+      if (b - m_base >= static_cast<TS>(m_max_buckets)) {
+        break;
+      }
+      if (b - m_base >= static_cast<TS>(m_buckets.size())) {
+        grow(b - m_base + 1);
+      }
+      insert_sorted(bucket_at(b), std::move(*it));
+      m_window_size++;
+    }
+    m_overflow.erase(m_overflow.begin(), it);
+  }
+
+  /// Moves entries of buckets `first` and later to the front of overflow.
+  void spill(TS first)
+  {
+    std::vector<Entry> spilled{};
+    for (TS b = first; b < m_base + static_cast<TS>(m_buckets.size()); b++) {
+      Bucket &bucket = bucket_at(b);
+      m_window_size -= bucket.size();
+      std::move(bucket.begin(), bucket.end(), std::back_inserter(spilled));
+      bucket.clear();
+    }
+    m_overflow.insert(
+      m_overflow.begin(), std::make_move_iterator(spilled.begin()), std::make_move_iterator(spilled.end()));
+  }
+
+  /// Makes space for entries `n` buckets ahead of base, `n` does not exceed `m_max_buckets`.
+  void grow(TS n)
+  {
+    std::vector<Bucket> buckets(round_up_pow2(static_cast<size_t>(n)));
+    for (TS b = m_base; b < m_base + static_cast<TS>(m_buckets.size()); b++) {
+      std::swap(buckets[static_cast<size_t>(b) & (buckets.size() - 1)], bucket_at(b));
+    }
+    m_buckets = std::move(buckets);
+  }
+
+  /// Moves base back to bucket `b`, which is needed for out-of-order entries. Entries which no longer fit the window,
+  /// as when timestamps jump back, are moved to overflow.
+  void rebase(TS b)
+  {
+    TS max_last = b + static_cast<TS>(m_max_buckets) - 1;
+    if (max_last < m_base + static_cast<TS>(m_buckets.size()) - 1) {
+      spill(std::max(max_last + 1, m_base));
+    }
+
+    TS last = b;
+    for (TS i = m_base + static_cast<TS>(m_buckets.size()) - 1; m_window_size > 0 && i >= m_base; i--) {
+      if (!bucket_at(i).empty()) {
+        last = i;
+        break;
+      }
+    }
+
+    if (last - b >= static_cast<TS>(m_buckets.size())) {
+      grow(last - b + 1);
+    }
+
+    m_base = b;
+  }
+};
+}
@@ -10,19 +10,26 @@ using metamix::scte35::SpliceNull;
 
 namespace metamix {
 
-std::optional<std::vector<Metadata<SeiKind>>>
-ClearInput::run_query_sei(ClockTS since_ts, ClockTS until_ts, const ApplicationContext &)
+bool
+ClearInput::run_query_sei(ClockTS since_ts,
+                          ClockTS until_ts,
+                          const ApplicationContext &,
+                          std::vector<Metadata<SeiKind>> &found)
 {
-  auto meta = build_cc_reset_metadata(m_spec.id, std::max(since_ts, until_ts - 1_clock));
-  return std::make_optional<std::vector<Metadata<SeiKind>>>({ std::move(meta) });
+  found.push_back(build_cc_reset_metadata(m_spec.id, std::max(since_ts, until_ts - 1_clock)));
+  return true;
 }
 
-std::optional<std::vector<Metadata<ScteKind>>>
-ClearInput::run_query_scte(ClockTS since_ts, ClockTS until_ts, const ApplicationContext &)
+bool
+ClearInput::run_query_scte(ClockTS since_ts,
+                           ClockTS until_ts,
+                           const ApplicationContext &,
+                           std::vector<Metadata<ScteKind>> &found)
 {
+  static auto SPLICE_NULL = std::make_shared<SpliceInfoSection>(false, 0, 0, 0, 0xfff, SpliceNull{});
+
   auto ts = std::max(since_ts, until_ts - 1_clock);
-  auto br = std::make_shared<SpliceInfoSection>(false, 0, 0, 0, 0xfff, SpliceNull{});
-  Metadata<ScteKind> meta(m_spec.id, ts, ts, 0, std::move(br));
-  return std::make_optional<std::vector<Metadata<ScteKind>>>({ std::move(meta) });
+  found.emplace_back(m_spec.id, ts, ts, 0, SPLICE_NULL);
+  return true;
 }
 }
@@ -26,12 +26,14 @@ public:
   const InputSpec &spec() const override { return m_spec; };
 
 protected:
-  virtual std::optional<std::vector<Metadata<SeiKind>>> run_query_sei(ClockTS since_ts,
-                                                                      ClockTS until_ts,
-                                                                      const ApplicationContext &ctx);
-
-  virtual std::optional<std::vector<Metadata<ScteKind>>> run_query_scte(ClockTS since_ts,
-                                                                        ClockTS until_ts,
-                                                                        const ApplicationContext &ctx);
+  virtual bool run_query_sei(ClockTS since_ts,
+                             ClockTS until_ts,
+                             const ApplicationContext &ctx,
+                             std::vector<Metadata<SeiKind>> &found);
+
+  virtual bool run_query_scte(ClockTS since_ts,
+                              ClockTS until_ts,
+                              const ApplicationContext &ctx,
+                              std::vector<Metadata<ScteKind>> &found);
 };
 }
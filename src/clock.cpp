@@ -40,6 +40,17 @@ TSRescaler::rescale_to_clock(StreamTS ts)
 
   auto r = m_base + rescale_ts<StreamTS, ClockTS>(ts - *m_ts_zero, m_local_time_base, m_clock->time_base());
 
+  if (m_max_resume_drift) {
+    auto now = m_clock->now();
+    if (r - now > *m_max_resume_drift || now - r > *m_max_resume_drift) {
+      LOG(debug) << "Stream timestamps are discontinued, not resuming rescaler state";
+      m_base = now;
+      m_ts_zero = ts;
+      r = now;
+    }
+    m_max_resume_drift.reset();
+  }
+
   // LOG(trace) << "ts: " << ts << ", "
   //            << "m_local_time_base: " << m_local_time_base << ", "
   //            << "m_ts_zero: " << *m_ts_zero << ", "
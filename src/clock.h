@@ -28,21 +28,36 @@ rescale_ts(From ts, typename From::TimeBaseType intb, typename To::TimeBaseType
 class Clock
 {
 private:
-  std::atomic<TS> m_val{ 0 };
+  std::atomic<TS> m_own_val{ 0 };
+
+  /// Storage shared with other processes, if any.
+  std::shared_ptr<std::atomic<TS>> m_shared_val{};
+
+  std::atomic<TS> &m_val;
   ClockTimeBase m_my_time_base{ 1, SYS_CLOCK_RATE };
 
 public:
-  Clock() = default;
+  Clock()
+    : m_val(m_own_val)
+  {}
 
   explicit Clock(ClockTS initial_value)
-    : m_val(initial_value)
+    : m_own_val(initial_value)
+    , m_val(m_own_val)
   {}
 
   Clock(ClockTS initial_value, ClockTimeBase time_base)
-    : m_val(initial_value)
+    : m_own_val(initial_value)
+    , m_val(m_own_val)
     , m_my_time_base(time_base)
   {}
 
+  /// Creates clock keeping its value in external storage, e.g. in shared memory, so that other processes see it.
+  explicit Clock(std::shared_ptr<std::atomic<TS>> shared_value)
+    : m_shared_val(std::move(shared_value))
+    , m_val(*m_shared_val)
+  {}
+
   ClockTS now() const volatile noexcept { return ClockTS(m_val); }
 
   /// Guaranteed to be constant during entire clock life time.
@@ -75,17 +90,36 @@ public:
     : m_clock(std::move(clock))
   {}
 
+  /// Creates ticker which treats `last_ts` as already ticked, so that the clock continues from its current value.
+  TSTicker(std::shared_ptr<Clock> clock, ClockTS last_ts)
+    : m_clock(std::move(clock))
+    , m_last_ts(last_ts)
+  {}
+
   void tick(ClockTS ts);
 };
 
 class TSRescaler
 {
+public:
+  /// Mapping of stream timestamps to clock, it can be persisted and resumed later.
+  struct State
+  {
+    ClockTS base;
+    std::optional<StreamTS> ts_zero;
+
+    bool operator==(const State &rhs) const { return base == rhs.base && ts_zero == rhs.ts_zero; }
+  };
+
 private:
   std::shared_ptr<Clock> m_clock;
   StreamTimeBase m_local_time_base;
   ClockTS m_base;
   std::optional<StreamTS> m_ts_zero{};
 
+  /// Set for resumed rescaler until the first rescale.
+  std::optional<ClockTS> m_max_resume_drift{};
+
 public:
   TSRescaler(std::shared_ptr<Clock> clock, ClockTS base, StreamTimeBase local_time_base) noexcept
     : m_clock(std::move(clock))
@@ -93,6 +127,19 @@ public:
     , m_base(base)
   {}
 
+  /// Creates rescaler continuing given state. If the first rescaled timestamp is further than `max_drift` from clock,
+  /// the stream is considered discontinued, and the rescaler starts relative to clock instead.
+  static TSRescaler resumed(std::shared_ptr<Clock> clock,
+                            const State &state,
+                            StreamTimeBase local_time_base,
+                            ClockTS max_drift) noexcept
+  {
+    TSRescaler r(std::move(clock), state.base, local_time_base);
+    r.m_ts_zero = state.ts_zero;
+    r.m_max_resume_drift = max_drift;
+    return r;
+  }
+
   static TSRescaler clock_relative(std::shared_ptr<Clock> clock, StreamTimeBase local_time_base) noexcept
   {
     auto clock_delta = clock->now();
@@ -100,5 +147,7 @@ public:
   }
 
   ClockTS rescale_to_clock(StreamTS ts);
+
+  State state() const noexcept { return State{ m_base, m_ts_zero }; }
 };
 }
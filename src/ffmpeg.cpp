@@ -1,5 +1,10 @@
 #include "ffmpeg.h"
 
+#include <algorithm>
+#include <cassert>
+#include <climits>
+#include <cstring>
+
 std::runtime_error
 ff::runtime_error(const std::string &description, int e)
 {
@@ -33,6 +38,12 @@ ff::AVPacketDeleter::operator()(AVPacket *o) const
   av_packet_free(&o);
 }
 
+void
+ff::AVBufferPoolDeleter::operator()(AVBufferPool *o) const
+{
+  av_buffer_pool_uninit(&o);
+}
+
 ff::AVPacketUniquePtr
 ff::packet_alloc()
 {
@@ -58,6 +69,56 @@ ff::shrink_packet(AVPacket &pkt, int size)
   av_shrink_packet(&pkt, size);
 }
 
+AVBufferRef *
+ff::PacketBufferPool::get(size_t size)
+{
+  size_t needed = size + AV_INPUT_BUFFER_PADDING_SIZE;
+
+  if (!m_pool || m_buffer_size < needed) {
+    m_buffer_size = std::max(needed, 2 * m_buffer_size);
+    m_pool.reset(av_buffer_pool_init(m_buffer_size, nullptr));
+    if (!m_pool) {
+      throw std::runtime_error("Could not allocate packet buffer pool");
+    }
+  }
+
+  AVBufferRef *buf = av_buffer_pool_get(m_pool.get());
+  if (!buf) {
+    throw std::runtime_error("Could not allocate packet buffer");
+  }
+
+  std::memset(buf->data + size, 0, AV_INPUT_BUFFER_PADDING_SIZE);
+  return buf;
+}
+
+size_t
+ff::splice_packet(AVPacket &pkt, size_t begin, size_t end, const uint8_t *data, size_t size, PacketBufferPool &pool)
+{
+  assert(begin <= end && end <= static_cast<size_t>(pkt.size));
+
+  if (size == end - begin && pkt.buf && av_buffer_is_writable(pkt.buf)) {
+    std::memcpy(pkt.data + begin, data, size);
+    return size;
+  }
+
+  size_t new_size = pkt.size - (end - begin) + size;
+  if (new_size > INT_MAX - AV_INPUT_BUFFER_PADDING_SIZE) {
+    throw std::length_error("Spliced AVPacket is too large");
+  }
+
+  AVBufferRef *buf = pool.get(new_size);
+  std::memcpy(buf->data, pkt.data, begin);
+  std::memcpy(buf->data + begin, data, size);
+  std::memcpy(buf->data + begin + size, pkt.data + end, pkt.size - end);
+
+  av_buffer_unref(&pkt.buf);
+  pkt.buf = buf;
+  pkt.data = buf->data;
+  pkt.size = static_cast<int>(new_size);
+
+  return new_size;
+}
+
 ff::AVPacketUnrefGuard::AVPacketUnrefGuard(AVPacket *packet)
   : m_pkt(packet)
 {}
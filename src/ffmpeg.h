@@ -43,9 +43,15 @@ struct AVPacketDeleter
   void operator()(AVPacket *o) const;
 };
 
+struct AVBufferPoolDeleter
+{
+  void operator()(AVBufferPool *o) const;
+};
+
 using AVFormatContextUniquePtr = std::unique_ptr<AVFormatContext, AVFormatContextDeleter>;
 using AVCodecContextUniquePtr = std::unique_ptr<AVCodecContext, AVCodecContextDeleter>;
 using AVPacketUniquePtr = std::unique_ptr<AVPacket, AVPacketDeleter>;
+using AVBufferPoolUniquePtr = std::unique_ptr<AVBufferPool, AVBufferPoolDeleter>;
 
 AVPacketUniquePtr
 packet_alloc();
@@ -56,6 +62,35 @@ grow_packet(AVPacket &pkt, int grow_by);
 void
 shrink_packet(AVPacket &pkt, int size);
 
+/**
+ * @brief Pool of packet buffers, which are reused once muxer releases the packets.
+ *
+ * Buffers of pool are of the same size, so the pool is replaced by one with buffers of twice the size, when a larger
+ * buffer is requested. Buffers of replaced pool are freed when released.
+ */
+class PacketBufferPool
+{
+private:
+  AVBufferPoolUniquePtr m_pool{};
+  size_t m_buffer_size{ 0 };
+
+public:
+  /// \return buffer with room for `size` bytes, followed by zeroed padding
+  AVBufferRef *get(size_t size);
+};
+
+/**
+ * @brief Replaces bytes `[begin, end)` of packet data by `size` bytes of `data`.
+ *
+ * Packet data are overwritten in place if their buffer is writable and their size does not change. Otherwise, packet
+ * gets buffer from pool, to which the bytes around the range and the new bytes are copied, so packet data are copied
+ * once at most.
+ *
+ * \return count of bytes copied
+ */
+size_t
+splice_packet(AVPacket &pkt, size_t begin, size_t end, const uint8_t *data, size_t size, PacketBufferPool &pool);
+
 class AVPacketUnrefGuard
 {
 private:
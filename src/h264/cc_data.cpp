@@ -0,0 +1,152 @@
+#include "cc_data.h"
+
+#include <algorithm>
+#include <cassert>
+
+#include "../binary_parser.h"
+
+namespace metamix::h264 {
+
+namespace {
+
+constexpr uint8_t PROCESS_CC_DATA_FLAG = 0b0100'0000;
+constexpr uint8_t CC_COUNT_MASK = 0b0001'1111;
+constexpr uint8_t CC_VALID_FLAG = 0b0000'0100;
+constexpr uint8_t CC_TYPE_MASK = 0b0000'0011;
+
+/// `marker_bits` of each triplet, and of `user_data_type_structure` following them.
+constexpr uint8_t CC_MARKER_BITS = 0b1111'1000;
+constexpr uint8_t CC_DATA_MARKER_BITS = 0xFF;
+}
+
+std::ostream &
+operator<<(std::ostream &os, CcType type)
+{
+  switch (type) {
+  case CcType::NTSC_CC_FIELD_1:
+    return os << "NTSC_CC_FIELD_1";
+  case CcType::NTSC_CC_FIELD_2:
+    return os << "NTSC_CC_FIELD_2";
+  case CcType::DTVCC_PACKET_DATA:
+    return os << "DTVCC_PACKET_DATA";
+  case CcType::DTVCC_PACKET_START:
+    return os << "DTVCC_PACKET_START";
+  }
+  return os << "UNKNOWN";
+}
+
+CcData
+parse_cc_data(const SeiPayload &sei)
+{
+  assert(is_closed_caption(sei));
+
+  const uint8_t *pos = sei.data() + CC_T35_HEADER.size();
+  const uint8_t *end = sei.data() + sei.size();
+
+  if (end - pos < 2) {
+    throw BinaryParseError("malformed cc_data, missing header", pos - sei.data(), end - pos);
+  }
+
+  CcData cc_data{};
+  uint8_t flags = pos[0];
+  cc_data.em_data = pos[1];
+  pos += 2;
+
+  size_t cc_count = flags & CC_COUNT_MASK;
+  if (static_cast<size_t>(end - pos) < cc_count * 3) {
+    throw BinaryParseError("malformed cc_data, truncated triplets", pos - sei.data(), end - pos);
+  }
+
+  if ((flags & PROCESS_CC_DATA_FLAG) == 0) {
+    return cc_data;
+  }
+
+  for (size_t i = 0; i < cc_count; i++, pos += 3) {
+    cc_data.triplets[i] = CcTriplet{ (pos[0] & CC_VALID_FLAG) != 0,
+                                     static_cast<CcType>(pos[0] & CC_TYPE_MASK),
+                                     pos[1],
+                                     pos[2] };
+  }
+  cc_data.cc_count = static_cast<uint8_t>(cc_count);
+
+  return cc_data;
+}
+
+OwnedSeiPayload
+build_cc_data_payload(const CcTriplet *first, const CcTriplet *last, uint8_t em_data)
+{
+  assert(0 <= last - first && static_cast<size_t>(last - first) <= CcData::MAX_CC_COUNT);
+
+  std::array<uint8_t, CC_T35_HEADER.size() + 2 + CcData::MAX_CC_COUNT * 3 + 1> data{};
+  auto dest = std::copy(CC_T35_HEADER.begin(), CC_T35_HEADER.end(), data.begin());
+
+  *dest++ = PROCESS_CC_DATA_FLAG | static_cast<uint8_t>(last - first);
+  *dest++ = em_data;
+
+  for (; first != last; first++) {
+    *dest++ = CC_MARKER_BITS | (first->valid ? CC_VALID_FLAG : 0) | static_cast<uint8_t>(first->type);
+    *dest++ = first->data_1;
+    *dest++ = first->data_2;
+  }
+
+  *dest++ = CC_DATA_MARKER_BITS;
+
+  // Largest `cc_data` fits in inline storage of payload, so it is copied there without allocation
+  return OwnedSeiPayload(SeiType::USER_DATA_REGISTERED, data, dest - data.begin());
+}
+
+bool
+CcDataCoalescer::add(const SeiPayload &sei)
+{
+  if (!is_closed_caption(sei)) {
+    return false;
+  }
+
+  CcData cc_data;
+  try {
+    cc_data = parse_cc_data(sei);
+  } catch (BinaryParseError &) {
+    return false;
+  }
+
+  for (const auto &triplet : cc_data) {
+    if (triplet.is_ntsc()) {
+      if (triplet.valid) {
+        (triplet.type == CcType::NTSC_CC_FIELD_1 ? m_field_1 : m_field_2).push_back(triplet);
+      }
+    } else if (triplet.valid || m_dtvcc_open) {
+      m_dtvcc.push_back(triplet);
+      m_dtvcc_open = triplet.valid;
+    }
+  }
+  m_pending = true;
+
+  return true;
+}
+
+size_t
+CcDataCoalescer::take(std::vector<CcTriplet> &queue, size_t limit, CcTriplet *triplets, size_t count, size_t capacity)
+{
+  size_t taken = std::min({ queue.size(), limit, capacity - std::min(count, capacity) });
+  std::copy(queue.begin(), queue.begin() + taken, triplets + count);
+  queue.erase(queue.begin(), queue.begin() + taken);
+  return count + taken;
+}
+
+void
+CcDataCoalescer::drop_overflow()
+{
+  // Each field carries one CEA-608 pair per frame
+  auto drop = [&](std::vector<CcTriplet> &queue, size_t max_backlog) {
+    if (queue.size() > max_backlog) {
+      size_t excess = queue.size() - max_backlog;
+      queue.erase(queue.begin(), queue.begin() + excess);
+      m_dropped += excess;
+    }
+  };
+
+  drop(m_field_1, MAX_DEFERRED_FRAMES);
+  drop(m_field_2, MAX_DEFERRED_FRAMES);
+  drop(m_dtvcc, MAX_DEFERRED_FRAMES * m_cc_count);
+}
+}
@@ -0,0 +1,179 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <cstdint>
+#include <ostream>
+#include <vector>
+
+#include "sei_payload.h"
+
+namespace metamix::h264 {
+
+/*
+ * Table 4 – cc_type values in CEA-708-E, section 4.4
+ */
+enum class CcType : uint8_t
+{
+  NTSC_CC_FIELD_1 = 0,
+  NTSC_CC_FIELD_2 = 1,
+  DTVCC_PACKET_DATA = 2,
+  DTVCC_PACKET_START = 3,
+};
+
+std::ostream &
+operator<<(std::ostream &os, CcType type);
+
+/// One `cc_data_pkt` of `cc_data`, carrying a byte pair of CEA-608 field or of DTVCC packet.
+struct CcTriplet
+{
+  bool valid{ false };
+  CcType type{ CcType::DTVCC_PACKET_DATA };
+  uint8_t data_1{ 0 };
+  uint8_t data_2{ 0 };
+
+  /// Whether triplet carries CEA-608 data, which precedes DTVCC data in `cc_data`.
+  constexpr bool is_ntsc() const { return type == CcType::NTSC_CC_FIELD_1 || type == CcType::NTSC_CC_FIELD_2; }
+
+  constexpr bool operator==(const CcTriplet &rhs) const
+  {
+    return valid == rhs.valid && type == rhs.type && data_1 == rhs.data_1 && data_2 == rhs.data_2;
+  }
+
+  constexpr bool operator!=(const CcTriplet &rhs) const { return !(*this == rhs); }
+};
+
+/**
+ * @brief `cc_data` of ATSC A/53 closed caption SEI payload.
+ *
+ * Triplets are held inline, as `cc_count` is a 5-bit field, so parsing does not allocate.
+ */
+struct CcData
+{
+  static constexpr size_t MAX_CC_COUNT = 31;
+
+  uint8_t em_data{ 0 };
+  uint8_t cc_count{ 0 };
+  std::array<CcTriplet, MAX_CC_COUNT> triplets{};
+
+  const CcTriplet *begin() const { return triplets.data(); }
+
+  const CcTriplet *end() const { return triplets.data() + cc_count; }
+};
+
+/**
+ * @brief Parses `cc_data` of closed caption SEI payload, as told by `is_closed_caption`.
+ *
+ * Triplets of payload with `process_cc_data_flag` unset are to be ignored, so none are returned.
+ *
+ * @throw BinaryParseError if payload is truncated
+ */
+CcData
+parse_cc_data(const SeiPayload &sei);
+
+/// Builds closed caption SEI payload carrying given triplets, of which there can be `CcData::MAX_CC_COUNT` at most.
+OwnedSeiPayload
+build_cc_data_payload(const CcTriplet *first, const CcTriplet *last, uint8_t em_data = 0);
+
+/**
+ * @brief Merges closed captions destined for one frame into as few SEI payloads as possible.
+ *
+ * Each closed caption payload repeats its T.35 header, and some decoders use only the first payload of a frame.
+ * Triplets of added payloads are collected instead, CEA-608 ones ahead of DTVCC ones and each in the order of
+ * addition, dropping triplets marked as not valid, which are padding, except for the first one following DTVCC data,
+ * which terminates DTVCC packet. They are emitted by `flush` in a single payload of `cc_count` triplets at most, as
+ * given by output frame rate, carrying one CEA-608 pair per field at most, as CEA-608 allows no more per frame. Excess
+ * triplets are deferred to following frames, up to `MAX_DEFERRED_FRAMES` frames of them, beyond which the oldest are
+ * dropped. Buffers are kept across frames.
+ */
+class CcDataCoalescer
+{
+public:
+  static constexpr size_t MAX_DEFERRED_FRAMES = 8;
+
+private:
+  /// Triplets per frame, as given by output frame rate.
+  size_t m_cc_count;
+
+  std::vector<CcTriplet> m_field_1{};
+  std::vector<CcTriplet> m_field_2{};
+  std::vector<CcTriplet> m_dtvcc{};
+  bool m_pending{ false };
+
+  /// Whether DTVCC data has been added since the last DTVCC packet terminator.
+  bool m_dtvcc_open{ false };
+
+  size_t m_dropped{ 0 };
+
+public:
+  /// \param cc_count  triplets per frame of output stream, see `CcPacer::cc_count_of`, or `CcData::MAX_CC_COUNT` if its
+  ///                  frame rate is not known
+  explicit CcDataCoalescer(size_t cc_count = CcData::MAX_CC_COUNT)
+    : m_cc_count{ std::clamp<size_t>(cc_count, 1, CcData::MAX_CC_COUNT) }
+  {}
+
+  /// Triplets emitted in each frame at most.
+  size_t cc_count() const { return m_cc_count; }
+
+  /// Changes triplets emitted in each frame at most, once output frame rate is known.
+  void set_cc_count(size_t cc_count) { m_cc_count = std::clamp<size_t>(cc_count, 1, CcData::MAX_CC_COUNT); }
+
+  /// Collects triplets of closed caption payload.
+  ///
+  /// \return false if payload does not carry closed captions or is malformed, so that it is to be passed as it is
+  bool add(const SeiPayload &sei);
+
+  /// Whether there are payloads added since the last flush, or triplets deferred by it.
+  bool pending() const { return m_pending || !m_field_1.empty() || !m_field_2.empty() || !m_dtvcc.empty(); }
+
+  /// Count of collected triplets deferred to following frames.
+  size_t backlog() const { return m_field_1.size() + m_field_2.size() + m_dtvcc.size(); }
+
+  /// Count of triplets dropped for overflowing backlog so far.
+  size_t dropped() const { return m_dropped; }
+
+  /// Drops collected triplets, such as those of previous input, which are not to be emitted after switching inputs.
+  void clear()
+  {
+    m_field_1.clear();
+    m_field_2.clear();
+    m_dtvcc.clear();
+    m_pending = false;
+    m_dtvcc_open = false;
+  }
+
+  /// Emits collected triplets as closed caption payload and clears them, except for those not fitting in it. If all
+  /// of them were padding, a payload with a single padding triplet is emitted, so that frame still carries closed
+  /// captions.
+  template<class OutputIt>
+  OutputIt flush(OutputIt dest)
+  {
+    if (!pending()) {
+      return dest;
+    }
+
+    std::array<CcTriplet, CcData::MAX_CC_COUNT> triplets{};
+    size_t count = take(m_field_1, 1, triplets.data(), 0, m_cc_count);
+    count = take(m_field_2, 1, triplets.data(), count, m_cc_count);
+    count = take(m_dtvcc, m_cc_count, triplets.data(), count, m_cc_count);
+    if (count == 0) {
+      triplets[count++] = CcTriplet{ false, CcType::DTVCC_PACKET_DATA, 0, 0 };
+    }
+
+    *dest = build_cc_data_payload(triplets.data(), triplets.data() + count);
+    dest++;
+
+    m_pending = false;
+    drop_overflow();
+
+    return dest;
+  }
+
+private:
+  /// Moves up to `limit` leading triplets of `queue` to `triplets`, up to `capacity` of them, and returns their new
+  /// count.
+  static size_t take(std::vector<CcTriplet> &queue, size_t limit, CcTriplet *triplets, size_t count, size_t capacity);
+
+  void drop_overflow();
+};
+}
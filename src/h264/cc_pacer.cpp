@@ -0,0 +1,167 @@
+#include "cc_pacer.h"
+
+#include <algorithm>
+#include <array>
+#include <stdexcept>
+
+#include "../binary_parser.h"
+
+namespace metamix::h264 {
+
+namespace {
+
+/// CEA-608 pairs per field and second, i.e. the frame rate of NTSC video.
+constexpr int64_t NTSC_RATE_NUM = 30000;
+constexpr int64_t NTSC_RATE_DEN = 1001;
+
+/// Triplets per second, 20 per frame of 29.97 fps video, in which `cc_count` is rounded.
+constexpr int64_t CC_RATE = 600;
+
+/// Frame rate from which each frame carries a single CEA-608 field.
+constexpr int64_t FIELD_PER_FRAME_RATE = 50;
+
+/// Capacities of backlogs, in triplets.
+constexpr size_t NTSC_BACKLOG = CcPacer::MAX_BACKLOG_SECONDS * NTSC_RATE_NUM / NTSC_RATE_DEN;
+constexpr size_t DTVCC_BACKLOG = CcPacer::MAX_BACKLOG_SECONDS * CC_RATE;
+
+constexpr CcTriplet PADDING{ false, CcType::DTVCC_PACKET_DATA, 0x00, 0x00 };
+
+/// CEA-608 null pair, 0x00 with odd parity in both bytes, which fills fields without captions.
+constexpr uint8_t NTSC_NULL = 0x80;
+}
+
+CcPacer::CcPacer(TimeBase frame_rate)
+  : m_field_1(NTSC_BACKLOG)
+  , m_field_2(NTSC_BACKLOG)
+  , m_dtvcc(DTVCC_BACKLOG)
+{
+  if (frame_rate.numerator() <= 0 || frame_rate.denominator() <= 0) {
+    throw std::invalid_argument("frame rate of closed caption pacer has to be positive");
+  }
+
+  int64_t num = frame_rate.numerator();
+  int64_t den = frame_rate.denominator();
+
+  m_cc_count = cc_count_of(frame_rate);
+  m_ntsc_credit_per_frame = NTSC_RATE_NUM * den;
+  m_ntsc_cost = NTSC_RATE_DEN * num;
+  m_alternate_fields = num >= FIELD_PER_FRAME_RATE * den;
+}
+
+size_t
+CcPacer::cc_count_of(TimeBase frame_rate)
+{
+  int64_t num = frame_rate.numerator();
+  int64_t den = frame_rate.denominator();
+  return static_cast<size_t>(std::clamp<int64_t>(
+    (2 * CC_RATE * den + num) / (2 * num), 1, static_cast<int64_t>(CcData::MAX_CC_COUNT)));
+}
+
+bool
+CcPacer::add(const SeiPayload &sei)
+{
+  if (!is_closed_caption(sei)) {
+    return false;
+  }
+
+  CcData cc_data;
+  try {
+    cc_data = parse_cc_data(sei);
+  } catch (BinaryParseError &) {
+    return false;
+  }
+
+  for (const auto &triplet : cc_data) {
+    if (triplet.is_ntsc() && (!triplet.valid || (triplet.data_1 == NTSC_NULL && triplet.data_2 == NTSC_NULL))) {
+      continue;
+    }
+
+    switch (triplet.type) {
+    case CcType::NTSC_CC_FIELD_1:
+      push(m_field_1, triplet);
+      break;
+    case CcType::NTSC_CC_FIELD_2:
+      push(m_field_2, triplet);
+      break;
+    default:
+      if (triplet.valid || m_dtvcc_open) {
+        push(m_dtvcc, triplet);
+        m_dtvcc_open = triplet.valid;
+      }
+      break;
+    }
+  }
+  m_pending = true;
+
+  return true;
+}
+
+OwnedSeiPayload
+CcPacer::next_frame()
+{
+  std::array<CcTriplet, CcData::MAX_CC_COUNT> triplets{};
+  size_t count = 0;
+
+  // CEA-608 pairs go first, as many as earned credits allow
+  auto take_ntsc = [&](boost::circular_buffer<CcTriplet> &queue, int64_t &credit) {
+    credit += m_ntsc_credit_per_frame;
+    while (!queue.empty() && credit >= m_ntsc_cost && count < m_cc_count) {
+      triplets[count++] = queue.front();
+      queue.pop_front();
+      credit -= m_ntsc_cost;
+    }
+
+    // Credits are not saved up while idle, so that pairs arriving later are not sent in a burst
+    if (queue.empty()) {
+      credit = std::min(credit, std::max<int64_t>(0, m_ntsc_cost - m_ntsc_credit_per_frame));
+    }
+  };
+  if (m_alternate_fields) {
+    // Field of frame is given by its parity, which carries a single pair, at the CEA-608 rate at 59.94 fps
+    auto &queue = m_frame % 2 == 0 ? m_field_1 : m_field_2;
+    if (!queue.empty()) {
+      triplets[count++] = queue.front();
+      queue.pop_front();
+    }
+  } else {
+    take_ntsc(m_field_1, m_field_1_credit);
+    take_ntsc(m_field_2, m_field_2_credit);
+  }
+  m_frame++;
+
+  while (!m_dtvcc.empty() && count < m_cc_count) {
+    triplets[count++] = m_dtvcc.front();
+    m_dtvcc.pop_front();
+  }
+
+  while (count < m_cc_count) {
+    triplets[count++] = PADDING;
+  }
+
+  m_pending = false;
+
+  return build_cc_data_payload(triplets.data(), triplets.data() + count);
+}
+
+void
+CcPacer::clear()
+{
+  m_field_1.clear();
+  m_field_2.clear();
+  m_dtvcc.clear();
+  m_field_1_credit = 0;
+  m_field_2_credit = 0;
+  m_pending = false;
+  m_dtvcc_open = false;
+}
+
+void
+CcPacer::push(boost::circular_buffer<CcTriplet> &queue, const CcTriplet &triplet)
+{
+  // Full buffer overwrites its oldest triplet
+  if (queue.full()) {
+    m_dropped++;
+  }
+  queue.push_back(triplet);
+}
+}
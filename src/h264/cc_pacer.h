@@ -0,0 +1,97 @@
+#pragma once
+
+#include <cstdint>
+
+#include <boost/circular_buffer.hpp>
+
+#include "../clock_types.h"
+
+#include "cc_data.h"
+#include "sei_payload.h"
+
+namespace metamix::h264 {
+
+/**
+ * @brief Re-paces closed captions to the frame rate of the output stream.
+ *
+ * Closed captions are carried at a fixed rate, regardless of the frame rate of the video: CEA-608 at one byte pair
+ * per field 30000/1001 times a second, and all of `cc_data` at 20 triplets per frame of 29.97 fps video, i.e. about
+ * 600 triplets a second. When frame rate is converted, captions of one input frame no longer fit one output frame,
+ * or leave output frames empty.
+ *
+ * Pacer buffers valid triplets of added closed caption payloads per CEA-608 field and for DTVCC, and emits exactly
+ * `cc_count` triplets per output frame: CEA-608 pairs as their rate allows, then DTVCC triplets, then padding. At 50
+ * fps and more, each frame carries a single field, so CEA-608 pairs of field 1 go in even frames and pairs of field 2
+ * in odd ones, one pair at most. Excess
+ * triplets are carried to following frames, up to `MAX_BACKLOG_SECONDS` of them, beyond which the oldest are dropped.
+ * Padding is not buffered, as emitted frames are padded anyway: neither invalid triplets, except for the first one
+ * following DTVCC data which terminates DTVCC packet, nor CEA-608 null pairs.
+ */
+class CcPacer
+{
+public:
+  static constexpr int64_t MAX_BACKLOG_SECONDS = 2;
+
+private:
+  /// Triplets per frame.
+  size_t m_cc_count;
+
+  /// CEA-608 pairs are paced by credits, which are earned each frame and spent on each pair.
+  int64_t m_ntsc_credit_per_frame;
+  int64_t m_ntsc_cost;
+
+  int64_t m_field_1_credit{ 0 };
+  int64_t m_field_2_credit{ 0 };
+
+  /// Whether CEA-608 fields alternate by frame parity, rather than being paced by credits.
+  bool m_alternate_fields;
+
+  /// Count of emitted frames, parity of which tells their CEA-608 field.
+  uint64_t m_frame{ 0 };
+
+  /// Backlogs are allocated upfront, so that pacing does not allocate per frame.
+  boost::circular_buffer<CcTriplet> m_field_1;
+  boost::circular_buffer<CcTriplet> m_field_2;
+  boost::circular_buffer<CcTriplet> m_dtvcc;
+
+  bool m_pending{ false };
+
+  /// Whether DTVCC data has been added since the last DTVCC packet terminator.
+  bool m_dtvcc_open{ false };
+
+  size_t m_dropped{ 0 };
+
+public:
+  /// \param frame_rate frame rate of output stream, in frames per second
+  explicit CcPacer(TimeBase frame_rate);
+
+  /// Triplets emitted in each frame, as given by frame rate.
+  size_t cc_count() const { return m_cc_count; }
+
+  /// Triplets per frame of given frame rate, 20 at 29.97 fps, rounded and clamped to `CcData::MAX_CC_COUNT`.
+  static size_t cc_count_of(TimeBase frame_rate);
+
+  /// Buffers triplets of closed caption payload.
+  ///
+  /// \return false if payload does not carry closed captions or is malformed, so that it is to be passed as it is
+  bool add(const SeiPayload &sei);
+
+  /// Whether there are triplets to be emitted, or payloads added since the last frame.
+  bool pending() const { return m_pending || !m_field_1.empty() || !m_field_2.empty() || !m_dtvcc.empty(); }
+
+  /// Count of buffered triplets, which are carried to following frames.
+  size_t backlog() const { return m_field_1.size() + m_field_2.size() + m_dtvcc.size(); }
+
+  /// Count of triplets dropped for overflowing backlog so far.
+  size_t dropped() const { return m_dropped; }
+
+  /// Emits closed caption payload of next frame.
+  OwnedSeiPayload next_frame();
+
+  /// Drops buffered triplets, such as those of previous input, which are not to be emitted after switching inputs.
+  void clear();
+
+private:
+  void push(boost::circular_buffer<CcTriplet> &queue, const CcTriplet &triplet);
+};
+}
@@ -1,9 +1,15 @@
 #pragma once
 
+#include <algorithm>
+#include <array>
 #include <cassert>
 #include <iterator>
+#include <stdexcept>
+#include <utility>
+#include <vector>
 
 #include <boost/endian/conversion.hpp>
+#include <boost/iterator/function_output_iterator.hpp>
 
 #include "nalu.h"
 #include "rbsp.h"
@@ -15,7 +21,10 @@ namespace detail {
 
 using boost::endian::native_to_big_inplace;
 
-constexpr uint8_t SEI_NALU_TYPE_BYTE = static_cast<uint8_t>(NaluType::SEI);
+constexpr std::array<uint8_t, 1> SEI_NALU_HEADER{ static_cast<uint8_t>(NaluType::SEI) };
+
+/// Start code with leading zero_byte, which is required before parameter sets and the first NALU of access unit.
+constexpr std::array<uint8_t, 4> ANNEXB_START_CODE{ 0x00, 0x00, 0x00, 0x01 };
 
 constexpr unsigned int
 variadic_length_int_size(unsigned int num)
@@ -30,7 +39,7 @@ emit_variadic_length_int(unsigned int num, OutputIt dest)
   while (num >= 255) {
     *dest = 0xFF;
     dest++;
-    num /= 255;
+    num -= 255;
   }
 
   *dest = num % 255;
@@ -39,7 +48,7 @@ emit_variadic_length_int(unsigned int num, OutputIt dest)
   return dest;
 }
 
-template<class OutputIt, unsigned int NaluLengthSize = 4>
+template<unsigned int NaluLengthSize, class OutputIt>
 OutputIt
 emit_nalu_length(uint32_t nalu_length, OutputIt dest)
 {
@@ -47,6 +56,12 @@ emit_nalu_length(uint32_t nalu_length, OutputIt dest)
 
   assert(0 <= nalu_length && nalu_length < Nalu::MAX_LENGTH);
 
+  if constexpr (NaluLengthSize < sizeof(uint32_t)) {
+    if (nalu_length >> (8 * NaluLengthSize) != 0) {
+      throw std::length_error("NALU is too long for its length prefix");
+    }
+  }
+
   union
   {
     uint32_t number;
@@ -57,38 +72,151 @@ emit_nalu_length(uint32_t nalu_length, OutputIt dest)
 
   return std::copy(result.array + sizeof(result) - NaluLengthSize, result.array + sizeof(result), dest);
 }
-}
 
-uint32_t
-sei_payload_size_hint(const SeiPayload &sei)
+/// Writes bytes to output iterator, inserting emulation prevention bytes, so that bytes written one by one are escaped.
+template<class OutputIt>
+struct EbspWriter
 {
-  uint32_t x = 0;
-
-  // RBSP payload size, it is not possible to get emulation byte in payload type/size,
-  // so we don't count them
-  x += sei.size() + count_emulation_prevention_bytes(sei.cbegin(), sei.cend()) + 1;
+  OutputIt *dest;
 
-  // Payload length size
-  x += detail::variadic_length_int_size(static_cast<unsigned int>(sei.size()));
+  /// Count of zero bytes written since the last emulation prevention byte.
+  unsigned int *zeros;
 
-  // Payload type size
-  x += detail::variadic_length_int_size(sei.type());
-
-  return x;
+  void operator()(uint8_t byte) const
+  {
+    if (*zeros >= 2 && byte <= 3) {
+      **dest = 0x03;
+      ++*dest;
+      *zeros = 0;
+    }
+    *zeros = byte == 0 ? *zeros + 1 : 0;
+    **dest = byte;
+    ++*dest;
+  }
+};
 }
 
+/// Emits SEI message, i.e. payload type, size and payload, as SODB without emulation prevention.
 template<class OutputIt>
 OutputIt
-emit_sei_payload(const SeiPayload &sei, OutputIt dest)
+emit_sei_message(const SeiPayload &sei, OutputIt dest)
 {
   dest = detail::emit_variadic_length_int(sei.type(), dest);
   dest = detail::emit_variadic_length_int(static_cast<unsigned int>(sei.size()), dest);
-  return copy_sodb_to_ebsp(sei.cbegin(), sei.cend(), dest);
+  return std::copy(sei.data(), sei.data() + sei.size(), dest);
 }
 
-template<class InputIt, class OutputIt, unsigned int NaluLengthSize = 4>
+/**
+ * @brief Serializes SEI message of payload at compile time, so that static payloads are never serialized at runtime,
+ * see `OwnedSeiPayload::message_header`.
+ *
+ * Payload type and size have to be coded in a byte each, and payload must not need emulation prevention, which fails
+ * compilation of constant expressions otherwise.
+ */
+template<size_t N>
+constexpr std::array<uint8_t, N + 2>
+serialize_sei_message(SeiType type, const std::array<uint8_t, N> &payload)
+{
+  static_assert(N < 255, "payload size has to be coded in a byte");
+
+  if (type >= 255) {
+    throw std::invalid_argument("payload type has to be coded in a byte");
+  }
+
+  std::array<uint8_t, N + 2> message{ static_cast<uint8_t>(type), static_cast<uint8_t>(N) };
+  unsigned int zeros = 0;
+  for (size_t i = 0; i < message.size(); i++) {
+    if (i >= 2) {
+      message[i] = payload[i - 2];
+    }
+    if (zeros >= 2 && message[i] <= 3) {
+      throw std::invalid_argument("payload needs emulation prevention");
+    }
+    zeros = message[i] == 0 ? zeros + 1 : 0;
+  }
+
+  return message;
+}
+
+namespace detail {
+
+/// Counts bytes written to output iterator, which is assignable unlike one of a capturing lambda.
+struct ByteCounter
+{
+  uint32_t *count;
+
+  void operator()(uint8_t) const { ++*count; }
+};
+
+/// Count of zero bytes ending escaped bytes, which escaping of following bytes carries on from.
+inline unsigned int
+trailing_zeros(const uint8_t *first, const uint8_t *last) noexcept
+{
+  unsigned int zeros = 0;
+  while (last != first && zeros < 2 && last[-1] == 0) {
+    zeros++;
+    last--;
+  }
+  return zeros;
+}
+
+/// Emits SEI message with emulation prevention bytes, carrying on escaping from `zeros` zero bytes emitted before it.
+template<class OutputIt, class = typename std::iterator_traits<OutputIt>::iterator_category>
 OutputIt
-emit_sei_payloads_to_avcc_nalu(InputIt from, InputIt to, OutputIt dest)
+emit_escaped_sei_message(const SeiPayload &sei, OutputIt dest, unsigned int &zeros)
+{
+  auto escaping_dest = boost::make_function_output_iterator(EbspWriter<OutputIt>{ &dest, &zeros });
+  emit_sei_message(sei, escaping_dest);
+  return dest;
+}
+
+/// Appends escaped SEI message to byte vector, which is escaped by vectorized kernel, only if it needs to be, after a
+/// non-zero byte.
+inline void
+emit_escaped_sei_message(const SeiPayload &sei, std::vector<uint8_t> &out, unsigned int &zeros)
+{
+  if (zeros != 0) {
+    emit_escaped_sei_message(sei, std::back_inserter(out), zeros);
+    return;
+  }
+
+  size_t start = out.size();
+  emit_sei_message(sei, std::back_inserter(out));
+
+  size_t size = out.size() - start;
+  if (count_emulation_prevention_bytes_needed(out.data() + start, out.data() + out.size()) > 0) {
+    // Escaped message is written past its SODB, and moved in its place
+    out.resize(start + size + size + size / 2 + 1);
+    auto sodb = out.data() + start;
+    auto end = copy_to_ebsp_bytes(sodb, sodb + size, sodb + size);
+    end = std::copy(sodb + size, end, sodb);
+    out.resize(end - out.data());
+  }
+
+  zeros = trailing_zeros(out.data() + start, out.data() + out.size());
+}
+
+/// Appends SEI message to byte vector, copying message header serialized in advance and payload as they are after a
+/// non-zero byte.
+inline void
+emit_escaped_sei_message(const OwnedSeiPayload &sei, std::vector<uint8_t> &out, unsigned int &zeros)
+{
+  auto [first, last] = sei.message_header();
+  if (zeros != 0 || first == last) {
+    emit_escaped_sei_message(static_cast<const SeiPayload &>(sei), out, zeros);
+    return;
+  }
+
+  out.insert(out.end(), first, last);
+  out.insert(out.end(), sei.data(), sei.data() + sei.size());
+  zeros = trailing_zeros(sei.data(), sei.data() + sei.size());
+}
+}
+
+/// Emits SEI RBSP of given payloads, with emulation prevention bytes and trailing stop bit.
+template<class InputIt, class OutputIt, class = typename std::iterator_traits<OutputIt>::iterator_category>
+OutputIt
+emit_sei_rbsp(InputIt from, InputIt to, OutputIt dest)
 {
   static_assert(
     std::is_base_of<std::random_access_iterator_tag, typename std::iterator_traits<InputIt>::iterator_category>::value,
@@ -97,28 +225,151 @@ emit_sei_payloads_to_avcc_nalu(InputIt from, InputIt to, OutputIt dest)
     std::is_base_of<std::output_iterator_tag, typename std::iterator_traits<OutputIt>::iterator_category>::value,
     "output iterator must be of output iterator category");
 
-  auto size_hint = 1;
+  unsigned int zeros = 0;
   for (auto it = from; it != to; it++) {
-    size_hint += sei_payload_size_hint(*it);
+    dest = detail::emit_escaped_sei_message(*it, dest, zeros);
   }
 
-  dest = detail::emit_nalu_length<OutputIt, NaluLengthSize>(size_hint, dest);
-
-  *dest = detail::SEI_NALU_TYPE_BYTE;
+  *dest = 0x80;
   dest++;
+  return dest;
+}
 
+/// Appends SEI RBSP of given payloads to byte vector, escaping messages by vectorized kernel. Messages of owned
+/// payloads, which have been serialized in advance, are copied as they are when they need no escaping.
+template<class InputIt>
+void
+emit_sei_rbsp(InputIt from, InputIt to, std::vector<uint8_t> &dest)
+{
+  unsigned int zeros = 0;
   for (auto it = from; it != to; it++) {
-    dest = emit_sei_payload(*it, dest);
+    detail::emit_escaped_sei_message(*it, dest, zeros);
   }
 
-  return dest;
+  dest.push_back(0x80);
+}
+
+/// Size of SEI RBSP of given payloads, as emitted by `emit_sei_rbsp`.
+template<class InputIt>
+uint32_t
+sei_rbsp_size(InputIt from, InputIt to)
+{
+  uint32_t size = 0;
+  emit_sei_rbsp(from, to, boost::make_function_output_iterator(detail::ByteCounter{ &size }));
+  return size;
+}
+
+/**
+ * @brief Emits SEI NALU starting with given NALU header, prefixed with its length.
+ *
+ * SEI message syntax is shared by H.264 and H.265, which differ in NALU headers only.
+ *
+ * \throw std::length_error if NALU length does not fit in `NaluLengthSize` bytes
+ */
+template<unsigned int NaluLengthSize = 4,
+         class Header,
+         class InputIt,
+         class OutputIt,
+         class = typename std::iterator_traits<OutputIt>::iterator_category>
+OutputIt
+emit_sei_payloads_to_avcc_nalu(const Header &header, InputIt from, InputIt to, OutputIt dest)
+{
+  dest = detail::emit_nalu_length<NaluLengthSize>(static_cast<uint32_t>(header.size()) + sei_rbsp_size(from, to), dest);
+  dest = std::copy(header.begin(), header.end(), dest);
+  return emit_sei_rbsp(from, to, dest);
+}
+
+/// Appends SEI NALU to byte vector in single pass, filling its length afterwards.
+///
+/// \throw std::length_error if NALU length does not fit in `NaluLengthSize` bytes
+template<unsigned int NaluLengthSize = 4, class Header, class InputIt>
+void
+emit_sei_payloads_to_avcc_nalu(const Header &header, InputIt from, InputIt to, std::vector<uint8_t> &dest)
+{
+  size_t start = dest.size();
+  dest.resize(start + NaluLengthSize);
+  dest.insert(dest.end(), header.begin(), header.end());
+
+  emit_sei_rbsp(from, to, dest);
+
+  detail::emit_nalu_length<NaluLengthSize>(static_cast<uint32_t>(dest.size() - start - NaluLengthSize),
+                                           dest.data() + start);
+}
+
+/// \throw std::length_error if NALU length does not fit in `NaluLengthSize` bytes
+template<unsigned int NaluLengthSize = 4,
+         class InputIt,
+         class OutputIt,
+         class = typename std::iterator_traits<OutputIt>::iterator_category>
+OutputIt
+emit_sei_payloads_to_avcc_nalu(InputIt from, InputIt to, OutputIt dest)
+{
+  return emit_sei_payloads_to_avcc_nalu<NaluLengthSize>(detail::SEI_NALU_HEADER, from, to, dest);
+}
+
+/// \throw std::length_error if NALU length does not fit in `NaluLengthSize` bytes
+template<unsigned int NaluLengthSize = 4, class InputIt>
+void
+emit_sei_payloads_to_avcc_nalu(InputIt from, InputIt to, std::vector<uint8_t> &dest)
+{
+  emit_sei_payloads_to_avcc_nalu<NaluLengthSize>(detail::SEI_NALU_HEADER, from, to, dest);
 }
 
-template<class OutputIt, unsigned int NaluLengthSize = 4>
+/// \throw std::length_error if NALU length does not fit in `NaluLengthSize` bytes
+template<unsigned int NaluLengthSize = 4, class OutputIt>
 OutputIt
 emit_avcc_nalu(const Nalu &nalu, OutputIt dest)
 {
-  dest = detail::emit_nalu_length<OutputIt, NaluLengthSize>(static_cast<uint32_t>(nalu.size()), dest);
+  dest = detail::emit_nalu_length<NaluLengthSize>(static_cast<uint32_t>(nalu.size()), dest);
+  return std::copy(nalu.cbegin(), nalu.cend(), dest);
+}
+
+/// Emits SEI NALU starting with given NALU header, prefixed with start code.
+template<class Header,
+         class InputIt,
+         class OutputIt,
+         class = typename std::iterator_traits<OutputIt>::iterator_category>
+OutputIt
+emit_sei_payloads_to_annexb_nalu(const Header &header, InputIt from, InputIt to, OutputIt dest)
+{
+  static_assert(
+    std::is_base_of<std::output_iterator_tag, typename std::iterator_traits<OutputIt>::iterator_category>::value,
+    "output iterator must be of output iterator category");
+
+  dest = std::copy(detail::ANNEXB_START_CODE.begin(), detail::ANNEXB_START_CODE.end(), dest);
+  dest = std::copy(header.begin(), header.end(), dest);
+  return emit_sei_rbsp(from, to, dest);
+}
+
+/// Appends SEI NALU prefixed with start code to byte vector.
+template<class Header, class InputIt>
+void
+emit_sei_payloads_to_annexb_nalu(const Header &header, InputIt from, InputIt to, std::vector<uint8_t> &dest)
+{
+  dest.insert(dest.end(), detail::ANNEXB_START_CODE.begin(), detail::ANNEXB_START_CODE.end());
+  dest.insert(dest.end(), header.begin(), header.end());
+  emit_sei_rbsp(from, to, dest);
+}
+
+template<class InputIt, class OutputIt, class = typename std::iterator_traits<OutputIt>::iterator_category>
+OutputIt
+emit_sei_payloads_to_annexb_nalu(InputIt from, InputIt to, OutputIt dest)
+{
+  return emit_sei_payloads_to_annexb_nalu(detail::SEI_NALU_HEADER, from, to, dest);
+}
+
+template<class InputIt>
+void
+emit_sei_payloads_to_annexb_nalu(InputIt from, InputIt to, std::vector<uint8_t> &dest)
+{
+  emit_sei_payloads_to_annexb_nalu(detail::SEI_NALU_HEADER, from, to, dest);
+}
+
+template<class OutputIt>
+OutputIt
+emit_annexb_nalu(const Nalu &nalu, OutputIt dest)
+{
+  dest = std::copy(detail::ANNEXB_START_CODE.begin(), detail::ANNEXB_START_CODE.end(), dest);
   return std::copy(nalu.cbegin(), nalu.cend(), dest);
 }
 }
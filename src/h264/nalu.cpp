@@ -71,6 +71,43 @@ operator<<(std::ostream &os, const NaluType &ty)
   return os << nalu_type_to_string(ty);
 }
 
+NaluFormat
+detect_nalu_format(const uint8_t *extradata, size_t size) noexcept
+{
+  if (extradata == nullptr || size == 0 || extradata[0] != 1) {
+    return NaluFormat{ NaluFraming::ANNEX_B };
+  }
+
+  // Truncated record, assume the most common length size
+  if (size < 5) {
+    return NaluFormat{ NaluFraming::AVCC };
+  }
+
+  return NaluFormat{ NaluFraming::AVCC, (extradata[4] & 0b11u) + 1 };
+}
+
+std::ostream &
+operator<<(std::ostream &os, NaluFraming framing)
+{
+  switch (framing) {
+  case NaluFraming::AVCC:
+    return os << "AVCC";
+  case NaluFraming::ANNEX_B:
+    return os << "Annex B";
+  }
+  return os << "unknown";
+}
+
+std::ostream &
+operator<<(std::ostream &os, const NaluFormat &format)
+{
+  os << format.framing;
+  if (format.framing == NaluFraming::AVCC) {
+    os << " with " << format.length_size << "-byte lengths";
+  }
+  return os;
+}
+
 std::ostream &
 operator<<(std::ostream &os, const Nalu &nalu)
 {
@@ -70,9 +70,10 @@ class Nalu : public AbstractSlice<Nalu, uint8_t>
 public:
   static constexpr size_t MAX_LENGTH = 4 * 1024 * 2014;
 
-public:
-  ~Nalu() override = default;
+protected:
+  using AbstractSlice::AbstractSlice;
 
+public:
   bool is_valid() const noexcept { return !empty() > 0 && (front() & 0b1'00'00000) == 0b0'00'00000; }
 
   NaluType type() const noexcept { return static_cast<NaluType>(front() & 0b0'00'11111); }
@@ -84,4 +85,50 @@ class OwnedNalu : public AbstractOwnedSlice<OwnedNalu, Nalu>
 {
   using AbstractOwnedSlice::AbstractOwnedSlice;
 };
+
+/// NALU referring to bytes of parsed buffer, which has to outlive it.
+class NaluView : public Nalu
+{
+public:
+  NaluView() = default;
+
+  NaluView(const uint8_t *data, size_t size) noexcept
+    : Nalu(const_cast<uint8_t *>(data), size)
+  {}
+};
+
+/// Way NALUs are delimited within packets of H.264 stream.
+enum class NaluFraming
+{
+  /// NALUs prefixed with their length, as in MP4 and FLV
+  AVCC,
+
+  /// NALUs prefixed with start codes, as in Annex B byte streams carried by MPEG-TS
+  ANNEX_B,
+};
+
+/// Framing of NALUs within packets of H.264 stream.
+struct NaluFormat
+{
+  NaluFraming framing{ NaluFraming::AVCC };
+
+  /// Size of NALU length prefix of AVCC framing, which is 1, 2 or 4 bytes in conforming streams.
+  unsigned int length_size{ 4 };
+};
+
+/**
+ * @brief Detects NALU format from codec extradata of the stream.
+ *
+ * Length prefixed streams carry AVCDecoderConfigurationRecord, which starts with configurationVersion 1 and holds
+ * lengthSizeMinusOne in its fifth byte, while Annex B streams carry SPS and PPS preceded by start codes, or no extradata
+ * at all.
+ */
+NaluFormat
+detect_nalu_format(const uint8_t *extradata, size_t size) noexcept;
+
+std::ostream &
+operator<<(std::ostream &os, NaluFraming framing);
+
+std::ostream &
+operator<<(std::ostream &os, const NaluFormat &format);
 }
@@ -0,0 +1,88 @@
+#pragma once
+
+#include <utility>
+#include <vector>
+
+#include "emitter.h"
+#include "nalu.h"
+#include "nalu_parser.h"
+
+namespace metamix::h264 {
+
+/**
+ * @brief Parsing and emission of NALUs prefixed with big endian length of `NaluLengthSize` bytes.
+ */
+template<unsigned int NaluLengthSize>
+struct AvccFraming
+{
+  using Parser = AvccNaluViewParser<NaluLengthSize>;
+
+  template<class OutputIt>
+  static OutputIt emit_nalu(const Nalu &nalu, OutputIt dest)
+  {
+    return emit_avcc_nalu<NaluLengthSize>(nalu, dest);
+  }
+
+  template<class Header, class InputIt, class OutputIt>
+  static OutputIt emit_sei_nalu(const Header &header, InputIt from, InputIt to, OutputIt dest)
+  {
+    return emit_sei_payloads_to_avcc_nalu<NaluLengthSize>(header, from, to, dest);
+  }
+
+  template<class Header, class InputIt>
+  static void emit_sei_nalu(const Header &header, InputIt from, InputIt to, std::vector<uint8_t> &dest)
+  {
+    emit_sei_payloads_to_avcc_nalu<NaluLengthSize>(header, from, to, dest);
+  }
+};
+
+/**
+ * @brief Parsing and emission of NALUs prefixed with Annex B start codes.
+ */
+struct AnnexBFraming
+{
+  using Parser = AnnexBNaluViewParser;
+
+  template<class OutputIt>
+  static OutputIt emit_nalu(const Nalu &nalu, OutputIt dest)
+  {
+    return emit_annexb_nalu(nalu, dest);
+  }
+
+  template<class Header, class InputIt, class OutputIt>
+  static OutputIt emit_sei_nalu(const Header &header, InputIt from, InputIt to, OutputIt dest)
+  {
+    return emit_sei_payloads_to_annexb_nalu(header, from, to, dest);
+  }
+
+  template<class Header, class InputIt>
+  static void emit_sei_nalu(const Header &header, InputIt from, InputIt to, std::vector<uint8_t> &dest)
+  {
+    emit_sei_payloads_to_annexb_nalu(header, from, to, dest);
+  }
+};
+
+/**
+ * @brief Calls `f` with framing type matching given NALU format, so that packets are processed by code specialized
+ * for the format, which is selected once per stream.
+ */
+template<class F>
+decltype(auto)
+visit_nalu_format(const NaluFormat &format, F &&f)
+{
+  if (format.framing == NaluFraming::ANNEX_B) {
+    return std::forward<F>(f)(AnnexBFraming{});
+  }
+
+  switch (format.length_size) {
+  case 1:
+    return std::forward<F>(f)(AvccFraming<1>{});
+  case 2:
+    return std::forward<F>(f)(AvccFraming<2>{});
+  case 3:
+    return std::forward<F>(f)(AvccFraming<3>{});
+  default:
+    return std::forward<F>(f)(AvccFraming<4>{});
+  }
+}
+}
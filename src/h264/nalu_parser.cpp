@@ -16,10 +16,11 @@ namespace metamix::h264 {
 
 namespace {
 
+template<unsigned int NaluLengthSize>
 uint32_t
-parse_avcc_nalu_length(const uint8_t *data, uint32_t nalu_length_size)
+parse_avcc_nalu_length(const uint8_t *data)
 {
-  assert(0 < nalu_length_size && nalu_length_size <= sizeof(uint32_t));
+  static_assert(0 < NaluLengthSize && NaluLengthSize <= sizeof(uint32_t));
 
   union
   {
@@ -28,31 +29,40 @@ parse_avcc_nalu_length(const uint8_t *data, uint32_t nalu_length_size)
   } result{ 0 };
 
   // Copy NALU length to result, right-aligned
-  std::copy(data, data + nalu_length_size, result.array + sizeof(result) - nalu_length_size);
+  std::copy(data, data + NaluLengthSize, result.array + sizeof(result) - NaluLengthSize);
 
   // Convert NALU length to native endian
   big_to_native_inplace(result.number);
 
   return result.number;
 }
+}
+
+namespace detail {
+
+const uint8_t *
+find_start_code(const uint8_t *first, const uint8_t *last, SimdLevel level) noexcept
+{
+  return find_zero_prefixed(first, last, 0x01, level);
+}
+}
 
+template<unsigned int NaluLengthSize>
 std::optional<BinaryParserBounds>
-next_avcc_bounds(uint32_t nalu_length_size_minus_one, const uint8_t *startptr, size_t length)
+avcc_nalu_parser_next(const uint8_t *startptr, size_t length)
 {
   // Check whether there is any data left to parse
   if (length == 0) {
     return std::nullopt;
   }
 
-  uint32_t nalu_length_size = nalu_length_size_minus_one + 1;
-
   // Check whether there is space for NALU length
-  if (nalu_length_size > length) {
+  if (NaluLengthSize > length) {
     static auto FMT = boost::format("next NALU length size is larger than buffer space available: %1% > %2%");
-    throw BinaryParseError((FMT % nalu_length_size % length).str());
+    throw BinaryParseError((FMT % NaluLengthSize % length).str());
   }
 
-  uint32_t nalu_length = parse_avcc_nalu_length(startptr, nalu_length_size);
+  uint32_t nalu_length = parse_avcc_nalu_length<NaluLengthSize>(startptr);
 
   // NALU should have some length
   if (nalu_length == 0) {
@@ -66,25 +76,62 @@ next_avcc_bounds(uint32_t nalu_length_size_minus_one, const uint8_t *startptr, s
   }
 
   // Buffer overflow
-  if (nalu_length_size + nalu_length > length) {
+  if (NaluLengthSize + nalu_length > length) {
     static auto FMT = boost::format("next NALU is larger than buffer space available: %1% > %2%");
-    throw BinaryParseError((FMT % (nalu_length_size + nalu_length) % length).str());
+    throw BinaryParseError((FMT % (NaluLengthSize + nalu_length) % length).str());
   }
 
   // Return NALU boundaries
-  return BinaryParserBounds(startptr + nalu_length_size, nalu_length);
+  return BinaryParserBounds(startptr + NaluLengthSize, nalu_length);
 }
 
+template std::optional<BinaryParserBounds>
+avcc_nalu_parser_next<1>(const uint8_t *startptr, size_t length);
+template std::optional<BinaryParserBounds>
+avcc_nalu_parser_next<2>(const uint8_t *startptr, size_t length);
+template std::optional<BinaryParserBounds>
+avcc_nalu_parser_next<3>(const uint8_t *startptr, size_t length);
+template std::optional<BinaryParserBounds>
+avcc_nalu_parser_next<4>(const uint8_t *startptr, size_t length);
+
 std::optional<BinaryParserBounds>
-next_avcc_bounds_4(const uint8_t *startptr, size_t length)
+nalu_parser_next(const uint8_t *startptr, size_t length)
 {
-  return next_avcc_bounds(3, startptr, length);
-}
+  return avcc_nalu_parser_next<4>(startptr, length);
 }
 
 std::optional<BinaryParserBounds>
-nalu_parser_next(const uint8_t *startptr, size_t length)
+annexb_nalu_parser_next(const uint8_t *startptr, size_t length)
 {
-  return next_avcc_bounds_4(startptr, length);
+  // Check whether there is any data left to parse
+  if (length == 0) {
+    return std::nullopt;
+  }
+
+  const uint8_t *endptr = startptr + length;
+
+  // Skip zero bytes preceding 00 00 01 start code prefix, either trailing previous NALU or leading this start code
+  const uint8_t *nalu = std::find_if(startptr, endptr, [](uint8_t byte) { return byte != 0; });
+  if (nalu - startptr < 2 || nalu == endptr || *nalu != 1) {
+    throw BinaryParseError("Annex B start code not found");
+  }
+  nalu++;
+
+  // NALU ends where the next one starts
+  BinaryParserBounds bounds(nalu, detail::find_start_code(nalu, endptr) - nalu);
+  size_t nalu_length = annexb_nalu_length(bounds);
+
+  // NALU should have some length
+  if (nalu_length == 0) {
+    throw BinaryParseError("0-sized NALU");
+  }
+
+  // NALU length is too large
+  if (nalu_length > Nalu::MAX_LENGTH) {
+    static auto FMT = boost::format("NALU length is larger than maximum: %1%");
+    throw BinaryParseError((FMT % nalu_length).str());
+  }
+
+  return bounds;
 }
 }
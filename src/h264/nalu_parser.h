@@ -7,8 +7,80 @@
 
 #include "../binary_parser.h"
 
+#include "nalu.h"
+#include "rbsp.h"
+
 namespace metamix::h264 {
 
+namespace detail {
+
+/// Finds the first `00 00 01` start code prefix in given bytes.
+///
+/// \return start of the prefix, or `last` if there is none
+const uint8_t *
+find_start_code(const uint8_t *first, const uint8_t *last, SimdLevel level = simd_level()) noexcept;
+}
+
+/// Finds next NALU prefixed with its big endian length of `NaluLengthSize` bytes, instantiated for 1 to 4 bytes.
+template<unsigned int NaluLengthSize>
+std::optional<BinaryParserBounds>
+avcc_nalu_parser_next(const uint8_t *startptr, size_t length);
+
+extern template std::optional<BinaryParserBounds>
+avcc_nalu_parser_next<1>(const uint8_t *startptr, size_t length);
+extern template std::optional<BinaryParserBounds>
+avcc_nalu_parser_next<2>(const uint8_t *startptr, size_t length);
+extern template std::optional<BinaryParserBounds>
+avcc_nalu_parser_next<3>(const uint8_t *startptr, size_t length);
+extern template std::optional<BinaryParserBounds>
+avcc_nalu_parser_next<4>(const uint8_t *startptr, size_t length);
+
+/// Finds next NALU prefixed with 4-byte length.
 std::optional<BinaryParserBounds>
 nalu_parser_next(const uint8_t *startptr, size_t length);
+
+/// Finds next NALU of Annex B byte stream.
+///
+/// \return bounds of NALU including trailing zero bytes, which precede next start code or end of the buffer
+std::optional<BinaryParserBounds>
+annexb_nalu_parser_next(const uint8_t *startptr, size_t length);
+
+/// Length of Annex B NALU with trailing zero bytes stripped, as the last byte of NALU is never 0x00.
+inline size_t
+annexb_nalu_length(const BinaryParserBounds &bounds) noexcept
+{
+  size_t length = bounds.length();
+  while (length > 0 && bounds.startptr()[length - 1] == 0) {
+    length--;
+  }
+  return length;
+}
+
+inline NaluView
+nalu_view_parser_pack([[maybe_unused]] const BinaryParserContext &ctx, const BinaryParserBounds &bounds)
+{
+  assert(bounds.startptr() >= ctx.startptr());
+  return NaluView(bounds.startptr(), bounds.length());
+}
+
+inline NaluView
+annexb_nalu_view_parser_pack(const BinaryParserContext &ctx, const BinaryParserBounds &bounds)
+{
+  return nalu_view_parser_pack(ctx, BinaryParserBounds(bounds.startptr(), annexb_nalu_length(bounds)));
+}
+
+// Input: packet data, Output: NaluView into the data, without its length prefix
+template<unsigned int NaluLengthSize>
+using AvccNaluViewParser = BinaryParser<NaluView,
+                                        BinaryParserContext,
+                                        BinaryParserBounds,
+                                        avcc_nalu_parser_next<NaluLengthSize>,
+                                        nalu_view_parser_pack>;
+
+// Input: packet data, Output: NaluView into the data, without start code and trailing zero bytes
+using AnnexBNaluViewParser = BinaryParser<NaluView,
+                                          BinaryParserContext,
+                                          BinaryParserBounds,
+                                          annexb_nalu_parser_next,
+                                          annexb_nalu_view_parser_pack>;
 }
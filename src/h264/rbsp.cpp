@@ -0,0 +1,404 @@
+#include "rbsp.h"
+
+#include <algorithm>
+#include <cstddef>
+#include <cstring>
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#include <immintrin.h>
+#define METAMIX_X86_SIMD 1
+#endif
+
+namespace metamix::h264 {
+
+namespace {
+
+/// Scalar kernel, continuing at `pos`, which must be preceded by at least two bytes of the same buffer.
+uint8_t *
+copy_from_ebsp_scalar(const uint8_t *pos, const uint8_t *last, uint8_t *dest) noexcept
+{
+  while (pos < last) {
+    // Check whether we are on emulation prevention byte (00 00 <here> 03)
+    if (pos[-2] == 0 && pos[-1] == 0 && pos[0] == 3) {
+      pos++;
+    } else {
+      *dest++ = *pos++;
+    }
+  }
+  return dest;
+}
+
+/// Progress of emulation prevention byte insertion, bytes are written only if `Write` is set.
+struct EscapeState
+{
+  uint8_t *dest;
+  size_t count;
+
+  /// Count of zero bytes emitted since the last emulation prevention byte, up to 2.
+  unsigned int zeros;
+};
+
+template<bool Write>
+inline EscapeState
+escape_scalar(const uint8_t *pos, const uint8_t *last, EscapeState state) noexcept
+{
+  for (; pos < last; pos++) {
+    // Check whether we are on emulation byte (00 00 <here> 00-03)
+    if (state.zeros >= 2 && *pos <= 3) {
+      if constexpr (Write) {
+        *state.dest++ = 0x03;
+      }
+      state.count++;
+      state.zeros = 0;
+    }
+
+    if constexpr (Write) {
+      *state.dest++ = *pos;
+    }
+    state.zeros = *pos == 0 ? std::min(state.zeros + 1, 2u) : 0;
+  }
+  return state;
+}
+
+/// Zero count after block of `width` bytes at `pos`, which needed no emulation prevention bytes.
+inline unsigned int
+trailing_zeros(const uint8_t *pos, size_t width) noexcept
+{
+  return pos[width - 1] != 0 ? 0 : pos[width - 2] != 0 ? 1 : 2;
+}
+
+/// Copies bytes at `pos` preceding candidate at offset `candidate`, which is the first one, and escapes the candidate.
+///
+/// \return position following the candidate
+template<bool Write>
+inline const uint8_t *
+escape_candidate(const uint8_t *pos, unsigned int candidate, EscapeState &state) noexcept
+{
+  if (candidate >= 2) {
+    // Candidate is preceded by two zeros, and there is no emulation prevention byte in between
+    if constexpr (Write) {
+      std::memcpy(state.dest, pos, candidate);
+      state.dest += candidate;
+    }
+    state.zeros = 2;
+  } else {
+    state = escape_scalar<Write>(pos, pos + candidate, state);
+  }
+
+  state = escape_scalar<Write>(pos + candidate, pos + candidate + 1, state);
+  return pos + candidate + 1;
+}
+
+/// Copies block of `width` bytes at `pos`, skipping bytes marked in `mask`.
+inline uint8_t *
+copy_block_skipping(const uint8_t *pos, size_t width, uint32_t mask, uint8_t *dest) noexcept
+{
+  const uint8_t *run = pos;
+  while (mask != 0) {
+    const uint8_t *skipped = pos + __builtin_ctz(mask);
+    std::memcpy(dest, run, skipped - run);
+    dest += skipped - run;
+    run = skipped + 1;
+    mask &= mask - 1;
+  }
+  std::memcpy(dest, run, pos + width - run);
+  return dest + (pos + width - run);
+}
+
+#ifdef METAMIX_X86_SIMD
+
+__attribute__((target("sse2"))) uint8_t *
+copy_from_ebsp_sse2(const uint8_t *pos, const uint8_t *last, uint8_t *dest) noexcept
+{
+  const __m128i zero = _mm_setzero_si128();
+  const __m128i three = _mm_set1_epi8(3);
+
+  while (last - pos >= 16) {
+    __m128i cur = _mm_loadu_si128(reinterpret_cast<const __m128i *>(pos));
+    __m128i prev1 = _mm_loadu_si128(reinterpret_cast<const __m128i *>(pos - 1));
+    __m128i prev2 = _mm_loadu_si128(reinterpret_cast<const __m128i *>(pos - 2));
+
+    __m128i escaped =
+      _mm_and_si128(_mm_and_si128(_mm_cmpeq_epi8(prev2, zero), _mm_cmpeq_epi8(prev1, zero)), _mm_cmpeq_epi8(cur, three));
+    auto mask = static_cast<uint32_t>(_mm_movemask_epi8(escaped));
+
+    if (mask == 0) {
+      _mm_storeu_si128(reinterpret_cast<__m128i *>(dest), cur);
+      dest += 16;
+    } else {
+      dest = copy_block_skipping(pos, 16, mask, dest);
+    }
+    pos += 16;
+  }
+
+  return copy_from_ebsp_scalar(pos, last, dest);
+}
+
+__attribute__((target("avx2"))) uint8_t *
+copy_from_ebsp_avx2(const uint8_t *pos, const uint8_t *last, uint8_t *dest) noexcept
+{
+  const __m256i zero = _mm256_setzero_si256();
+  const __m256i three = _mm256_set1_epi8(3);
+
+  while (last - pos >= 32) {
+    __m256i cur = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(pos));
+    __m256i prev1 = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(pos - 1));
+    __m256i prev2 = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(pos - 2));
+
+    __m256i escaped = _mm256_and_si256(_mm256_and_si256(_mm256_cmpeq_epi8(prev2, zero), _mm256_cmpeq_epi8(prev1, zero)),
+                                       _mm256_cmpeq_epi8(cur, three));
+    auto mask = static_cast<uint32_t>(_mm256_movemask_epi8(escaped));
+
+    if (mask == 0) {
+      _mm256_storeu_si256(reinterpret_cast<__m256i *>(dest), cur);
+      dest += 32;
+    } else {
+      dest = copy_block_skipping(pos, 32, mask, dest);
+    }
+    pos += 32;
+  }
+
+  // Legacy SSE code following dirty upper halves of AVX registers is penalized
+  _mm256_zeroupper();
+  return copy_from_ebsp_sse2(pos, last, dest);
+}
+
+// Vectorized insertion finds candidates, bytes 00-03 preceded by two zero bytes, which is a superset of bytes needing
+// escaping, as emulation prevention byte inserted right before a candidate cancels it. Blocks free of candidates are
+// copied at once, otherwise bytes up to the first candidate are, and the candidate goes through scalar kernel.
+
+template<bool Write>
+__attribute__((target("sse2"))) EscapeState
+escape_sse2(const uint8_t *pos, const uint8_t *last, EscapeState state) noexcept
+{
+  const __m128i zero = _mm_setzero_si128();
+  const __m128i three = _mm_set1_epi8(3);
+
+  while (last - pos >= 16) {
+    __m128i cur = _mm_loadu_si128(reinterpret_cast<const __m128i *>(pos));
+    __m128i prev1 = _mm_loadu_si128(reinterpret_cast<const __m128i *>(pos - 1));
+    __m128i prev2 = _mm_loadu_si128(reinterpret_cast<const __m128i *>(pos - 2));
+
+    __m128i candidates = _mm_and_si128(_mm_and_si128(_mm_cmpeq_epi8(prev2, zero), _mm_cmpeq_epi8(prev1, zero)),
+                                       _mm_cmpeq_epi8(_mm_min_epu8(cur, three), cur));
+
+    auto mask = static_cast<uint32_t>(_mm_movemask_epi8(candidates));
+    if (mask == 0) {
+      if constexpr (Write) {
+        _mm_storeu_si128(reinterpret_cast<__m128i *>(state.dest), cur);
+        state.dest += 16;
+      }
+      state.zeros = trailing_zeros(pos, 16);
+      pos += 16;
+    } else {
+      pos = escape_candidate<Write>(pos, __builtin_ctz(mask), state);
+    }
+  }
+
+  return escape_scalar<Write>(pos, last, state);
+}
+
+template<bool Write>
+__attribute__((target("avx2"))) EscapeState
+escape_avx2(const uint8_t *pos, const uint8_t *last, EscapeState state) noexcept
+{
+  const __m256i zero = _mm256_setzero_si256();
+  const __m256i three = _mm256_set1_epi8(3);
+
+  while (last - pos >= 32) {
+    __m256i cur = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(pos));
+    __m256i prev1 = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(pos - 1));
+    __m256i prev2 = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(pos - 2));
+
+    __m256i candidates =
+      _mm256_and_si256(_mm256_and_si256(_mm256_cmpeq_epi8(prev2, zero), _mm256_cmpeq_epi8(prev1, zero)),
+                       _mm256_cmpeq_epi8(_mm256_min_epu8(cur, three), cur));
+
+    auto mask = static_cast<uint32_t>(_mm256_movemask_epi8(candidates));
+    if (mask == 0) {
+      if constexpr (Write) {
+        _mm256_storeu_si256(reinterpret_cast<__m256i *>(state.dest), cur);
+        state.dest += 32;
+      }
+      state.zeros = trailing_zeros(pos, 32);
+      pos += 32;
+    } else {
+      pos = escape_candidate<Write>(pos, __builtin_ctz(mask), state);
+    }
+  }
+
+  // Legacy SSE code following dirty upper halves of AVX registers is penalized
+  _mm256_zeroupper();
+  return escape_sse2<Write>(pos, last, state);
+}
+
+#endif
+
+template<bool Write>
+EscapeState
+escape(const uint8_t *first, const uint8_t *last, EscapeState state, SimdLevel level) noexcept
+{
+  // Vectorized kernels look two bytes back, and the first two bytes are never escaped
+  const uint8_t *head = first + std::min<ptrdiff_t>(last - first, 2);
+  state = escape_scalar<Write>(first, head, state);
+
+  switch (level) {
+#ifdef METAMIX_X86_SIMD
+  case SimdLevel::AVX2:
+    return escape_avx2<Write>(head, last, state);
+  case SimdLevel::SSE2:
+    return escape_sse2<Write>(head, last, state);
+#endif
+  default:
+    return escape_scalar<Write>(head, last, state);
+  }
+}
+
+/// Scalar kernel of `detail::find_zero_prefixed`.
+const uint8_t *
+find_zero_prefixed_scalar(const uint8_t *pos, const uint8_t *last, uint8_t third) noexcept
+{
+  while (last - pos >= 3) {
+    if (pos[2] != 0 && pos[2] != third) {
+      // No sequence may begin at any of the three bytes
+      pos += 3;
+    } else if (pos[0] == 0 && pos[1] == 0 && pos[2] == third) {
+      return pos;
+    } else {
+      pos++;
+    }
+  }
+  return last;
+}
+
+#ifdef METAMIX_X86_SIMD
+
+__attribute__((target("sse2"))) const uint8_t *
+find_zero_prefixed_sse2(const uint8_t *pos, const uint8_t *last, uint8_t third) noexcept
+{
+  const __m128i zero = _mm_setzero_si128();
+  const __m128i wanted = _mm_set1_epi8(static_cast<char>(third));
+
+  // Compare each byte with two following ones, so that sequence crossing block boundary is found as well
+  while (last - pos >= 16 + 2) {
+    __m128i cur = _mm_loadu_si128(reinterpret_cast<const __m128i *>(pos));
+    __m128i next1 = _mm_loadu_si128(reinterpret_cast<const __m128i *>(pos + 1));
+    __m128i next2 = _mm_loadu_si128(reinterpret_cast<const __m128i *>(pos + 2));
+
+    __m128i found = _mm_and_si128(_mm_and_si128(_mm_cmpeq_epi8(cur, zero), _mm_cmpeq_epi8(next1, zero)),
+                                  _mm_cmpeq_epi8(next2, wanted));
+    auto mask = static_cast<uint32_t>(_mm_movemask_epi8(found));
+
+    if (mask != 0) {
+      return pos + __builtin_ctz(mask);
+    }
+    pos += 16;
+  }
+
+  return find_zero_prefixed_scalar(pos, last, third);
+}
+
+__attribute__((target("avx2"))) const uint8_t *
+find_zero_prefixed_avx2(const uint8_t *pos, const uint8_t *last, uint8_t third) noexcept
+{
+  const __m256i zero = _mm256_setzero_si256();
+  const __m256i wanted = _mm256_set1_epi8(static_cast<char>(third));
+
+  while (last - pos >= 32 + 2) {
+    __m256i cur = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(pos));
+    __m256i next1 = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(pos + 1));
+    __m256i next2 = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(pos + 2));
+
+    __m256i found = _mm256_and_si256(_mm256_and_si256(_mm256_cmpeq_epi8(cur, zero), _mm256_cmpeq_epi8(next1, zero)),
+                                     _mm256_cmpeq_epi8(next2, wanted));
+    auto mask = static_cast<uint32_t>(_mm256_movemask_epi8(found));
+
+    if (mask != 0) {
+      _mm256_zeroupper();
+      return pos + __builtin_ctz(mask);
+    }
+    pos += 32;
+  }
+
+  _mm256_zeroupper();
+  return find_zero_prefixed_sse2(pos, last, third);
+}
+
+#endif
+}
+
+SimdLevel
+simd_level() noexcept
+{
+#ifdef METAMIX_X86_SIMD
+  static const SimdLevel level = []() {
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2")) {
+      return SimdLevel::AVX2;
+    } else if (__builtin_cpu_supports("sse2")) {
+      return SimdLevel::SSE2;
+    }
+    return SimdLevel::SCALAR;
+  }();
+  return level;
+#else
+  return SimdLevel::SCALAR;
+#endif
+}
+
+namespace detail {
+
+uint8_t *
+copy_from_ebsp_bytes(const uint8_t *first, const uint8_t *last, uint8_t *dest, SimdLevel level) noexcept
+{
+  // Emulation prevention byte is preceded by two bytes at least, which are copied as they are
+  if (last - first <= 2) {
+    std::memcpy(dest, first, last - first);
+    return dest + (last - first);
+  }
+
+  dest[0] = first[0];
+  dest[1] = first[1];
+  first += 2;
+  dest += 2;
+
+  switch (level) {
+#ifdef METAMIX_X86_SIMD
+  case SimdLevel::AVX2:
+    return copy_from_ebsp_avx2(first, last, dest);
+  case SimdLevel::SSE2:
+    return copy_from_ebsp_sse2(first, last, dest);
+#endif
+  default:
+    return copy_from_ebsp_scalar(first, last, dest);
+  }
+}
+
+uint8_t *
+copy_to_ebsp_bytes(const uint8_t *first, const uint8_t *last, uint8_t *dest, SimdLevel level) noexcept
+{
+  return escape<true>(first, last, EscapeState{ dest, 0, 0 }, level).dest;
+}
+
+size_t
+count_ebsp_escapes(const uint8_t *first, const uint8_t *last, SimdLevel level) noexcept
+{
+  return escape<false>(first, last, EscapeState{ nullptr, 0, 0 }, level).count;
+}
+
+const uint8_t *
+find_zero_prefixed(const uint8_t *first, const uint8_t *last, uint8_t third, SimdLevel level) noexcept
+{
+  switch (level) {
+#ifdef METAMIX_X86_SIMD
+  case SimdLevel::AVX2:
+    return find_zero_prefixed_avx2(first, last, third);
+  case SimdLevel::SSE2:
+    return find_zero_prefixed_sse2(first, last, third);
+#endif
+  default:
+    return find_zero_prefixed_scalar(first, last, third);
+  }
+}
+}
+}
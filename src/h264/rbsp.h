@@ -2,13 +2,73 @@
 
 #include <algorithm>
 #include <cassert>
+#include <cstdint>
 #include <iterator>
 #include <stdexcept>
+#include <type_traits>
+#include <vector>
 
 namespace metamix::h264 {
 
+/// Instruction set used by byte stream kernels.
+enum class SimdLevel
+{
+  SCALAR,
+  SSE2,
+  AVX2,
+};
+
+/// The best instruction set supported by the running CPU, detected once.
+SimdLevel
+simd_level() noexcept;
+
+/// End of SODB in RBSP, which precedes the stop bit byte and trailing zero bytes.
+template<class Iter>
+Iter
+sodb_end(Iter first, Iter last)
+{
+  while (last != first && last[-1] == 0) {
+    last--;
+  }
+
+  if (last == first || last[-1] != 0x80) {
+    throw std::runtime_error("malformed RBSP payload, missing stop bit");
+  }
+
+  return last - 1;
+}
+
 namespace detail {
 
+/// Copies EBSP bytes to `dest`, dropping emulation prevention bytes, which must have room for `last - first` bytes.
+///
+/// \return end of written bytes
+uint8_t *
+copy_from_ebsp_bytes(const uint8_t *first,
+                     const uint8_t *last,
+                     uint8_t *dest,
+                     SimdLevel level = simd_level()) noexcept;
+
+/// Copies RBSP bytes to `dest`, inserting emulation prevention bytes, which must have room for `(last - first) * 3 /
+/// 2` bytes.
+///
+/// \return end of written bytes
+uint8_t *
+copy_to_ebsp_bytes(const uint8_t *first, const uint8_t *last, uint8_t *dest, SimdLevel level = simd_level()) noexcept;
+
+/// Count of emulation prevention bytes `copy_to_ebsp_bytes` inserts into given RBSP bytes.
+size_t
+count_ebsp_escapes(const uint8_t *first, const uint8_t *last, SimdLevel level = simd_level()) noexcept;
+
+/// Finds the first `00 00 <third>` sequence in given bytes.
+///
+/// \return start of the sequence, or `last` if there is none
+const uint8_t *
+find_zero_prefixed(const uint8_t *first,
+                   const uint8_t *last,
+                   uint8_t third,
+                   SimdLevel level = simd_level()) noexcept;
+
 template<bool DropStopBit, class InputIt, class OutputIt>
 OutputIt
 copy_from_ebsp_impl(InputIt first, InputIt last, OutputIt dest)
@@ -26,15 +86,7 @@ copy_from_ebsp_impl(InputIt first, InputIt last, OutputIt dest)
 
   // Skip stop bit if requested
   if constexpr (DropStopBit) {
-    while (last[-1] == 0) {
-      last--;
-    }
-
-    if (last[-1] != 0x80) {
-      throw std::runtime_error("malformed RBSP payload, missing stop bit");
-    }
-
-    last--;
+    last = sodb_end(first, last);
   }
 
   // If payload is to short, just copy it and return
@@ -75,25 +127,22 @@ copy_to_ebsp_impl(InputIt first, InputIt last, OutputIt dest)
     return dest;
   }
 
-  if (std::distance(first, last) <= 2) {
-    dest = std::copy(first, last, dest);
-  } else {
-    // Copy first two bytes
-    dest = std::copy(first, first + 2, dest);
-    first += 2;
-
-    while (first < last) {
-      // Check whether we are on emulation byte (00 00 <here> 00-03)
-      if (first[-2] == 0 && first[-1] == 0 && first[0] <= 3) {
-        // Insert emulation prevention byte
-        *dest = 0x03;
-        dest++;
-      }
+  // Count of zero bytes emitted since the last emulation prevention byte
+  unsigned int zeros = 0;
 
-      *dest = *first;
-      first++;
+  while (first < last) {
+    // Check whether we are on emulation byte (00 00 <here> 00-03)
+    if (zeros >= 2 && *first <= 3) {
+      // Insert emulation prevention byte
+      *dest = 0x03;
       dest++;
+      zeros = 0;
     }
+
+    zeros = *first == 0 ? zeros + 1 : 0;
+    *dest = *first;
+    first++;
+    dest++;
   }
 
   // Add stop bit if requested
@@ -104,8 +153,55 @@ copy_to_ebsp_impl(InputIt first, InputIt last, OutputIt dest)
 
   return dest;
 }
+
+/// Appends contiguous EBSP bytes to byte vector without emulation prevention bytes, using vectorized kernel.
+template<bool DropStopBit>
+void
+copy_from_ebsp_impl(const uint8_t *first, const uint8_t *last, std::vector<uint8_t> &dest)
+{
+  if (first == last) {
+    return;
+  }
+
+  // Skip stop bit if requested
+  if constexpr (DropStopBit) {
+    last = sodb_end(first, last);
+  }
+
+  size_t size = dest.size();
+  dest.resize(size + (last - first));
+  auto end = copy_from_ebsp_bytes(first, last, dest.data() + size);
+  dest.resize(end - dest.data());
 }
 
+/// Appends contiguous bytes to byte vector with emulation prevention bytes, using vectorized kernel.
+template<bool AddStopBit>
+void
+copy_to_ebsp_impl(const uint8_t *first, const uint8_t *last, std::vector<uint8_t> &dest)
+{
+  if (first == last) {
+    return;
+  }
+
+  // Emulation prevention byte is inserted at most once per two bytes, plus room for stop bit
+  size_t size = dest.size();
+  dest.resize(size + (last - first) + (last - first) / 2 + 1);
+  auto end = copy_to_ebsp_bytes(first, last, dest.data() + size);
+  if constexpr (AddStopBit) {
+    *end++ = 0x80;
+  }
+  dest.resize(end - dest.data());
+}
+}
+
+/// Whether EBSP contains any emulation prevention byte, so that it differs from its RBSP.
+inline bool
+has_emulation_prevention_bytes(const uint8_t *first, const uint8_t *last) noexcept
+{
+  return detail::find_zero_prefixed(first, last, 0x03) != last;
+}
+
+/// Count of emulation prevention bytes present in EBSP.
 template<class Iter>
 unsigned int
 count_emulation_prevention_bytes(Iter first, Iter last)
@@ -130,31 +226,84 @@ count_emulation_prevention_bytes(Iter first, Iter last)
   return count;
 }
 
-template<class InputIt, class OutputIt>
+/// Count of emulation prevention bytes, which have to be inserted into RBSP or SODB to make it EBSP.
+template<class Iter>
+unsigned int
+count_emulation_prevention_bytes_needed(Iter first, Iter last)
+{
+  if constexpr (std::is_pointer<Iter>::value) {
+    static_assert(sizeof(*first) == 1, "input has to be byte array");
+    return static_cast<unsigned int>(
+      detail::count_ebsp_escapes(reinterpret_cast<const uint8_t *>(first), reinterpret_cast<const uint8_t *>(last)));
+  }
+
+  unsigned int count = 0;
+  unsigned int zeros = 0;
+
+  for (; first != last; first++) {
+    if (zeros >= 2 && *first <= 3) {
+      count++;
+      zeros = 0;
+    }
+    zeros = *first == 0 ? zeros + 1 : 0;
+  }
+
+  return count;
+}
+
+template<class InputIt, class OutputIt, class = typename std::iterator_traits<OutputIt>::iterator_category>
 OutputIt
 copy_ebsp_to_rbsp(InputIt srcbeg, InputIt srcend, OutputIt dstbeg)
 {
   return detail::copy_from_ebsp_impl<false>(srcbeg, srcend, dstbeg);
 }
 
-template<class InputIt, class OutputIt>
+/// Appends RBSP of contiguous EBSP bytes to `dest`.
+inline void
+copy_ebsp_to_rbsp(const uint8_t *srcbeg, const uint8_t *srcend, std::vector<uint8_t> &dest)
+{
+  detail::copy_from_ebsp_impl<false>(srcbeg, srcend, dest);
+}
+
+template<class InputIt, class OutputIt, class = typename std::iterator_traits<OutputIt>::iterator_category>
 OutputIt
 copy_ebsp_to_sodb(InputIt srcbeg, InputIt srcend, OutputIt dstbeg)
 {
   return detail::copy_from_ebsp_impl<true>(srcbeg, srcend, dstbeg);
 }
 
-template<class InputIt, class OutputIt>
+/// Appends SODB of contiguous EBSP bytes to `dest`.
+inline void
+copy_ebsp_to_sodb(const uint8_t *srcbeg, const uint8_t *srcend, std::vector<uint8_t> &dest)
+{
+  detail::copy_from_ebsp_impl<true>(srcbeg, srcend, dest);
+}
+
+template<class InputIt, class OutputIt, class = typename std::iterator_traits<OutputIt>::iterator_category>
 OutputIt
 copy_rbsp_to_ebsp(InputIt srcbeg, InputIt srcend, OutputIt dstbeg)
 {
   return detail::copy_to_ebsp_impl<false>(srcbeg, srcend, dstbeg);
 }
 
-template<class InputIt, class OutputIt>
+/// Appends EBSP of contiguous RBSP bytes to `dest`.
+inline void
+copy_rbsp_to_ebsp(const uint8_t *srcbeg, const uint8_t *srcend, std::vector<uint8_t> &dest)
+{
+  detail::copy_to_ebsp_impl<false>(srcbeg, srcend, dest);
+}
+
+template<class InputIt, class OutputIt, class = typename std::iterator_traits<OutputIt>::iterator_category>
 OutputIt
 copy_sodb_to_ebsp(InputIt srcbeg, InputIt srcend, OutputIt dstbeg)
 {
   return detail::copy_to_ebsp_impl<true>(srcbeg, srcend, dstbeg);
 }
+
+/// Appends EBSP of contiguous SODB bytes to `dest`, with trailing stop bit.
+inline void
+copy_sodb_to_ebsp(const uint8_t *srcbeg, const uint8_t *srcend, std::vector<uint8_t> &dest)
+{
+  detail::copy_to_ebsp_impl<true>(srcbeg, srcend, dest);
+}
 }
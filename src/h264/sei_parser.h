@@ -1,6 +1,10 @@
 #pragma once
 
+#include <cstdint>
+#include <vector>
+
 #include "../binary_parser.h"
+#include "rbsp.h"
 #include "sei_payload.h"
 
 namespace metamix::h264 {
@@ -26,10 +30,72 @@ inline OwnedSeiPayload sei_parser_pack([[maybe_unused]] const BinaryParserContex
 {
   assert(bounds.startptr() >= ctx.startptr());
   assert(bounds.length() > 0);
-  return OwnedSeiPayload(static_cast<SeiType>(bounds.payload_type()),
-                         std::vector<uint8_t>(bounds.startptr(), bounds.startptr() + bounds.length()));
+  return OwnedSeiPayload(
+    static_cast<SeiType>(bounds.payload_type()), bounds.startptr(), bounds.startptr() + bounds.length());
+}
+
+inline SeiPayloadView
+sei_view_parser_pack([[maybe_unused]] const BinaryParserContext &ctx, const SeiParserBounds &bounds)
+{
+  assert(bounds.startptr() >= ctx.startptr());
+  return SeiPayloadView(static_cast<SeiType>(bounds.payload_type()), bounds.startptr(), bounds.length());
 }
 
 // Input: SODB byte array, Output: OwnedSeiPayload
 using SeiParser = BinaryParser<OwnedSeiPayload, BinaryParserContext, SeiParserBounds, sei_parser_next, sei_parser_pack>;
+
+// Input: SODB byte array, Output: SeiPayloadView into the array
+using SeiViewParser =
+  BinaryParser<SeiPayloadView, BinaryParserContext, SeiParserBounds, sei_parser_next, sei_view_parser_pack>;
+
+/**
+ * @brief Calls `f` with view of each SEI payload of SEI NALU, which starts with NALU header of `header_size` bytes.
+ *
+ * NALUs without emulation prevention bytes, which most SEI NALUs are, are parsed in place. The others are converted
+ * to SODB in `scratch` first, which is reused across calls. Either way, views are valid only during the call of `f`,
+ * so payloads to be kept have to be copied.
+ */
+template<class F>
+void
+for_each_sei_payload(const uint8_t *first,
+                     const uint8_t *last,
+                     size_t header_size,
+                     std::vector<uint8_t> &scratch,
+                     F &&f)
+{
+  const uint8_t *sodb_first;
+  const uint8_t *sodb_last;
+
+  if (!has_emulation_prevention_bytes(first, last)) {
+    sodb_first = first + header_size;
+    sodb_last = sodb_end(first, last);
+  } else {
+    scratch.clear();
+    copy_ebsp_to_sodb(first, last, scratch);
+    sodb_first = scratch.data() + header_size;
+    sodb_last = scratch.data() + scratch.size();
+  }
+
+  if (sodb_last < sodb_first) {
+    throw BinaryParseError("malformed SEI");
+  }
+
+  SeiViewParser parser = SeiViewParser::create(sodb_first, sodb_last);
+  SeiPayloadView sei;
+  while (parser) {
+    parser >> sei;
+    f(sei);
+  }
+}
+
+/// Whether SEI NALU carries closed captions, which is told from payload headers, without copying any payload.
+inline bool
+has_closed_captions(const uint8_t *first, const uint8_t *last, size_t header_size, std::vector<uint8_t> &scratch)
+{
+  bool found = false;
+  for_each_sei_payload(first, last, header_size, scratch, [&](const SeiPayloadView &sei) {
+    found = found || is_closed_caption(sei);
+  });
+  return found;
+}
 }
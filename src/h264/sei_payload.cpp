@@ -3,6 +3,9 @@
 #include <boost/core/demangle.hpp>
 #include <boost/format.hpp>
 
+#include "emitter.h"
+#include "rbsp.h"
+
 namespace metamix::h264 {
 
 std::string
@@ -52,4 +55,23 @@ operator<<(std::ostream &os, const SeiPayload &sei)
   os << "}";
   return os;
 }
+
+void
+OwnedSeiPayload::serialize_message_header() noexcept
+{
+  m_message_header_size = 0;
+
+  auto type = static_cast<unsigned int>(this->type());
+  auto size = static_cast<unsigned int>(this->size());
+  if (detail::variadic_length_int_size(type) + detail::variadic_length_int_size(size) > MAX_MESSAGE_HEADER_SIZE) {
+    return;
+  }
+
+  // Payload follows non-zero byte of header, so it is copied as it is if it does not need emulation prevention itself.
+  uint8_t *header = m_message_header.data();
+  uint8_t *end = detail::emit_variadic_length_int(size, detail::emit_variadic_length_int(type, header));
+  if (std::find(header, end, 0) == end && count_emulation_prevention_bytes_needed(data(), data() + this->size()) == 0) {
+    m_message_header_size = static_cast<uint8_t>(end - header);
+  }
+}
 }
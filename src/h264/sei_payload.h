@@ -1,10 +1,14 @@
 #pragma once
 
+#include <algorithm>
+#include <array>
 #include <cassert>
 #include <cstdint>
 #include <iostream>
 #include <limits>
 #include <string>
+#include <utility>
+#include <vector>
 
 #include "../slice.h"
 
@@ -33,37 +37,179 @@ sei_type_string(SeiType ty);
 
 class SeiPayload : public AbstractSlice<SeiPayload, uint8_t>
 {
-public:
-  ~SeiPayload() override = default;
+private:
+  SeiType m_payload_type = SeiType::UNDEFINED;
+
+protected:
+  SeiPayload() = default;
+
+  SeiPayload(SeiType payload_type, const uint8_t *data, size_t size) noexcept
+    : AbstractSlice(const_cast<uint8_t *>(data), size)
+    , m_payload_type(payload_type)
+  {}
+
+  void set_type(SeiType payload_type) noexcept { m_payload_type = payload_type; }
 
-  virtual SeiType type() const = 0;
+public:
+  SeiType type() const noexcept { return m_payload_type; }
 
   friend std::ostream &operator<<(std::ostream &os, const SeiPayload &sei);
+
+  friend bool operator==(const SeiPayload &lhs, const SeiPayload &rhs)
+  {
+    return lhs.type() == rhs.type() && lhs.size() == rhs.size() &&
+           std::equal(lhs.data(), lhs.data() + lhs.size(), rhs.data());
+  }
+
+  friend bool operator!=(const SeiPayload &lhs, const SeiPayload &rhs) { return !(lhs == rhs); }
 };
 
-class OwnedSeiPayload : public AbstractOwnedSlice<OwnedSeiPayload, SeiPayload>
+/**
+ * @brief SEI payload owning its bytes. CEA-708 closed caption payloads fit in inline storage, so they are copied without
+ * allocating.
+ *
+ * Payloads are shared by metadata queues and output frames, so their bytes are not modified in place. Header of their
+ * SEI message is serialized once constructed, so that payloads emitted over and over, such as paced and static closed
+ * captions, are copied as they are, without being serialized and scanned for emulation prevention again.
+ */
+class OwnedSeiPayload : public AbstractSmallOwnedSlice<OwnedSeiPayload, SeiPayload, 128>
 {
+public:
+  /// Longest coded payload type and size of SEI message serialized in advance.
+  static constexpr size_t MAX_MESSAGE_HEADER_SIZE = 4;
+
 private:
-  SeiType m_payload_type = SeiType::UNDEFINED;
+  std::array<uint8_t, MAX_MESSAGE_HEADER_SIZE> m_message_header{};
+  uint8_t m_message_header_size{ 0 };
 
 public:
   OwnedSeiPayload() = default;
 
   explicit OwnedSeiPayload(SeiType payload_type, std::vector<uint8_t> data)
-    : AbstractOwnedSlice(std::move(data))
-    , m_payload_type(payload_type)
-  {}
+    : AbstractSmallOwnedSlice(std::move(data))
+  {
+    set_type(payload_type);
+    serialize_message_header();
+  }
+
+  OwnedSeiPayload(SeiType payload_type, const uint8_t *first, const uint8_t *last)
+    : AbstractSmallOwnedSlice(first, last)
+  {
+    set_type(payload_type);
+    serialize_message_header();
+  }
+
+  template<size_t M>
+  OwnedSeiPayload(SeiType payload_type, const std::array<uint8_t, M> &data, size_t size)
+    : AbstractSmallOwnedSlice(data, size)
+  {
+    set_type(payload_type);
+    serialize_message_header();
+  }
+
+  /// Copies payload of SEI message serialized at compile time by `serialize_sei_message`, which is known to need no
+  /// emulation prevention.
+  template<size_t M>
+  explicit OwnedSeiPayload(const std::array<uint8_t, M> &message)
+    : AbstractSmallOwnedSlice(message.data() + 2, message.data() + M)
+    , m_message_header{ message[0], message[1] }
+    , m_message_header_size{ 2 }
+  {
+    set_type(static_cast<SeiType>(message[0]));
+  }
 
   explicit OwnedSeiPayload(const SeiPayload &base)
-    : AbstractOwnedSlice(base)
-    , m_payload_type(base.type())
-  {}
+    : AbstractSmallOwnedSlice(base)
+  {
+    set_type(base.type());
+    serialize_message_header();
+  }
 
   OwnedSeiPayload(SeiType payload_type, std::initializer_list<uint8_t> init)
-    : AbstractOwnedSlice(init)
-    , m_payload_type(payload_type)
+    : AbstractSmallOwnedSlice(init)
+  {
+    set_type(payload_type);
+    serialize_message_header();
+  }
+
+  OwnedSeiPayload(const OwnedSeiPayload &) = default;
+  OwnedSeiPayload &operator=(const OwnedSeiPayload &) = default;
+
+  /// Moved-from payload is left empty, without message header.
+  OwnedSeiPayload(OwnedSeiPayload &&other) noexcept
+    : AbstractSmallOwnedSlice(std::move(other))
+    , m_message_header{ other.m_message_header }
+    , m_message_header_size{ std::exchange(other.m_message_header_size, 0) }
   {}
 
-  SeiType type() const override { return m_payload_type; }
+  OwnedSeiPayload &operator=(OwnedSeiPayload &&other) noexcept
+  {
+    if (this != &other) {
+      AbstractSmallOwnedSlice::operator=(std::move(other));
+      m_message_header = other.m_message_header;
+      m_message_header_size = std::exchange(other.m_message_header_size, 0);
+    }
+    return *this;
+  }
+
+  /// Replaces contents, serializing message header again.
+  void assign(const uint8_t *first, const uint8_t *last)
+  {
+    AbstractSmallOwnedSlice::assign(first, last);
+    serialize_message_header();
+  }
+
+  /// Coded payload type and size of SEI message, which is followed by payload bytes as they are, unless it follows zero
+  /// bytes.
+  ///
+  /// \return range of header, which is empty if the message needs emulation prevention or its header is too long
+  std::pair<const uint8_t *, const uint8_t *> message_header() const noexcept
+  {
+    return { m_message_header.data(), m_message_header.data() + m_message_header_size };
+  }
+
+private:
+  void serialize_message_header() noexcept;
+};
+
+/// SEI payload referring to bytes of parsed buffer, which has to outlive it.
+class SeiPayloadView : public SeiPayload
+{
+public:
+  SeiPayloadView() = default;
+
+  SeiPayloadView(SeiType payload_type, const uint8_t *data, size_t size) noexcept
+    : SeiPayload(payload_type, data, size)
+  {}
 };
+
+/**
+ * @brief Leading bytes of registered user data SEI payloads carrying ATSC A/53 closed captions.
+ *
+ * These are T.35 country code of USA, provider code of ATSC, `GA94` user identifier and user data type code of
+ * `cc_data`.
+ */
+constexpr std::array<uint8_t, 8> CC_T35_HEADER{ 0xB5, 0x00, 0x31, 'G', 'A', '9', '4', 0x03 };
+
+/// Whether SEI payload carries closed captions, as told by its type and T.35 header, so that other payloads are
+/// skipped before they are copied.
+inline bool
+is_closed_caption(SeiType type, const uint8_t *data, size_t size) noexcept
+{
+  return type == SeiType::USER_DATA_REGISTERED && size >= CC_T35_HEADER.size() &&
+         std::equal(CC_T35_HEADER.begin(), CC_T35_HEADER.end(), data);
+}
+
+inline bool
+is_closed_caption(const SeiPayload &sei) noexcept
+{
+  return is_closed_caption(sei.type(), sei.data(), sei.size());
+}
+
+/// Approximate memory held by SEI payload, used for metadata queue budgets.
+inline size_t
+metadata_value_bytes(const OwnedSeiPayload &payload)
+{
+  return sizeof(payload) + (payload.is_inline() ? 0 : payload.size());
+}
 }
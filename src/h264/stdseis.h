@@ -15,4 +15,13 @@ build_empty_metadata(InputId input_id, ClockTS ts);
 
 Metadata<SeiKind>
 build_cc_reset_metadata(InputId input_id, ClockTS ts);
+
+/// Whether SEI payload is the one of metadata of `build_empty_metadata`, which fills frames without closed captions,
+/// or a copy of it, such as one read from shared memory queue or snapshot.
+bool
+is_empty_sei(const SeiPayload &sei);
+
+/// Whether SEI payload is the one of metadata of `build_cc_reset_metadata`, or a copy of it.
+bool
+is_cc_reset_sei(const SeiPayload &sei);
 }
@@ -0,0 +1,101 @@
+#include "nalu.h"
+
+#include <boost/core/demangle.hpp>
+
+namespace metamix::h265 {
+
+const char *
+nalu_type_to_string(NaluType ty)
+{
+  switch (ty) {
+  case NaluType::TRAIL_N:
+    return "TRAIL_N";
+  case NaluType::TRAIL_R:
+    return "TRAIL_R";
+  case NaluType::TSA_N:
+    return "TSA_N";
+  case NaluType::TSA_R:
+    return "TSA_R";
+  case NaluType::STSA_N:
+    return "STSA_N";
+  case NaluType::STSA_R:
+    return "STSA_R";
+  case NaluType::RADL_N:
+    return "RADL_N";
+  case NaluType::RADL_R:
+    return "RADL_R";
+  case NaluType::RASL_N:
+    return "RASL_N";
+  case NaluType::RASL_R:
+    return "RASL_R";
+  case NaluType::BLA_W_LP:
+    return "BLA_W_LP";
+  case NaluType::BLA_W_RADL:
+    return "BLA_W_RADL";
+  case NaluType::BLA_N_LP:
+    return "BLA_N_LP";
+  case NaluType::IDR_W_RADL:
+    return "IDR_W_RADL";
+  case NaluType::IDR_N_LP:
+    return "IDR_N_LP";
+  case NaluType::CRA:
+    return "CRA";
+  case NaluType::VPS:
+    return "VPS";
+  case NaluType::SPS:
+    return "SPS";
+  case NaluType::PPS:
+    return "PPS";
+  case NaluType::AUD:
+    return "AUD";
+  case NaluType::END_SEQUENCE:
+    return "END_SEQUENCE";
+  case NaluType::END_BITSTREAM:
+    return "END_BITSTREAM";
+  case NaluType::FILLER_DATA:
+    return "FILLER_DATA";
+  case NaluType::PREFIX_SEI:
+    return "PREFIX_SEI";
+  case NaluType::SUFFIX_SEI:
+    return "SUFFIX_SEI";
+  }
+
+  return static_cast<uint8_t>(ty) < 48 ? "RESERVED" : "UNSPECIFIED";
+}
+
+std::ostream &
+operator<<(std::ostream &os, const NaluType &ty)
+{
+  return os << nalu_type_to_string(ty);
+}
+
+std::ostream &
+operator<<(std::ostream &os, const Nalu &nalu)
+{
+  os << boost::core::demangle(typeid(nalu).name()) << "{";
+  if (!nalu.empty()) {
+    os << "type=" << nalu.type() << ","
+       << "data=0x" << std::hex << reinterpret_cast<size_t>(nalu.data()) << std::dec << ","
+       << "size=" << nalu.size();
+  } else {
+    os << "0-sized";
+  }
+  os << "}";
+  return os;
+}
+
+h264::NaluFormat
+detect_nalu_format(const uint8_t *extradata, size_t size) noexcept
+{
+  if (extradata == nullptr || size == 0 || extradata[0] != 1) {
+    return h264::NaluFormat{ h264::NaluFraming::ANNEX_B };
+  }
+
+  // Truncated record, assume the most common length size
+  if (size < 22) {
+    return h264::NaluFormat{ h264::NaluFraming::AVCC };
+  }
+
+  return h264::NaluFormat{ h264::NaluFraming::AVCC, (extradata[21] & 0b11u) + 1 };
+}
+}
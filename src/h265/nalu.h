@@ -0,0 +1,119 @@
+#pragma once
+
+#include <array>
+#include <cstdint>
+#include <optional>
+#include <ostream>
+#include <string>
+
+#include "../h264/nalu.h"
+#include "../slice.h"
+
+namespace metamix::h265 {
+
+/*
+ * Table 7-1 – NAL unit type codes and NAL unit type classes in T-REC-H.265-201802,
+ * reserved and unspecified types are not named
+ */
+enum class NaluType : uint8_t
+{
+  TRAIL_N = 0,
+  TRAIL_R = 1,
+  TSA_N = 2,
+  TSA_R = 3,
+  STSA_N = 4,
+  STSA_R = 5,
+  RADL_N = 6,
+  RADL_R = 7,
+  RASL_N = 8,
+  RASL_R = 9,
+  BLA_W_LP = 16,
+  BLA_W_RADL = 17,
+  BLA_N_LP = 18,
+  IDR_W_RADL = 19,
+  IDR_N_LP = 20,
+  CRA = 21,
+  VPS = 32,
+  SPS = 33,
+  PPS = 34,
+  AUD = 35,
+  END_SEQUENCE = 36,
+  END_BITSTREAM = 37,
+  FILLER_DATA = 38,
+  PREFIX_SEI = 39,
+  SUFFIX_SEI = 40,
+};
+
+const char *
+nalu_type_to_string(NaluType ty);
+
+std::ostream &
+operator<<(std::ostream &os, const NaluType &ty);
+
+/// Type of NALU, given the first byte of its 2-byte header.
+constexpr NaluType
+nalu_type(uint8_t header) noexcept
+{
+  return static_cast<NaluType>((header & 0b0'111111'0) >> 1);
+}
+
+/// Checks forbidden_zero_bit and nuh_temporal_id_plus1, which must not be 0, of NALU header.
+constexpr bool
+is_valid_header(const uint8_t *data, size_t size) noexcept
+{
+  return size >= 2 && (data[0] & 0b1'000000'0) == 0 && (data[1] & 0b00000'111) != 0;
+}
+
+class Nalu : public AbstractSlice<Nalu, uint8_t>
+{
+public:
+  static constexpr size_t HEADER_SIZE = 2;
+  static constexpr size_t MAX_LENGTH = h264::Nalu::MAX_LENGTH;
+
+protected:
+  using AbstractSlice::AbstractSlice;
+
+public:
+  bool is_valid() const noexcept { return is_valid_header(data(), size()); }
+
+  NaluType type() const noexcept { return nalu_type(front()); }
+
+  friend std::ostream &operator<<(std::ostream &os, const Nalu &nalu);
+};
+
+class OwnedNalu : public AbstractOwnedSlice<OwnedNalu, Nalu>
+{
+  using AbstractOwnedSlice::AbstractOwnedSlice;
+};
+
+/// Header of prefix SEI NALU in base layer, with nuh_layer_id 0 and nuh_temporal_id_plus1 1.
+constexpr std::array<uint8_t, Nalu::HEADER_SIZE> PREFIX_SEI_NALU_HEADER{
+  static_cast<uint8_t>(static_cast<uint8_t>(NaluType::PREFIX_SEI) << 1),
+  0x01,
+};
+
+/**
+ * @brief Header of prefix SEI NALU in the same layer and temporal sub-layer as NALU of given header.
+ *
+ * SEI NALUs must share nuh_layer_id and TemporalId with the access unit they belong to, so both are copied from another
+ * NALU of it, which are the lowest bit of the first byte, and the whole second byte.
+ */
+constexpr std::array<uint8_t, Nalu::HEADER_SIZE>
+prefix_sei_nalu_header(const uint8_t *header) noexcept
+{
+  return {
+    static_cast<uint8_t>(PREFIX_SEI_NALU_HEADER[0] | (header[0] & 0b0'000000'1)),
+    header[1],
+  };
+}
+
+/**
+ * @brief Detects NALU format from codec extradata of the stream.
+ *
+ * Length prefixed streams carry HEVCDecoderConfigurationRecord, which starts with configurationVersion 1 and holds
+ * lengthSizeMinusOne in its 22nd byte, while Annex B streams carry parameter sets preceded by start codes, or no
+ * extradata at all.
+ */
+h264::NaluFormat
+detect_nalu_format(const uint8_t *extradata, size_t size) noexcept;
+}
@@ -0,0 +1,112 @@
+#pragma once
+
+#include <cstdint>
+#include <unordered_map>
+
+#include "iospec.h"
+
+namespace metamix {
+
+/**
+ * @brief Tracks generation number, live entry count and footprint of each input feeding a metadata queue.
+ *
+ * Queue entries are stamped with their input's generation when pushed. Dropping all entries of an input is then just a
+ * generation bump: entries with older stamp are stale and are discarded lazily, whenever the queue comes across them.
+ *
+ * Not thread-safe, meant to be guarded by owning queue's lock.
+ */
+class InputGenerations
+{
+public:
+  using Generation = uint32_t;
+
+private:
+  struct State
+  {
+    Generation generation{ 0 };
+    size_t live{ 0 };
+    size_t bytes{ 0 };
+  };
+
+  std::unordered_map<InputId, State> m_states{};
+  size_t m_live{ 0 };
+  size_t m_bytes{ 0 };
+
+public:
+  /// Registers new entry of given input.
+  ///
+  /// \return generation the entry has to be stamped with
+  Generation acquire(InputId id, size_t bytes = 0)
+  {
+    State &state = m_states[id];
+    state.live++;
+    state.bytes += bytes;
+    m_live++;
+    m_bytes += bytes;
+    return state.generation;
+  }
+
+  /// Unregisters entry of given input, which is being removed from queue.
+  ///
+  /// \return true if the entry was live, false if it was stale
+  bool release(InputId id, Generation generation, size_t bytes = 0) noexcept
+  {
+    auto it = m_states.find(id);
+    if (it == m_states.end() || it->second.generation != generation) {
+      return false;
+    }
+
+    it->second.live--;
+    it->second.bytes -= bytes;
+    m_live--;
+    m_bytes -= bytes;
+    return true;
+  }
+
+  /// Checks whether entry of given input and generation has not been dropped.
+  bool is_live(InputId id, Generation generation) const noexcept
+  {
+    auto it = m_states.find(id);
+    return it != m_states.end() && it->second.generation == generation;
+  }
+
+  /// Makes all entries of given input stale, in constant time.
+  ///
+  /// \return count of entries which became stale
+  size_t drop(InputId id) noexcept
+  {
+    auto it = m_states.find(id);
+    if (it == m_states.end()) {
+      return 0;
+    }
+
+    size_t dropped = it->second.live;
+    it->second.generation++;
+    it->second.live = 0;
+    m_live -= dropped;
+    m_bytes -= it->second.bytes;
+    it->second.bytes = 0;
+    return dropped;
+  }
+
+  /// Total count of live entries.
+  size_t live() const noexcept { return m_live; }
+
+  /// Count of live entries of given input.
+  size_t live(InputId id) const noexcept
+  {
+    auto it = m_states.find(id);
+    return it == m_states.end() ? 0 : it->second.live;
+  }
+
+  /// Total footprint of live entries.
+  size_t live_bytes() const noexcept { return m_bytes; }
+
+  /// Footprint of live entries of given input.
+  size_t live_bytes(InputId id) const noexcept
+  {
+    auto it = m_states.find(id);
+    return it == m_states.end() ? 0 : it->second.bytes;
+  }
+};
+}
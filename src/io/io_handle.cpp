@@ -1,49 +1,21 @@
 #include "io_handle.h"
 
-#include <boost/algorithm/string.hpp>
-
 #include "../log.h"
 
 namespace metamix::io {
 
 namespace {
 
-const AVInputFormat *
-find_iformat(const char *needle)
+/// Frame rate of video stream, zero if unknown.
+TimeBase
+stream_frame_rate(const AVStream *stream)
 {
-  const AVInputFormat *fmt = nullptr;
-  void *opaque = nullptr;
-
-  while ((fmt = av_demuxer_iterate(&opaque)) != nullptr) {
-    for (auto it = boost::make_split_iterator(fmt->name, boost::first_finder(","));
-         it != boost::split_iterator<const char *>();
-         it++) {
-      if (boost::copy_range<std::string>(*it) == needle) {
-        return fmt;
-      }
+  for (auto rate : { stream->avg_frame_rate, stream->r_frame_rate }) {
+    if (rate.num > 0 && rate.den > 0) {
+      return TimeBase(rate.num, rate.den);
     }
   }
-
-  return nullptr;
-}
-
-const AVOutputFormat *
-find_oformat(const char *needle)
-{
-  const AVOutputFormat *fmt = nullptr;
-  void *opaque = nullptr;
-
-  while ((fmt = av_muxer_iterate(&opaque)) != nullptr) {
-    for (auto it = boost::make_split_iterator(fmt->name, boost::first_finder(","));
-         it != boost::split_iterator<const char *>();
-         it++) {
-      if (boost::copy_range<std::string>(*it) == needle) {
-        return fmt;
-      }
-    }
-  }
-
-  return nullptr;
+  return TimeBase(0);
 }
 }
 
@@ -56,13 +28,6 @@ IOHandle::all_streams() const
 StreamClassification
 IOHandle::classify_streams() const
 {
-  static const AVInputFormat *ifmt_mpegts = find_iformat("mpegts");
-  static const AVOutputFormat *ofmt_mpegts = find_oformat("mpegts");
-
-  if(ifmt_mpegts == nullptr || ofmt_mpegts == nullptr) {
-    LOG(warning) << "Using FFmpeg build with no support for MPEG-TS!";
-  }
-
   int e;
   StreamClassification sc;
 
@@ -80,13 +45,17 @@ IOHandle::classify_streams() const
     }
 
     if (codec_parameters->codec_id == AV_CODEC_ID_H264) {
-      if ((ifmt_mpegts != nullptr && fmt_ctx->iformat != nullptr && fmt_ctx->iformat == ifmt_mpegts) ||
-          (ofmt_mpegts != nullptr && fmt_ctx->oformat != nullptr && fmt_ctx->oformat == ofmt_mpegts)) {
-        LOG(warning) << "Found H.264 stream within MPEG-TS, Annex B formatted NALUs are not supported yet";
-      } else {
-        LOG(debug) << "This is CC SEI stream";
-        sc.classify<SeiKind>(i);
-      }
+      sc.classify<SeiKind>(i);
+      sc.sei_codec = VideoCodec::H264;
+      sc.sei_format = h264::detect_nalu_format(codec_parameters->extradata, codec_parameters->extradata_size);
+      sc.sei_frame_rate = stream_frame_rate(fmt_ctx->streams[i]);
+      LOG(debug) << "This is H.264 CC SEI stream, NALU format: " << sc.sei_format;
+    } else if (codec_parameters->codec_id == AV_CODEC_ID_HEVC) {
+      sc.classify<SeiKind>(i);
+      sc.sei_codec = VideoCodec::H265;
+      sc.sei_format = h265::detect_nalu_format(codec_parameters->extradata, codec_parameters->extradata_size);
+      sc.sei_frame_rate = stream_frame_rate(fmt_ctx->streams[i]);
+      LOG(debug) << "This is H.265 CC SEI stream, NALU format: " << sc.sei_format;
     } else if (codec_parameters->codec_id == AV_CODEC_ID_SCTE_35) {
       LOG(debug) << "This is SCTE-35 stream";
       sc.classify<ScteKind>(i);
@@ -5,7 +5,10 @@
 #include <string>
 #include <utility>
 
+#include "../clock_types.h"
+#include "../h264/nalu.h"
 #include "../metadata_kind.h"
+#include "../video_codec.h"
 
 namespace metamix::io {
 
@@ -19,6 +22,15 @@ struct StreamClassification
   std::optional<size_t> sei{};
   std::optional<size_t> scte{};
 
+  /// Codec of SEI stream.
+  VideoCodec sei_codec{ VideoCodec::H264 };
+
+  /// NALU format of SEI stream, detected from its extradata.
+  h264::NaluFormat sei_format{};
+
+  /// Frame rate of SEI stream in frames per second, zero if unknown.
+  TimeBase sei_frame_rate{ 0 };
+
   template<class K>
   bool has() const
   {
@@ -53,7 +65,8 @@ struct StreamClassification
   friend std::ostream &operator<<(std::ostream &os, const StreamClassification &sc)
   {
     return os << "TimeSource:" << sc.time_source << ", "
-              << "SEI:" << sc.sei << ", "
+              << "SEI:" << sc.sei << " (" << sc.sei_codec << ", " << sc.sei_format << ", " << sc.sei_frame_rate
+              << " fps), "
               << "SCTE:" << sc.scte;
   }
 };
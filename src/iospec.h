@@ -1,6 +1,8 @@
 #pragma once
 
+#include <cstdint>
 #include <optional>
+#include <ostream>
 #include <string>
 
 namespace metamix {
@@ -18,6 +20,25 @@ struct InputSpec
   bool is_virtual{ false };
 };
 
+/// Frames of output stream, into which SEI NALU carrying closed captions is injected.
+enum class InjectionMode
+{
+  DENSE,  ///< All frames, with empty closed captions where there are none, as ATSC A/53 requires.
+  SPARSE, ///< Frames with closed captions to inject or to strip only, the others are passed untouched.
+};
+
+inline std::ostream &
+operator<<(std::ostream &os, InjectionMode mode)
+{
+  switch (mode) {
+  case InjectionMode::DENSE:
+    return os << "dense";
+  case InjectionMode::SPARSE:
+    return os << "sparse";
+  }
+  return os << "unknown";
+}
+
 struct OutputSpec
 {
   std::string source{};
@@ -25,5 +46,6 @@ struct OutputSpec
   std::optional<std::string> source_format{ std::nullopt };
   std::optional<std::string> sink_format{ std::nullopt };
   int64_t ts_adjustment{ 0 };
+  InjectionMode injection{ InjectionMode::DENSE };
 };
 }
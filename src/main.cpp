@@ -1,7 +1,10 @@
 #include <algorithm>
+#include <atomic>
 #include <cstdlib>
 #include <iostream>
 #include <memory>
+#include <new>
+#include <optional>
 #include <thread>
 #include <vector>
 
@@ -15,7 +18,10 @@
 #include "proc/controller.h"
 #include "proc/extractor.h"
 #include "proc/injector.h"
+#include "proc/snapshotter.h"
 #include "program_options.h"
+#include "shared_memory.h"
+#include "snapshot.h"
 #include "supervisor.h"
 #include "user_defined_input.h"
 
@@ -23,6 +29,21 @@ namespace log = metamix::log;
 using namespace metamix;
 using namespace metamix::proc;
 
+namespace {
+
+/// Clock kept in shared memory, so that extractor processes rescale timestamps against the clock driven by injector
+/// process.
+std::shared_ptr<Clock>
+make_shared_memory_clock(const SharedQueueSpec &spec)
+{
+  auto memory = std::make_shared<SharedMemory>(spec.name + ".clock", sizeof(std::atomic<TS>));
+  auto ptr = memory->created() ? new (memory->data()) std::atomic<TS>(0)
+                               : reinterpret_cast<std::atomic<TS> *>(memory->data());
+  auto value = std::shared_ptr<std::atomic<TS>>(memory, ptr);
+  return std::make_shared<Clock>(std::move(value));
+}
+}
+
 int
 main(int argc, char *argv[])
 {
@@ -35,15 +56,33 @@ main(int argc, char *argv[])
 
     log::set_filter(options->logging_level, options->logging_thread);
 
-    auto meta_queue = std::make_shared<ApplicationMetadataQueueGroup>();
-    auto clock = std::make_shared<Clock>();
+    std::shared_ptr<SnapshotFile> snapshot_file{};
+    std::optional<Snapshot> snapshot{};
+    if (options->snapshot_file) {
+      snapshot_file = std::make_shared<SnapshotFile>(*options->snapshot_file, options->snapshot_size);
+      if (auto payload = snapshot_file->read(); payload) {
+        try {
+          snapshot = parse_snapshot(payload->data(), payload->data() + payload->size());
+          LOG(info) << "Restoring snapshot from " << *options->snapshot_file;
+        } catch (const BinaryParseError &ex) {
+          LOG(warning) << "Ignoring malformed snapshot: " << ex;
+        }
+      }
+    }
+
+    auto clock = options->queue_engine == MetadataQueueEngine::SHM
+                   ? make_shared_memory_clock(options->shared_queue)
+                   : std::make_shared<Clock>(snapshot ? snapshot->clock : 0_clock);
+
+    LOG(debug) << "Using " << options->queue_engine << " metadata queue engine";
+    auto meta_queue = std::make_shared<ApplicationMetadataQueueGroup>(
+      options->queue_engine, options->queue_budgets, clock, options->shared_queue_spec());
 
     std::vector<std::unique_ptr<AbstractInput>> inputs;
 
     inputs.push_back(std::make_unique<ClearInput>(0)); // must be first!
 
-    for (auto &is : options->user_inputs) {
-      is.id = inputs.size();
+    for (const auto &is : options->user_inputs) {
       inputs.push_back(std::make_unique<UserDefinedInput>(is));
     }
 
@@ -67,16 +106,33 @@ main(int argc, char *argv[])
       // clang-format on
     );
 
+    ctx->snapshot_file = std::move(snapshot_file);
+    if (snapshot) {
+      restore_snapshot(*snapshot, *ctx);
+    }
+
     std::vector<std::thread> primary_threads, secondary_threads;
     primary_threads.reserve(ctx->input_manager->size());
 
-    secondary_threads.emplace_back(supervised(controller, !ctx->options->norestart), ctx);
+    LOG(debug) << "Running as " << ctx->options->role;
+
+    if (ctx->options->runs_injector()) {
+      secondary_threads.emplace_back(supervised(controller, !ctx->options->norestart), ctx);
+    }
+
+    if (ctx->snapshot_file) {
+      secondary_threads.emplace_back(supervised(snapshotter, false), ctx);
+    }
 
     for (const auto &is : ctx->options->user_inputs) {
-      primary_threads.emplace_back(supervised(extractor, !ctx->options->norestart), is.name, ctx);
+      if (ctx->options->runs_extractor(is)) {
+        primary_threads.emplace_back(supervised(extractor, !ctx->options->norestart), is.name, ctx);
+      }
     }
 
-    primary_threads.emplace_back(supervised(injector, !ctx->options->norestart), ctx);
+    if (ctx->options->runs_injector()) {
+      primary_threads.emplace_back(supervised(injector, !ctx->options->norestart), ctx);
+    }
 
     for (auto &th : primary_threads) {
       if (th.joinable()) {
@@ -52,6 +52,9 @@ struct Metadata
   int order;
   std::shared_ptr<ValueType> val;
 
+  /// Clock value at which metadata has been pushed to queue, stamped by queues tracking metrics.
+  ClockTS queued_at{ 0 };
+
   Metadata(InputId input_id, ClockTS pts, ClockTS dts, int order, std::shared_ptr<ValueType> val)
     : input_id{ input_id }
     , pts{ pts }
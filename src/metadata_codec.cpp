@@ -0,0 +1,79 @@
+#include "metadata_codec.h"
+
+#include <algorithm>
+#include <iterator>
+
+#include "binary_emitter_util.h"
+#include "binary_parser_util.h"
+#include "h264/sei_payload.h"
+#include "scte35/emitter.h"
+#include "scte35/parser.h"
+#include "scte35/scte35.h"
+
+using metamix::h264::OwnedSeiPayload;
+using metamix::h264::SeiType;
+using metamix::scte35::Scte35Parser;
+using metamix::scte35::SpliceInfoSection;
+
+namespace metamix {
+
+void
+MetadataValueCodec<OwnedSeiPayload>::emit(const OwnedSeiPayload &sei, std::vector<uint8_t> &out)
+{
+  write_32(static_cast<uint32_t>(sei.type()), std::back_inserter(out));
+  out.insert(out.end(), sei.data(), sei.data() + sei.size());
+}
+
+uint8_t *
+MetadataValueCodec<OwnedSeiPayload>::emit(const OwnedSeiPayload &sei, uint8_t *ptr, uint8_t *endptr) noexcept
+{
+  if (static_cast<size_t>(endptr - ptr) < 4 + sei.size()) {
+    return nullptr;
+  }
+
+  auto type = static_cast<uint32_t>(sei.type());
+  *ptr++ = static_cast<uint8_t>(type >> 24);
+  *ptr++ = static_cast<uint8_t>(type >> 16);
+  *ptr++ = static_cast<uint8_t>(type >> 8);
+  *ptr++ = static_cast<uint8_t>(type);
+  return std::copy(sei.data(), sei.data() + sei.size(), ptr);
+}
+
+OwnedSeiPayload
+MetadataValueCodec<OwnedSeiPayload>::parse(const uint8_t *ptr, const uint8_t *endptr)
+{
+  auto type = static_cast<SeiType>(read_32(ptr, endptr));
+  return OwnedSeiPayload(type, ptr, endptr);
+}
+
+void
+MetadataValueCodec<SpliceInfoSection>::emit(const SpliceInfoSection &section, std::vector<uint8_t> &out)
+{
+  scte35::emit(section, std::back_inserter(out));
+}
+
+uint8_t *
+MetadataValueCodec<SpliceInfoSection>::emit(const SpliceInfoSection &section, uint8_t *ptr, uint8_t *endptr)
+{
+  // Splice info sections are rare, their emitter writes to growing buffer only.
+  thread_local std::vector<uint8_t> buffer{};
+  buffer.clear();
+  emit(section, buffer);
+
+  if (static_cast<size_t>(endptr - ptr) < buffer.size()) {
+    return nullptr;
+  }
+  return std::copy(buffer.begin(), buffer.end(), ptr);
+}
+
+SpliceInfoSection
+MetadataValueCodec<SpliceInfoSection>::parse(const uint8_t *ptr, const uint8_t *endptr)
+{
+  auto parser = Scte35Parser::create(ptr, endptr);
+  auto section = parser.next();
+  if (!section) {
+    throw BinaryParseError("expected splice info section");
+  }
+  return std::move(*section);
+}
+}
@@ -0,0 +1,124 @@
+#pragma once
+
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <type_traits>
+#include <vector>
+
+#include "binary_parser.h"
+#include "value_pool.h"
+
+namespace metamix::h264 {
+class OwnedSeiPayload;
+}
+
+namespace metamix::scte35 {
+class SpliceInfoSection;
+}
+
+namespace metamix {
+
+/**
+ * @brief Binary representation of metadata values, used wherever metadata leaves process memory.
+ *
+ * Trivially copyable values are copied verbatim, other value types specialize the codec.
+ */
+template<class T>
+struct MetadataValueCodec
+{
+  static_assert(std::is_trivially_copyable_v<T>, "metadata value type must specialize MetadataValueCodec");
+
+  static void emit(const T &value, std::vector<uint8_t> &out)
+  {
+    auto bytes = reinterpret_cast<const uint8_t *>(&value);
+    out.insert(out.end(), bytes, bytes + sizeof(T));
+  }
+
+  static uint8_t *emit(const T &value, uint8_t *ptr, uint8_t *endptr) noexcept
+  {
+    if (static_cast<size_t>(endptr - ptr) < sizeof(T)) {
+      return nullptr;
+    }
+
+    std::memcpy(ptr, &value, sizeof(T));
+    return ptr + sizeof(T);
+  }
+
+  static T parse(const uint8_t *ptr, const uint8_t *endptr)
+  {
+    if (static_cast<size_t>(endptr - ptr) != sizeof(T)) {
+      throw BinaryParseError("unexpected metadata value size", 0, endptr - ptr);
+    }
+
+    T val;
+    std::memcpy(&val, ptr, sizeof(T));
+    return val;
+  }
+};
+
+/// SEI payload is represented as type:32 followed by payload bytes.
+template<>
+struct MetadataValueCodec<h264::OwnedSeiPayload>
+{
+  static void emit(const h264::OwnedSeiPayload &sei, std::vector<uint8_t> &out);
+
+  static uint8_t *emit(const h264::OwnedSeiPayload &sei, uint8_t *ptr, uint8_t *endptr) noexcept;
+
+  /// \throws BinaryParseError if data is malformed
+  static h264::OwnedSeiPayload parse(const uint8_t *ptr, const uint8_t *endptr);
+};
+
+/// Splice info section is represented as emitted to transport stream.
+template<>
+struct MetadataValueCodec<scte35::SpliceInfoSection>
+{
+  static void emit(const scte35::SpliceInfoSection &section, std::vector<uint8_t> &out);
+
+  static uint8_t *emit(const scte35::SpliceInfoSection &section, uint8_t *ptr, uint8_t *endptr);
+
+  /// \throws BinaryParseError if data is malformed
+  static scte35::SpliceInfoSection parse(const uint8_t *ptr, const uint8_t *endptr);
+};
+
+/// Appends binary representation of metadata value to buffer.
+template<class T>
+inline void
+emit_metadata_value(const T &value, std::vector<uint8_t> &out)
+{
+  MetadataValueCodec<T>::emit(value, out);
+}
+
+/// Writes binary representation of metadata value to fixed-size buffer.
+///
+/// \return end of written representation, or nullptr if it does not fit, buffer contents are unspecified then
+template<class T>
+inline uint8_t *
+emit_metadata_value(const T &value, uint8_t *ptr, uint8_t *endptr)
+{
+  return MetadataValueCodec<T>::emit(value, ptr, endptr);
+}
+
+/// Parses binary representation of metadata value, taking the whole range.
+///
+/// \throws BinaryParseError if data is malformed
+template<class T>
+inline void
+parse_metadata_value(const uint8_t *ptr, const uint8_t *endptr, std::shared_ptr<T> &val)
+{
+  val = std::make_shared<T>(MetadataValueCodec<T>::parse(ptr, endptr));
+}
+
+/// Parses binary representation of metadata value, taking the whole range, into value allocated from pool.
+///
+/// \throws BinaryParseError if data is malformed
+template<class T>
+inline void
+parse_metadata_value(const uint8_t *ptr,
+                     const uint8_t *endptr,
+                     std::shared_ptr<T> &val,
+                     typename ValuePool<T>::Producer &values)
+{
+  val = values.make(MetadataValueCodec<T>::parse(ptr, endptr));
+}
+}
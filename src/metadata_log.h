@@ -0,0 +1,289 @@
+#pragma once
+
+#include <algorithm>
+#include <deque>
+#include <limits>
+#include <mutex>
+#include <optional>
+#include <tuple>
+#include <type_traits>
+
+#include "input_generations.h"
+#include "metadata.h"
+#include "queue_budget.h"
+#include "queue_metrics.h"
+
+namespace metamix {
+
+/**
+ * @brief Append-only, time-ordered metadata log read by single consumer.
+ *
+ * Entries are kept sorted as they are appended, extractors push in nearly monotonic order, so that reading walks the
+ * log front to back. Read position only moves forward, and entries are reclaimed once it has passed them.
+ */
+template<class K>
+class MetadataLog
+{
+public:
+  using Self = MetadataLog<K>;
+  using Kind = K;
+  using MetaType = Metadata<K>;
+  using ValueType = typename MetaType::ValueType;
+
+private:
+  /// Position in log, entries are ordered by it.
+  using Key = std::tuple<TS, InputId, int>;
+
+  struct Entry
+  {
+    MetaType meta;
+    InputGenerations::Generation generation;
+    size_t bytes;
+
+    Key key() const noexcept { return Key{ meta.pts.val, meta.input_id, meta.order }; }
+  };
+
+  mutable std::mutex m{};
+  std::deque<Entry> m_entries{};
+  InputGenerations m_generations{};
+
+  /// Read position, every entry before it has been passed.
+  Key m_position;
+
+  size_t m_stored_bytes{ 0 };
+
+  const QueueBudget m_budget;
+  size_t m_evicted_entries{ 0 };
+  size_t m_evicted_bytes{ 0 };
+
+public:
+  explicit MetadataLog(QueueBudget budget = {})
+    : m_position{ lowest_key(std::numeric_limits<TS>::min()) }
+    , m_budget{ budget }
+  {}
+
+  MetadataLog(const Self &) = delete;
+  Self &operator=(const Self &) = delete;
+
+  bool empty() const noexcept { return size() == 0; }
+
+  /// Count of live entries retained in log.
+  size_t size() const noexcept
+  {
+    std::lock_guard<std::mutex> guard(m);
+    return m_generations.live();
+  }
+
+  QueueStats stats() const
+  {
+    std::lock_guard<std::mutex> guard(m);
+    return QueueStats{ m_generations.live(), m_generations.live_bytes(), m_evicted_entries, m_evicted_bytes };
+  }
+
+  void push(MetaType value)
+  {
+    std::lock_guard<std::mutex> guard(m);
+    push_impl(std::move(value));
+  }
+
+  /// Appends all values with single lock acquisition.
+  template<class InputIt>
+  void push_range(InputIt first, InputIt last)
+  {
+    std::lock_guard<std::mutex> guard(m);
+    for (; first != last; ++first) {
+      push_impl(*first);
+    }
+  }
+
+  /// Pops value earliest in given time frame, assigned to given input id, which has not been passed yet.
+  /// Moves read position past the popped value, or to `until` if nothing has been popped.
+  ///
+  /// \param id       input id, popped value must be assigned to it, values of other inputs are passed
+  /// \param since    start time for lookup, inclusive
+  /// \param until    end time for lookup, exclusive
+  /// \param on_drop  called with each passed live value and DropReason
+  /// \return popped value or nothing
+  template<class OnDrop = IgnoreDrops>
+  std::optional<MetaType> pop(InputId id, TS since, TS until, OnDrop &&on_drop = {})
+  {
+    std::lock_guard<std::mutex> guard(m);
+
+    std::optional<MetaType> result{};
+    for (auto it = first_unread(); it != m_entries.end() && it->meta.pts < until; it++) {
+      if (!m_generations.is_live(it->meta.input_id, it->generation)) {
+        continue;
+      }
+      if (it->meta.pts >= since && it->meta.input_id == id) {
+        // Entry is passed, and reclaimed below
+        m_position = next_key(it->key());
+        result.emplace(std::move(it->meta));
+        break;
+      }
+      on_drop(it->meta, passed_drop_reason(it->meta, id, since));
+    }
+
+    if (!result) {
+      m_position = std::max(m_position, lowest_key(until));
+    }
+
+    reclaim();
+    return result;
+  }
+
+  /// Pops all values in given time frame, assigned to given input id, which have not been passed yet.
+  /// Moves read position to `until`.
+  ///
+  /// \tparam     OutputIt  output iterator type
+  /// \param      id        input id, popped values must be assigned to it, values of other inputs are passed
+  /// \param      since     start time for lookup, inclusive
+  /// \param      until     end time for lookup, exclusive
+  /// \param[out] out       output iterator, popped values will be moved here
+  /// \param      on_drop   called with each passed live value and DropReason
+  /// \return               count of popped items
+  template<class OutputIt, class OnDrop = IgnoreDrops>
+  unsigned int pop_all(InputId id, TS since, TS until, OutputIt out, OnDrop &&on_drop = {})
+  {
+    static_assert(
+      std::is_base_of<std::output_iterator_tag, typename std::iterator_traits<OutputIt>::iterator_category>::value,
+      "output iterator must be of output iterator category");
+
+    std::lock_guard<std::mutex> guard(m);
+
+    unsigned int count = 0;
+    for (auto it = first_unread(); it != m_entries.end() && it->meta.pts < until; it++) {
+      if (!m_generations.is_live(it->meta.input_id, it->generation)) {
+        continue;
+      }
+      if (it->meta.pts >= since && it->meta.input_id == id) {
+        *out++ = std::move(it->meta);
+        count++;
+      } else {
+        on_drop(it->meta, passed_drop_reason(it->meta, id, since));
+      }
+    }
+
+    m_position = std::max(m_position, lowest_key(until));
+
+    reclaim();
+    return count;
+  }
+
+  /// Drops all entries of given input, in constant time. Dropped entries are skipped when read.
+  ///
+  /// \return count of dropped entries
+  size_t drop_id(InputId id)
+  {
+    std::lock_guard<std::mutex> guard(m);
+    return m_generations.drop(id);
+  }
+
+  /// Copies all live entries not passed yet to output iterator in log order, payloads are shared.
+  template<class OutputIt>
+  void snapshot(OutputIt out) const
+  {
+    std::lock_guard<std::mutex> guard(m);
+
+    for (const Entry &entry : m_entries) {
+      if (!(entry.key() < m_position) && m_generations.is_live(entry.meta.input_id, entry.generation)) {
+        *out++ = entry.meta;
+      }
+    }
+  }
+
+private:
+  static Key lowest_key(TS pts) noexcept
+  {
+    return Key{ pts, std::numeric_limits<InputId>::min(), std::numeric_limits<int>::min() };
+  }
+
+  static Key next_key(const Key &key) noexcept
+  {
+    return Key{ std::get<0>(key), std::get<1>(key), std::get<2>(key) + 1 };
+  }
+
+  typename std::deque<Entry>::iterator first_unread()
+  {
+    return std::lower_bound(
+      m_entries.begin(), m_entries.end(), m_position, [](const Entry &e, const Key &key) { return e.key() < key; });
+  }
+
+  void push_impl(MetaType value)
+  {
+    Key key{ value.pts.val, value.input_id, value.order };
+
+    // Entry already passed would never be read.
+    if (key < m_position) {
+      return;
+    }
+
+    size_t bytes = metadata_footprint(value);
+    size_t stored_entries = m_entries.size();
+    auto evict_oldest = [&]() { return evict_first([](const Entry &) { return true; }, stored_entries); };
+    auto evict_input = [&](InputId id) {
+      return evict_first([&](const Entry &e) { return e.meta.input_id == id; }, stored_entries);
+    };
+
+    if (!m_budget.make_room(
+          value.input_id, bytes, stored_entries, m_stored_bytes, m_generations, evict_oldest, evict_input)) {
+      m_evicted_entries++;
+      m_evicted_bytes += bytes;
+      return;
+    }
+
+    auto generation = m_generations.acquire(value.input_id, bytes);
+    m_stored_bytes += bytes;
+
+    // Extractors push in (nearly) monotonic order, look up insertion point from the back.
+    auto pos = m_entries.end();
+    while (pos != m_entries.begin() && key < std::prev(pos)->key()) {
+      pos--;
+    }
+    m_entries.insert(pos, Entry{ std::move(value), generation, bytes });
+  }
+
+  /// Removes passed entries from the front of log.
+  void reclaim()
+  {
+    while (!m_entries.empty() && m_entries.front().key() < m_position) {
+      release(m_entries.front());
+      m_entries.pop_front();
+    }
+  }
+
+  bool release(const Entry &entry) noexcept
+  {
+    m_stored_bytes -= entry.bytes;
+    return m_generations.release(entry.meta.input_id, entry.generation, entry.bytes);
+  }
+
+  /// Evicts earliest live entry matching predicate, removing stale entries before it on the way.
+  ///
+  /// \return false if there is no such entry
+  template<class Predicate>
+  bool evict_first(Predicate &&pred, size_t &stored_entries)
+  {
+    for (auto it = m_entries.begin(); it != m_entries.end();) {
+      bool live = m_generations.is_live(it->meta.input_id, it->generation);
+      if (live && !pred(*it)) {
+        it++;
+        continue;
+      }
+
+      release(*it);
+      if (live) {
+        m_evicted_entries++;
+        m_evicted_bytes += it->bytes;
+      }
+
+      it = m_entries.erase(it);
+      stored_entries = m_entries.size();
+
+      if (live) {
+        return true;
+      }
+    }
+    return false;
+  }
+};
+}
@@ -4,17 +4,41 @@
 #include <cassert>
 #include <cstdint>
 #include <functional>
+#include <iterator>
 #include <limits>
 #include <mutex>
 #include <optional>
+#include <ostream>
+#include <stdexcept>
 #include <tuple>
 #include <type_traits>
+#include <unordered_map>
 #include <utility>
+#include <variant>
 
+
+#include "calendar_metadata_queue.h"
+#include "clock.h"
+#include "input_generations.h"
 #include "metadata.h"
+#include "metadata_log.h"
+#include "queue_budget.h"
+#include "queue_metrics.h"
+#include "ring_metadata_queue.h"
+#include "shared_metadata_queue.h"
 
 namespace metamix {
 
+/**
+ * @brief Metadata queue backed by a single binary heap guarded by mutex.
+ *
+ * Entries are stamped with generation of their input, see InputGenerations. Dropping an input only makes its entries
+ * stale, they are discarded lazily when they reach the top of the heap.
+ *
+ * If budget limits single inputs, keys of each input's entries are indexed by a heap of their own, so that the earliest
+ * entry of an input is found in logarithmic time. Evicting it leaves a tombstone key, and the entry is discarded lazily
+ * like stale ones. Once tombstones make up half of the queue, they are swept at once.
+ */
 template<class K>
 class MetadataQueue
 {
@@ -25,64 +49,147 @@ public:
   using ValueType = typename MetaType::ValueType;
 
 private:
+  struct Entry
+  {
+    MetaType meta;
+    InputGenerations::Generation generation;
+    size_t bytes;
+
+    /// Push sequence number, orders otherwise equal entries.
+    uint64_t seq;
+  };
+
+  /// Ordering key of entry within its input.
+  struct Key
+  {
+    TS pts;
+    int order;
+    uint64_t seq;
+    InputGenerations::Generation generation;
+    size_t bytes;
+  };
+
+  /// Heaps of keys of entries of single input, earliest on top.
+  struct InputIndex
+  {
+    /// Keys of stored entries which have not been evicted.
+    std::vector<Key> keys{};
+
+    /// Keys of evicted entries, which are still stored in queue.
+    std::vector<Key> tombstones{};
+  };
+
   std::mutex m{};
-  std::vector<MetaType> q{};
+  std::vector<Entry> q{};
+  InputGenerations m_generations{};
+  uint64_t m_next_seq{ 0 };
+
+  /// Indexes of inputs, maintained only if budget limits single inputs, see `indexes_inputs`.
+  std::unordered_map<InputId, InputIndex> m_inputs{};
+  size_t m_tombstones{ 0 };
+
+  QueueBudget m_budget{};
+
+  /// Footprint of all stored entries, including stale ones.
+  size_t m_stored_bytes{ 0 };
+
+  size_t m_evicted_entries{ 0 };
+  size_t m_evicted_bytes{ 0 };
 
 public:
   MetadataQueue() = default;
 
   explicit MetadataQueue(size_t reserved) { q.reserve(reserved); }
 
+  explicit MetadataQueue(QueueBudget budget)
+    : m_budget{ budget }
+  {}
+
   template<class InputIt>
   MetadataQueue(InputIt first, InputIt last)
-    : q(first, last)
   {
+    for (; first != last; ++first) {
+      q.push_back(make_entry(*first));
+    }
     std::make_heap(q.begin(), q.end(), comparator);
   }
 
   MetadataQueue(std::initializer_list<MetaType> init)
-    : q{ init }
-  {
-    std::make_heap(q.begin(), q.end(), comparator);
-  }
+    : MetadataQueue(init.begin(), init.end())
+  {}
 
   MetadataQueue(const Self &other)
     : q{ other.q }
+    , m_generations{ other.m_generations }
+    , m_next_seq{ other.m_next_seq }
+    , m_inputs{ other.m_inputs }
+    , m_tombstones{ other.m_tombstones }
+    , m_budget{ other.m_budget }
+    , m_stored_bytes{ other.m_stored_bytes }
+    , m_evicted_entries{ other.m_evicted_entries }
+    , m_evicted_bytes{ other.m_evicted_bytes }
   {}
 
   Self &operator=(const Self &other)
   {
     q = other.q;
+    m_generations = other.m_generations;
+    m_next_seq = other.m_next_seq;
+    m_inputs = other.m_inputs;
+    m_tombstones = other.m_tombstones;
+    m_budget = other.m_budget;
+    m_stored_bytes = other.m_stored_bytes;
+    m_evicted_entries = other.m_evicted_entries;
+    m_evicted_bytes = other.m_evicted_bytes;
     return *this;
   }
 
   MetadataQueue(Self &&other) noexcept = default;
   Self &operator=(Self &&other) noexcept = default;
 
-  bool empty() const noexcept { return q.empty(); }
+  bool empty() const noexcept { return size() == 0; }
 
-  size_t size() const noexcept { return q.size(); }
+  /// Count of live entries, not including dropped ones still waiting for removal.
+  size_t size() const noexcept { return m_generations.live(); }
 
-  const MetaType &top() const { return q.front(); }
+  /// Earliest entry in queue, it may belong to dropped generation of its input.
+  const MetaType &top() const { return q.front().meta; }
+
+  QueueStats stats()
+  {
+    std::lock_guard<std::mutex> guard(m);
+    return QueueStats{ m_generations.live(), m_generations.live_bytes(), m_evicted_entries, m_evicted_bytes };
+  }
 
   void push(MetaType value)
   {
     std::lock_guard<std::mutex> guard(m);
-    q.push_back(std::move(value));
-    std::push_heap(q.begin(), q.end(), comparator);
+    push_impl(std::move(value));
+  }
+
+  /// Pushes all values with single lock acquisition.
+  template<class InputIt>
+  void push_range(InputIt first, InputIt last)
+  {
+    std::lock_guard<std::mutex> guard(m);
+    for (; first != last; ++first) {
+      push_impl(*first);
+    }
   }
 
   /// Pops value earliest in given time frame, assigned to given input id from queue.
   /// Drops all values which were earlier in queue.
   ///
-  /// \param id     input id, popped value must by assigned to it, other values will be dropped
-  /// \param since  start time for lookup, inclusive
-  /// \param until  end time for lookup, exclusive
+  /// \param id       input id, popped value must by assigned to it, other values will be dropped
+  /// \param since    start time for lookup, inclusive
+  /// \param until    end time for lookup, exclusive
+  /// \param on_drop  called with each dropped live value and DropReason
   /// \return popped value or nothing if queue is empty
-  std::optional<MetaType> pop(InputId id, TS since, TS until)
+  template<class OnDrop = IgnoreDrops>
+  std::optional<MetaType> pop(InputId id, TS since, TS until, OnDrop &&on_drop = {})
   {
     std::lock_guard<std::mutex> guard(m);
-    return pop_impl(id, since, until);
+    return pop_impl(id, since, until, on_drop);
   }
 
   /// Pops all values in given time frame, assigned to given input id from queue. Moves popped value to output iterator.
@@ -93,9 +200,10 @@ public:
   /// \param      since     start time for lookup, inclusive
   /// \param      until     end time for lookup, exclusive
   /// \param[out] out       output iterator, popped values will be moved here
+  /// \param      on_drop   called with each dropped live value and DropReason
   /// \return               count of popped items
-  template<class OutputIt>
-  unsigned int pop_all(InputId id, TS since, TS until, OutputIt out)
+  template<class OutputIt, class OnDrop = IgnoreDrops>
+  unsigned int pop_all(InputId id, TS since, TS until, OutputIt out, OnDrop &&on_drop = {})
   {
     static_assert(
       std::is_base_of<std::output_iterator_tag, typename std::iterator_traits<OutputIt>::iterator_category>::value,
@@ -105,7 +213,7 @@ public:
 
     int count = 0;
     for (;;) {
-      auto opt = pop_impl(id, since, until);
+      auto opt = pop_impl(id, since, until, on_drop);
       if (!opt) {
         break;
       }
@@ -116,25 +224,219 @@ public:
     return count;
   }
 
+  /// Drops all entries of given input, in constant time.
+  ///
+  /// \return count of dropped entries
   size_t drop_id(InputId id)
   {
     std::lock_guard<std::mutex> guard(m);
-    size_t old_size = q.size();
-    auto tail = std::remove_if(q.begin(), q.end(), [&](const auto &t) { return t.input_id == id; });
-    q.erase(tail, q.end());
-    return old_size - q.size();
+    return m_generations.drop(id);
+  }
+
+  /// Copies all live entries to output iterator, in no particular order, payloads are shared. Queue is left intact.
+  template<class OutputIt>
+  void snapshot(OutputIt out)
+  {
+    std::lock_guard<std::mutex> guard(m);
+
+    for (const Entry &entry : q) {
+      if (m_generations.is_live(entry.meta.input_id, entry.generation)) {
+        *out++ = entry.meta;
+      }
+    }
   }
 
 private:
-  MetaType pop_any_impl()
+  void push_impl(MetaType value)
+  {
+    size_t bytes = metadata_footprint(value);
+    size_t stored_entries = q.size();
+    if (!m_budget.make_room(
+          value.input_id,
+          bytes,
+          stored_entries,
+          m_stored_bytes,
+          m_generations,
+          [&]() { return evict_oldest(stored_entries); },
+          [&](InputId id) { return evict_input(id, stored_entries); })) {
+      m_evicted_entries++;
+      m_evicted_bytes += bytes;
+      return;
+    }
+
+    q.push_back(make_entry(std::move(value), bytes));
+
+    if (indexes_inputs()) {
+      InputIndex &index = m_inputs[q.back().meta.input_id];
+      index.keys.push_back(key_of(q.back()));
+      std::push_heap(index.keys.begin(), index.keys.end(), key_comparator);
+    }
+
+    std::push_heap(q.begin(), q.end(), comparator);
+  }
+
+  /// Whether budget limits single inputs, so that their earliest entries have to be found.
+  bool indexes_inputs() const noexcept
+  {
+    return m_budget.policy == EvictionPolicy::DROP_OLDEST &&
+           (m_budget.max_input_entries > 0 || m_budget.max_input_bytes > 0);
+  }
+
+  static Key key_of(const Entry &entry) noexcept
+  {
+    return Key{ entry.meta.pts, entry.meta.order, entry.seq, entry.generation, entry.bytes };
+  }
+
+  /// Removes key of entry leaving the heap from index of its input.
+  ///
+  /// \return true if the entry had been evicted
+  bool unindex(const Entry &entry)
+  {
+    InputIndex &index = m_inputs[entry.meta.input_id];
+
+    // Entries of one input leave the heap in key order, so the entry is on top of one of the heaps.
+    if (!index.tombstones.empty() && index.tombstones.front().seq == entry.seq) {
+      std::pop_heap(index.tombstones.begin(), index.tombstones.end(), key_comparator);
+      index.tombstones.pop_back();
+      m_tombstones--;
+      return true;
+    }
+
+    assert(!index.keys.empty() && index.keys.front().seq == entry.seq);
+    std::pop_heap(index.keys.begin(), index.keys.end(), key_comparator);
+    index.keys.pop_back();
+    return false;
+  }
+
+  /// Removes evicted and stale entries from heap, and rebuilds input indexes.
+  void sweep()
+  {
+    std::vector<uint64_t> evicted{};
+    evicted.reserve(m_tombstones);
+    for (auto &[id, index] : m_inputs) {
+      for (const Key &key : index.tombstones) {
+        evicted.push_back(key.seq);
+      }
+      index.keys.clear();
+      index.tombstones.clear();
+    }
+    std::sort(evicted.begin(), evicted.end());
+    m_tombstones = 0;
+
+    q.erase(std::remove_if(q.begin(),
+                           q.end(),
+                           [&](const Entry &entry) {
+                             if (m_generations.is_live(entry.meta.input_id, entry.generation) &&
+                                 !std::binary_search(evicted.begin(), evicted.end(), entry.seq)) {
+                               return false;
+                             }
+                             m_stored_bytes -= entry.bytes;
+                             return true;
+                           }),
+            q.end());
+    std::make_heap(q.begin(), q.end(), comparator);
+
+    for (const Entry &entry : q) {
+      m_inputs[entry.meta.input_id].keys.push_back(key_of(entry));
+    }
+    for (auto &[id, index] : m_inputs) {
+      std::make_heap(index.keys.begin(), index.keys.end(), key_comparator);
+    }
+  }
+
+  Entry make_entry(MetaType value)
+  {
+    size_t bytes = metadata_footprint(value);
+    return make_entry(std::move(value), bytes);
+  }
+
+  Entry make_entry(MetaType value, size_t bytes)
+  {
+    auto generation = m_generations.acquire(value.input_id, bytes);
+    m_stored_bytes += bytes;
+    return Entry{ std::move(value), generation, bytes, m_next_seq++ };
+  }
+
+  /// Removes stored entry from accounting.
+  ///
+  /// \return true if the entry was live
+  bool release(const Entry &entry)
+  {
+    m_stored_bytes -= entry.bytes;
+    if (indexes_inputs() && unindex(entry)) {
+      // Evicted entry has been released already
+      return false;
+    }
+    return m_generations.release(entry.meta.input_id, entry.generation, entry.bytes);
+  }
+
+  /// Removes earliest entry from heap.
+  ///
+  /// \return the entry, or nothing if it was stale
+  std::optional<MetaType> pop_any_impl()
   {
     std::pop_heap(q.begin(), q.end(), comparator);
-    auto value = std::move(q.back());
+    Entry entry = std::move(q.back());
     q.pop_back();
-    return value;
+
+    if (!release(entry)) {
+      return std::nullopt;
+    }
+    return std::move(entry.meta);
+  }
+
+  bool evict_oldest(size_t &stored_entries)
+  {
+    while (!q.empty()) {
+      size_t bytes = q.front().bytes;
+      bool live = pop_any_impl().has_value();
+      stored_entries = q.size();
+
+      if (live) {
+        m_evicted_entries++;
+        m_evicted_bytes += bytes;
+        return true;
+      }
+    }
+    return false;
+  }
+
+  bool evict_input(InputId id, size_t &stored_entries)
+  {
+    assert(indexes_inputs());
+
+    auto it = m_inputs.find(id);
+    if (it == m_inputs.end()) {
+      return false;
+    }
+
+    InputIndex &index = it->second;
+    bool evicted = false;
+    while (!evicted && !index.keys.empty()) {
+      Key key = index.keys.front();
+      std::pop_heap(index.keys.begin(), index.keys.end(), key_comparator);
+      index.keys.pop_back();
+      index.tombstones.push_back(key);
+      std::push_heap(index.tombstones.begin(), index.tombstones.end(), key_comparator);
+      m_tombstones++;
+
+      // Stale keys of dropped generations are buried on the way
+      if (m_generations.release(id, key.generation, key.bytes)) {
+        m_evicted_entries++;
+        m_evicted_bytes += key.bytes;
+        evicted = true;
+      }
+    }
+
+    if (m_tombstones > q.size() / 2) {
+      sweep();
+      stored_entries = q.size();
+    }
+    return evicted;
   }
 
-  std::optional<MetaType> pop_impl(InputId id, TS since, TS until)
+  template<class OnDrop>
+  std::optional<MetaType> pop_impl(InputId id, TS since, TS until, OnDrop &on_drop)
   {
     for (;;) {
       // If queue is empty, nothing can be popped
@@ -143,38 +445,46 @@ private:
       }
 
       // If the very next item is past the range, nothing more can be popped.
-      if (q.front().pts >= until) {
+      if (q.front().meta.pts >= until) {
         return std::nullopt;
       }
 
-      // Pop earliest item.
+      // Pop earliest item, skipping ones dropped with their input.
       auto value = pop_any_impl();
+      if (!value) {
+        continue;
+      }
 
       // If the item is within the range, and it's assigned to requested input...
-      if (value.pts >= since && value.input_id == id) {
-        // ...drop any other colliding metadata from queue.
-        while (!q.empty() && q.front().pts == value.pts) {
-          assert(q.front().input_id != value.input_id);
-          pop_any_impl();
+      if (value->pts >= since && value->input_id == id) {
+        // ...drop any other colliding metadata from queue. Further items of the same input and pts are ordered right
+        // after this one, keep them for subsequent pops.
+        while (!q.empty() && q.front().meta.pts == value->pts && q.front().meta.input_id != value->input_id) {
+          if (auto colliding = pop_any_impl()) {
+            on_drop(*colliding, passed_drop_reason(*colliding, id, since));
+          }
         }
 
         // Item must match query conditions.
-        assert(value.pts >= since && value.pts < until && value.input_id == id);
+        assert(value->pts >= since && value->pts < until && value->input_id == id);
 
         // ...return matched item.
         return value;
       }
 
-      // Otherwise, this is out-of-range item, before the since timestamp.
+      // Otherwise, this is out-of-range item, before the since timestamp, or item of another input.
       // This means it should be dropped, which we are doing now and proceed again.
+      on_drop(*value, passed_drop_reason(*value, id, since));
     }
   }
 
-  static bool comparator(const MetaType &lhs, const MetaType &rhs)
+  static bool comparator(const Entry &lhs_entry, const Entry &rhs_entry)
   {
+    const MetaType &lhs = lhs_entry.meta;
+    const MetaType &rhs = rhs_entry.meta;
     if (lhs.pts == rhs.pts) {
       if (lhs.input_id == rhs.input_id) {
-        return lhs.order > rhs.order;
+        return lhs.order == rhs.order ? lhs_entry.seq > rhs_entry.seq : lhs.order > rhs.order;
       } else {
         return lhs.input_id > rhs.input_id;
       }
@@ -182,62 +492,341 @@ private:
       return lhs.pts > rhs.pts;
     }
   }
+
+  /// Orders keys of one input like `comparator` orders their entries.
+  static bool key_comparator(const Key &lhs, const Key &rhs)
+  {
+    return std::tie(lhs.pts, lhs.order, lhs.seq) > std::tie(rhs.pts, rhs.order, rhs.seq);
+  }
+};
+
+/// Storage engine backing metadata queues, selectable at start-up.
+/// Enumerator values must match alternative indices of MetadataQueueVariant::Variant.
+enum class MetadataQueueEngine
+{
+  HEAP,     ///< Single binary heap guarded by mutex, see MetadataQueue.
+  RING,     ///< Lock-free ring per input, see RingMetadataQueue.
+  CALENDAR, ///< Time-bucketed index guarded by mutex, see CalendarMetadataQueue.
+  LOG,      ///< Sorted append-only log guarded by mutex, see MetadataLog.
+  SHM,      ///< Lock-free ring per input in shared memory, fed by other processes, see SharedMetadataQueue.
+};
+
+inline std::ostream &
+operator<<(std::ostream &os, MetadataQueueEngine engine)
+{
+  switch (engine) {
+  case MetadataQueueEngine::HEAP:
+    return os << "heap";
+  case MetadataQueueEngine::RING:
+    return os << "ring";
+  case MetadataQueueEngine::CALENDAR:
+    return os << "calendar";
+  case MetadataQueueEngine::LOG:
+    return os << "log";
+  case MetadataQueueEngine::SHM:
+    return os << "shm";
+  }
+  return os << "unknown";
+}
+
+/// Run-time configuration of single metadata queue.
+struct MetadataQueueConfig
+{
+  MetadataQueueEngine engine{ MetadataQueueEngine::HEAP };
+  QueueBudget budget{};
+
+  /// Clock stamping pushed entries, queue metrics are recorded only if it is set.
+  std::shared_ptr<const Clock> clock{};
+
+  /// Shared memory settings of SHM engine.
+  SharedQueueSpec shared{};
+};
+
+/**
+ * @brief Metadata queue of one kind, backed by storage engine chosen at run-time.
+ *
+ * All engines share the same interface, calls are dispatched with std::visit.
+ *
+ * If configured with a clock, the queue records QueueMetrics of each input: entries are stamped with the clock on push,
+ * so that their residency time is known on pop, and entries dropped by engine are counted by DropReason.
+ */
+template<class K>
+class MetadataQueueVariant
+{
+public:
+  using Kind = K;
+  using MetaType = Metadata<K>;
+  using Variant = std::variant<MetadataQueue<K>,
+                               RingMetadataQueue<K>,
+                               CalendarMetadataQueue<K>,
+                               MetadataLog<K>,
+                               SharedMetadataQueue<K>>;
+
+private:
+  Variant m_queue;
+  std::shared_ptr<const Clock> m_clock{};
+  QueueMetrics m_metrics{};
+
+public:
+  explicit MetadataQueueVariant(MetadataQueueEngine engine = MetadataQueueEngine::HEAP)
+    : m_queue{ make_queue(engine, {}, {}) }
+  {}
+
+  explicit MetadataQueueVariant(const MetadataQueueConfig &config)
+    : m_queue{ make_queue(config.engine, config.budget, config.shared) }
+    , m_clock{ config.clock }
+  {}
+
+  MetadataQueueVariant(const MetadataQueueVariant &) = delete;
+  MetadataQueueVariant &operator=(const MetadataQueueVariant &) = delete;
+
+  template<class Visitor>
+  inline auto visit(Visitor &&vis)
+  {
+    return std::visit(std::forward<Visitor>(vis), m_queue);
+  }
+
+  template<class Visitor>
+  inline auto visit(Visitor &&vis) const
+  {
+    return std::visit(std::forward<Visitor>(vis), m_queue);
+  }
+
+  MetadataQueueEngine engine() const noexcept { return static_cast<MetadataQueueEngine>(m_queue.index()); }
+
+  bool empty() const
+  {
+    return visit([](const auto &q) { return q.empty(); });
+  }
+
+  size_t size() const
+  {
+    return visit([](const auto &q) { return q.size(); });
+  }
+
+  QueueStats stats()
+  {
+    return visit([](auto &q) { return q.stats(); });
+  }
+
+  /// Whether queue records metrics, see MetadataQueueConfig::clock.
+  bool has_metrics() const noexcept { return m_clock != nullptr; }
+
+  const QueueMetrics &metrics() const noexcept { return m_metrics; }
+
+  void push(MetaType value)
+  {
+    if (m_clock) {
+      stamp(value, m_clock->now());
+    }
+    visit([&](auto &q) { q.push(std::move(value)); });
+  }
+
+  /// Pushes range of values at once, values are stamped in place if metrics are recorded.
+  template<class ForwardIt>
+  void push_range(ForwardIt first, ForwardIt last)
+  {
+    if (m_clock) {
+      ClockTS now = m_clock->now();
+      std::for_each(first, last, [&](auto &&value) { stamp(value, now); });
+    }
+    visit([&](auto &q) { q.push_range(first, last); });
+  }
+
+  std::optional<MetaType> pop(InputId id, TS since, TS until)
+  {
+    if (!m_clock) {
+      return visit([&](auto &q) { return q.pop(id, since, until); });
+    }
+
+    auto result = visit([&](auto &q) { return q.pop(id, since, until, drop_recorder()); });
+    if (result) {
+      m_metrics.record_pop(id, m_clock->now() - result->queued_at);
+    }
+    return result;
+  }
+
+  template<class OutputIt>
+  unsigned int pop_all(InputId id, TS since, TS until, OutputIt out)
+  {
+    if (!m_clock) {
+      return visit([&](auto &q) { return q.pop_all(id, since, until, std::move(out)); });
+    }
+
+    RecordingIterator<OutputIt> recording_out{ m_metrics, id, m_clock->now(), std::move(out) };
+    return visit([&](auto &q) { return q.pop_all(id, since, until, recording_out, drop_recorder()); });
+  }
+
+  size_t drop_id(InputId id)
+  {
+    size_t count = visit([&](auto &q) { return q.drop_id(id); });
+    if (m_clock) {
+      m_metrics.record_drop(id, DropReason::DROP_ID, count);
+    }
+    return count;
+  }
+
+  bool supports_snapshot() const noexcept
+  {
+    return engine() != MetadataQueueEngine::RING && engine() != MetadataQueueEngine::SHM;
+  }
+
+  /// Copies all live entries to output iterator, see `supports_snapshot`.
+  template<class OutputIt>
+  void snapshot(OutputIt out)
+  {
+    visit([&](auto &q) { q.snapshot(std::move(out)); });
+  }
+
+private:
+  /// Output iterator recording residency of popped values, which it moves to wrapped iterator.
+  template<class OutputIt>
+  struct RecordingIterator
+  {
+    using iterator_category = std::output_iterator_tag;
+    using value_type = void;
+    using difference_type = void;
+    using pointer = void;
+    using reference = void;
+
+    QueueMetrics &metrics;
+    InputId id;
+    ClockTS now;
+    OutputIt out;
+
+    RecordingIterator &operator*() noexcept { return *this; }
+    RecordingIterator &operator++() noexcept { return *this; }
+    RecordingIterator &operator++(int) noexcept { return *this; }
+
+    RecordingIterator &operator=(MetaType &&value)
+    {
+      metrics.record_pop(id, now - value.queued_at);
+      *out++ = std::move(value);
+      return *this;
+    }
+  };
+
+  void stamp(MetaType &value, ClockTS now)
+  {
+    value.queued_at = now;
+    m_metrics.record_push(value.input_id, value.pts);
+  }
+
+  auto drop_recorder()
+  {
+    return [this](const MetaType &value, DropReason reason) { m_metrics.record_drop(value.input_id, reason); };
+  }
+
+  static Variant make_queue(MetadataQueueEngine engine, QueueBudget budget, const SharedQueueSpec &shared)
+  {
+    switch (engine) {
+    case MetadataQueueEngine::HEAP:
+      return Variant(std::in_place_type<MetadataQueue<K>>, budget);
+    case MetadataQueueEngine::RING:
+      return Variant(std::in_place_type<RingMetadataQueue<K>>,
+                     budget.is_bounded() && budget.max_input_entries > 0
+                       ? budget.max_input_entries
+                       : RingMetadataQueue<K>::DEFAULT_LANE_CAPACITY,
+                     budget.policy);
+    case MetadataQueueEngine::CALENDAR:
+      return Variant(std::in_place_type<CalendarMetadataQueue<K>>,
+                     CalendarMetadataQueue<K>::DEFAULT_BUCKET_WIDTH,
+                     CalendarMetadataQueue<K>::DEFAULT_BUCKET_COUNT,
+                     budget);
+    case MetadataQueueEngine::LOG:
+      return Variant(std::in_place_type<MetadataLog<K>>, budget);
+    case MetadataQueueEngine::SHM:
+      return Variant(std::in_place_type<SharedMetadataQueue<K>>,
+                     shared.name + "." + K::NAME,
+                     budget.is_bounded() && budget.max_input_entries > 0
+                       ? budget.max_input_entries
+                       : SharedMetadataQueue<K>::DEFAULT_LANE_CAPACITY,
+                     shared.slot_size,
+                     shared.lane_count,
+                     shared.input_fingerprint);
+    }
+    throw std::invalid_argument("unknown metadata queue engine");
+  }
 };
 
 template<class... Ks>
 class MetadataQueueGroup
 {
 private:
-  std::tuple<MetadataQueue<Ks>...> m_queues{};
+  std::tuple<MetadataQueueVariant<Ks>...> m_queues;
 
 public:
+  /// \param budgets  budgets of queues of each kind
+  /// \param clock    clock stamping pushed entries, queues record metrics if it's set
+  /// \param shared   shared memory settings of SHM engine
+  explicit MetadataQueueGroup(MetadataQueueEngine engine = MetadataQueueEngine::HEAP,
+                              const QueueBudgets &budgets = {},
+                              std::shared_ptr<const Clock> clock = {},
+                              const SharedQueueSpec &shared = {})
+    : m_queues{ MetadataQueueConfig{ engine, budgets.template for_kind<Ks>(), clock, shared }... }
+  {}
+
   template<class K>
-  inline MetadataQueue<K> &get()
+  inline MetadataQueueVariant<K> &get()
   {
-    return std::get<MetadataQueue<K>>(m_queues);
+    return std::get<MetadataQueueVariant<K>>(m_queues);
   }
 
   template<class K>
-  inline const MetadataQueue<K> &get() const
+  inline const MetadataQueueVariant<K> &get() const
   {
-    return std::get<MetadataQueue<K>>(m_queues);
+    return std::get<MetadataQueueVariant<K>>(m_queues);
   }
 
   template<class K, class Visitor>
   inline auto visit(Visitor &&vis)
   {
-    return std::invoke(std::forward<Visitor>(vis), get<K>());
+    return get<K>().visit(std::forward<Visitor>(vis));
   }
 
   template<class Visitor>
   inline void visit_each(Visitor &&vis)
   {
-    std::apply([&](auto &... q) { (..., std::invoke(std::forward<Visitor>(vis), q)); }, m_queues);
+    std::apply([&](auto &... q) { (..., q.visit(vis)); }, m_queues);
   }
 
   template<class M>
   inline void push(M meta)
   {
-    visit<typename M::Kind>([meta{ std::move(meta) }](auto &q) { q.push(std::move(meta)); });
+    get<typename M::Kind>().push(std::move(meta));
+  }
+
+  /// Pushes range of metadata of single kind at once.
+  template<class ForwardIt>
+  inline void push_range(ForwardIt first, ForwardIt last)
+  {
+    using M = typename std::iterator_traits<ForwardIt>::value_type;
+    get<typename M::Kind>().push_range(first, last);
   }
 
   template<class K>
-  inline std::optional<K> pop(InputId id, TS since, TS until)
+  inline std::optional<Metadata<K>> pop(InputId id, TS since, TS until)
   {
-    return visit<K>([&](auto &q) { return q.pop(id, since, until); });
+    return get<K>().pop(id, since, until);
   }
 
   template<class K, class OutputIt>
   unsigned int pop_all(InputId id, TS since, TS until, OutputIt out)
   {
-    return visit<K>([&, out{ std::move(out) }](auto &q) { return q.pop_all(id, since, until, std::move(out)); });
+    return get<K>().pop_all(id, since, until, std::move(out));
   }
 
   inline size_t drop_id(InputId id)
   {
     size_t count = 0;
-    visit_each([&](auto &q) { count += q.drop_id(id); });
+    std::apply([&](auto &... q) { (..., (count += q.drop_id(id))); }, m_queues);
     return count;
   }
+
+  template<class K, class OutputIt>
+  void snapshot(OutputIt out)
+  {
+    get<K>().snapshot(std::move(out));
+  }
 };
 }
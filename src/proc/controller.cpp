@@ -1,6 +1,7 @@
 #include "controller.h"
 
 #include <algorithm>
+#include <string>
 #include <thread>
 #include <variant>
 
@@ -19,6 +20,7 @@
 #include "../log.h"
 #include "../metadata_queue.h"
 #include "../program_options.h"
+#include "../queue_metrics.h"
 
 #include <src/config.h>
 
@@ -84,17 +86,83 @@ get_input_by_json(const ApplicationContext &ctx, const json &args)
   return get_input_by_ref(ctx, parse_input_ref(args));
 }
 
+double
+clock_to_ms(ClockTS ts)
+{
+  return static_cast<double>(ts.val) * 1000 / SYS_CLOCK_RATE;
+}
+
+json
+get_input_metrics(const ApplicationContext &ctx, const QueueMetrics::InputMetrics &metrics)
+{
+  json buckets_json;
+  for (size_t i = 0; i < LatencyHistogram::BUCKET_COUNT; i++) {
+    auto le = i < LatencyHistogram::BOUNDS_MS.size() ? std::to_string(LatencyHistogram::BOUNDS_MS[i]) : "+Inf";
+    buckets_json[le] = metrics.residency.buckets[i];
+  }
+
+  return json{
+    { "leadMs", metrics.newest_pts ? json(clock_to_ms(*metrics.newest_pts - ctx.clock->now())) : json() },
+    { "residencyMs",
+      {
+        { "count", metrics.residency.count },
+        { "sum", clock_to_ms(metrics.residency.sum) },
+        { "buckets", buckets_json },
+      } },
+    { "dropped",
+      {
+        { "stale", metrics.dropped_stale },
+        { "foreignInput", metrics.dropped_foreign_input },
+        { "dropId", metrics.dropped_drop_id },
+      } },
+  };
+}
+
 json
 get_stats(const ApplicationContext &ctx)
 {
-  json queue_size_json;
+  json queue_size_json, queue_bytes_json, queue_evicted_json, queue_evicted_bytes_json, queue_late_json,
+    queue_grown_json;
+  json queue_metrics_json = json::object();
+  json value_pools_json = json::object();
   InputCapabilities::Kinds::for_each([&](auto k) {
     using K = decltype(k);
-    queue_size_json[K::API_NAME] = ctx.meta_queue->get<K>().size();
+    auto &queue = ctx.meta_queue->get<K>();
+    auto stats = queue.stats();
+    queue_size_json[K::API_NAME] = stats.entries;
+    queue_bytes_json[K::API_NAME] = stats.bytes;
+    queue_evicted_json[K::API_NAME] = stats.evicted_entries;
+    queue_evicted_bytes_json[K::API_NAME] = stats.evicted_bytes;
+    queue_late_json[K::API_NAME] = stats.late_entries;
+    queue_grown_json[K::API_NAME] = stats.grown_buffers;
+
+    if (queue.has_metrics()) {
+      json kind_metrics_json = json::object();
+      queue.metrics().for_each_input([&](InputId id, const QueueMetrics::InputMetrics &metrics) {
+        if (auto input = ctx.input_manager->get_input_by_id(id); input) {
+          kind_metrics_json[input->get().spec().name] = get_input_metrics(ctx, metrics);
+        }
+      });
+      queue_metrics_json[K::API_NAME] = kind_metrics_json;
+    }
+
+    auto pool_stats = ctx.value_pools->get<K>().stats();
+    value_pools_json[K::API_NAME] = {
+      { "capacity", pool_stats.capacity },
+      { "inUse", pool_stats.in_use },
+      { "producers", pool_stats.producers },
+    };
   });
 
   return json{
     { "queueSize", queue_size_json },
+    { "queueBytes", queue_bytes_json },
+    { "queueEvicted", queue_evicted_json },
+    { "queueEvictedBytes", queue_evicted_bytes_json },
+    { "queueLate", queue_late_json },
+    { "queueGrown", queue_grown_json },
+    { "queueMetrics", queue_metrics_json },
+    { "valuePools", value_pools_json },
     { "clockNow", ctx.clock->now().val },
   };
 }
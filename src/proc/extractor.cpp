@@ -6,9 +6,7 @@
 
 #include "../clock.h"
 #include "../ffmpeg.h"
-#include "../h264/av_packet_nalu.h"
-#include "../h264/av_packet_nalu_parser.h"
-#include "../h264/rbsp.h"
+#include "../h264/nalu_framing.h"
 #include "../h264/sei_parser.h"
 #include "../h264/stdseis.h"
 #include "../input_manager.h"
@@ -21,20 +19,20 @@
 #include "../program_options.h"
 #include "../scte35/parser.h"
 #include "../scte35/scte35.h"
+#include "../snapshot.h"
 #include "../user_defined_input.h"
 #include "../util.h"
+#include "../value_pool.h"
+#include "../video_codec.h"
 
 using metamix::ScteKind;
 using metamix::SeiKind;
 using metamix::TimeSourceKind;
-using metamix::h264::AVPacketNalu;
-using metamix::h264::AVPacketNaluParser;
 using metamix::h264::build_cc_reset_metadata;
-using metamix::h264::copy_ebsp_to_sodb;
-using metamix::h264::NaluType;
+using metamix::h264::NaluFormat;
+using metamix::h264::NaluView;
 using metamix::h264::OwnedSeiPayload;
-using metamix::h264::SeiParser;
-using metamix::h264::SeiType;
+using metamix::h264::SeiPayloadView;
 using metamix::io::PacketProcessor;
 using metamix::io::SinkHandle;
 using metamix::io::SourceHandle;
@@ -46,6 +44,14 @@ namespace metamix::proc {
 
 namespace {
 
+/// Name of extractor rescaler, under which its state is snapshotted.
+template<class K>
+std::string
+rescaler_key(const UserDefinedInput &input, const char *ts)
+{
+  return "input:" + input.spec().name + "/" + K::NAME + "/" + ts;
+}
+
 class MaintenanceProcessor : public PacketProcessor<TimeSourceKind>
 {
 private:
@@ -70,68 +76,101 @@ private:
   UserDefinedInput &input;
   const ApplicationContext &ctx;
 
-  TSRescaler pts_rescaler;
-  TSRescaler dts_rescaler;
+  VideoCodec codec;
+  NaluFormat format;
+
+  PersistentTSRescaler pts_rescaler;
+  PersistentTSRescaler dts_rescaler;
+
+  /// Values of found metadata are allocated from this extractor's shard of value pool.
+  ValuePool<OwnedSeiPayload>::Producer values;
+
+  /// Metadata found in currently processed packet, published at once.
+  std::vector<Metadata<SeiKind>> batch{};
+
+  /// SODB of SEI NALUs containing emulation prevention bytes, reused across packets.
+  std::vector<uint8_t> sodb{};
 
 public:
-  SeiExtractor(StreamTimeBase stream_time_base, UserDefinedInput &input, const ApplicationContext &ctx)
+  SeiExtractor(StreamTimeBase stream_time_base,
+               VideoCodec codec,
+               NaluFormat format,
+               UserDefinedInput &input,
+               const ApplicationContext &ctx)
     : input{ input }
     , ctx{ ctx }
-    , pts_rescaler{ TSRescaler::clock_relative(ctx.clock, stream_time_base) }
-    , dts_rescaler{ TSRescaler::clock_relative(ctx.clock, stream_time_base) }
+    , codec{ codec }
+    , format{ format }
+    , pts_rescaler{ ctx.rescaler_states, rescaler_key<SeiKind>(input, "pts"), ctx.clock, stream_time_base }
+    , dts_rescaler{ ctx.rescaler_states, rescaler_key<SeiKind>(input, "dts"), ctx.clock, stream_time_base }
+    , values{ ctx.value_pools->get<SeiKind>().producer() }
   {}
 
   static std::unique_ptr<PacketProcessor<SeiKind>> factory(StreamTimeBase stream_time_base,
+                                                           VideoCodec codec,
+                                                           NaluFormat format,
                                                            UserDefinedInput &input,
                                                            const ApplicationContext &ctx)
   {
-    return std::make_unique<SeiExtractor>(stream_time_base, input, ctx);
+    return std::make_unique<SeiExtractor>(stream_time_base, codec, format, input, ctx);
   }
 
   bool process(AVPacket &pkt) override
   {
-    int order = 0;
-
     // LOG(trace) << "dts: " << pkt.dts << " pts: " << pkt.pts << " pos: " << pkt.pos << " dur: " << pkt.duration
     //            << " flags: 0x" << std::hex << pkt.flags;
 
     try {
-      auto parser = AVPacketNaluParser::create(pkt);
-      AVPacketNalu nalu;
-      while (parser) {
-        parser >> nalu;
+      visit_video_codec(codec, [&](auto syntax) {
+        h264::visit_nalu_format(format, [&](auto framing) {
+          extract<decltype(syntax), typename decltype(framing)::Parser>(pkt);
+        });
+      });
+    } catch (BinaryParseError &ex) {
+      LOG(error) << "Parse error: " << ex;
+    }
+
+    input.push_range(batch.begin(), batch.end(), ctx);
+    batch.clear();
 
-        if (!nalu.is_valid()) {
-          LOG(error) << "Invalid NALU, skipping processing";
-        } else if (nalu.type() == NaluType::SEI) {
-          std::vector<uint8_t> sodb_data;
-          sodb_data.reserve(nalu.size());
+    return false;
+  }
 
-          copy_ebsp_to_sodb(nalu.data(), nalu.data() + nalu.size(), std::back_inserter(sodb_data));
+private:
+  template<class SeiSyntax, class NaluParser>
+  void extract(AVPacket &pkt)
+  {
+    int order = 0;
 
-          SeiParser sei_parser = SeiParser::create(sodb_data.data() + 1, sodb_data.data() + sodb_data.size());
-          while (sei_parser) {
-            auto sei = std::make_shared<OwnedSeiPayload>();
-            sei_parser >> *sei;
+    auto parser = NaluParser::create(pkt.data, pkt.data + pkt.size);
+    NaluView nalu;
+    while (parser) {
+      parser >> nalu;
+
+      if (!SeiSyntax::is_valid(nalu)) {
+        LOG(error) << "Invalid NALU, skipping processing";
+      } else if (SeiSyntax::is_sei(nalu)) {
+        h264::for_each_sei_payload(
+          nalu.data(), nalu.data() + nalu.size(), SeiSyntax::NALU_HEADER_SIZE, sodb, [&](const SeiPayloadView &sei) {
+            if (!h264::is_closed_caption(sei)) {
+              return;
+            }
 
-            if (sei->type() == SeiType::USER_DATA_REGISTERED) {
-              auto rescaled_pts = pts_rescaler.rescale_to_clock(StreamTS(pkt.pts));
-              auto rescaled_dts = dts_rescaler.rescale_to_clock(StreamTS(pkt.dts));
+            auto rescaled_pts = pts_rescaler.rescale_to_clock(StreamTS(pkt.pts));
+            auto rescaled_dts = dts_rescaler.rescale_to_clock(StreamTS(pkt.dts));
 
-              LOG(trace) << "Found CC SEI at pts " << pkt.pts << ", rescaled " << rescaled_pts;
+            LOG(trace) << "Found CC SEI at pts " << pkt.pts << ", rescaled " << rescaled_pts;
 
-              input.push<SeiKind>(rescaled_pts, rescaled_dts, order, std::move(sei), ctx);
+            batch.emplace_back(input.spec().id,
+                               rescaled_pts,
+                               rescaled_dts,
+                               order,
+                               values.make(sei.type(), sei.data(), sei.data() + sei.size()));
 
-              order++;
-            }
-          }
-        }
+            order++;
+          });
       }
-    } catch (BinaryParseError &ex) {
-      LOG(error) << "Parse error: " << ex;
     }
-
-    return false;
   }
 };
 
@@ -141,15 +180,22 @@ private:
   UserDefinedInput &input;
   const ApplicationContext &ctx;
 
-  TSRescaler pts_rescaler;
-  TSRescaler dts_rescaler;
+  PersistentTSRescaler pts_rescaler;
+  PersistentTSRescaler dts_rescaler;
+
+  /// Values of found metadata are allocated from this extractor's shard of value pool.
+  ValuePool<SpliceInfoSection>::Producer values;
+
+  /// Metadata found in currently processed packet, published at once.
+  std::vector<Metadata<ScteKind>> batch{};
 
 public:
   ScteExtractor(StreamTimeBase stream_time_base, UserDefinedInput &input, const ApplicationContext &ctx)
     : input{ input }
     , ctx{ ctx }
-    , pts_rescaler{ TSRescaler::clock_relative(ctx.clock, stream_time_base) }
-    , dts_rescaler{ TSRescaler::clock_relative(ctx.clock, stream_time_base) }
+    , pts_rescaler{ ctx.rescaler_states, rescaler_key<ScteKind>(input, "pts"), ctx.clock, stream_time_base }
+    , dts_rescaler{ ctx.rescaler_states, rescaler_key<ScteKind>(input, "dts"), ctx.clock, stream_time_base }
+    , values{ ctx.value_pools->get<ScteKind>().producer() }
   {}
 
   static std::unique_ptr<PacketProcessor<ScteKind>> factory(StreamTimeBase stream_time_base,
@@ -164,7 +210,7 @@ public:
     try {
       auto parser = Scte35Parser::create(pkt.data, pkt.data + pkt.size);
       while (parser) {
-        auto section = std::make_shared<SpliceInfoSection>();
+        auto section = values.make();
         parser >> *section;
 
         auto rescaled_pts = pts_rescaler.rescale_to_clock(StreamTS(pkt.pts));
@@ -173,12 +219,15 @@ public:
         LOG(trace) << "Found SCTE-35 packet at dts " << pkt.dts << " pts " << pkt.pts << ", rescaled " << rescaled_pts
                    << ": " << *section;
 
-        input.push<ScteKind>(rescaled_pts, rescaled_dts, 0, std::move(section), ctx);
+        batch.emplace_back(input.spec().id, rescaled_pts, rescaled_dts, 0, std::move(section));
       }
     } catch (BinaryParseError &ex) {
       LOG(error) << "Parse error: " << ex;
     }
 
+    input.push_range(batch.begin(), batch.end(), ctx);
+    batch.clear();
+
     return false;
   }
 };
@@ -233,7 +282,7 @@ extractor(std::string input_name, std::shared_ptr<ApplicationContext> ctx)
              sink,
              sc,
              { std::bind(&MaintenanceProcessor::factory, std::ref(input)),
-               std::bind(&SeiExtractor::factory, ph::_1, std::ref(input), std::cref(*ctx)),
+               std::bind(&SeiExtractor::factory, ph::_1, sc.sei_codec, sc.sei_format, std::ref(input), std::cref(*ctx)),
                std::bind(&ScteExtractor::factory, ph::_1, std::ref(input), std::cref(*ctx)) });
 }
 }
@@ -5,18 +5,13 @@
 #include <chrono>
 #include <iostream>
 #include <iterator>
+#include <optional>
+#include <stdexcept>
 #include <thread>
 
 #include "../application_context.h"
 #include "../clock.h"
 #include "../ffmpeg.h"
-#include "../h264/av_packet_nalu.h"
-#include "../h264/av_packet_nalu_parser.h"
-#include "../h264/emitter.h"
-#include "../h264/rbsp.h"
-#include "../h264/sei_parser.h"
-#include "../h264/sei_payload.h"
-#include "../h264/stdseis.h"
 #include "../input_manager.h"
 #include "../io/remux_loop.h"
 #include "../io/sink_handle.h"
@@ -25,20 +20,15 @@
 #include "../log.h"
 #include "../metadata.h"
 #include "../program_options.h"
+#include "../snapshot.h"
 #include "../util.h"
+#include "../video_codec.h"
+#include "sei_injection.h"
 
 using metamix::ScteKind;
 using metamix::SeiKind;
 using metamix::TimeSourceKind;
-using metamix::h264::AVPacketNalu;
-using metamix::h264::AVPacketNaluParser;
-using metamix::h264::build_cc_reset_metadata;
-using metamix::h264::copy_ebsp_to_sodb;
-using metamix::h264::emit_sei_payloads_to_avcc_nalu;
-using metamix::h264::NaluType;
-using metamix::h264::OwnedSeiPayload;
-using metamix::h264::SeiParser;
-using metamix::h264::SeiType;
+using metamix::h264::NaluFormat;
 using metamix::io::NullPacketProcessor;
 using metamix::io::PacketProcessor;
 using metamix::io::SinkHandle;
@@ -48,25 +38,22 @@ namespace ph = std::placeholders;
 
 namespace metamix::proc {
 
-template<class T>
-static void
-vector_append_move(T &vec, T app)
-{
-  vec.insert(std::end(vec), std::make_move_iterator(std::begin(app)), std::make_move_iterator(std::end(app)));
-}
-
 namespace {
 
 class ClockTicker : public PacketProcessor<TimeSourceKind>
 {
 private:
+  PersistentTSRescaler pts_rescaler;
+
+  /// Clock resumed from snapshot continues from its restored value, instead of being advanced by the first timestamp.
   TSTicker ticker;
-  TSRescaler pts_rescaler;
 
 public:
   ClockTicker(StreamTimeBase stream_time_base, const ApplicationContext &ctx)
-    : ticker{ ctx.clock }
-    , pts_rescaler{ TSRescaler::clock_relative(ctx.clock, stream_time_base) }
+    : pts_rescaler{
+      ctx.rescaler_states, std::string("output/") + TimeSourceKind::NAME + "/pts", ctx.clock, stream_time_base
+    }
+    , ticker{ pts_rescaler.is_resumed() ? TSTicker(ctx.clock, ctx.clock->now()) : TSTicker(ctx.clock) }
   {}
 
   static std::unique_ptr<PacketProcessor<TimeSourceKind>> factory(StreamTimeBase stream_time_base,
@@ -88,21 +75,30 @@ class SeiInjector : public PacketProcessor<SeiKind>
 private:
   const ApplicationContext &ctx;
 
-  TSRescaler pts_rescaler;
+  PersistentTSRescaler pts_rescaler;
 
-  ClockTS prev_pts{ std::numeric_limits<TS>::min() };
-  std::optional<InputId> prev_input_id = std::nullopt;
+  SeiInjection sei_injection;
 
 public:
-  SeiInjector(StreamTimeBase stream_time_base, const ApplicationContext &ctx)
+  SeiInjector(StreamTimeBase stream_time_base,
+              VideoCodec codec,
+              NaluFormat format,
+              TimeBase frame_rate,
+              InjectionMode injection,
+              const ApplicationContext &ctx)
     : ctx{ ctx }
-    , pts_rescaler{ TSRescaler::clock_relative(ctx.clock, stream_time_base) }
+    , pts_rescaler{ ctx.rescaler_states, std::string("output/") + SeiKind::NAME + "/pts", ctx.clock, stream_time_base }
+    , sei_injection{ codec, format, frame_rate, injection }
   {}
 
   static std::unique_ptr<PacketProcessor<SeiKind>> factory(StreamTimeBase stream_time_base,
+                                                           VideoCodec codec,
+                                                           NaluFormat format,
+                                                           TimeBase frame_rate,
+                                                           InjectionMode injection,
                                                            const ApplicationContext &ctx)
   {
-    return std::make_unique<SeiInjector>(stream_time_base, ctx);
+    return std::make_unique<SeiInjector>(stream_time_base, codec, format, frame_rate, injection, ctx);
   }
 
   bool process(AVPacket &pkt) override
@@ -110,123 +106,10 @@ public:
     // LOG(trace) << "dts: " << pkt.dts << " pts: " << pkt.pts << " pos: " << pkt.pos << " dur: " << pkt.duration
     //            << " flags: 0x" << std::hex << pkt.flags;
 
-    std::vector<Metadata<SeiKind>> found_sei_metadata{};
-    std::vector<uint8_t> buf{};
-
     auto rescaled_pts = pts_rescaler.rescale_to_clock(StreamTS(pkt.pts)) - ctx.ts_adjustment();
-
-    auto &input = ctx.input_manager->get_current_input<SeiKind>();
-    const auto input_id = input.spec().id;
-
-    if (input_id != prev_input_id) {
-      found_sei_metadata.push_back(build_cc_reset_metadata(input_id, rescaled_pts));
-    }
-
-    prev_input_id = input_id;
-
-    vector_append_move(found_sei_metadata, input.query<SeiKind>(prev_pts, rescaled_pts + 1_clock, ctx));
-
-    prev_pts = rescaled_pts + 1_clock;
-
-    try {
-      // Collect all NALUs from packet
-      std::vector<AVPacketNalu> nalus;
-      auto nalu_parser = AVPacketNaluParser::create(pkt);
-      while (nalu_parser) {
-        AVPacketNalu nalu;
-        nalu_parser >> nalu;
-
-        if (!nalu.is_valid()) {
-          LOG(warning) << "Invalid NALU spotted";
-          continue;
-        }
-
-        nalus.push_back(nalu);
-      }
-
-      auto it = nalus.begin();
-
-      // Remux NALUs which are expected to be first, before SEIs
-      for (; it != nalus.end(); it++) {
-        if (it->type() == NaluType::AUD || it->type() == NaluType::SPS || it->type() == NaluType::PPS) {
-          emit_avcc_nalu(*it, std::back_inserter(buf));
-        } else {
-          break;
-        }
-      }
-
-      // Get first SEI NALU and collect its payloads, stripping existing closed captions
-      std::vector<OwnedSeiPayload> seis{};
-      if (it != nalus.end() && it->type() == NaluType::SEI) {
-        seis = strip_cc(*it);
-        it++;
-      }
-
-      // Append closed captions from metadata queue
-      for (const auto &meta : found_sei_metadata) {
-        seis.push_back(*meta.val);
-      }
-
-      // Remux SEI NALU
-      assert(!seis.empty());
-      emit_sei_payloads_to_avcc_nalu(seis.begin(), seis.end(), std::back_inserter(buf));
-
-      // Remux rest of packets
-      for (; it != nalus.end(); it++) {
-        emit_avcc_nalu(*it, std::back_inserter(buf));
-      }
-
-      // Adjust remuxed packet size; beware of FFmpeg API inconsistency regarding second argument!
-      if (pkt.size < buf.size()) {
-        // If original packet is smaller than remuxed one, grow it by size difference
-        ff::grow_packet(pkt, buf.size() - pkt.size);
-      } else if (pkt.size > buf.size()) {
-        // If original packet is bigger than remuxed one, set its size to remuxed one's size
-        ff::shrink_packet(pkt, buf.size());
-      }
-
-      assert(pkt.size == buf.size());
-
-      std::copy(buf.begin(), buf.end(), pkt.data);
-    } catch (BinaryParseError &ex) {
-      LOG(error) << "Parse error: " << ex;
-    }
-
+    sei_injection.process(pkt, rescaled_pts, ctx.input_manager->get_current_input<SeiKind>(), ctx);
     return false;
   }
-
-private:
-  std::vector<OwnedSeiPayload> strip_cc(const AVPacketNalu &nalu)
-  {
-    assert(nalu.type() == NaluType::SEI);
-
-    std::vector<OwnedSeiPayload> non_cc_seis;
-
-    try {
-      std::vector<uint8_t> sodb{};
-      sodb.reserve(nalu.size());
-      copy_ebsp_to_sodb(nalu.data(), nalu.data() + nalu.size(), std::back_inserter(sodb));
-
-      SeiParser sei_parser = SeiParser::create(sodb.data() + 1, sodb.data() + sodb.size());
-      OwnedSeiPayload sei;
-
-      while (sei_parser) {
-        sei_parser >> sei;
-
-        if (sei.type() == SeiType::USER_DATA_REGISTERED) {
-          LOG(trace) << "Dropping CC SEI from source.";
-          // metamix::hex_dump(sei.begin(), sei.end());
-        } else {
-          non_cc_seis.push_back(std::move(sei));
-        }
-      }
-    } catch (BinaryParseError &) {
-      LOG(error) << "Error stripping CC SEI...";
-      throw;
-    }
-
-    return non_cc_seis;
-  }
 };
 }
 
@@ -259,7 +142,13 @@ injector(std::shared_ptr<ApplicationContext> ctx)
              sink,
              sc,
              { std::bind(&ClockTicker::factory, ph::_1, std::cref(*ctx)),
-               std::bind(&SeiInjector::factory, ph::_1, std::cref(*ctx)),
+               std::bind(&SeiInjector::factory,
+                         ph::_1,
+                         sc.sei_codec,
+                         sc.sei_format,
+                         sc.sei_frame_rate,
+                         output_spec.injection,
+                         std::cref(*ctx)),
                NullPacketProcessor<ScteKind>::factory });
 }
 }
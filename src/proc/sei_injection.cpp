@@ -0,0 +1,186 @@
+#include "sei_injection.h"
+
+#include <cassert>
+#include <iterator>
+#include <stdexcept>
+
+#include "../abstract_input.h"
+#include "../binary_parser.h"
+#include "../h264/emitter.h"
+#include "../h264/nalu_framing.h"
+#include "../h264/sei_parser.h"
+#include "../h264/stdseis.h"
+#include "../log.h"
+
+using metamix::h264::build_cc_reset_metadata;
+using metamix::h264::NaluView;
+using metamix::h264::SeiPayloadView;
+
+namespace metamix::proc {
+
+SeiInjection::SeiInjection(VideoCodec codec, h264::NaluFormat format, TimeBase frame_rate, InjectionMode injection)
+  : codec{ codec }
+  , format{ format }
+  , injection{ injection }
+{
+  if (frame_rate > 0) {
+    pacer.emplace(frame_rate);
+    LOG(info) << "Pacing closed captions at " << pacer->cc_count() << " triplets per frame of " << frame_rate
+              << " fps";
+  } else {
+    LOG(warning) << "Unknown output frame rate, closed captions are not paced";
+  }
+  LOG(info) << "Injecting closed captions in " << injection << " mode";
+}
+
+void
+SeiInjection::process(AVPacket &pkt, ClockTS pts, AbstractInput &input, const ApplicationContext &ctx)
+{
+  found_sei_metadata.clear();
+
+  const auto input_id = input.spec().id;
+
+  // Captions buffered from previous input are dropped, rather than being emitted after the reset
+  if (input_id != prev_input_id) {
+    if (pacer) {
+      pacer->clear();
+    } else {
+      coalescer.clear();
+    }
+    found_sei_metadata.push_back(build_cc_reset_metadata(input_id, pts));
+  }
+
+  prev_input_id = input_id;
+
+  if (!pacer) {
+    estimate_frame_rate(pts);
+  }
+
+  // Frames without closed captions are filled with empty ones, unless they are passed untouched
+  input.query<SeiKind>(prev_pts, pts + 1_clock, ctx, found_sei_metadata, injection == InjectionMode::DENSE);
+
+  prev_pts = pts + 1_clock;
+
+  try {
+    visit_video_codec(codec, [&](auto syntax) {
+      h264::visit_nalu_format(format, [&](auto framing) {
+        remux<decltype(syntax), decltype(framing)>(pkt);
+      });
+    });
+  } catch (BinaryParseError &ex) {
+    LOG(error) << "Parse error: " << ex;
+  } catch (std::length_error &ex) {
+    LOG(error) << "Remux error: " << ex.what();
+  }
+}
+
+/// Limits triplets per frame of coalesced closed captions to the frame rate given by the shortest pts delta so far.
+void
+SeiInjection::estimate_frame_rate(ClockTS pts)
+{
+  if (prev_packet_pts) {
+    TS delta = (pts - *prev_packet_pts).val;
+    if (delta > 0 && delta <= SYS_CLOCK_RATE && (frame_duration == 0 || delta < frame_duration)) {
+      frame_duration = delta;
+      coalescer.set_cc_count(h264::CcPacer::cc_count_of(TimeBase(SYS_CLOCK_RATE, frame_duration)));
+      LOG(debug) << "Limiting closed captions to " << coalescer.cc_count() << " triplets per frame";
+    }
+  }
+  prev_packet_pts = pts;
+}
+
+/// Rewrites packet with SEI NALU carrying closed captions from found metadata, in place of the original one.
+///
+/// Only the SEI NALU is rewritten, the rest of access unit, such as slices, is spliced around it as it is. In sparse
+/// mode, packets with nothing to inject and no closed captions to strip are left untouched.
+template<class SeiSyntax, class Framing>
+void
+SeiInjection::remux(AVPacket &pkt)
+{
+  auto sei = find_sei_nalu<SeiSyntax, typename Framing::Parser>(pkt.data, pkt.size);
+
+  bool cc_pending = pacer ? pacer->pending() : coalescer.pending();
+  if (injection == InjectionMode::SPARSE && found_sei_metadata.empty() && !cc_pending &&
+      !has_closed_captions<SeiSyntax>(sei.nalu)) {
+    return;
+  }
+
+  // Collect payloads of SEI NALU to be replaced, stripping existing closed captions
+  seis.clear();
+  if (!sei.nalu.empty()) {
+    strip_cc<SeiSyntax>(sei.nalu);
+  }
+
+  // Append closed captions from metadata queue, paced to frame rate or merged into a single payload. Static empty and
+  // reset closed captions bypass pacer, which would queue them behind real captions: paced frames are padded anyway,
+  // and a reset takes the place of paced frame.
+  bool reset = false;
+  for (const auto &meta : found_sei_metadata) {
+    if (pacer && h264::is_empty_sei(*meta.val)) {
+      continue;
+    }
+    if (pacer && h264::is_cc_reset_sei(*meta.val)) {
+      if (!reset) {
+        seis.push_back(*meta.val);
+        reset = true;
+      }
+      continue;
+    }
+    if (!(pacer ? pacer->add(*meta.val) : coalescer.add(*meta.val))) {
+      seis.push_back(*meta.val);
+    }
+  }
+  if (pacer) {
+    if (!reset && (pacer->pending() || injection == InjectionMode::DENSE)) {
+      seis.push_back(pacer->next_frame());
+    }
+  } else {
+    coalescer.flush(std::back_inserter(seis));
+  }
+  size_t cc_drops = pacer ? pacer->dropped() : coalescer.dropped();
+  if (cc_drops > reported_cc_drops) {
+    LOG(warning) << "Dropped " << cc_drops - reported_cc_drops << " closed caption triplets overflowing backlog";
+    reported_cc_drops = cc_drops;
+  }
+
+  // Emit SEI NALU and splice it into packet, SEI NALU left without payloads is removed.
+  sei_nalu.clear();
+  if (!seis.empty()) {
+    auto header = SeiSyntax::sei_nalu_header(sei.anchor);
+    Framing::emit_sei_nalu(header, seis.begin(), seis.end(), sei_nalu);
+  }
+
+  ff::splice_packet(pkt, sei.begin, sei.end, sei_nalu.data(), sei_nalu.size(), packet_buffers);
+}
+
+template<class SeiSyntax>
+bool
+SeiInjection::has_closed_captions(const NaluView &nalu)
+{
+  return !nalu.empty() &&
+         h264::has_closed_captions(nalu.data(), nalu.data() + nalu.size(), SeiSyntax::NALU_HEADER_SIZE, sodb);
+}
+
+/// Appends payloads of SEI NALU to `seis`, except for closed captions.
+template<class SeiSyntax>
+void
+SeiInjection::strip_cc(const NaluView &nalu)
+{
+  assert(SeiSyntax::is_sei(nalu));
+
+  try {
+    h264::for_each_sei_payload(
+      nalu.data(), nalu.data() + nalu.size(), SeiSyntax::NALU_HEADER_SIZE, sodb, [&](const SeiPayloadView &sei) {
+        if (h264::is_closed_caption(sei)) {
+          LOG(trace) << "Dropping CC SEI from source.";
+          // metamix::hex_dump(sei.begin(), sei.end());
+        } else {
+          seis.emplace_back(sei);
+        }
+      });
+  } catch (BinaryParseError &) {
+    LOG(error) << "Error stripping CC SEI...";
+    throw;
+  }
+}
+}
@@ -0,0 +1,94 @@
+#pragma once
+
+#include <cstdint>
+#include <limits>
+#include <optional>
+#include <vector>
+
+#include "../application_context.h"
+#include "../clock_types.h"
+#include "../ffmpeg.h"
+#include "../h264/cc_data.h"
+#include "../h264/cc_pacer.h"
+#include "../h264/nalu.h"
+#include "../h264/sei_payload.h"
+#include "../iospec.h"
+#include "../metadata.h"
+#include "../video_codec.h"
+
+namespace metamix {
+
+class AbstractInput;
+}
+
+namespace metamix::proc {
+
+/**
+ * @brief Injects closed captions of the current input into packets of output video stream, one packet at a time.
+ *
+ * Keeps state of injection carried across packets, such as pacing of closed captions, and scratch buffers which are
+ * cleared per packet and reused across packets, so that once they have grown, packets are processed without
+ * allocation.
+ */
+class SeiInjection
+{
+private:
+  VideoCodec codec;
+  h264::NaluFormat format;
+  InjectionMode injection;
+
+  ClockTS prev_pts{ std::numeric_limits<TS>::min() };
+  std::optional<InputId> prev_input_id = std::nullopt;
+
+  /// Metadata found for current packet.
+  std::vector<Metadata<SeiKind>> found_sei_metadata{};
+
+  /// Payloads of emitted SEI NALU.
+  std::vector<h264::OwnedSeiPayload> seis{};
+
+  /// SODB of SEI NALUs containing emulation prevention bytes.
+  std::vector<uint8_t> sodb{};
+
+  /// Merges closed captions found for a frame, limited to triplets per frame of output frame rate. If it is not known,
+  /// it is estimated by the shortest positive pts delta of packets, which are in decode order.
+  h264::CcDataCoalescer coalescer{};
+  std::optional<ClockTS> prev_packet_pts = std::nullopt;
+  TS frame_duration{ 0 };
+
+  /// Re-paces closed captions to output frame rate, if it is known, in place of merging them per frame.
+  std::optional<h264::CcPacer> pacer{};
+  size_t reported_cc_drops{ 0 };
+
+  /// Emitted SEI NALU.
+  std::vector<uint8_t> sei_nalu{};
+
+  /// Buffers of packets, whose SEI NALU is replaced by one of different size.
+  ff::PacketBufferPool packet_buffers{};
+
+public:
+  /// \param frame_rate  frame rate of output stream, closed captions are paced to it unless it is 0
+  SeiInjection(VideoCodec codec, h264::NaluFormat format, TimeBase frame_rate, InjectionMode injection);
+
+  /**
+   * @brief Rewrites SEI NALU of packet with closed captions of `input` found up to `pts`.
+   *
+   * Closed captions of the previous input are reset when `input` differs from the one of the previous packet. Parse
+   * and remux errors are logged, and leave packet untouched.
+   *
+   * \param pts  presentation timestamp of packet on clock, adjusted by injection TS adjustment
+   */
+  void process(AVPacket &pkt, ClockTS pts, AbstractInput &input, const ApplicationContext &ctx);
+
+private:
+  void estimate_frame_rate(ClockTS pts);
+
+  template<class SeiSyntax, class Framing>
+  void remux(AVPacket &pkt);
+
+  template<class SeiSyntax>
+  bool has_closed_captions(const h264::NaluView &nalu);
+
+  template<class SeiSyntax>
+  void strip_cc(const h264::NaluView &nalu);
+};
+}
@@ -0,0 +1,135 @@
+#include "snapshotter.h"
+
+#include <chrono>
+#include <condition_variable>
+#include <iterator>
+#include <mutex>
+
+#include "../clock.h"
+#include "../h264/sei_payload.h"
+#include "../input_manager.h"
+#include "../log.h"
+#include "../program_options.h"
+#include "../scte35/scte35.h"
+
+namespace metamix::proc {
+
+void
+take_snapshot(ApplicationContext &ctx, Snapshot &snapshot)
+{
+  snapshot.clock = ctx.clock->now();
+
+  snapshot.inputs.clear();
+  for (const auto &input : *ctx.input_manager) {
+    snapshot.inputs[input.spec().id] = input.spec().name;
+  }
+
+  snapshot.rescalers = ctx.rescaler_states->current();
+
+  // Vectors keep their capacity, queues are copied into it without allocating while they're locked.
+  MetadataKindPack::for_each([&](auto k) {
+    using K = decltype(k);
+    snapshot.get<K>().clear();
+    ctx.meta_queue->snapshot<K>(std::back_inserter(snapshot.get<K>()));
+  });
+}
+
+Snapshot
+take_snapshot(ApplicationContext &ctx)
+{
+  Snapshot snapshot{};
+  take_snapshot(ctx, snapshot);
+  return snapshot;
+}
+
+void
+restore_snapshot(const Snapshot &snapshot, ApplicationContext &ctx)
+{
+  std::map<InputId, InputId> ids{};
+  for (const auto &[id, name] : snapshot.inputs) {
+    if (auto input = ctx.input_manager->get_input_by_name(name); input) {
+      ids[id] = input->get().spec().id;
+    } else {
+      LOG(warning) << "Input " << name << " is no longer configured, dropping its snapshotted metadata";
+    }
+  }
+
+  MetadataKindPack::for_each([&](auto k) {
+    using K = decltype(k);
+
+    std::vector<Metadata<K>> entries{};
+    for (const auto &meta : snapshot.get<K>()) {
+      if (auto it = ids.find(meta.input_id); it != ids.end()) {
+        entries.push_back(meta);
+        entries.back().input_id = it->second;
+      }
+    }
+
+    ctx.meta_queue->push_range(entries.begin(), entries.end());
+    LOG(info) << "Restored " << entries.size() << " " << K::NAME << " metadata entries from snapshot";
+  });
+
+  ctx.rescaler_states->restore(snapshot.rescalers);
+}
+
+/// \return true if snapshot has been written
+static bool
+write_snapshot(ApplicationContext &ctx, Snapshot &snapshot, std::vector<uint8_t> &buf)
+{
+  // Keep snapshotting through transient I/O errors, losing snapshots must not stop the pipeline.
+  try {
+    take_snapshot(ctx, snapshot);
+
+    buf.clear();
+    emit_snapshot(snapshot, buf);
+
+    if (!ctx.snapshot_file->write(buf)) {
+      LOG(warning) << "Snapshot of " << buf.size() << " bytes exceeds snapshot file capacity of "
+                   << ctx.snapshot_file->slot_capacity() << " bytes, skipping it";
+      return false;
+    }
+    return true;
+  } catch (const std::exception &ex) {
+    LOG(error) << "Failed writing snapshot: " << ex.what();
+    return false;
+  }
+}
+
+void
+snapshotter(std::shared_ptr<ApplicationContext> ctx)
+{
+  metamix::log::set_thread_name("snapshot");
+
+  std::mutex m;
+  std::condition_variable cv;
+
+  boost::signals2::scoped_connection on_exit_conn(ctx->on_exit.connect([&]() {
+    std::lock_guard<std::mutex> guard(m);
+    cv.notify_all();
+  }));
+
+  const auto interval = std::chrono::milliseconds(ctx->options->snapshot_interval);
+  Snapshot snapshot{};
+  std::vector<uint8_t> buf{};
+
+  bool running = true;
+  bool written = false;
+
+  std::unique_lock<std::mutex> lock(m);
+  while (running) {
+    // The last snapshot is written after exit has been seen
+    running = !cv.wait_for(lock, interval, [&]() { return !ctx->is_running(); });
+
+    // Exit notification must not wait for the snapshot being written
+    lock.unlock();
+    written = write_snapshot(*ctx, snapshot, buf);
+    lock.lock();
+  }
+
+  if (written) {
+    LOG(debug) << "Wrote final snapshot";
+  } else {
+    LOG(error) << "Failed writing final snapshot, previous one is kept";
+  }
+}
+}
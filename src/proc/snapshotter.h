@@ -0,0 +1,28 @@
+#pragma once
+
+#include <memory>
+#include <string>
+#include <thread>
+
+#include "../application_context.h"
+#include "../snapshot.h"
+
+namespace metamix::proc {
+
+/// Copies metadata queues, clock and rescaler states, leaving them intact.
+Snapshot
+take_snapshot(ApplicationContext &ctx);
+
+/// Copies metadata queues, clock and rescaler states into existing snapshot, reusing its storage.
+void
+take_snapshot(ApplicationContext &ctx, Snapshot &snapshot);
+
+/// Restores metadata queue entries and rescaler states, entries of inputs which are no longer configured are dropped.
+/// Clock is expected to be created with snapshot clock value.
+void
+restore_snapshot(const Snapshot &snapshot, ApplicationContext &ctx);
+
+/// Periodically writes snapshots to `ctx->snapshot_file` until application exits, and once more on exit.
+void
+snapshotter(std::shared_ptr<ApplicationContext> ctx);
+}
@@ -1,5 +1,7 @@
 #include "program_options.h"
 
+#include <algorithm>
+#include <cctype>
 #include <iomanip>
 #include <sstream>
 #include <unordered_set>
@@ -29,13 +31,40 @@ get_input_spec_or_create(ProgramOptions &o, const std::string &input_name)
     }
   }
 
+  // Id 0 is taken by the clear input
   InputSpec is;
-  is.id = o.user_inputs.size();
+  is.id = o.user_inputs.size() + 1;
   is.name = input_name;
   o.user_inputs.push_back(std::move(is));
   return o.user_inputs.back();
 }
 
+const std::string &
+single_option_value(const po::option &opt)
+{
+  if (opt.value.empty()) {
+    throw std::runtime_error("Missing option " + opt.string_key + " value.");
+  } else if (opt.value.size() > 1) {
+    throw std::runtime_error("Option " + opt.string_key + " is single-value.");
+  }
+  return opt.value.front();
+}
+
+size_t
+parse_size_option(const po::option &opt)
+{
+  const auto &value = single_option_value(opt);
+  if (value.empty() || !std::all_of(value.begin(), value.end(), [](char c) { return std::isdigit(c); })) {
+    throw std::runtime_error("Option " + opt.string_key + " has to be a non-negative number.");
+  }
+
+  try {
+    return std::stoull(value);
+  } catch (std::out_of_range &) {
+    throw std::runtime_error("Option " + opt.string_key + " is out of range.");
+  }
+}
+
 std::string
 ts_adjustment_description()
 {
@@ -61,6 +90,31 @@ ProgramOptions::parse(int argc, char **argv)
     { "fatal", boost::log::trivial::severity_level::fatal },
   };
 
+  std::map<std::string, MetadataQueueEngine> queue_engine_map{
+    { "heap", MetadataQueueEngine::HEAP },
+    { "ring", MetadataQueueEngine::RING },
+    { "calendar", MetadataQueueEngine::CALENDAR },
+    { "log", MetadataQueueEngine::LOG },
+    { "shm", MetadataQueueEngine::SHM },
+  };
+
+  std::map<std::string, ProcessRole> role_map{
+    { "all", ProcessRole::ALL },
+    { "extractor", ProcessRole::EXTRACTOR },
+    { "injector", ProcessRole::INJECTOR },
+  };
+
+  std::map<std::string, InjectionMode> injection_mode_map{
+    { "dense", InjectionMode::DENSE },
+    { "sparse", InjectionMode::SPARSE },
+  };
+
+  std::map<std::string, EvictionPolicy> eviction_policy_map{
+    { "drop-oldest", EvictionPolicy::DROP_OLDEST },
+    { "drop-newest", EvictionPolicy::DROP_NEWEST },
+    { "never-evict", EvictionPolicy::NEVER_EVICT },
+  };
+
   boost::optional<std::string> config_file;
 
   po::options_description generic("Generic options (cannot be set via configuration file)");
@@ -74,6 +128,10 @@ ProgramOptions::parse(int argc, char **argv)
   boost::optional<std::string> start_input_name;
   std::string log_level_str;
   boost::optional<std::string> log_thread_name;
+  std::string queue_engine_str;
+  std::string queue_eviction_str;
+  boost::optional<std::string> snapshot_file;
+  std::string role_str;
 
   po::options_description behavior("System options");
   // clang-format off
@@ -85,7 +143,39 @@ ProgramOptions::parse(int argc, char **argv)
     ("log", po::value(&log_level_str)->value_name("level")->default_value("info"),
      "logging severity level, must be one of: trace, debug, info, warning, error, fatal")
     ("log-thread", po::value(&log_thread_name)->value_name("name"), "show logs only from specified thread")
-    ("no-restart", "don't restart streams");
+    ("no-restart", "don't restart streams")
+    ("queue-engine", po::value(&queue_engine_str)->value_name("engine")->default_value("heap"),
+     "metadata queue storage engine, must be one of: heap, ring, calendar, log, shm; "
+     "shm is implied by extractor and injector roles")
+    ("queue-max-entries", po::value(&o->queue_budgets.common.max_entries)->value_name("count")->default_value(0),
+     "maximum count of entries in each metadata queue, 0 for unlimited")
+    ("queue-max-bytes", po::value(&o->queue_budgets.common.max_bytes)->value_name("bytes")->default_value(0),
+     "maximum memory held by each metadata queue, 0 for unlimited")
+    ("queue-max-input-entries", po::value(&o->queue_budgets.common.max_input_entries)->value_name("count")
+       ->default_value(0),
+     "maximum count of entries of single input in each metadata queue, 0 for unlimited")
+    ("queue-max-input-bytes", po::value(&o->queue_budgets.common.max_input_bytes)->value_name("bytes")
+       ->default_value(0),
+     "maximum memory held by entries of single input in each metadata queue, 0 for unlimited")
+    ("queue-eviction", po::value(&queue_eviction_str)->value_name("policy")->default_value("drop-oldest"),
+     "what to do when metadata queue exceeds its limits, must be one of: drop-oldest, drop-newest, never-evict; "
+     "SCTE-35 metadata is never evicted unless set for its kind")
+    ("snapshot-file", po::value(&snapshot_file)->value_name("path"),
+     "periodically save metadata queues to this file, and restore them from it on start")
+    ("snapshot-interval", po::value(&o->snapshot_interval)->value_name("ms")->default_value(100),
+     "interval between metadata queue snapshots, in milliseconds")
+    ("snapshot-size", po::value(&o->snapshot_size)->value_name("bytes")->default_value(o->snapshot_size),
+     "maximum size of single metadata queue snapshot, larger ones are skipped")
+    ("role", po::value(&role_str)->value_name("role")->default_value("all"),
+     "components to run, must be one of: all, extractor, injector; "
+     "extractor processes feed injector process through shared memory")
+    ("extract", po::value(&o->extract_inputs)->value_name("name")->composing(),
+     "with extractor role, run extractor of this input only, may be repeated")
+    ("shm-name", po::value(&o->shared_queue.name)->value_name("name")->default_value(o->shared_queue.name),
+     "name prefix of shared memory objects holding metadata queues and clock of shm queue engine")
+    ("shm-slot-size", po::value(&o->shared_queue.slot_size)->value_name("bytes")
+       ->default_value(o->shared_queue.slot_size),
+     "size of single entry of shm queue engine, larger metadata is dropped");
   // clang-format on
 
   po::options_description inputs("Specifying inputs (at least one required, replace * with input name)");
@@ -99,7 +189,22 @@ ProgramOptions::parse(int argc, char **argv)
      "input sink format, or auto detect");
   // clang-format on
 
+  po::options_description queues(
+    "Limiting metadata queue of single kind (replace * with adMarker or closedCaption), overrides --queue-* options");
+  // clang-format off
+  queues.add_options()
+    ("queue.*.max-entries", po::value<size_t>()->value_name("count"), "maximum count of entries, 0 for unlimited")
+    ("queue.*.max-bytes", po::value<size_t>()->value_name("bytes"), "maximum memory held, 0 for unlimited")
+    ("queue.*.max-input-entries", po::value<size_t>()->value_name("count"),
+     "maximum count of entries of single input, 0 for unlimited")
+    ("queue.*.max-input-bytes", po::value<size_t>()->value_name("bytes"),
+     "maximum memory held by entries of single input, 0 for unlimited")
+    ("queue.*.eviction", po::value<std::string>()->value_name("policy"),
+     "what to do when the queue exceeds its limits, must be one of: drop-oldest, drop-newest, never-evict");
+  // clang-format on
+
   boost::optional<std::string> output_source_format, output_sink_format;
+  std::string injection_str;
 
   po::options_description outputs("Specifying output (required)");
   // clang-format off
@@ -110,14 +215,17 @@ ProgramOptions::parse(int argc, char **argv)
      "output source format, or auto detect")
     ("output.sinkformat", po::value(&output_sink_format)->value_name("format"), "output sink format, or auto detect")
     ("output.ts_adjustment", po::value(&o->output.ts_adjustment)->value_name("ticks")->default_value(0),
-     ts_adjustment_description().c_str());
+     ts_adjustment_description().c_str())
+    ("output.injection", po::value(&injection_str)->value_name("mode")->default_value("dense"),
+     "frames to inject closed captions into, must be one of: dense, sparse; sparse passes frames without closed "
+     "captions untouched");
   // clang-format on
 
   po::options_description cmdline_opts;
-  cmdline_opts.add(generic).add(behavior).add(inputs).add(outputs);
+  cmdline_opts.add(generic).add(behavior).add(queues).add(inputs).add(outputs);
 
   po::options_description config_opts;
-  config_opts.add(behavior).add(inputs).add(outputs);
+  config_opts.add(behavior).add(queues).add(inputs).add(outputs);
 
   std::vector<po::option> unrecognized;
 
@@ -132,6 +240,7 @@ ProgramOptions::parse(int argc, char **argv)
               << std::endl
               << generic << std::endl
               << behavior << std::endl
+              << queues << std::endl
               << inputs << std::endl
               << outputs << std::endl;
 
@@ -159,6 +268,13 @@ ProgramOptions::parse(int argc, char **argv)
                  [](const auto &it) { return it.unregistered; });
   }
 
+  // Overrides of single metadata kinds start from the common budget
+  if (eviction_policy_map.find(queue_eviction_str) != eviction_policy_map.end()) {
+    o->queue_budgets.common.policy = eviction_policy_map[queue_eviction_str];
+  } else {
+    throw std::runtime_error("Unknown metadata queue eviction policy " + queue_eviction_str);
+  }
+
   for (const auto &opt : unrecognized) {
     if (boost::starts_with(opt.string_key, "input.")) {
       std::vector<std::string> parts;
@@ -171,15 +287,7 @@ ProgramOptions::parse(int argc, char **argv)
       const auto &input_name = parts[1];
       const auto &param = parts[2];
 
-      const auto &opt_value = opt.value;
-
-      if (opt_value.empty()) {
-        throw std::runtime_error("Missing option " + opt.string_key + " value.");
-      } else if (opt_value.size() > 1) {
-        throw std::runtime_error("Option " + opt.string_key + " is single-value.");
-      }
-
-      const auto &value = opt_value.front();
+      const auto &value = single_option_value(opt);
 
       InputSpec &input = get_input_spec_or_create(*o, input_name);
 
@@ -194,6 +302,46 @@ ProgramOptions::parse(int argc, char **argv)
       } else {
         throw std::runtime_error("Unknown option " + opt.string_key);
       }
+    } else if (boost::starts_with(opt.string_key, "queue.")) {
+      std::vector<std::string> parts;
+      boost::split(parts, opt.string_key, [](auto it) { return it == '.'; });
+
+      if (parts.size() != 3) {
+        throw std::runtime_error("Unknown option " + opt.string_key);
+      }
+
+      const auto &kind_name = parts[1];
+      const auto &param = parts[2];
+
+      QueueBudget *budget = nullptr;
+      MetadataKindPack::for_each([&](auto k) {
+        using K = decltype(k);
+        if (kind_name == K::API_NAME) {
+          budget = &o->queue_budgets.override_kind<K>();
+        }
+      });
+
+      if (budget == nullptr) {
+        throw std::runtime_error("Unknown metadata kind of option " + opt.string_key);
+      }
+
+      if (param == "max-entries") {
+        budget->max_entries = parse_size_option(opt);
+      } else if (param == "max-bytes") {
+        budget->max_bytes = parse_size_option(opt);
+      } else if (param == "max-input-entries") {
+        budget->max_input_entries = parse_size_option(opt);
+      } else if (param == "max-input-bytes") {
+        budget->max_input_bytes = parse_size_option(opt);
+      } else if (param == "eviction") {
+        const auto &value = single_option_value(opt);
+        if (eviction_policy_map.find(value) == eviction_policy_map.end()) {
+          throw std::runtime_error("Unknown metadata queue eviction policy " + value);
+        }
+        budget->policy = eviction_policy_map[value];
+      } else {
+        throw std::runtime_error("Unknown option " + opt.string_key);
+      }
     } else {
       LOG(warning) << "Unrecognised option " + opt.string_key;
     }
@@ -206,9 +354,32 @@ ProgramOptions::parse(int argc, char **argv)
     o->logging_level = boost::log::trivial::severity_level::info;
   }
 
+  if (role_map.find(role_str) != role_map.end()) {
+    o->role = role_map[role_str];
+  } else {
+    throw std::runtime_error("Unknown process role " + role_str);
+  }
+
+  if (queue_engine_map.find(queue_engine_str) != queue_engine_map.end()) {
+    o->queue_engine = queue_engine_map[queue_engine_str];
+  } else {
+    throw std::runtime_error("Unknown metadata queue engine " + queue_engine_str);
+  }
+
+  if (o->role != ProcessRole::ALL && vm["queue-engine"].defaulted()) {
+    o->queue_engine = MetadataQueueEngine::SHM;
+  }
+
+  if (injection_mode_map.find(injection_str) != injection_mode_map.end()) {
+    o->output.injection = injection_mode_map[injection_str];
+  } else {
+    throw std::runtime_error("Unknown injection mode " + injection_str);
+  }
+
   o->start_input_name = boost_optional_to_std(start_input_name);
   o->logging_thread = boost_optional_to_std(log_thread_name);
   o->norestart = vm.count("no-restart") > 0;
+  o->snapshot_file = boost_optional_to_std(snapshot_file);
 
   o->output.source_format = boost_optional_to_std(output_source_format);
   o->output.sink_format = boost_optional_to_std(output_sink_format);
@@ -252,18 +423,72 @@ ProgramOptions::validate() const
     }
   }
 
-  if (output.source.empty()) {
+  if (runs_injector() && output.source.empty()) {
     LOG(error) << "Output source missing";
     terminate = true;
   }
 
-  if (output.sink.empty()) {
+  if (runs_injector() && output.sink.empty()) {
     LOG(error) << "Output sink missing";
     terminate = true;
   }
 
+  if (role != ProcessRole::ALL && queue_engine != MetadataQueueEngine::SHM) {
+    LOG(error) << "Process role " << role << " requires " << MetadataQueueEngine::SHM << " metadata queue engine";
+    terminate = true;
+  }
+
+  if (!extract_inputs.empty() && role != ProcessRole::EXTRACTOR) {
+    LOG(error) << "Inputs to extract may be given with " << ProcessRole::EXTRACTOR << " role only";
+    terminate = true;
+  }
+
+  for (const auto &name : extract_inputs) {
+    if (std::none_of(user_inputs.begin(), user_inputs.end(), [&](const auto &is) { return is.name == name; })) {
+      LOG(error) << "Unknown input to extract " << name;
+      terminate = true;
+    }
+  }
+
+  if (snapshot_file && (queue_engine == MetadataQueueEngine::RING || queue_engine == MetadataQueueEngine::SHM)) {
+    LOG(error) << "Metadata queue engine " << queue_engine << " does not support snapshots";
+    terminate = true;
+  }
+
+  if (snapshot_file && snapshot_interval == 0) {
+    LOG(error) << "Snapshot interval must be positive";
+    terminate = true;
+  }
+
   if (terminate) {
     throw std::runtime_error("Invalid options provided, terminating");
   }
 }
+
+SharedQueueSpec
+ProgramOptions::shared_queue_spec() const
+{
+  // FNV-1a hash of input names in id order
+  uint64_t fingerprint = 0xcbf29ce484222325;
+  for (const auto &is : user_inputs) {
+    for (char c : is.name + '\0') {
+      fingerprint = (fingerprint ^ static_cast<uint8_t>(c)) * 0x100000001b3;
+    }
+  }
+
+  SharedQueueSpec spec = shared_queue;
+  spec.lane_count = user_inputs.size() + 1;
+  spec.input_fingerprint = fingerprint;
+  return spec;
+}
+
+bool
+ProgramOptions::runs_extractor(const InputSpec &is) const
+{
+  if (role == ProcessRole::INJECTOR) {
+    return false;
+  }
+  return extract_inputs.empty() ||
+         std::find(extract_inputs.begin(), extract_inputs.end(), is.name) != extract_inputs.end();
+}
 }
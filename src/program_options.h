@@ -2,14 +2,39 @@
 
 #include <iostream>
 #include <map>
+#include <ostream>
 #include <string>
 #include <vector>
 
 #include "iospec.h"
 #include "log.h"
+#include "metadata_queue.h"
+#include "snapshot.h"
 
 namespace metamix {
 
+/// Components run by Metamix process.
+enum class ProcessRole
+{
+  ALL,       ///< Extractors, injector and REST API in single process.
+  EXTRACTOR, ///< Extractors only, feeding metadata queues in shared memory.
+  INJECTOR,  ///< Injector and REST API, consuming metadata queues in shared memory.
+};
+
+inline std::ostream &
+operator<<(std::ostream &os, ProcessRole role)
+{
+  switch (role) {
+  case ProcessRole::ALL:
+    return os << "all";
+  case ProcessRole::EXTRACTOR:
+    return os << "extractor";
+  case ProcessRole::INJECTOR:
+    return os << "injector";
+  }
+  return os << "unknown";
+}
+
 struct ProgramOptions
 {
   std::vector<InputSpec> user_inputs{};
@@ -25,8 +50,29 @@ struct ProgramOptions
 
   bool norestart{ false };
 
+  ProcessRole role{ ProcessRole::ALL };
+
+  /// Names of inputs to run extractors of, all user-defined inputs if empty.
+  std::vector<std::string> extract_inputs{};
+
+  MetadataQueueEngine queue_engine{ MetadataQueueEngine::HEAP };
+  QueueBudgets queue_budgets{};
+  SharedQueueSpec shared_queue{};
+
+  std::optional<std::string> snapshot_file{};
+  unsigned int snapshot_interval{ 100 };
+  size_t snapshot_size{ SnapshotFile::DEFAULT_SLOT_CAPACITY };
+
   static ProgramOptions *parse(int argc, char *argv[]);
 
   void validate() const;
+
+  /// Shared memory settings of SHM engine, with a ring for the clear input and every user input, whose ids are given
+  /// by order of their options.
+  SharedQueueSpec shared_queue_spec() const;
+
+  bool runs_extractor(const InputSpec &is) const;
+
+  bool runs_injector() const noexcept { return role != ProcessRole::EXTRACTOR; }
 };
 }
@@ -0,0 +1,184 @@
+#pragma once
+
+#include <cstddef>
+#include <map>
+#include <ostream>
+#include <string>
+#include <type_traits>
+
+#include "input_generations.h"
+#include "metadata.h"
+
+namespace metamix {
+
+/// What metadata queue does when pushing an entry would exceed its budget.
+enum class EvictionPolicy
+{
+  DROP_OLDEST, ///< Evict earliest entries, of the same input if input budget is exceeded.
+  DROP_NEWEST, ///< Reject the entry being pushed.
+  NEVER_EVICT, ///< Ignore the budget.
+};
+
+inline std::ostream &
+operator<<(std::ostream &os, EvictionPolicy policy)
+{
+  switch (policy) {
+  case EvictionPolicy::DROP_OLDEST:
+    return os << "drop-oldest";
+  case EvictionPolicy::DROP_NEWEST:
+    return os << "drop-newest";
+  case EvictionPolicy::NEVER_EVICT:
+    return os << "never-evict";
+  }
+  return os << "unknown";
+}
+
+/// Whether metadata of given kind may be evicted from over-budget queue. Losing a splice cue breaks ad insertion
+/// downstream, while SCTE-35 traffic is too sparse to matter for memory.
+template<class K>
+inline constexpr bool is_evictable_kind = true;
+
+template<>
+inline constexpr bool is_evictable_kind<ScteKind> = false;
+
+/// Approximate memory held by metadata value. Value types owning dynamic storage provide their own overload, which is
+/// found by argument-dependent lookup.
+template<class T>
+inline size_t
+metadata_value_bytes(const T &)
+{
+  return sizeof(T);
+}
+
+/// Approximate memory held by queued metadata entry.
+template<class K>
+inline size_t
+metadata_footprint(const Metadata<K> &meta)
+{
+  return sizeof(Metadata<K>) + metadata_value_bytes(*meta.val);
+}
+
+/**
+ * @brief Limits of single metadata queue. Zero means unlimited.
+ *
+ * Total limits count every stored entry, input limits count live entries of one input.
+ */
+struct QueueBudget
+{
+  size_t max_entries{ 0 };
+  size_t max_bytes{ 0 };
+  size_t max_input_entries{ 0 };
+  size_t max_input_bytes{ 0 };
+  EvictionPolicy policy{ EvictionPolicy::DROP_OLDEST };
+
+  bool is_bounded() const noexcept
+  {
+    return policy != EvictionPolicy::NEVER_EVICT &&
+           (max_entries > 0 || max_bytes > 0 || max_input_entries > 0 || max_input_bytes > 0);
+  }
+
+  /// Budget to apply to queue of given metadata kind.
+  template<class K>
+  QueueBudget for_kind() const noexcept
+  {
+    QueueBudget budget = *this;
+    if constexpr (!is_evictable_kind<K>) {
+      budget.policy = EvictionPolicy::NEVER_EVICT;
+    }
+    return budget;
+  }
+
+  /// Makes room for new entry of given input and size, evicting entries according to policy.
+  ///
+  /// \param id              input id of the new entry
+  /// \param bytes           footprint of the new entry
+  /// \param stored_entries  count of entries stored in queue, kept up to date by eviction callables
+  /// \param stored_bytes    footprint of entries stored in queue, kept up to date by eviction callables
+  /// \param generations     live entry accounting of the queue
+  /// \param evict_oldest    callable evicting earliest entry in queue, returns false if there is nothing to evict
+  /// \param evict_input     callable evicting earliest entry of given input, returns false if there is nothing to evict
+  /// \return true if the new entry should be enqueued, false if it should be rejected
+  template<class EvictOldest, class EvictInput>
+  bool make_room(InputId id,
+                 size_t bytes,
+                 const size_t &stored_entries,
+                 const size_t &stored_bytes,
+                 const InputGenerations &generations,
+                 EvictOldest &&evict_oldest,
+                 EvictInput &&evict_input) const
+  {
+    if (!is_bounded()) {
+      return true;
+    }
+
+    for (;;) {
+      bool input_over = exceeds(generations.live(id) + 1, max_input_entries) ||
+                        exceeds(generations.live_bytes(id) + bytes, max_input_bytes);
+      bool total_over = exceeds(stored_entries + 1, max_entries) || exceeds(stored_bytes + bytes, max_bytes);
+
+      if (!input_over && !total_over) {
+        return true;
+      }
+
+      if (policy == EvictionPolicy::DROP_NEWEST) {
+        return false;
+      }
+
+      if (!(input_over ? evict_input(id) : evict_oldest())) {
+        // New entry alone does not fit.
+        return false;
+      }
+    }
+  }
+
+private:
+  static bool exceeds(size_t value, size_t limit) noexcept { return limit > 0 && value > limit; }
+};
+
+/**
+ * @brief Budgets of metadata queues of all kinds: common one, and ones overriding it for single kinds.
+ *
+ * Overrides are keyed by API name of metadata kind.
+ */
+struct QueueBudgets
+{
+  QueueBudget common{};
+  std::map<std::string, QueueBudget> kinds{};
+
+  /// Budget to apply to queue of given metadata kind.
+  template<class K>
+  QueueBudget for_kind() const
+  {
+    if (auto it = kinds.find(K::API_NAME); it != kinds.end()) {
+      return it->second;
+    }
+    return common.template for_kind<K>();
+  }
+
+  /// Budget of given metadata kind to be overridden, initialized with the common one.
+  template<class K>
+  QueueBudget &override_kind()
+  {
+    auto it = kinds.find(K::API_NAME);
+    if (it == kinds.end()) {
+      it = kinds.emplace(K::API_NAME, common.template for_kind<K>()).first;
+    }
+    return it->second;
+  }
+};
+
+/// Usage and eviction counters of single metadata queue.
+struct QueueStats
+{
+  size_t entries{ 0 };
+  size_t bytes{ 0 };
+  size_t evicted_entries{ 0 };
+  size_t evicted_bytes{ 0 };
+
+  /// Entries dropped on push for being earlier than what the consumer has already passed.
+  size_t late_entries{ 0 };
+
+  /// Buffers which have been grown, because they were full and their entries may not be evicted.
+  size_t grown_buffers{ 0 };
+};
+}
@@ -0,0 +1,246 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <limits>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <ostream>
+
+#include "clock_types.h"
+#include "iospec.h"
+
+namespace metamix {
+
+/// Why metadata queue dropped an entry instead of handing it to the consumer.
+enum class DropReason
+{
+  STALE,         ///< Entry was earlier than the consumer's lookup window, or collided with popped entry.
+  FOREIGN_INPUT, ///< Entry was passed while the consumer was reading another input.
+  DROP_ID,       ///< Entry was dropped together with its input, see `drop_id`.
+};
+
+inline std::ostream &
+operator<<(std::ostream &os, DropReason reason)
+{
+  switch (reason) {
+  case DropReason::STALE:
+    return os << "stale";
+  case DropReason::FOREIGN_INPUT:
+    return os << "foreign-input";
+  case DropReason::DROP_ID:
+    return os << "drop-id";
+  }
+  return os << "unknown";
+}
+
+/// Reason of dropping entry, which has been passed by a pop for input `id` looking up values since `since`.
+template<class M>
+inline DropReason
+passed_drop_reason(const M &meta, InputId id, TS since) noexcept
+{
+  return meta.pts >= since && meta.input_id != id ? DropReason::FOREIGN_INPUT : DropReason::STALE;
+}
+
+/// Drop observer of metadata queue engines, which ignores drops.
+struct IgnoreDrops
+{
+  template<class M>
+  void operator()(const M &, DropReason) const noexcept
+  {}
+};
+
+/**
+ * @brief Lock-free histogram of durations, with fixed buckets on millisecond scale.
+ *
+ * Durations are given in clock ticks of 1/SYS_CLOCK_RATE.
+ */
+class LatencyHistogram
+{
+public:
+  /// Inclusive upper bounds of buckets in milliseconds, the last bucket holds everything longer.
+  static constexpr std::array<TS, 14> BOUNDS_MS{ 0, 1, 2, 5, 10, 20, 50, 100, 200, 500, 1000, 2000, 5000, 10000 };
+  static constexpr size_t BUCKET_COUNT = BOUNDS_MS.size() + 1;
+
+  struct Counts
+  {
+    std::array<uint64_t, BUCKET_COUNT> buckets{};
+    uint64_t count{ 0 };
+    ClockTS sum{ 0 };
+  };
+
+private:
+  std::array<std::atomic<uint64_t>, BUCKET_COUNT> m_buckets{};
+  std::atomic<uint64_t> m_count{ 0 };
+  std::atomic<TS> m_sum{ 0 };
+
+public:
+  /// Records single duration, negative ones are clamped to zero.
+  void record(ClockTS duration) noexcept
+  {
+    TS ticks = std::max(duration.val, TS(0));
+    m_buckets[bucket_of(ticks)].fetch_add(1, std::memory_order_relaxed);
+    m_count.fetch_add(1, std::memory_order_relaxed);
+    m_sum.fetch_add(ticks, std::memory_order_relaxed);
+  }
+
+  /// Approximately consistent copy of counters, they are read one by one.
+  Counts counts() const noexcept
+  {
+    Counts c{};
+    for (size_t i = 0; i < BUCKET_COUNT; i++) {
+      c.buckets[i] = m_buckets[i].load(std::memory_order_relaxed);
+    }
+    c.count = m_count.load(std::memory_order_relaxed);
+    c.sum = ClockTS(m_sum.load(std::memory_order_relaxed));
+    return c;
+  }
+
+  static size_t bucket_of(TS ticks) noexcept
+  {
+    for (size_t i = 0; i < BOUNDS_MS.size(); i++) {
+      if (ticks * 1000 <= BOUNDS_MS[i] * SYS_CLOCK_RATE) {
+        return i;
+      }
+    }
+    return BOUNDS_MS.size();
+  }
+};
+
+/**
+ * @brief Per-input health metrics of single metadata queue: residency time histogram, drop counters and timestamp of
+ * the newest entry.
+ *
+ * Counters of each input live in a lane allocated on first use, recording is lock-free afterwards, so that both
+ * producers and the consumer may record concurrently. Inputs with ids of `MAX_INPUTS` and above are not tracked.
+ */
+class QueueMetrics
+{
+public:
+  static constexpr size_t MAX_INPUTS = 256;
+
+  struct InputMetrics
+  {
+    LatencyHistogram::Counts residency{};
+    std::optional<ClockTS> newest_pts{};
+    uint64_t dropped_stale{ 0 };
+    uint64_t dropped_foreign_input{ 0 };
+    uint64_t dropped_drop_id{ 0 };
+  };
+
+private:
+  static constexpr TS NO_PTS = std::numeric_limits<TS>::min();
+
+  struct Lane
+  {
+    LatencyHistogram residency{};
+    std::atomic<TS> newest_pts{ NO_PTS };
+    std::array<std::atomic<uint64_t>, 3> dropped{};
+  };
+
+  std::mutex m_lanes_mutex{};
+  std::array<std::unique_ptr<Lane>, MAX_INPUTS> m_lanes_storage{};
+  std::array<std::atomic<Lane *>, MAX_INPUTS> m_lanes{};
+
+public:
+  QueueMetrics() = default;
+
+  QueueMetrics(const QueueMetrics &) = delete;
+  QueueMetrics &operator=(const QueueMetrics &) = delete;
+
+  /// Records entry of given input pushed to queue.
+  void record_push(InputId id, ClockTS pts)
+  {
+    if (Lane *lane = get_or_create_lane(id)) {
+      TS newest = lane->newest_pts.load(std::memory_order_relaxed);
+      while (newest < pts.val && !lane->newest_pts.compare_exchange_weak(newest, pts.val, std::memory_order_relaxed)) {
+      }
+    }
+  }
+
+  /// Records entry of given input handed to the consumer, after spending `residency` in queue.
+  void record_pop(InputId id, ClockTS residency)
+  {
+    if (Lane *lane = get_or_create_lane(id)) {
+      lane->residency.record(residency);
+    }
+  }
+
+  /// Records `count` entries of given input dropped for given reason.
+  void record_drop(InputId id, DropReason reason, uint64_t count = 1)
+  {
+    if (count == 0) {
+      return;
+    }
+    if (Lane *lane = get_or_create_lane(id)) {
+      lane->dropped[static_cast<size_t>(reason)].fetch_add(count, std::memory_order_relaxed);
+    }
+  }
+
+  /// Metrics of given input, or nothing if nothing has been recorded for it.
+  std::optional<InputMetrics> get(InputId id) const noexcept
+  {
+    Lane *lane = find_lane(id);
+    if (lane == nullptr) {
+      return std::nullopt;
+    }
+    return read(*lane);
+  }
+
+  /// Calls `f(InputId, const InputMetrics &)` for every input with recorded metrics.
+  template<class F>
+  void for_each_input(F &&f) const
+  {
+    for (size_t i = 0; i < MAX_INPUTS; i++) {
+      if (Lane *lane = m_lanes[i].load(std::memory_order_acquire); lane != nullptr) {
+        f(static_cast<InputId>(i), read(*lane));
+      }
+    }
+  }
+
+private:
+  Lane *find_lane(InputId id) const noexcept
+  {
+    if (id >= MAX_INPUTS) {
+      return nullptr;
+    }
+    return m_lanes[id].load(std::memory_order_acquire);
+  }
+
+  Lane *get_or_create_lane(InputId id)
+  {
+    if (Lane *lane = find_lane(id); lane != nullptr || id >= MAX_INPUTS) {
+      return lane;
+    }
+
+    std::lock_guard<std::mutex> guard(m_lanes_mutex);
+
+    if (!m_lanes_storage[id]) {
+      m_lanes_storage[id] = std::make_unique<Lane>();
+      m_lanes[id].store(m_lanes_storage[id].get(), std::memory_order_release);
+    }
+
+    return m_lanes_storage[id].get();
+  }
+
+  static InputMetrics read(const Lane &lane) noexcept
+  {
+    InputMetrics metrics{};
+    metrics.residency = lane.residency.counts();
+
+    TS newest = lane.newest_pts.load(std::memory_order_relaxed);
+    if (newest != NO_PTS) {
+      metrics.newest_pts = ClockTS(newest);
+    }
+
+    metrics.dropped_stale = lane.dropped[static_cast<size_t>(DropReason::STALE)].load(std::memory_order_relaxed);
+    metrics.dropped_foreign_input =
+      lane.dropped[static_cast<size_t>(DropReason::FOREIGN_INPUT)].load(std::memory_order_relaxed);
+    metrics.dropped_drop_id = lane.dropped[static_cast<size_t>(DropReason::DROP_ID)].load(std::memory_order_relaxed);
+    return metrics;
+  }
+};
+}
@@ -0,0 +1,461 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cassert>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <stdexcept>
+#include <tuple>
+#include <type_traits>
+#include <vector>
+
+#include "metadata.h"
+#include "queue_budget.h"
+#include "queue_metrics.h"
+#include "spsc_ring.h"
+
+namespace metamix {
+
+/**
+ * @brief Metadata queue keeping separate lock-free ring for each input.
+ *
+ * Each input is expected to be fed by exactly one producer thread (its extractor), and the whole queue is expected to
+ * be consumed by exactly one thread (the injector). Producers never block, neither on each other nor on the consumer.
+ *
+ * Extractors push metadata in decode order, which differs from pts order by at most a few frames with B-frames. The
+ * consumer stages ring heads into a small per-input reorder window, kept as a min-heap by pts, and popping is a merge
+ * over window heads: the consumer only walks the requested input's window and sweeps heads of other windows up to a
+ * watermark, dropping everything the output has already passed. Entries reordered further than `REORDER_WINDOW` are
+ * popped late and may be dropped as stale.
+ *
+ * Only per-input entry budget is supported, as the capacity of each ring, and full ring drops newest entry: producers
+ * can't evict from the consumer's end of the ring. With NEVER_EVICT policy, full ring is chained to a new one of double
+ * capacity instead, which the consumer moves to once it drains the full one. Outgrown rings are kept until the queue is
+ * destroyed, so that other threads may read their positions at any time.
+ *
+ * Rings can't be read by a third thread, so this engine does not support snapshots.
+ */
+template<class K>
+class RingMetadataQueue
+{
+public:
+  using Self = RingMetadataQueue<K>;
+  using Kind = K;
+  using MetaType = Metadata<K>;
+  using ValueType = typename MetaType::ValueType;
+
+  static constexpr size_t MAX_INPUTS = 256;
+  static constexpr size_t DEFAULT_LANE_CAPACITY = 4096;
+
+  /// Count of entries of one input which are sorted by pts before popping, covers reordering of H.264 B-frames.
+  static constexpr size_t REORDER_WINDOW = 64;
+
+private:
+  struct Segment
+  {
+    SpscRing<MetaType> ring;
+
+    /// Ring the producer moved on to, set after its last push to this one.
+    std::atomic<Segment *> next{ nullptr };
+
+    Segment(size_t capacity, size_t position)
+      : ring(capacity, position)
+    {}
+  };
+
+  /// Entry moved from ring into reorder window, with the ring position it has been read from.
+  struct Staged
+  {
+    size_t position;
+    MetaType value;
+
+    /// Heap order putting the earliest entry on top, entries of equal pts keep their push order.
+    friend bool operator<(const Staged &lhs, const Staged &rhs) noexcept
+    {
+      return std::tie(lhs.value.pts, lhs.position) > std::tie(rhs.value.pts, rhs.position);
+    }
+  };
+
+  struct Lane
+  {
+    /// All rings of the lane, appended by the producer only.
+    std::vector<std::unique_ptr<Segment>> segments{};
+
+    /// Ring read by the consumer.
+    std::atomic<Segment *> read{ nullptr };
+
+    /// Ring written by the producer, positions continue those of previous rings.
+    std::atomic<Segment *> write{ nullptr };
+
+    /// Ring position before which all entries are to be discarded by the consumer, set by `drop_id`.
+    std::atomic<size_t> discard_until{ 0 };
+
+    /// Reorder window, heap of entries read from rings by the consumer and not popped yet.
+    std::vector<Staged> staged{};
+
+    /// Size of the reorder window, for threads other than the consumer.
+    std::atomic<size_t> staged_count{ 0 };
+
+    explicit Lane(size_t capacity)
+    {
+      staged.reserve(REORDER_WINDOW);
+      segments.push_back(std::make_unique<Segment>(capacity, 0));
+      read.store(segments.back().get(), std::memory_order_relaxed);
+      write.store(segments.back().get(), std::memory_order_relaxed);
+    }
+  };
+
+  const size_t m_lane_capacity;
+
+  /// Whether full rings are grown instead of dropping entries.
+  const bool m_growable;
+
+  std::mutex m_lanes_mutex{};
+  std::array<std::unique_ptr<Lane>, MAX_INPUTS> m_lanes_storage{};
+  std::array<std::atomic<Lane *>, MAX_INPUTS> m_lanes{};
+  std::atomic<size_t> m_lanes_bound{ 0 };
+
+  std::atomic<size_t> m_overflow_count{ 0 };
+  std::atomic<size_t> m_grow_count{ 0 };
+
+public:
+  /// \param policy  NEVER_EVICT grows full rings, any other policy drops newest entries
+  explicit RingMetadataQueue(size_t lane_capacity = DEFAULT_LANE_CAPACITY,
+                             EvictionPolicy policy = EvictionPolicy::DROP_NEWEST)
+    : m_lane_capacity{ lane_capacity }
+    , m_growable{ policy == EvictionPolicy::NEVER_EVICT }
+  {}
+
+  RingMetadataQueue(const Self &) = delete;
+  Self &operator=(const Self &) = delete;
+
+  bool empty() const noexcept { return size() == 0; }
+
+  size_t size() const noexcept
+  {
+    size_t sum = 0;
+    for_each_lane([&](Lane &lane, InputId) { sum += live_size(lane); });
+    return sum;
+  }
+
+  /// Count of entries which have been rejected, because their input ring was full.
+  size_t overflow_count() const noexcept { return m_overflow_count.load(std::memory_order_relaxed); }
+
+  /// Count of full rings which have been grown, see NEVER_EVICT policy.
+  size_t grow_count() const noexcept { return m_grow_count.load(std::memory_order_relaxed); }
+
+  /// Usage and eviction counters, footprint is not tracked by this engine.
+  QueueStats stats() const noexcept
+  {
+    QueueStats stats{};
+    stats.entries = size();
+    stats.evicted_entries = overflow_count();
+    stats.grown_buffers = grow_count();
+    return stats;
+  }
+
+  /// Pushes value to the ring of its input. Must be called from the input's producer thread only.
+  ///
+  /// If the ring is full, value is dropped and accounted in `overflow_count()`, or the ring is grown if entries may not
+  /// be dropped. The producer never blocks.
+  void push(MetaType value)
+  {
+    InputId id = value.input_id;
+    Lane &lane = get_or_create_lane(id);
+    if (lane.write.load(std::memory_order_relaxed)->ring.try_push(std::move(value))) {
+      return;
+    }
+
+    if (m_growable) {
+      grow(lane, 1).ring.try_push(std::move(value));
+    } else {
+      m_overflow_count.fetch_add(1, std::memory_order_relaxed);
+    }
+  }
+
+  /// Pushes values to rings of their inputs, publishing each run of consecutive values of one input at once. Must be
+  /// called from the producer thread of these inputs only.
+  template<class ForwardIt>
+  void push_range(ForwardIt first, ForwardIt last)
+  {
+    while (first != last) {
+      InputId id = static_cast<const MetaType &>(*first).input_id;
+      ForwardIt run_last = std::find_if(std::next(first), last, [&](const MetaType &m) { return m.input_id != id; });
+
+      Lane &lane = get_or_create_lane(id);
+      size_t count = std::distance(first, run_last);
+      size_t pushed = lane.write.load(std::memory_order_relaxed)->ring.try_push_range(first, run_last);
+      if (pushed < count && m_growable) {
+        grow(lane, count - pushed).ring.try_push_range(std::next(first, pushed), run_last);
+      } else if (pushed < count) {
+        m_overflow_count.fetch_add(count - pushed, std::memory_order_relaxed);
+      }
+
+      first = run_last;
+    }
+  }
+
+  /// Pops value earliest in given time frame, assigned to given input id from queue.
+  /// Drops all values of other inputs up to popped value, inclusive, or up to `until` if nothing has been popped.
+  ///
+  /// \param id       input id, popped value must by assigned to it, other values will be dropped
+  /// \param since    start time for lookup, inclusive
+  /// \param until    end time for lookup, exclusive
+  /// \param on_drop  called with each dropped live value and DropReason
+  /// \return popped value or nothing if queue is empty
+  template<class OnDrop = IgnoreDrops>
+  std::optional<MetaType> pop(InputId id, TS since, TS until, OnDrop &&on_drop = {})
+  {
+    std::optional<MetaType> result{};
+
+    if (Lane *lane = find_lane(id); lane != nullptr) {
+      while (MetaType *head = staged_front(*lane)) {
+        if (head->pts >= until) {
+          break;
+        }
+
+        bool in_range = head->pts >= since;
+        if (in_range) {
+          result.emplace(std::move(*head));
+        } else {
+          on_drop(*head, DropReason::STALE);
+        }
+
+        pop_staged(*lane);
+
+        if (in_range) {
+          break;
+        }
+      }
+    }
+
+    sweep(id, since, result ? result->pts.val + 1 : until, on_drop);
+    return result;
+  }
+
+  /// Pops all values in given time frame, assigned to given input id from queue. Moves popped value to output iterator.
+  /// Drops all other values since queue begin to `until` time from queue.
+  ///
+  /// \tparam     OutputIt  output iterator type
+  /// \param      id        input id, popped value must by assigned to it, other values will be dropped
+  /// \param      since     start time for lookup, inclusive
+  /// \param      until     end time for lookup, exclusive
+  /// \param[out] out       output iterator, popped values will be moved here
+  /// \param      on_drop   called with each dropped live value and DropReason
+  /// \return               count of popped items
+  template<class OutputIt, class OnDrop = IgnoreDrops>
+  unsigned int pop_all(InputId id, TS since, TS until, OutputIt out, OnDrop &&on_drop = {})
+  {
+    static_assert(
+      std::is_base_of<std::output_iterator_tag, typename std::iterator_traits<OutputIt>::iterator_category>::value,
+      "output iterator must be of output iterator category");
+
+    unsigned int count = 0;
+
+    if (Lane *lane = find_lane(id); lane != nullptr) {
+      while (MetaType *head = staged_front(*lane)) {
+        if (head->pts >= until) {
+          break;
+        }
+
+        if (head->pts >= since) {
+          *out++ = std::move(*head);
+          count++;
+        } else {
+          on_drop(*head, DropReason::STALE);
+        }
+
+        pop_staged(*lane);
+      }
+    }
+
+    sweep(id, since, until, on_drop);
+    return count;
+  }
+
+  /// Marks all entries of given input, pushed so far, for removal. Must be called from the input's producer thread.
+  ///
+  /// Entries are released lazily by the consumer, this call does not touch the ring contents.
+  ///
+  /// \return count of dropped entries
+  size_t drop_id(InputId id)
+  {
+    Lane *lane = find_lane(id);
+    if (lane == nullptr) {
+      return 0;
+    }
+
+    size_t dropped = live_size(*lane);
+    lane->discard_until.store(lane->write.load(std::memory_order_relaxed)->ring.tail_position(),
+                              std::memory_order_release);
+    return dropped;
+  }
+
+  /// Rings may be read by their consumer only, so this engine can't be snapshotted.
+  template<class OutputIt>
+  void snapshot(OutputIt)
+  {
+    throw std::logic_error("ring metadata queue does not support snapshots");
+  }
+
+private:
+  Lane *find_lane(InputId id) const noexcept
+  {
+    if (id >= MAX_INPUTS) {
+      return nullptr;
+    }
+    return m_lanes[id].load(std::memory_order_acquire);
+  }
+
+  Lane &get_or_create_lane(InputId id)
+  {
+    if (Lane *lane = find_lane(id); lane != nullptr) {
+      return *lane;
+    }
+
+    if (id >= MAX_INPUTS) {
+      throw std::out_of_range("input id exceeds ring metadata queue capacity");
+    }
+
+    std::lock_guard<std::mutex> guard(m_lanes_mutex);
+
+    if (!m_lanes_storage[id]) {
+      m_lanes_storage[id] = std::make_unique<Lane>(m_lane_capacity);
+      m_lanes[id].store(m_lanes_storage[id].get(), std::memory_order_release);
+
+      size_t bound = m_lanes_bound.load(std::memory_order_relaxed);
+      m_lanes_bound.store(std::max(bound, static_cast<size_t>(id) + 1), std::memory_order_release);
+    }
+
+    return *m_lanes_storage[id];
+  }
+
+  /// Chains full write ring of lane to a new ring of double capacity, at least `needed`. Called by the producer.
+  Segment &grow(Lane &lane, size_t needed)
+  {
+    Segment *full = lane.write.load(std::memory_order_relaxed);
+    size_t capacity = std::max(full->ring.capacity() * 2, needed);
+    lane.segments.push_back(std::make_unique<Segment>(capacity, full->ring.tail_position()));
+
+    Segment *next = lane.segments.back().get();
+    full->next.store(next, std::memory_order_release);
+    lane.write.store(next, std::memory_order_release);
+    m_grow_count.fetch_add(1, std::memory_order_relaxed);
+    return *next;
+  }
+
+  template<class F>
+  void for_each_lane(F &&f) const
+  {
+    size_t bound = m_lanes_bound.load(std::memory_order_acquire);
+    for (size_t i = 0; i < bound; i++) {
+      if (Lane *lane = m_lanes[i].load(std::memory_order_acquire); lane != nullptr) {
+        f(*lane, static_cast<InputId>(i));
+      }
+    }
+  }
+
+  static size_t live_size(const Lane &lane) noexcept
+  {
+    size_t discard_until = lane.discard_until.load(std::memory_order_acquire);
+    size_t read = lane.read.load(std::memory_order_acquire)->ring.head_position();
+    size_t head = std::max(read, discard_until);
+    size_t tail = lane.write.load(std::memory_order_acquire)->ring.tail_position();
+
+    // Staged entries have been read before the ring head, all of them are dropped once the head is.
+    size_t staged = discard_until < read ? lane.staged_count.load(std::memory_order_acquire) : 0;
+    return (tail > head ? tail - head : 0) + staged;
+  }
+
+  /// Returns the first entry in lane which has not been dropped with `drop_id`, releasing dropped ones on the way.
+  /// Moves on to the next ring of grown lane once the current one is drained.
+  static MetaType *live_front(Lane &lane) noexcept
+  {
+    size_t discard_until = lane.discard_until.load(std::memory_order_acquire);
+
+    for (;;) {
+      Segment *segment = lane.read.load(std::memory_order_relaxed);
+      SpscRing<MetaType> &ring = segment->ring;
+      while (ring.head_position() < discard_until && ring.pop()) {
+      }
+
+      if (MetaType *head = ring.front(); head != nullptr) {
+        return head;
+      }
+
+      // Last push to the drained ring is visible once the next ring is, check it again before moving on.
+      Segment *next = segment->next.load(std::memory_order_acquire);
+      if (next == nullptr) {
+        return nullptr;
+      }
+      if (ring.front() == nullptr) {
+        lane.read.store(next, std::memory_order_release);
+      }
+    }
+  }
+
+  /// Destroys the first entry in lane, which has been returned by `live_front`.
+  static void pop_front(Lane &lane) noexcept { lane.read.load(std::memory_order_relaxed)->ring.pop(); }
+
+  /// Returns the earliest entry of lane's reorder window, after filling the window from lane's rings. Releases entries
+  /// dropped with `drop_id` on the way.
+  static MetaType *staged_front(Lane &lane) noexcept
+  {
+    std::vector<Staged> &staged = lane.staged;
+
+    size_t discard_until = lane.discard_until.load(std::memory_order_acquire);
+    auto discarded = std::remove_if(
+      staged.begin(), staged.end(), [&](const Staged &s) { return s.position < discard_until; });
+    if (discarded != staged.end()) {
+      staged.erase(discarded, staged.end());
+      std::make_heap(staged.begin(), staged.end());
+    }
+
+    while (staged.size() < REORDER_WINDOW) {
+      MetaType *head = live_front(lane);
+      if (head == nullptr) {
+        break;
+      }
+
+      size_t position = lane.read.load(std::memory_order_relaxed)->ring.head_position();
+      staged.push_back(Staged{ position, std::move(*head) });
+      std::push_heap(staged.begin(), staged.end());
+      pop_front(lane);
+    }
+
+    lane.staged_count.store(staged.size(), std::memory_order_release);
+    return staged.empty() ? nullptr : &staged.front().value;
+  }
+
+  /// Destroys the earliest entry of lane's reorder window, which has been returned by `staged_front`.
+  static void pop_staged(Lane &lane) noexcept
+  {
+    std::pop_heap(lane.staged.begin(), lane.staged.end());
+    lane.staged.pop_back();
+    lane.staged_count.store(lane.staged.size(), std::memory_order_release);
+  }
+
+  /// Drops entries of all inputs other than `id` earlier than `watermark`, for a pop looking up values since `since`.
+  template<class OnDrop>
+  void sweep(InputId id, TS since, TS watermark, OnDrop &on_drop)
+  {
+    for_each_lane([&](Lane &lane, InputId lane_id) {
+      if (lane_id == id) {
+        return;
+      }
+
+      while (MetaType *head = staged_front(lane)) {
+        if (head->pts >= watermark) {
+          break;
+        }
+        on_drop(*head, passed_drop_reason(*head, id, since));
+        pop_staged(lane);
+      }
+    });
+  }
+};
+}
@@ -0,0 +1,117 @@
+#include "shared_memory.h"
+
+#include <cerrno>
+#include <chrono>
+#include <stdexcept>
+#include <system_error>
+#include <thread>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace metamix {
+
+namespace {
+
+/// How long to wait for the creating process to size the object.
+constexpr auto SIZE_WAIT_TIMEOUT = std::chrono::seconds(1);
+constexpr auto SIZE_WAIT_STEP = std::chrono::milliseconds(10);
+
+size_t
+object_size(int fd, const std::string &name)
+{
+  struct stat st;
+  if (::fstat(fd, &st) < 0) {
+    throw std::system_error(errno, std::generic_category(), "Failed reading shared memory size of " + name);
+  }
+  return static_cast<size_t>(st.st_size);
+}
+}
+
+SharedMemory::SharedMemory(std::string name, size_t size)
+  : m_name{ std::move(name) }
+  , m_size{ size }
+{
+  m_fd = ::shm_open(m_name.c_str(), O_RDWR | O_CREAT | O_EXCL, 0600);
+  if (m_fd >= 0) {
+    m_created = true;
+  } else if (errno == EEXIST) {
+    m_fd = ::shm_open(m_name.c_str(), O_RDWR, 0600);
+  }
+
+  if (m_fd < 0) {
+    throw std::system_error(errno, std::generic_category(), "Failed opening shared memory " + m_name);
+  }
+
+  try {
+    if (m_created) {
+      if (::ftruncate(m_fd, static_cast<off_t>(size)) < 0) {
+        throw std::system_error(errno, std::generic_category(), "Failed resizing shared memory " + m_name);
+      }
+    } else {
+      // Creating process may not have sized the object yet.
+      size_t existing_size = object_size(m_fd, m_name);
+      for (auto waited = std::chrono::milliseconds(0); existing_size == 0 && waited < SIZE_WAIT_TIMEOUT;
+           waited += SIZE_WAIT_STEP) {
+        std::this_thread::sleep_for(SIZE_WAIT_STEP);
+        existing_size = object_size(m_fd, m_name);
+      }
+
+      if (existing_size != size) {
+        throw std::runtime_error("Shared memory " + m_name + " has size " + std::to_string(existing_size) +
+                                 ", expected " + std::to_string(size) + ", it was created with different settings");
+      }
+    }
+
+    void *data = ::mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, m_fd, 0);
+    if (data == MAP_FAILED) {
+      throw std::system_error(errno, std::generic_category(), "Failed mapping shared memory " + m_name);
+    }
+    m_data = static_cast<uint8_t *>(data);
+  } catch (...) {
+    ::close(m_fd);
+    if (m_created) {
+      ::shm_unlink(m_name.c_str());
+    }
+    throw;
+  }
+}
+
+SharedMemory::~SharedMemory()
+{
+  if (m_data != nullptr) {
+    ::munmap(m_data, m_size);
+  }
+  if (m_fd >= 0) {
+    ::close(m_fd);
+  }
+}
+
+bool
+SharedMemory::unlink(const std::string &name) noexcept
+{
+  return ::shm_unlink(name.c_str()) == 0;
+}
+
+bool
+SharedMemory::try_lock(size_t index)
+{
+  // Open file description locks belong to the descriptor rather than to the process, so they conflict between
+  // instances of one process too.
+  struct flock lock
+  {};
+  lock.l_type = F_WRLCK;
+  lock.l_whence = SEEK_SET;
+  lock.l_start = static_cast<off_t>(index);
+  lock.l_len = 1;
+
+  if (::fcntl(m_fd, F_OFD_SETLK, &lock) == 0) {
+    return true;
+  } else if (errno == EAGAIN || errno == EACCES) {
+    return false;
+  }
+  throw std::system_error(errno, std::generic_category(), "Failed locking shared memory " + m_name);
+}
+}
@@ -0,0 +1,61 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+namespace metamix {
+
+/**
+ * @brief POSIX shared memory object mapped to process memory.
+ *
+ * The object is created zero-filled by the first process opening it and persists until it is unlinked, so that
+ * processes attaching to it later, or restarted ones, find its contents intact.
+ */
+class SharedMemory
+{
+private:
+  std::string m_name;
+  int m_fd{ -1 };
+  uint8_t *m_data{ nullptr };
+  size_t m_size{ 0 };
+  bool m_created{ false };
+
+public:
+  /// Opens shared memory object, creating it if it does not exist.
+  ///
+  /// \param name  object name, starting with slash
+  /// \param size  expected object size
+  /// \throws std::system_error on I/O errors
+  /// \throws std::runtime_error if existing object has different size
+  SharedMemory(std::string name, size_t size);
+
+  ~SharedMemory();
+
+  SharedMemory(const SharedMemory &) = delete;
+  SharedMemory &operator=(const SharedMemory &) = delete;
+
+  const std::string &name() const noexcept { return m_name; }
+
+  uint8_t *data() const noexcept { return m_data; }
+
+  size_t size() const noexcept { return m_size; }
+
+  /// Whether the object has been created by this process, rather than attached to.
+  bool created() const noexcept { return m_created; }
+
+  /// Locks single byte of the object without blocking, through the open file description of this instance. The lock is
+  /// held until the instance is destroyed, and the kernel releases it once its holder dies, so ownership of dead
+  /// processes is taken over while live ones are never mistaken for dead ones.
+  ///
+  /// \param index  index of locked byte, one per owned resource, it may lie past the end of the object
+  /// \return false if another instance, in this or another process, holds the lock
+  /// \throws std::system_error on I/O errors
+  bool try_lock(size_t index);
+
+  /// Removes shared memory object name, existing mappings stay valid.
+  ///
+  /// \return false if there was no such object
+  static bool unlink(const std::string &name) noexcept;
+};
+}
@@ -0,0 +1,689 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <new>
+#include <optional>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <tuple>
+#include <type_traits>
+#include <vector>
+
+#include "metadata.h"
+#include "metadata_codec.h"
+#include "queue_budget.h"
+#include "queue_metrics.h"
+#include "shared_memory.h"
+#include "value_pool.h"
+
+namespace metamix {
+
+/// Shared memory settings of SharedMetadataQueue.
+struct SharedQueueSpec
+{
+  static constexpr size_t DEFAULT_SLOT_SIZE = 256;
+  static constexpr size_t DEFAULT_LANE_COUNT = 16;
+
+  /// Name prefix of shared memory objects, the queue of each kind appends its kind name.
+  std::string name{ "/metamix" };
+
+  /// Size of single entry slot, including its header. Entries with larger values are rejected.
+  size_t slot_size{ DEFAULT_SLOT_SIZE };
+
+  /// Count of rings, one past the highest input id, all processes sharing queues must agree on it.
+  size_t lane_count{ DEFAULT_LANE_COUNT };
+
+  /// Fingerprint of inputs mapped to rings, all processes sharing queues must agree on it.
+  uint64_t input_fingerprint{ 0 };
+};
+
+/**
+ * @brief Metadata queue in POSIX shared memory, fed by producers in other processes.
+ *
+ * Like RingMetadataQueue, it keeps separate lock-free single-producer single-consumer ring for each input, but rings
+ * live in shared memory object and consist of fixed-size slots holding binary representation of metadata. Each input
+ * is fed by exactly one producer process, and the whole queue is consumed by exactly one consumer process. Producers
+ * publish fully written slots only, so a producer dying at any point leaves the ring consistent, and its successor
+ * takes the input over. The queue survives restarts of both producers and the consumer.
+ *
+ * Producers and the consumer own their side by holding a lock on a byte of the shared memory object, which the kernel
+ * releases once they die. Values of popped entries are allocated from the consumer's value pool.
+ *
+ * Producers push entries in decode order. Like RingMetadataQueue, the consumer copies ring heads into a per-input
+ * reorder window of `REORDER_WINDOW` slots in its own memory, kept as a min-heap by pts, and pops from window heads.
+ * Entries held in the window of a dying consumer are lost.
+ *
+ * Rings are read by their consumer only, so this engine does not support snapshots.
+ */
+template<class K>
+class SharedMetadataQueue
+{
+public:
+  using Self = SharedMetadataQueue<K>;
+  using Kind = K;
+  using MetaType = Metadata<K>;
+  using ValueType = typename MetaType::ValueType;
+
+  static constexpr uint32_t MAGIC = 0x4d4d5351; // "MMSQ"
+  static constexpr uint32_t VERSION = 4;
+
+  static constexpr size_t MAX_INPUTS = 256;
+  static constexpr size_t DEFAULT_LANE_CAPACITY = 1024;
+  static constexpr size_t CACHE_LINE_SIZE = 64;
+
+  /// Count of entries of one input which are sorted by pts before popping, covers reordering of H.264 B-frames.
+  static constexpr size_t REORDER_WINDOW = 64;
+
+private:
+  static_assert(std::atomic<uint64_t>::is_always_lock_free && std::atomic<int32_t>::is_always_lock_free,
+                "shared memory queue requires address-free atomics");
+
+  struct Header
+  {
+    std::atomic<uint32_t> magic;
+    uint32_t version;
+    uint32_t lane_count;
+    uint32_t lane_capacity;
+    uint32_t slot_size;
+    uint64_t input_fingerprint;
+
+    /// One past the highest input id ever fed.
+    std::atomic<uint32_t> lanes_bound;
+  };
+
+  struct Lane
+  {
+    /// Next position to read, written by consumer only.
+    alignas(CACHE_LINE_SIZE) std::atomic<uint64_t> head;
+
+    /// Next position to write, written by producer only.
+    alignas(CACHE_LINE_SIZE) std::atomic<uint64_t> tail;
+
+    /// Ring position before which all entries are to be discarded by the consumer, set by `drop_id`.
+    std::atomic<uint64_t> discard_until;
+
+    /// Count of entries rejected because the ring was full or the entry did not fit in slot.
+    std::atomic<uint64_t> overflow;
+
+    /// Count of entries moved from the ring to the consumer's reorder window, and not popped yet.
+    std::atomic<uint64_t> staged;
+  };
+
+  struct SlotHeader
+  {
+    TS pts;
+    TS dts;
+    TS queued_at;
+    int32_t order;
+    uint32_t length;
+  };
+
+  /// Slot copied from ring into reorder window, with the ring position it has been read from.
+  struct Staged
+  {
+    TS pts;
+    uint64_t position;
+
+    /// Index of window cell holding the copy.
+    uint32_t cell;
+
+    /// Heap order putting the earliest entry on top, entries of equal pts keep their push order.
+    friend bool operator<(const Staged &lhs, const Staged &rhs) noexcept
+    {
+      return std::tie(lhs.pts, lhs.position) > std::tie(rhs.pts, rhs.position);
+    }
+  };
+
+  /// Reorder window of one ring, in the consumer's memory.
+  struct Window
+  {
+    /// Heap of staged slots.
+    std::vector<Staged> staged{};
+
+    /// Copies of staged slots, `REORDER_WINDOW` cells of slot size, allocated on first use.
+    std::unique_ptr<uint8_t[]> cells{};
+
+    /// Cells not holding any staged slot.
+    std::vector<uint32_t> free_cells{};
+  };
+
+  static constexpr size_t HEADER_SIZE = (sizeof(Header) + CACHE_LINE_SIZE - 1) / CACHE_LINE_SIZE * CACHE_LINE_SIZE;
+
+  /// Locked bytes of shared memory object, claiming the consumer side and the producer side of each lane.
+  static constexpr size_t CONSUMER_LOCK = 0;
+  static constexpr size_t FIRST_PRODUCER_LOCK = 1;
+
+  /// How long to wait for the creating process to initialize the header.
+  static constexpr auto INIT_WAIT_TIMEOUT = std::chrono::seconds(1);
+  static constexpr auto INIT_WAIT_STEP = std::chrono::milliseconds(10);
+
+  const size_t m_lane_count;
+  const uint64_t m_input_fingerprint;
+  const size_t m_lane_capacity;
+  const size_t m_slot_size;
+
+  SharedMemory m_memory;
+  Header *m_header;
+  Lane *m_lanes;
+  uint8_t *m_slots;
+
+  /// Whether this instance has claimed each input's ring, or the consumer side.
+  std::unique_ptr<std::atomic<bool>[]> m_producer_claimed;
+  std::atomic<bool> m_consumer_claimed{ false };
+
+  /// Reorder windows of all rings, used by the consumer only.
+  std::unique_ptr<Window[]> m_windows;
+
+  /// Values of popped entries, returned to the pool once the injector releases them.
+  ValuePool<ValueType> m_values{};
+  typename ValuePool<ValueType>::Producer m_consumer_values;
+
+public:
+  /// Opens queue in shared memory object, creating it if it does not exist.
+  ///
+  /// \param name           shared memory object name
+  /// \param lane_capacity  capacity of ring of each input, rounded up to power of two
+  /// \param slot_size      size of single entry slot
+  /// \param lane_count     count of rings, one past the highest input id
+  /// \param input_fingerprint  fingerprint of inputs mapped to rings
+  /// \throws std::system_error on I/O errors
+  /// \throws std::runtime_error if existing object has been created with different settings or for different inputs
+  SharedMetadataQueue(const std::string &name,
+                      size_t lane_capacity = DEFAULT_LANE_CAPACITY,
+                      size_t slot_size = SharedQueueSpec::DEFAULT_SLOT_SIZE,
+                      size_t lane_count = SharedQueueSpec::DEFAULT_LANE_COUNT,
+                      uint64_t input_fingerprint = 0)
+    : m_lane_count{ check_lane_count(lane_count) }
+    , m_input_fingerprint{ input_fingerprint }
+    , m_lane_capacity{ round_up_pow2(lane_capacity) }
+    , m_slot_size{ round_up_slot(slot_size) }
+    , m_memory{ name, memory_size(m_lane_count, m_lane_capacity, m_slot_size) }
+    , m_header{ reinterpret_cast<Header *>(m_memory.data()) }
+    , m_lanes{ reinterpret_cast<Lane *>(m_memory.data() + HEADER_SIZE) }
+    , m_slots{ m_memory.data() + HEADER_SIZE + m_lane_count * sizeof(Lane) }
+    , m_producer_claimed{ std::make_unique<std::atomic<bool>[]>(m_lane_count) }
+    , m_windows{ std::make_unique<Window[]>(m_lane_count) }
+    , m_consumer_values{ m_values.producer() }
+  {
+    if (m_memory.created()) {
+      // Zero-filled memory holds no objects yet, construct them before publishing the header.
+      m_header = new (m_memory.data()) Header{};
+      m_header->version = VERSION;
+      m_header->lane_count = static_cast<uint32_t>(m_lane_count);
+      m_header->lane_capacity = static_cast<uint32_t>(m_lane_capacity);
+      m_header->slot_size = static_cast<uint32_t>(m_slot_size);
+      m_header->input_fingerprint = m_input_fingerprint;
+      for (size_t i = 0; i < m_lane_count; i++) {
+        new (&m_lanes[i]) Lane{};
+      }
+      m_header->magic.store(MAGIC, std::memory_order_release);
+    } else {
+      validate_header();
+    }
+  }
+
+  SharedMetadataQueue(const Self &) = delete;
+  Self &operator=(const Self &) = delete;
+
+  bool empty() const noexcept { return size() == 0; }
+
+  size_t size() const noexcept
+  {
+    size_t sum = 0;
+    for_each_lane([&](const Lane &lane, InputId) { sum += live_size(lane); });
+    return sum;
+  }
+
+  /// Count of entries which have been rejected by all producers.
+  size_t overflow_count() const noexcept
+  {
+    size_t sum = 0;
+    for_each_lane([&](const Lane &lane, InputId) { sum += lane.overflow.load(std::memory_order_relaxed); });
+    return sum;
+  }
+
+  /// Usage and eviction counters, footprint is not tracked by this engine.
+  QueueStats stats() const noexcept
+  {
+    QueueStats stats{};
+    stats.entries = size();
+    stats.evicted_entries = overflow_count();
+    return stats;
+  }
+
+  /// Largest binary representation of value which fits in slot.
+  size_t value_capacity() const noexcept { return m_slot_size - sizeof(SlotHeader); }
+
+  /// Pushes value to the ring of its input. Must be called from the input's producer thread only.
+  ///
+  /// If the ring is full, or value does not fit in slot, value is dropped and accounted in `overflow_count()`.
+  void push(MetaType value)
+  {
+    Lane &lane = claim_lane(value.input_id);
+    uint64_t tail = lane.tail.load(std::memory_order_relaxed);
+
+    if (tail - lane.head.load(std::memory_order_acquire) >= m_lane_capacity || !write_slot(value, tail)) {
+      lane.overflow.fetch_add(1, std::memory_order_relaxed);
+      return;
+    }
+
+    lane.tail.store(tail + 1, std::memory_order_release);
+  }
+
+  /// Pushes values to rings of their inputs, publishing each run of consecutive values of one input at once. Must be
+  /// called from the producer thread of these inputs only.
+  template<class ForwardIt>
+  void push_range(ForwardIt first, ForwardIt last)
+  {
+    while (first != last) {
+      InputId id = static_cast<const MetaType &>(*first).input_id;
+      Lane &lane = claim_lane(id);
+
+      uint64_t tail = lane.tail.load(std::memory_order_relaxed);
+      uint64_t head = lane.head.load(std::memory_order_acquire);
+      uint64_t rejected = 0;
+
+      for (; first != last; ++first) {
+        const MetaType &value = *first;
+        if (value.input_id != id) {
+          break;
+        }
+
+        if (tail - head >= m_lane_capacity || !write_slot(value, tail)) {
+          rejected++;
+          continue;
+        }
+        tail++;
+      }
+
+      lane.tail.store(tail, std::memory_order_release);
+      if (rejected > 0) {
+        lane.overflow.fetch_add(rejected, std::memory_order_relaxed);
+      }
+    }
+  }
+
+  /// Pops value earliest in given time frame, assigned to given input id from queue. Must be called from the consumer
+  /// thread only.
+  /// Drops all values of other inputs up to popped value, inclusive, or up to `until` if nothing has been popped.
+  ///
+  /// \param id       input id, popped value must by assigned to it, other values will be dropped
+  /// \param since    start time for lookup, inclusive
+  /// \param until    end time for lookup, exclusive
+  /// \param on_drop  called with each dropped value and DropReason, values are passed without payloads
+  /// \return popped value or nothing if queue is empty
+  /// \throws BinaryParseError if popped slot is malformed
+  template<class OnDrop = IgnoreDrops>
+  std::optional<MetaType> pop(InputId id, TS since, TS until, OnDrop &&on_drop = {})
+  {
+    claim_consumer();
+
+    std::optional<MetaType> result{};
+
+    if (Lane *lane = find_lane(id); lane != nullptr) {
+      while (const SlotHeader *head = staged_front(*lane, id)) {
+        if (head->pts >= until) {
+          break;
+        }
+
+        bool in_range = head->pts >= since;
+        if (in_range) {
+          result.emplace(read_slot(id, *head));
+        } else {
+          on_drop(header_only(id, *head), DropReason::STALE);
+        }
+
+        pop_staged(*lane, id);
+
+        if (in_range) {
+          break;
+        }
+      }
+    }
+
+    sweep(id, since, result ? result->pts.val + 1 : until, on_drop);
+    return result;
+  }
+
+  /// Pops all values in given time frame, assigned to given input id from queue. Moves popped value to output iterator.
+  /// Drops all other values since queue begin to `until` time from queue.
+  ///
+  /// \tparam     OutputIt  output iterator type
+  /// \param      id        input id, popped value must by assigned to it, other values will be dropped
+  /// \param      since     start time for lookup, inclusive
+  /// \param      until     end time for lookup, exclusive
+  /// \param[out] out       output iterator, popped values will be moved here
+  /// \param      on_drop   called with each dropped value and DropReason, values are passed without payloads
+  /// \return               count of popped items
+  /// \throws BinaryParseError if popped slot is malformed
+  template<class OutputIt, class OnDrop = IgnoreDrops>
+  unsigned int pop_all(InputId id, TS since, TS until, OutputIt out, OnDrop &&on_drop = {})
+  {
+    static_assert(
+      std::is_base_of<std::output_iterator_tag, typename std::iterator_traits<OutputIt>::iterator_category>::value,
+      "output iterator must be of output iterator category");
+
+    claim_consumer();
+
+    unsigned int count = 0;
+
+    if (Lane *lane = find_lane(id); lane != nullptr) {
+      while (const SlotHeader *head = staged_front(*lane, id)) {
+        if (head->pts >= until) {
+          break;
+        }
+
+        if (head->pts >= since) {
+          *out++ = read_slot(id, *head);
+          count++;
+        } else {
+          on_drop(header_only(id, *head), DropReason::STALE);
+        }
+
+        pop_staged(*lane, id);
+      }
+    }
+
+    sweep(id, since, until, on_drop);
+    return count;
+  }
+
+  /// Marks all entries of given input, pushed so far, for removal. Must be called from the input's producer thread.
+  ///
+  /// \return count of dropped entries
+  size_t drop_id(InputId id)
+  {
+    Lane &lane = claim_lane(id);
+
+    size_t dropped = live_size(lane);
+    lane.discard_until.store(lane.tail.load(std::memory_order_relaxed), std::memory_order_release);
+    return dropped;
+  }
+
+  /// Rings may be read by their consumer only, so this engine can't be snapshotted.
+  template<class OutputIt>
+  void snapshot(OutputIt)
+  {
+    throw std::logic_error("shared metadata queue does not support snapshots");
+  }
+
+private:
+  static size_t round_up_pow2(size_t x)
+  {
+    if (x == 0) {
+      throw std::invalid_argument("ring capacity must be positive");
+    }
+
+    size_t r = 1;
+    while (r < x) {
+      r <<= 1;
+    }
+    return r;
+  }
+
+  static size_t round_up_slot(size_t slot_size)
+  {
+    if (slot_size <= sizeof(SlotHeader)) {
+      throw std::invalid_argument("shared metadata queue slot size is too small");
+    }
+    return (slot_size + alignof(SlotHeader) - 1) / alignof(SlotHeader) * alignof(SlotHeader);
+  }
+
+  static size_t check_lane_count(size_t lane_count)
+  {
+    if (lane_count == 0 || lane_count > MAX_INPUTS) {
+      throw std::invalid_argument("shared metadata queue lane count must be between 1 and " +
+                                  std::to_string(MAX_INPUTS));
+    }
+    return lane_count;
+  }
+
+  static size_t memory_size(size_t lane_count, size_t lane_capacity, size_t slot_size) noexcept
+  {
+    return HEADER_SIZE + lane_count * sizeof(Lane) + lane_count * lane_capacity * slot_size;
+  }
+
+  void validate_header() const
+  {
+    for (auto waited = std::chrono::milliseconds(0);
+         m_header->magic.load(std::memory_order_acquire) != MAGIC && waited < INIT_WAIT_TIMEOUT;
+         waited += INIT_WAIT_STEP) {
+      std::this_thread::sleep_for(INIT_WAIT_STEP);
+    }
+
+    if (m_header->magic.load(std::memory_order_acquire) != MAGIC || m_header->version != VERSION ||
+        m_header->lane_count != m_lane_count || m_header->lane_capacity != m_lane_capacity ||
+        m_header->slot_size != m_slot_size) {
+      throw std::runtime_error("Shared memory " + m_memory.name() + " holds incompatible metadata queue");
+    }
+
+    // Inputs of the same count but different names or order would be mapped to each other's rings
+    if (m_header->input_fingerprint != m_input_fingerprint) {
+      throw std::runtime_error("Shared memory " + m_memory.name() + " holds metadata queue of different inputs");
+    }
+  }
+
+  Lane *find_lane(InputId id) const noexcept
+  {
+    if (id >= m_lane_count) {
+      return nullptr;
+    }
+    return &m_lanes[id];
+  }
+
+  /// Returns the ring of given input, making this process its producer on first use.
+  Lane &claim_lane(InputId id)
+  {
+    if (id >= m_lane_count) {
+      throw std::out_of_range("input id exceeds shared metadata queue lane count");
+    }
+
+    Lane &lane = m_lanes[id];
+    if (!m_producer_claimed[id].load(std::memory_order_acquire)) {
+      claim(FIRST_PRODUCER_LOCK + id, "input #" + std::to_string(id) + " of metadata queue " + m_memory.name());
+      m_producer_claimed[id].store(true, std::memory_order_release);
+
+      uint32_t bound = m_header->lanes_bound.load(std::memory_order_relaxed);
+      while (bound < id + 1 && !m_header->lanes_bound.compare_exchange_weak(bound, id + 1)) {
+      }
+    }
+    return lane;
+  }
+
+  void claim_consumer()
+  {
+    if (!m_consumer_claimed.load(std::memory_order_relaxed)) {
+      claim(CONSUMER_LOCK, "metadata queue " + m_memory.name());
+      m_consumer_claimed.store(true, std::memory_order_relaxed);
+
+      // Reorder windows of a dead predecessor are gone with it.
+      for (size_t i = 0; i < m_lane_count; i++) {
+        m_lanes[i].staged.store(0, std::memory_order_relaxed);
+      }
+    }
+  }
+
+  /// Takes ownership of locked resource over, unless another live instance owns it.
+  void claim(size_t lock, const std::string &what)
+  {
+    if (!m_memory.try_lock(lock)) {
+      throw std::runtime_error(what + " is owned by another process");
+    }
+  }
+
+  template<class F>
+  void for_each_lane(F &&f) const
+  {
+    size_t bound = m_header->lanes_bound.load(std::memory_order_acquire);
+    for (size_t i = 0; i < bound; i++) {
+      f(m_lanes[i], static_cast<InputId>(i));
+    }
+  }
+
+  uint8_t *slot_at(InputId id, uint64_t position) const noexcept
+  {
+    return m_slots + (id * m_lane_capacity + (position & (m_lane_capacity - 1))) * m_slot_size;
+  }
+
+  /// Writes value to slot at given position of its input's ring, without publishing it.
+  ///
+  /// \return false if value does not fit in slot
+  bool write_slot(const MetaType &value, uint64_t position)
+  {
+    // Value is encoded right into the slot, behind its header.
+    uint8_t *slot = slot_at(value.input_id, position);
+    uint8_t *data = slot + sizeof(SlotHeader);
+    uint8_t *end = emit_metadata_value(*value.val, data, slot + m_slot_size);
+    if (end == nullptr) {
+      return false;
+    }
+
+    SlotHeader header{
+      value.pts.val, value.dts.val, value.queued_at.val, value.order, static_cast<uint32_t>(end - data)
+    };
+    std::memcpy(slot, &header, sizeof(header));
+    return true;
+  }
+
+  MetaType read_slot(InputId id, const SlotHeader &header)
+  {
+    auto data = reinterpret_cast<const uint8_t *>(&header) + sizeof(SlotHeader);
+    if (header.length > value_capacity()) {
+      throw BinaryParseError("shared metadata queue slot length exceeds slot size", 0, header.length);
+    }
+
+    std::shared_ptr<ValueType> val{};
+    parse_metadata_value(data, data + header.length, val, m_consumer_values);
+
+    MetaType meta = header_only(id, header);
+    meta.val = std::move(val);
+    return meta;
+  }
+
+  static MetaType header_only(InputId id, const SlotHeader &header)
+  {
+    MetaType meta(id, ClockTS(header.pts), ClockTS(header.dts), header.order, nullptr);
+    meta.queued_at = ClockTS(header.queued_at);
+    return meta;
+  }
+
+  static size_t live_size(const Lane &lane) noexcept
+  {
+    uint64_t discard_until = lane.discard_until.load(std::memory_order_acquire);
+    uint64_t read = lane.head.load(std::memory_order_acquire);
+    uint64_t head = std::max(read, discard_until);
+    uint64_t tail = lane.tail.load(std::memory_order_acquire);
+
+    // Staged entries have been read before the ring head, all of them are dropped once the head is.
+    uint64_t staged = discard_until < read ? lane.staged.load(std::memory_order_acquire) : 0;
+    return (tail > head ? tail - head : 0) + staged;
+  }
+
+  /// Returns header of the first slot in lane which has not been dropped with `drop_id`, skipping dropped ones.
+  const SlotHeader *live_front(Lane &lane, InputId id) noexcept
+  {
+    uint64_t head = lane.head.load(std::memory_order_relaxed);
+    uint64_t discard_until = lane.discard_until.load(std::memory_order_acquire);
+    if (head < discard_until) {
+      head = discard_until;
+      lane.head.store(head, std::memory_order_release);
+    }
+
+    if (head == lane.tail.load(std::memory_order_acquire)) {
+      return nullptr;
+    }
+    return reinterpret_cast<const SlotHeader *>(slot_at(id, head));
+  }
+
+  static void pop_front(Lane &lane) noexcept
+  {
+    lane.head.store(lane.head.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+  }
+
+  uint8_t *cell_at(const Window &window, uint32_t cell) const noexcept { return window.cells.get() + cell * m_slot_size; }
+
+  /// Returns header of the earliest slot of lane's reorder window, after filling the window from lane's ring. Releases
+  /// slots dropped with `drop_id` on the way.
+  const SlotHeader *staged_front(Lane &lane, InputId id)
+  {
+    Window &window = m_windows[id];
+    if (!window.cells) {
+      window.cells = std::make_unique<uint8_t[]>(REORDER_WINDOW * m_slot_size);
+      window.staged.reserve(REORDER_WINDOW);
+      window.free_cells.reserve(REORDER_WINDOW);
+      for (uint32_t cell = REORDER_WINDOW; cell > 0; cell--) {
+        window.free_cells.push_back(cell - 1);
+      }
+    }
+
+    std::vector<Staged> &staged = window.staged;
+
+    uint64_t discard_until = lane.discard_until.load(std::memory_order_acquire);
+    auto discarded = std::partition(
+      staged.begin(), staged.end(), [&](const Staged &s) { return s.position >= discard_until; });
+    if (discarded != staged.end()) {
+      std::for_each(discarded, staged.end(), [&](const Staged &s) { window.free_cells.push_back(s.cell); });
+      staged.erase(discarded, staged.end());
+      std::make_heap(staged.begin(), staged.end());
+    }
+
+    while (staged.size() < REORDER_WINDOW) {
+      const SlotHeader *head = live_front(lane, id);
+      if (head == nullptr) {
+        break;
+      }
+
+      // Value is copied as it is, it is parsed once popped.
+      uint32_t cell = window.free_cells.back();
+      window.free_cells.pop_back();
+      std::memcpy(cell_at(window, cell), head, sizeof(SlotHeader) + std::min<size_t>(head->length, value_capacity()));
+
+      staged.push_back(Staged{ head->pts, lane.head.load(std::memory_order_relaxed), cell });
+      std::push_heap(staged.begin(), staged.end());
+      pop_front(lane);
+    }
+
+    lane.staged.store(staged.size(), std::memory_order_release);
+    return staged.empty() ? nullptr : reinterpret_cast<const SlotHeader *>(cell_at(window, staged.front().cell));
+  }
+
+  /// Releases the earliest slot of lane's reorder window, which has been returned by `staged_front`.
+  void pop_staged(Lane &lane, InputId id) noexcept
+  {
+    Window &window = m_windows[id];
+    std::pop_heap(window.staged.begin(), window.staged.end());
+    window.free_cells.push_back(window.staged.back().cell);
+    window.staged.pop_back();
+    lane.staged.store(window.staged.size(), std::memory_order_release);
+  }
+
+  /// Drops entries of all inputs other than `id` earlier than `watermark`, for a pop looking up values since `since`.
+  template<class OnDrop>
+  void sweep(InputId id, TS since, TS watermark, OnDrop &on_drop)
+  {
+    size_t bound = m_header->lanes_bound.load(std::memory_order_acquire);
+    for (size_t i = 0; i < bound; i++) {
+      auto lane_id = static_cast<InputId>(i);
+      if (lane_id == id) {
+        continue;
+      }
+
+      while (const SlotHeader *head = staged_front(m_lanes[i], lane_id)) {
+        if (head->pts >= watermark) {
+          break;
+        }
+
+        MetaType dropped = header_only(lane_id, *head);
+        on_drop(dropped, passed_drop_reason(dropped, id, since));
+        pop_staged(m_lanes[i], lane_id);
+      }
+    }
+  }
+};
+}
@@ -1,7 +1,10 @@
 #pragma once
 
+#include <algorithm>
+#include <array>
 #include <cassert>
 #include <cstdint>
+#include <initializer_list>
 #include <iterator>
 #include <stdexcept>
 #include <type_traits>
@@ -11,18 +14,48 @@
 
 namespace metamix {
 
+/**
+ * @brief Contiguous elements, referred to by pointer and size kept in the base, so that element access needs no virtual
+ * call and is inlined. Deriving slices owning their elements point the base to their storage whenever it changes.
+ *
+ * Iterators are plain pointers, unless assertions are enabled, in which case they are checked on every dereference.
+ */
 template<class Deriving, typename T>
 class AbstractSlice
 {
 public:
   using ValueType = T;
 
+private:
+  T *m_data{ nullptr };
+  size_t m_size{ 0 };
+
+protected:
+  constexpr AbstractSlice() = default;
+
+  constexpr AbstractSlice(T *data, size_t size) noexcept
+    : m_data{ data }
+    , m_size{ size }
+  {}
+
+  AbstractSlice(const AbstractSlice &) = default;
+  AbstractSlice &operator=(const AbstractSlice &) = default;
+
+  ~AbstractSlice() = default;
+
+  /// Points the slice to given elements.
+  void set_span(T *data, size_t size) noexcept
+  {
+    m_data = data;
+    m_size = size;
+  }
+
 public:
-  virtual ~AbstractSlice() = default;
+  size_t size() const noexcept { return m_size; }
 
-  virtual size_t size() const noexcept = 0;
-  virtual T *data() noexcept = 0;
-  virtual const T *data() const noexcept = 0;
+  T *data() noexcept { return m_data; }
+
+  const T *data() const noexcept { return m_data; }
 
   bool empty() const noexcept { return size() == 0; }
 
@@ -62,6 +95,19 @@ public:
 
   const T &back() const { return (*this)[size() - 1]; }
 
+#ifdef NDEBUG
+public:
+  using Iterator = T *;
+  using ConstIterator = const T *;
+
+  Iterator begin() noexcept { return data(); }
+
+  Iterator end() noexcept { return data() + size(); }
+
+  ConstIterator cbegin() const noexcept { return data(); }
+
+  ConstIterator cend() const noexcept { return data() + size(); }
+#else
 private:
   template<typename Value>
   class IteratorImpl : public boost::iterator_facade<IteratorImpl<Value>, Value, boost::random_access_traversal_tag>
@@ -136,6 +182,7 @@ public:
   ConstIterator cbegin() const { return ConstIterator(static_cast<const Deriving *>(this), 0); }
 
   ConstIterator cend() const { return ConstIterator(static_cast<const Deriving *>(this), size()); }
+#endif
 };
 
 template<class Deriving, class DerivingBase, typename T = typename DerivingBase::ValueType>
@@ -151,18 +198,165 @@ public:
   AbstractOwnedSlice() = default;
   explicit AbstractOwnedSlice(std::vector<T> data)
     : m_data(std::move(data))
-  {}
+  {
+    sync();
+  }
   explicit AbstractOwnedSlice(const DerivingBase &base)
     : m_data(base.data(), base.data() + base.size())
-  {}
+  {
+    sync();
+  }
   AbstractOwnedSlice(std::initializer_list<T> init)
     : m_data(init)
-  {}
+  {
+    sync();
+  }
+
+  AbstractOwnedSlice(const AbstractOwnedSlice &other)
+    : DerivingBase(other)
+    , m_data(other.m_data)
+  {
+    sync();
+  }
+
+  AbstractOwnedSlice(AbstractOwnedSlice &&other) noexcept
+    : DerivingBase(std::move(other))
+    , m_data(std::move(other.m_data))
+  {
+    sync();
+    other.sync();
+  }
+
+  AbstractOwnedSlice &operator=(const AbstractOwnedSlice &other)
+  {
+    if (this != &other) {
+      DerivingBase::operator=(other);
+      m_data = other.m_data;
+      sync();
+    }
+    return *this;
+  }
+
+  AbstractOwnedSlice &operator=(AbstractOwnedSlice &&other) noexcept
+  {
+    if (this != &other) {
+      DerivingBase::operator=(std::move(other));
+      m_data = std::move(other.m_data);
+      sync();
+      other.m_data.clear();
+      other.sync();
+    }
+    return *this;
+  }
+
+private:
+  void sync() noexcept { this->set_span(m_data.data(), m_data.size()); }
+};
+
+/**
+ * @brief Owned slice keeping up to `N` elements inline, only larger contents are allocated on heap.
+ *
+ * Copying and moving small slices never allocates.
+ */
+template<class Deriving, class DerivingBase, size_t N, typename T = typename DerivingBase::ValueType>
+class AbstractSmallOwnedSlice : public DerivingBase
+{
+  static_assert(std::is_base_of<AbstractSlice<DerivingBase, T>, DerivingBase>::value,
+                "Deriving base has to inherit from AbstractSlice<DerivingBase, T>");
+  static_assert(std::is_trivially_copyable<T>::value, "Inline storage requires trivially copyable elements");
+
+public:
+  static constexpr size_t INLINE_CAPACITY = N;
+
+private:
+  std::array<T, N> m_inline;
+  std::vector<T> m_heap{};
+
+public:
+  AbstractSmallOwnedSlice() { this->set_span(m_inline.data(), 0); }
+  AbstractSmallOwnedSlice(const T *first, const T *last) { assign(first, last); }
+  explicit AbstractSmallOwnedSlice(std::vector<T> data)
+  {
+    if (data.size() > N) {
+      m_heap = std::move(data);
+      this->set_span(m_heap.data(), m_heap.size());
+    } else {
+      assign(data.data(), data.data() + data.size());
+    }
+  }
+  explicit AbstractSmallOwnedSlice(const DerivingBase &base) { assign(base.data(), base.data() + base.size()); }
+  AbstractSmallOwnedSlice(std::initializer_list<T> init) { assign(init.begin(), init.end()); }
+
+  /// Copies leading `size` elements of buffer, which fits in inline storage, so that they are copied without branching
+  /// to heap storage.
+  template<size_t M>
+  AbstractSmallOwnedSlice(const std::array<T, M> &data, size_t size)
+  {
+    static_assert(M <= N, "Buffer has to fit in inline storage");
+    assert(size <= M);
+    std::copy(data.data(), data.data() + size, m_inline.data());
+    this->set_span(m_inline.data(), size);
+  }
+
+  AbstractSmallOwnedSlice(const AbstractSmallOwnedSlice &other)
+    : DerivingBase(other)
+  {
+    assign(other.data(), other.data() + other.size());
+  }
+
+  AbstractSmallOwnedSlice(AbstractSmallOwnedSlice &&other) noexcept
+    : DerivingBase(std::move(other))
+  {
+    take(std::move(other));
+  }
+
+  AbstractSmallOwnedSlice &operator=(const AbstractSmallOwnedSlice &other)
+  {
+    if (this != &other) {
+      DerivingBase::operator=(other);
+      assign(other.data(), other.data() + other.size());
+    }
+    return *this;
+  }
+
+  AbstractSmallOwnedSlice &operator=(AbstractSmallOwnedSlice &&other) noexcept
+  {
+    if (this != &other) {
+      DerivingBase::operator=(std::move(other));
+      take(std::move(other));
+    }
+    return *this;
+  }
+
+  ~AbstractSmallOwnedSlice() = default;
 
-  size_t size() const noexcept override { return m_data.size(); }
+  /// Whether contents are held in inline storage.
+  bool is_inline() const noexcept { return this->size() <= N; }
 
-  T *data() noexcept override { return m_data.data(); }
+  /// Replaces contents, heap storage of previous contents is reused when possible.
+  void assign(const T *first, const T *last)
+  {
+    size_t size = last - first;
+    if (size > N) {
+      m_heap.assign(first, last);
+      this->set_span(m_heap.data(), size);
+    } else {
+      std::copy(first, last, m_inline.data());
+      this->set_span(m_inline.data(), size);
+    }
+  }
 
-  const T *data() const noexcept override { return m_data.data(); }
+private:
+  void take(AbstractSmallOwnedSlice &&other) noexcept
+  {
+    if (other.is_inline()) {
+      std::copy(other.m_inline.data(), other.m_inline.data() + other.size(), m_inline.data());
+      this->set_span(m_inline.data(), other.size());
+    } else {
+      m_heap = std::move(other.m_heap);
+      this->set_span(m_heap.data(), m_heap.size());
+    }
+    other.set_span(other.m_inline.data(), 0);
+  }
 };
 }
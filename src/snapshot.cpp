@@ -0,0 +1,420 @@
+#include "snapshot.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <iterator>
+#include <stdexcept>
+#include <system_error>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "binary_emitter_util.h"
+#include "binary_parser_util.h"
+#include "h264/sei_payload.h"
+#include "log.h"
+#include "metadata_codec.h"
+#include "scte35/crc32.h"
+#include "scte35/scte35.h"
+
+using metamix::scte35::CRC32;
+
+namespace metamix {
+
+namespace {
+
+template<class OutputIt>
+OutputIt
+emit_string(const std::string &str, OutputIt out)
+{
+  if (str.size() > 0xff) {
+    throw std::length_error("snapshot string is too long: " + str);
+  }
+
+  out = write_8(static_cast<uint8_t>(str.size()), out);
+  return std::copy(str.begin(), str.end(), out);
+}
+
+std::string
+read_string(const uint8_t *&ptr, const uint8_t *endptr)
+{
+  auto length = read_8(ptr, endptr);
+  require_distance(ptr, endptr, length);
+  std::string str(ptr, ptr + length);
+  ptr += length;
+  return str;
+}
+
+/// input_id:32 pts:64 dts:64 order:32 length:32 value
+template<class K>
+void
+emit_entries(const std::vector<Metadata<K>> &entries, std::vector<uint8_t> &out)
+{
+  auto it = std::back_inserter(out);
+  write_32(static_cast<uint32_t>(entries.size()), it);
+
+  std::vector<uint8_t> value{};
+  for (const auto &meta : entries) {
+    value.clear();
+    emit_metadata_value(*meta.val, value);
+
+    write_32(meta.input_id, it);
+    write_64(static_cast<uint64_t>(meta.pts.val), it);
+    write_64(static_cast<uint64_t>(meta.dts.val), it);
+    write_32(static_cast<uint32_t>(meta.order), it);
+    write_32(static_cast<uint32_t>(value.size()), it);
+    out.insert(out.end(), value.begin(), value.end());
+  }
+}
+
+template<class K>
+void
+parse_entries(const uint8_t *ptr, const uint8_t *endptr, std::vector<Metadata<K>> &entries)
+{
+  auto count = read_32(ptr, endptr);
+  for (uint32_t i = 0; i < count; i++) {
+    auto input_id = static_cast<InputId>(read_32(ptr, endptr));
+    auto pts = ClockTS(static_cast<TS>(read_64(ptr, endptr)));
+    auto dts = ClockTS(static_cast<TS>(read_64(ptr, endptr)));
+    auto order = static_cast<int>(read_32(ptr, endptr));
+    auto length = read_32(ptr, endptr);
+    require_distance(ptr, endptr, length);
+
+    std::shared_ptr<typename Metadata<K>::ValueType> val;
+    parse_metadata_value(ptr, ptr + length, val);
+    ptr += length;
+
+    entries.emplace_back(input_id, pts, dts, order, std::move(val));
+  }
+
+  if (ptr != endptr) {
+    throw BinaryParseError("trailing bytes in snapshot entries section", 0, endptr - ptr);
+  }
+}
+
+/// CRC32 of slot header fields following the reserved one, and of slot payload.
+uint32_t
+slot_crc(const uint8_t *slot, uint32_t length)
+{
+  CRC32 crc{};
+  crc.update(slot + 8, slot + 20);
+  crc.update(slot + SnapshotFile::SLOT_HEADER_SIZE, slot + SnapshotFile::SLOT_HEADER_SIZE + length);
+  return crc;
+}
+
+void
+write_slot_header(uint8_t *slot, uint64_t sequence, uint32_t length)
+{
+  std::vector<uint8_t> header{};
+  header.reserve(SnapshotFile::SLOT_HEADER_SIZE);
+
+  auto out = std::back_inserter(header);
+  write_32(SnapshotFile::MAGIC, out);
+  write_16(SnapshotFile::VERSION, out);
+  write_16(0, out);
+  write_64(sequence, out);
+  write_32(length, out);
+  std::copy(header.begin(), header.end(), slot);
+
+  // CRC covers sequence and length fields as well, so torn header is detected too.
+  header.clear();
+  write_32(slot_crc(slot, length), out);
+  std::copy(header.begin(), header.end(), slot + 20);
+}
+}
+
+/// clock:64
+/// input_count:16 { input_id:32 name }*
+/// rescaler_count:16 { key base:64 has_ts_zero:8 ts_zero:64 }*
+/// { kind_name section_length:32 section }* for each metadata kind
+///
+/// Strings are prefixed with length:8.
+void
+emit_snapshot(const Snapshot &snapshot, std::vector<uint8_t> &out)
+{
+  auto it = std::back_inserter(out);
+
+  write_64(static_cast<uint64_t>(snapshot.clock.val), it);
+
+  write_16(static_cast<uint16_t>(snapshot.inputs.size()), it);
+  for (const auto &[id, name] : snapshot.inputs) {
+    write_32(id, it);
+    emit_string(name, it);
+  }
+
+  write_16(static_cast<uint16_t>(snapshot.rescalers.size()), it);
+  for (const auto &[key, state] : snapshot.rescalers) {
+    emit_string(key, it);
+    write_64(static_cast<uint64_t>(state.base.val), it);
+    write_8(state.ts_zero.has_value(), it);
+    write_64(static_cast<uint64_t>(state.ts_zero.value_or(StreamTS(0)).val), it);
+  }
+
+  std::vector<uint8_t> section{};
+  MetadataKindPack::for_each([&](auto k) {
+    using K = decltype(k);
+
+    section.clear();
+    emit_entries(snapshot.get<K>(), section);
+
+    emit_string(K::NAME, it);
+    write_32(static_cast<uint32_t>(section.size()), it);
+    out.insert(out.end(), section.begin(), section.end());
+  });
+}
+
+Snapshot
+parse_snapshot(const uint8_t *ptr, const uint8_t *endptr)
+{
+  Snapshot snapshot{};
+
+  snapshot.clock = ClockTS(static_cast<TS>(read_64(ptr, endptr)));
+
+  auto input_count = read_16(ptr, endptr);
+  for (uint16_t i = 0; i < input_count; i++) {
+    auto id = static_cast<InputId>(read_32(ptr, endptr));
+    snapshot.inputs[id] = read_string(ptr, endptr);
+  }
+
+  auto rescaler_count = read_16(ptr, endptr);
+  for (uint16_t i = 0; i < rescaler_count; i++) {
+    auto key = read_string(ptr, endptr);
+    TSRescaler::State state{};
+    state.base = ClockTS(static_cast<TS>(read_64(ptr, endptr)));
+    bool has_ts_zero = read_8(ptr, endptr) != 0;
+    auto ts_zero = StreamTS(static_cast<TS>(read_64(ptr, endptr)));
+    if (has_ts_zero) {
+      state.ts_zero = ts_zero;
+    }
+    snapshot.rescalers[key] = state;
+  }
+
+  while (ptr != endptr) {
+    auto name = read_string(ptr, endptr);
+    auto length = read_32(ptr, endptr);
+    require_distance(ptr, endptr, length);
+
+    MetadataKindPack::for_each([&](auto k) {
+      using K = decltype(k);
+      if (name == K::NAME) {
+        parse_entries(ptr, ptr + length, snapshot.get<K>());
+      }
+    });
+
+    ptr += length;
+  }
+
+  return snapshot;
+}
+
+SnapshotFile::SnapshotFile(const std::string &path, size_t slot_capacity)
+{
+  m_fd = ::open(path.c_str(), O_RDWR | O_CREAT, 0644);
+  if (m_fd < 0) {
+    throw std::system_error(errno, std::generic_category(), "Failed opening snapshot file " + path);
+  }
+
+  try {
+    struct stat st;
+    if (::fstat(m_fd, &st) < 0) {
+      throw std::system_error(errno, std::generic_category(), "Failed reading snapshot file size");
+    }
+
+    size_t size = 2 * (SLOT_HEADER_SIZE + slot_capacity);
+    size_t existing_size = static_cast<size_t>(st.st_size);
+
+    std::optional<std::vector<uint8_t>> kept{};
+    if (existing_size != size && existing_size >= 2 * SLOT_HEADER_SIZE && existing_size % 2 == 0) {
+      map(existing_size);
+      if (find_latest()) {
+        kept = read();
+      }
+      unmap();
+    }
+
+    // Fresh file, or one left by a different slot capacity.
+    if (existing_size != size) {
+      if (::ftruncate(m_fd, 0) < 0 || ::ftruncate(m_fd, static_cast<off_t>(size)) < 0) {
+        throw std::system_error(errno, std::generic_category(), "Failed resizing snapshot file");
+      }
+    }
+
+    map(size);
+    m_latest_slot = 1;
+    m_sequence = 0;
+    find_latest();
+
+    if (kept && !write(*kept)) {
+      LOG(warning) << "Latest snapshot does not fit in resized snapshot file, dropping it";
+    }
+  } catch (...) {
+    unmap();
+    ::close(m_fd);
+    throw;
+  }
+}
+
+SnapshotFile::~SnapshotFile()
+{
+  unmap();
+  ::close(m_fd);
+}
+
+std::optional<std::vector<uint8_t>>
+SnapshotFile::read() const
+{
+  if (!validate_slot(m_latest_slot)) {
+    return std::nullopt;
+  }
+
+  const uint8_t *slot = slot_data(m_latest_slot);
+  const uint8_t *ptr = slot + 16;
+  auto length = read_32(ptr, slot + SLOT_HEADER_SIZE);
+  return std::vector<uint8_t>(slot + SLOT_HEADER_SIZE, slot + SLOT_HEADER_SIZE + length);
+}
+
+bool
+SnapshotFile::write(const std::vector<uint8_t> &payload)
+{
+  if (payload.size() > slot_capacity()) {
+    return false;
+  }
+
+  size_t slot_idx = 1 - m_latest_slot;
+  uint8_t *slot = slot_data(slot_idx);
+  auto length = static_cast<uint32_t>(payload.size());
+
+  // Invalidate slot before overwriting it, then write payload and seal it with header.
+  std::fill(slot, slot + SLOT_HEADER_SIZE, 0);
+  std::copy(payload.begin(), payload.end(), slot + SLOT_HEADER_SIZE);
+  write_slot_header(slot, m_sequence + 1, length);
+
+  // Flushed range must start at page boundary.
+  size_t page_size = static_cast<size_t>(::sysconf(_SC_PAGESIZE));
+  size_t begin = static_cast<size_t>(slot - m_data) / page_size * page_size;
+  size_t end = static_cast<size_t>(slot - m_data) + SLOT_HEADER_SIZE + length;
+  if (::msync(m_data + begin, end - begin, MS_SYNC) < 0) {
+    throw std::system_error(errno, std::generic_category(), "Failed flushing snapshot file");
+  }
+
+  m_latest_slot = slot_idx;
+  m_sequence++;
+  return true;
+}
+
+void
+SnapshotFile::map(size_t size)
+{
+  void *data = ::mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, m_fd, 0);
+  if (data == MAP_FAILED) {
+    throw std::system_error(errno, std::generic_category(), "Failed mapping snapshot file");
+  }
+
+  m_data = static_cast<uint8_t *>(data);
+  m_size = size;
+}
+
+void
+SnapshotFile::unmap() noexcept
+{
+  if (m_data != nullptr) {
+    ::munmap(m_data, m_size);
+    m_data = nullptr;
+    m_size = 0;
+  }
+}
+
+bool
+SnapshotFile::find_latest() noexcept
+{
+  bool found = false;
+  for (size_t slot = 0; slot < 2; slot++) {
+    if (auto sequence = validate_slot(slot); sequence && (!found || *sequence > m_sequence)) {
+      m_latest_slot = slot;
+      m_sequence = *sequence;
+      found = true;
+    }
+  }
+  return found;
+}
+
+std::optional<uint64_t>
+SnapshotFile::validate_slot(size_t slot_idx) const noexcept
+{
+  const uint8_t *slot = slot_data(slot_idx);
+  const uint8_t *ptr = slot;
+  const uint8_t *endptr = slot + SLOT_HEADER_SIZE;
+
+  if (read_32(ptr, endptr) != MAGIC || read_16(ptr, endptr) != VERSION) {
+    return std::nullopt;
+  }
+
+  read_16(ptr, endptr);
+  auto sequence = read_64(ptr, endptr);
+  auto length = read_32(ptr, endptr);
+  auto crc = read_32(ptr, endptr);
+
+  if (length > slot_capacity() || crc != slot_crc(slot, length)) {
+    return std::nullopt;
+  }
+  return sequence;
+}
+
+void
+TSRescalerStates::restore(std::map<std::string, TSRescaler::State> states)
+{
+  std::lock_guard<std::mutex> guard(m);
+  m_restored = std::move(states);
+}
+
+std::optional<TSRescaler::State>
+TSRescalerStates::take_restored(const std::string &key)
+{
+  std::lock_guard<std::mutex> guard(m);
+
+  auto it = m_restored.find(key);
+  if (it == m_restored.end()) {
+    return std::nullopt;
+  }
+
+  auto state = it->second;
+  m_restored.erase(it);
+  return state;
+}
+
+void
+TSRescalerStates::publish(const std::string &key, const TSRescaler::State &state)
+{
+  std::lock_guard<std::mutex> guard(m);
+  m_current[key] = state;
+}
+
+std::map<std::string, TSRescaler::State>
+TSRescalerStates::current() const
+{
+  std::lock_guard<std::mutex> guard(m);
+  return m_current;
+}
+
+PersistentTSRescaler::PersistentTSRescaler(std::shared_ptr<TSRescalerStates> states,
+                                           std::string key,
+                                           std::shared_ptr<Clock> clock,
+                                           StreamTimeBase local_time_base)
+  : PersistentTSRescaler(states, key, std::move(clock), local_time_base, states->take_restored(key))
+{}
+
+PersistentTSRescaler::PersistentTSRescaler(std::shared_ptr<TSRescalerStates> states,
+                                           std::string key,
+                                           std::shared_ptr<Clock> clock,
+                                           StreamTimeBase local_time_base,
+                                           std::optional<TSRescaler::State> restored)
+  : m_states(std::move(states))
+  , m_key(std::move(key))
+  , m_resumed(restored.has_value())
+  , m_rescaler(restored
+                 ? TSRescaler::resumed(std::move(clock), *restored, local_time_base, SNAPSHOT_MAX_RESUME_DRIFT)
+                 : TSRescaler::clock_relative(std::move(clock), local_time_base))
+{}
+}
@@ -0,0 +1,194 @@
+#pragma once
+
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <tuple>
+#include <vector>
+
+#include "binary_parser.h"
+#include "clock.h"
+#include "iospec.h"
+#include "metadata.h"
+
+namespace metamix {
+
+/// Furthest distance between clock and the first rescaled timestamp, at which restored rescaler state is resumed.
+constexpr ClockTS SNAPSHOT_MAX_RESUME_DRIFT{ 10 * SYS_CLOCK_RATE };
+
+template<class... Ks>
+using MetadataVectors = std::tuple<std::vector<Metadata<Ks>>...>;
+
+/**
+ * @brief Point-in-time copy of state needed to resume injection after restart.
+ */
+struct Snapshot
+{
+  ClockTS clock{ 0 };
+
+  /// Names of inputs, entries are reassigned to inputs by names on restore, because ids depend on configuration.
+  std::map<InputId, std::string> inputs{};
+
+  /// States of rescalers, keyed by rescaler name.
+  std::map<std::string, TSRescaler::State> rescalers{};
+
+  /// Live metadata queue entries of each kind.
+  MetadataKindPack::Apply<MetadataVectors> entries{};
+
+  template<class K>
+  std::vector<Metadata<K>> &get()
+  {
+    return std::get<std::vector<Metadata<K>>>(entries);
+  }
+
+  template<class K>
+  const std::vector<Metadata<K>> &get() const
+  {
+    return std::get<std::vector<Metadata<K>>>(entries);
+  }
+};
+
+/// Appends binary representation of snapshot to output buffer.
+void
+emit_snapshot(const Snapshot &snapshot, std::vector<uint8_t> &out);
+
+/// Parses binary representation of snapshot, sections of unknown metadata kinds are skipped.
+///
+/// \throws BinaryParseError if data is malformed
+Snapshot
+parse_snapshot(const uint8_t *ptr, const uint8_t *endptr);
+
+/**
+ * @brief Snapshot storage in memory-mapped file, which survives crash at any point.
+ *
+ * The file consists of two equally sized slots, written alternately. Each slot is prefixed with header holding sequence
+ * number, length and CRC32 of its contents. Reader picks complete slot with the highest sequence number, so that torn
+ * write leaves the previous snapshot intact.
+ */
+class SnapshotFile
+{
+public:
+  static constexpr uint32_t MAGIC = 0x4d4d5350; // "MMSP"
+  static constexpr uint16_t VERSION = 1;
+
+  /// magic:32 version:16 reserved:16 sequence:64 length:32 crc:32
+  static constexpr size_t SLOT_HEADER_SIZE = 24;
+
+  static constexpr size_t DEFAULT_SLOT_CAPACITY = 1 << 20;
+
+private:
+  int m_fd{ -1 };
+  uint8_t *m_data{ nullptr };
+  size_t m_size{ 0 };
+
+  /// Slot holding the latest snapshot, and its sequence number.
+  size_t m_latest_slot{ 1 };
+  uint64_t m_sequence{ 0 };
+
+public:
+  /// Opens or creates snapshot file. File of different size is resized, the latest snapshot is kept if it fits.
+  ///
+  /// \throws std::system_error on I/O errors
+  explicit SnapshotFile(const std::string &path, size_t slot_capacity = DEFAULT_SLOT_CAPACITY);
+
+  ~SnapshotFile();
+
+  SnapshotFile(const SnapshotFile &) = delete;
+  SnapshotFile &operator=(const SnapshotFile &) = delete;
+
+  size_t slot_capacity() const noexcept { return m_size / 2 - SLOT_HEADER_SIZE; }
+
+  /// \return payload of the latest complete snapshot, or nothing if there is none
+  std::optional<std::vector<uint8_t>> read() const;
+
+  /// Writes payload to the slot not holding the latest snapshot, and flushes it to disk.
+  ///
+  /// \return false if payload exceeds slot capacity, nothing is written then
+  bool write(const std::vector<uint8_t> &payload);
+
+private:
+  void map(size_t size);
+  void unmap() noexcept;
+
+  /// Finds the latest complete slot, and sets m_latest_slot and m_sequence to it.
+  ///
+  /// \return false if there is no complete slot
+  bool find_latest() noexcept;
+
+  /// \return sequence number of slot, or nothing if it's not complete
+  std::optional<uint64_t> validate_slot(size_t slot) const noexcept;
+
+  const uint8_t *slot_data(size_t slot) const noexcept { return m_data + slot * (m_size / 2); }
+  uint8_t *slot_data(size_t slot) noexcept { return m_data + slot * (m_size / 2); }
+};
+
+/**
+ * @brief Registry of TSRescaler states, keyed by rescaler name.
+ *
+ * States restored from snapshot are handed out once, so that restarted extractors start afresh. States of running
+ * rescalers are collected for subsequent snapshots.
+ */
+class TSRescalerStates
+{
+private:
+  mutable std::mutex m{};
+  std::map<std::string, TSRescaler::State> m_restored{};
+  std::map<std::string, TSRescaler::State> m_current{};
+
+public:
+  void restore(std::map<std::string, TSRescaler::State> states);
+
+  std::optional<TSRescaler::State> take_restored(const std::string &key);
+
+  void publish(const std::string &key, const TSRescaler::State &state);
+
+  std::map<std::string, TSRescaler::State> current() const;
+};
+
+/**
+ * @brief TSRescaler resuming state restored from snapshot, which publishes its own state for subsequent snapshots.
+ *
+ * Without restored state it behaves like TSRescaler::clock_relative.
+ */
+class PersistentTSRescaler
+{
+private:
+  std::shared_ptr<TSRescalerStates> m_states;
+  std::string m_key;
+  bool m_resumed;
+  TSRescaler m_rescaler;
+  bool m_published{ false };
+
+public:
+  PersistentTSRescaler(std::shared_ptr<TSRescalerStates> states,
+                       std::string key,
+                       std::shared_ptr<Clock> clock,
+                       StreamTimeBase local_time_base);
+
+  /// Whether rescaler has been created from restored state.
+  bool is_resumed() const noexcept { return m_resumed; }
+
+  ClockTS rescale_to_clock(StreamTS ts)
+  {
+    auto r = m_rescaler.rescale_to_clock(ts);
+
+    // State is settled by the first rescale.
+    if (!m_published) {
+      m_states->publish(m_key, m_rescaler.state());
+      m_published = true;
+    }
+
+    return r;
+  }
+
+private:
+  PersistentTSRescaler(std::shared_ptr<TSRescalerStates> states,
+                       std::string key,
+                       std::shared_ptr<Clock> clock,
+                       StreamTimeBase local_time_base,
+                       std::optional<TSRescaler::State> restored);
+};
+}
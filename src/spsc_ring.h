@@ -0,0 +1,179 @@
+#pragma once
+
+#include <atomic>
+#include <cassert>
+#include <cstddef>
+#include <memory>
+#include <new>
+#include <stdexcept>
+#include <type_traits>
+#include <utility>
+
+namespace metamix {
+
+/**
+ * @brief Bounded, wait-free single-producer single-consumer ring buffer.
+ *
+ * Exactly one thread may call producer methods (`try_push`, `try_push_range`, `tail_position`) and exactly one (other)
+ * thread may call consumer methods (`front`, `pop`, `head_position`). `size` and `empty` may be called from any
+ * thread, but their result is only a snapshot.
+ *
+ * Positions are monotonic counters which never wrap in practice, slot index is obtained by masking them with capacity,
+ * which is always a power of two.
+ */
+template<typename T>
+class SpscRing
+{
+public:
+  using ValueType = T;
+
+  static constexpr size_t CACHE_LINE_SIZE = 64;
+
+private:
+  using Slot = std::aligned_storage_t<sizeof(T), alignof(T)>;
+
+  const size_t m_capacity;
+  const size_t m_mask;
+  std::unique_ptr<Slot[]> m_slots;
+
+  /// Next position to read, written by consumer only.
+  alignas(CACHE_LINE_SIZE) std::atomic<size_t> m_head{ 0 };
+
+  /// Producer's cached copy of m_head, avoids bouncing consumer's cache line on every push.
+  alignas(CACHE_LINE_SIZE) size_t m_head_cache{ 0 };
+
+  /// Next position to write, written by producer only.
+  alignas(CACHE_LINE_SIZE) std::atomic<size_t> m_tail{ 0 };
+
+  /// Consumer's cached copy of m_tail.
+  alignas(CACHE_LINE_SIZE) size_t m_tail_cache{ 0 };
+
+public:
+  /// \param position  position of the first element, so that positions may continue those of another ring
+  explicit SpscRing(size_t capacity, size_t position = 0)
+    : m_capacity{ round_up_pow2(capacity) }
+    , m_mask{ m_capacity - 1 }
+    , m_slots{ std::make_unique<Slot[]>(m_capacity) }
+    , m_head{ position }
+    , m_head_cache{ position }
+    , m_tail{ position }
+    , m_tail_cache{ position }
+  {}
+
+  SpscRing(const SpscRing &) = delete;
+  SpscRing &operator=(const SpscRing &) = delete;
+
+  ~SpscRing()
+  {
+    while (pop()) {
+    }
+  }
+
+  size_t capacity() const noexcept { return m_capacity; }
+
+  size_t size() const noexcept
+  {
+    auto head = m_head.load(std::memory_order_acquire);
+    auto tail = m_tail.load(std::memory_order_acquire);
+    return tail >= head ? tail - head : 0;
+  }
+
+  bool empty() const noexcept { return size() == 0; }
+
+  /// \return position one past the last pushed element (producer side)
+  size_t tail_position() const noexcept { return m_tail.load(std::memory_order_acquire); }
+
+  /// \return position of the oldest stored element (consumer side)
+  size_t head_position() const noexcept { return m_head.load(std::memory_order_acquire); }
+
+  /// Moves value into ring, if there is space for it.
+  ///
+  /// \return true if value has been pushed, false if ring is full (value is left intact then)
+  template<typename U>
+  bool try_push(U &&value) noexcept(std::is_nothrow_constructible_v<T, U &&>)
+  {
+    auto tail = m_tail.load(std::memory_order_relaxed);
+
+    if (tail - m_head_cache >= m_capacity) {
+      m_head_cache = m_head.load(std::memory_order_acquire);
+      if (tail - m_head_cache >= m_capacity) {
+        return false;
+      }
+    }
+
+    new (&m_slots[tail & m_mask]) T(std::forward<U>(value));
+    m_tail.store(tail + 1, std::memory_order_release);
+    return true;
+  }
+
+  /// Moves values into ring, as many as there is space for, and publishes them to consumer at once.
+  ///
+  /// \return count of pushed values, the rest is left intact
+  template<typename InputIt>
+  size_t try_push_range(InputIt first, InputIt last)
+  {
+    auto tail = m_tail.load(std::memory_order_relaxed);
+
+    size_t pushed = 0;
+    for (; first != last; ++first, ++pushed) {
+      if (tail + pushed - m_head_cache >= m_capacity) {
+        m_head_cache = m_head.load(std::memory_order_acquire);
+        if (tail + pushed - m_head_cache >= m_capacity) {
+          break;
+        }
+      }
+
+      new (&m_slots[(tail + pushed) & m_mask]) T(*first);
+    }
+
+    if (pushed > 0) {
+      m_tail.store(tail + pushed, std::memory_order_release);
+    }
+    return pushed;
+  }
+
+  /// \return pointer to the oldest element, or nullptr if ring is empty
+  T *front() noexcept
+  {
+    auto head = m_head.load(std::memory_order_relaxed);
+
+    if (head == m_tail_cache) {
+      m_tail_cache = m_tail.load(std::memory_order_acquire);
+      if (head == m_tail_cache) {
+        return nullptr;
+      }
+    }
+
+    return std::launder(reinterpret_cast<T *>(&m_slots[head & m_mask]));
+  }
+
+  /// Destroys the oldest element.
+  ///
+  /// \return false if ring was empty
+  bool pop() noexcept
+  {
+    T *value = front();
+    if (value == nullptr) {
+      return false;
+    }
+
+    value->~T();
+    m_head.store(m_head.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+    return true;
+  }
+
+private:
+  static size_t round_up_pow2(size_t x)
+  {
+    if (x == 0) {
+      throw std::invalid_argument("ring capacity must be positive");
+    }
+
+    size_t r = 1;
+    while (r < x) {
+      r <<= 1;
+    }
+    return r;
+  }
+};
+}
@@ -8,18 +8,13 @@ using metamix::h264::build_empty_metadata;
 
 namespace metamix {
 
-std::optional<std::vector<Metadata<SeiKind>>>
-UserDefinedInput::run_query_sei(ClockTS since_ts, ClockTS until_ts, const ApplicationContext &ctx)
+bool
+UserDefinedInput::run_query_sei(ClockTS since_ts,
+                                ClockTS until_ts,
+                                const ApplicationContext &ctx,
+                                std::vector<Metadata<SeiKind>> &found)
 {
-  std::vector<Metadata<SeiKind>> v;
-
-  int popped = ctx.meta_queue->pop_all<SeiKind>(m_spec.id, since_ts, until_ts, std::back_inserter(v));
-
-  if (popped > 0) {
-    return std::move(v);
-  } else {
-    return std::nullopt;
-  }
+  return ctx.meta_queue->pop_all<SeiKind>(m_spec.id, since_ts, until_ts, std::back_inserter(found)) > 0;
 }
 
 void
@@ -1,6 +1,7 @@
 #pragma once
 
 #include <atomic>
+#include <iterator>
 
 #include "abstract_input.h"
 
@@ -38,9 +39,25 @@ public:
     ctx.meta_queue->push(Metadata<K>(spec().id, pts, dts, order, std::move(val)));
   }
 
+  /// Pushes metadata of single kind, assigned to this input, with at most one queue lock acquisition (or one ring
+  /// publish). Values are moved from the range.
+  template<class ForwardIt>
+  void push_range(ForwardIt first, ForwardIt last, const ApplicationContext &ctx)
+  {
+    using K = typename std::iterator_traits<ForwardIt>::value_type::Kind;
+
+    if (first == last) {
+      return;
+    }
+
+    declare_capability<K>();
+    ctx.meta_queue->push_range(std::make_move_iterator(first), std::make_move_iterator(last));
+  }
+
 protected:
-  virtual std::optional<std::vector<Metadata<SeiKind>>> run_query_sei(ClockTS since_ts,
-                                                                      ClockTS until_ts,
-                                                                      const ApplicationContext &ctx);
+  virtual bool run_query_sei(ClockTS since_ts,
+                             ClockTS until_ts,
+                             const ApplicationContext &ctx,
+                             std::vector<Metadata<SeiKind>> &found);
 };
 }
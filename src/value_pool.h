@@ -0,0 +1,309 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <memory>
+#include <mutex>
+#include <new>
+#include <tuple>
+#include <utility>
+#include <vector>
+
+#include "metadata.h"
+
+namespace metamix {
+
+namespace detail {
+
+/**
+ * @brief Free list of equally sized memory blocks owned by single producer.
+ *
+ * Only the owning producer allocates, while any thread may return blocks. Returned blocks are pushed to a lock-free
+ * stack, which the owner takes over as a whole once its private free list runs out.
+ *
+ * Blocks of the size of the first allocation are pooled, other sizes fall through to the global allocator.
+ */
+class ValuePoolShard
+{
+private:
+  static constexpr size_t CACHE_LINE_SIZE = 64;
+
+  struct FreeBlock
+  {
+    FreeBlock *next;
+  };
+
+  std::atomic<size_t> m_block_size{ 0 };
+
+  // Owner side
+  FreeBlock *m_free{ nullptr };
+  std::atomic<size_t> m_capacity{ 0 };
+  std::atomic<size_t> m_allocated{ 0 };
+
+  // Returning side
+  alignas(CACHE_LINE_SIZE) std::atomic<FreeBlock *> m_returned{ nullptr };
+  std::atomic<size_t> m_released{ 0 };
+
+public:
+  ValuePoolShard() = default;
+
+  ValuePoolShard(const ValuePoolShard &) = delete;
+  ValuePoolShard &operator=(const ValuePoolShard &) = delete;
+
+  ~ValuePoolShard()
+  {
+    release_list(m_free);
+    release_list(m_returned.load(std::memory_order_acquire));
+  }
+
+  void *allocate(size_t size)
+  {
+    size_t block_size = m_block_size.load(std::memory_order_relaxed);
+    if (block_size == 0) {
+      block_size = std::max(size, sizeof(FreeBlock));
+      m_block_size.store(block_size, std::memory_order_relaxed);
+    }
+
+    if (std::max(size, sizeof(FreeBlock)) != block_size) {
+      return ::operator new(size);
+    }
+
+    if (m_free == nullptr) {
+      m_free = m_returned.exchange(nullptr, std::memory_order_acquire);
+    }
+
+    void *ptr;
+    if (m_free != nullptr) {
+      ptr = m_free;
+      m_free = m_free->next;
+    } else {
+      ptr = ::operator new(block_size);
+      m_capacity.store(m_capacity.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+    }
+
+    m_allocated.store(m_allocated.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+    return ptr;
+  }
+
+  void deallocate(void *ptr, size_t size) noexcept
+  {
+    if (std::max(size, sizeof(FreeBlock)) != m_block_size.load(std::memory_order_relaxed)) {
+      ::operator delete(ptr);
+      return;
+    }
+
+    auto block = static_cast<FreeBlock *>(ptr);
+    block->next = m_returned.load(std::memory_order_relaxed);
+    while (!m_returned.compare_exchange_weak(block->next, block, std::memory_order_release)) {
+    }
+    m_released.fetch_add(1, std::memory_order_relaxed);
+  }
+
+  /// Count of pooled blocks, both free and in use.
+  size_t capacity() const noexcept { return m_capacity.load(std::memory_order_relaxed); }
+
+  /// Approximate count of pooled blocks in use.
+  size_t in_use() const noexcept
+  {
+    size_t released = m_released.load(std::memory_order_relaxed);
+    size_t allocated = m_allocated.load(std::memory_order_relaxed);
+    return allocated > released ? allocated - released : 0;
+  }
+
+private:
+  static void release_list(FreeBlock *block) noexcept
+  {
+    while (block != nullptr) {
+      auto next = block->next;
+      ::operator delete(block);
+      block = next;
+    }
+  }
+};
+}
+
+/**
+ * @brief Allocator drawing memory from shard of ValuePool.
+ *
+ * Copies stored in control blocks of `std::allocate_shared` keep the shard alive until the last value is released.
+ */
+template<class T>
+class ValuePoolAllocator
+{
+  static_assert(alignof(T) <= alignof(std::max_align_t), "Pooled blocks are aligned to max_align_t");
+
+  template<class U>
+  friend class ValuePoolAllocator;
+
+public:
+  using value_type = T;
+
+private:
+  std::shared_ptr<detail::ValuePoolShard> m_shard;
+
+public:
+  explicit ValuePoolAllocator(std::shared_ptr<detail::ValuePoolShard> shard) noexcept
+    : m_shard(std::move(shard))
+  {}
+
+  template<class U>
+  ValuePoolAllocator(const ValuePoolAllocator<U> &other) noexcept
+    : m_shard(other.m_shard)
+  {}
+
+  T *allocate(size_t n) { return static_cast<T *>(m_shard->allocate(n * sizeof(T))); }
+
+  void deallocate(T *ptr, size_t n) noexcept { m_shard->deallocate(ptr, n * sizeof(T)); }
+
+  template<class U>
+  bool operator==(const ValuePoolAllocator<U> &rhs) const noexcept
+  {
+    return m_shard == rhs.m_shard;
+  }
+
+  template<class U>
+  bool operator!=(const ValuePoolAllocator<U> &rhs) const noexcept
+  {
+    return !(*this == rhs);
+  }
+};
+
+/**
+ * @brief Pool of memory backing shared values of type `T`, split into shards owned by producers.
+ *
+ * Each producer thread allocates from its own shard without synchronizing with other producers, and values released
+ * by the consumer return to the shard they came from. Shards of destroyed producers are handed to subsequent ones, so
+ * that restarted extractors reuse memory of their predecessors.
+ */
+template<class T>
+class ValuePool
+{
+public:
+  struct Stats
+  {
+    size_t capacity{ 0 };
+    size_t in_use{ 0 };
+    size_t producers{ 0 };
+  };
+
+  /**
+   * @brief Exclusive handle of single shard, used by one thread at a time.
+   */
+  class Producer
+  {
+  private:
+    ValuePool *m_pool;
+    std::shared_ptr<detail::ValuePoolShard> m_shard;
+
+  public:
+    Producer(ValuePool &pool, std::shared_ptr<detail::ValuePoolShard> shard)
+      : m_pool(&pool)
+      , m_shard(std::move(shard))
+    {}
+
+    Producer(const Producer &) = delete;
+    Producer &operator=(const Producer &) = delete;
+
+    Producer(Producer &&other) noexcept
+      : m_pool(other.m_pool)
+      , m_shard(std::move(other.m_shard))
+    {}
+
+    Producer &operator=(Producer &&) = delete;
+
+    ~Producer()
+    {
+      if (m_shard) {
+        m_pool->release(m_shard);
+      }
+    }
+
+    template<class... Args>
+    std::shared_ptr<T> make(Args &&... args)
+    {
+      return std::allocate_shared<T>(ValuePoolAllocator<T>(m_shard), std::forward<Args>(args)...);
+    }
+  };
+
+private:
+  struct ShardEntry
+  {
+    std::shared_ptr<detail::ValuePoolShard> shard;
+    bool taken;
+  };
+
+  mutable std::mutex m{};
+  std::vector<ShardEntry> m_shards{};
+
+public:
+  ValuePool() = default;
+
+  ValuePool(const ValuePool &) = delete;
+  ValuePool &operator=(const ValuePool &) = delete;
+
+  /// Hands out free shard, or a new one if all are taken.
+  Producer producer()
+  {
+    std::lock_guard<std::mutex> guard(m);
+
+    for (auto &entry : m_shards) {
+      if (!entry.taken) {
+        entry.taken = true;
+        return Producer(*this, entry.shard);
+      }
+    }
+
+    m_shards.push_back({ std::make_shared<detail::ValuePoolShard>(), true });
+    return Producer(*this, m_shards.back().shard);
+  }
+
+  Stats stats() const
+  {
+    std::lock_guard<std::mutex> guard(m);
+
+    Stats stats{};
+    for (const auto &entry : m_shards) {
+      stats.capacity += entry.shard->capacity();
+      stats.in_use += entry.shard->in_use();
+      stats.producers += entry.taken ? 1 : 0;
+    }
+    return stats;
+  }
+
+private:
+  void release(const std::shared_ptr<detail::ValuePoolShard> &shard)
+  {
+    std::lock_guard<std::mutex> guard(m);
+
+    for (auto &entry : m_shards) {
+      if (entry.shard == shard) {
+        entry.taken = false;
+      }
+    }
+  }
+};
+
+/**
+ * @brief Value pools of each metadata kind.
+ */
+template<class... Ks>
+class ValuePoolGroup
+{
+private:
+  std::tuple<ValuePool<typename Metadata<Ks>::ValueType>...> m_pools{};
+
+public:
+  template<class K>
+  ValuePool<typename Metadata<K>::ValueType> &get()
+  {
+    return std::get<ValuePool<typename Metadata<K>::ValueType>>(m_pools);
+  }
+
+  template<class K>
+  const ValuePool<typename Metadata<K>::ValueType> &get() const
+  {
+    return std::get<ValuePool<typename Metadata<K>::ValueType>>(m_pools);
+  }
+};
+}
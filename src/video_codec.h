@@ -0,0 +1,159 @@
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <ostream>
+#include <utility>
+
+#include "h264/emitter.h"
+#include "h264/nalu.h"
+#include "h265/nalu.h"
+#include "log.h"
+
+namespace metamix {
+
+/// Video codecs of streams carrying closed captions in SEI NALUs.
+enum class VideoCodec
+{
+  H264,
+  H265,
+};
+
+inline std::ostream &
+operator<<(std::ostream &os, VideoCodec codec)
+{
+  switch (codec) {
+  case VideoCodec::H264:
+    return os << "H.264";
+  case VideoCodec::H265:
+    return os << "H.265";
+  }
+  return os << "unknown";
+}
+
+/**
+ * @brief NALU header syntax of H.264 streams, as seen by SEI extraction and injection.
+ *
+ * NALUs of either codec are split by the same parsers, and their headers are interpreted by the syntax of the codec.
+ */
+struct H264SeiSyntax
+{
+  static constexpr size_t NALU_HEADER_SIZE = 1;
+
+  static constexpr const auto &SEI_NALU_HEADER = h264::detail::SEI_NALU_HEADER;
+
+  using SeiNaluHeader = std::array<uint8_t, NALU_HEADER_SIZE>;
+
+  /// Header of SEI NALU emitted into access unit containing given NALU, which may be empty.
+  static SeiNaluHeader sei_nalu_header(const h264::Nalu &) { return SEI_NALU_HEADER; }
+
+  static bool is_valid(const h264::Nalu &nalu) { return nalu.is_valid(); }
+
+  /// Whether NALU carries SEI messages, which may contain closed captions.
+  static bool is_sei(const h264::Nalu &nalu) { return nalu.type() == h264::NaluType::SEI; }
+
+  /// Whether NALU must precede SEI NALUs of access unit.
+  static bool precedes_sei(const h264::Nalu &nalu)
+  {
+    auto type = nalu.type();
+    return type == h264::NaluType::AUD || type == h264::NaluType::SPS || type == h264::NaluType::PPS;
+  }
+};
+
+/**
+ * @brief NALU header syntax of H.265 streams, which carry closed captions in prefix SEI NALUs.
+ */
+struct H265SeiSyntax
+{
+  static constexpr size_t NALU_HEADER_SIZE = h265::Nalu::HEADER_SIZE;
+
+  static constexpr const auto &SEI_NALU_HEADER = h265::PREFIX_SEI_NALU_HEADER;
+
+  using SeiNaluHeader = std::array<uint8_t, NALU_HEADER_SIZE>;
+
+  /// Header of SEI NALU emitted into access unit containing given NALU, in its layer and temporal sub-layer. Empty NALU
+  /// stands for access unit without any, whose SEI goes to base layer.
+  static SeiNaluHeader sei_nalu_header(const h264::Nalu &nalu)
+  {
+    return nalu.empty() ? SEI_NALU_HEADER : h265::prefix_sei_nalu_header(nalu.data());
+  }
+
+  static bool is_valid(const h264::Nalu &nalu) { return h265::is_valid_header(nalu.data(), nalu.size()); }
+
+  static bool is_sei(const h264::Nalu &nalu) { return h265::nalu_type(nalu.front()) == h265::NaluType::PREFIX_SEI; }
+
+  static bool precedes_sei(const h264::Nalu &nalu)
+  {
+    auto type = h265::nalu_type(nalu.front());
+    return type == h265::NaluType::AUD || type == h265::NaluType::VPS || type == h265::NaluType::SPS ||
+           type == h265::NaluType::PPS;
+  }
+};
+
+/// SEI NALU of access unit, or place where it is to be inserted.
+struct SeiNaluRange
+{
+  /// Offsets of SEI NALU in access unit, with its framing.
+  size_t begin;
+  size_t end;
+
+  /// Found SEI NALU, empty if there is none.
+  h264::NaluView nalu;
+
+  /// NALU of access unit whose header the emitted SEI NALU derives from: the found SEI NALU, or the NALU it is to be
+  /// inserted before. Empty if there is neither.
+  h264::NaluView anchor;
+};
+
+/**
+ * @brief Finds bytes of access unit to be replaced by SEI NALU.
+ *
+ * These are the first SEI NALU, with its framing, if it follows NALUs which have to precede SEIs. Otherwise the range
+ * is empty, and marks where SEI NALU is to be inserted, before the first NALU which must not precede it. NALUs
+ * following that one are not parsed at all, and parsed NALUs refer to access unit data.
+ */
+template<class SeiSyntax, class NaluParser>
+SeiNaluRange
+find_sei_nalu(const uint8_t *data, size_t size)
+{
+  size_t begin = 0;
+
+  auto nalu_parser = NaluParser::create(data, data + size);
+  h264::NaluView nalu;
+  while (nalu_parser) {
+    nalu_parser >> nalu;
+
+    if (!SeiSyntax::is_valid(nalu)) {
+      LOG(warning) << "Invalid NALU spotted";
+      continue;
+    }
+
+    // Framing of the next NALU begins right after the previous NALU
+    size_t nalu_end = nalu.data() + nalu.size() - data;
+
+    if (SeiSyntax::precedes_sei(nalu)) {
+      begin = nalu_end;
+    } else if (SeiSyntax::is_sei(nalu)) {
+      return { begin, nalu_end, nalu, nalu };
+    } else {
+      return { begin, begin, h264::NaluView(), nalu };
+    }
+  }
+
+  return { begin, begin, h264::NaluView(), h264::NaluView() };
+}
+
+/// Calls `f` with SEI syntax type of given codec.
+template<class F>
+decltype(auto)
+visit_video_codec(VideoCodec codec, F &&f)
+{
+  switch (codec) {
+  case VideoCodec::H265:
+    return std::forward<F>(f)(H265SeiSyntax{});
+  default:
+    return std::forward<F>(f)(H264SeiSyntax{});
+  }
+}
+}
@@ -0,0 +1,165 @@
+#include "allocation_counter.h"
+
+#include <cstddef>
+#include <cstdlib>
+#include <new>
+
+namespace {
+thread_local size_t allocation_count = 0;
+}
+
+namespace metamix::test {
+
+size_t
+thread_allocation_count() noexcept
+{
+  return allocation_count;
+}
+}
+
+// Replacements of all global allocation functions, so that no allocation form escapes counting. Standard library
+// forwards only some forms to others, which is left unspecified.
+
+namespace {
+
+void *
+counted_alloc(size_t size, size_t alignment) noexcept
+{
+  allocation_count++;
+  size = size == 0 ? 1 : size;
+  if (alignment <= alignof(std::max_align_t)) {
+    return std::malloc(size);
+  }
+  // Size of aligned allocation must be multiple of alignment
+  return std::aligned_alloc(alignment, (size + alignment - 1) / alignment * alignment);
+}
+
+void *
+counted_alloc_or_throw(size_t size, size_t alignment)
+{
+  if (void *ptr = counted_alloc(size, alignment)) {
+    return ptr;
+  }
+  throw std::bad_alloc();
+}
+}
+
+void *
+operator new(size_t size)
+{
+  return counted_alloc_or_throw(size, alignof(std::max_align_t));
+}
+
+void *
+operator new[](size_t size)
+{
+  return counted_alloc_or_throw(size, alignof(std::max_align_t));
+}
+
+void *
+operator new(size_t size, std::align_val_t alignment)
+{
+  return counted_alloc_or_throw(size, static_cast<size_t>(alignment));
+}
+
+void *
+operator new[](size_t size, std::align_val_t alignment)
+{
+  return counted_alloc_or_throw(size, static_cast<size_t>(alignment));
+}
+
+void *
+operator new(size_t size, const std::nothrow_t &) noexcept
+{
+  return counted_alloc(size, alignof(std::max_align_t));
+}
+
+void *
+operator new[](size_t size, const std::nothrow_t &) noexcept
+{
+  return counted_alloc(size, alignof(std::max_align_t));
+}
+
+void *
+operator new(size_t size, std::align_val_t alignment, const std::nothrow_t &) noexcept
+{
+  return counted_alloc(size, static_cast<size_t>(alignment));
+}
+
+void *
+operator new[](size_t size, std::align_val_t alignment, const std::nothrow_t &) noexcept
+{
+  return counted_alloc(size, static_cast<size_t>(alignment));
+}
+
+void
+operator delete(void *ptr) noexcept
+{
+  std::free(ptr);
+}
+
+void
+operator delete[](void *ptr) noexcept
+{
+  std::free(ptr);
+}
+
+void
+operator delete(void *ptr, size_t) noexcept
+{
+  std::free(ptr);
+}
+
+void
+operator delete[](void *ptr, size_t) noexcept
+{
+  std::free(ptr);
+}
+
+void
+operator delete(void *ptr, std::align_val_t) noexcept
+{
+  std::free(ptr);
+}
+
+void
+operator delete[](void *ptr, std::align_val_t) noexcept
+{
+  std::free(ptr);
+}
+
+void
+operator delete(void *ptr, size_t, std::align_val_t) noexcept
+{
+  std::free(ptr);
+}
+
+void
+operator delete[](void *ptr, size_t, std::align_val_t) noexcept
+{
+  std::free(ptr);
+}
+
+void
+operator delete(void *ptr, const std::nothrow_t &) noexcept
+{
+  std::free(ptr);
+}
+
+void
+operator delete[](void *ptr, const std::nothrow_t &) noexcept
+{
+  std::free(ptr);
+}
+
+void
+operator delete(void *ptr, std::align_val_t, const std::nothrow_t &) noexcept
+{
+  std::free(ptr);
+}
+
+void
+operator delete[](void *ptr, std::align_val_t, const std::nothrow_t &) noexcept
+{
+  std::free(ptr);
+}
@@ -0,0 +1,22 @@
+#pragma once
+
+#include <cstddef>
+
+namespace metamix::test {
+
+/// Count of heap allocations made by the calling thread so far.
+size_t
+thread_allocation_count() noexcept;
+
+/**
+ * @brief Counts heap allocations made by the calling thread since construction.
+ */
+class AllocationCounter
+{
+private:
+  size_t m_start{ thread_allocation_count() };
+
+public:
+  size_t count() const noexcept { return thread_allocation_count() - m_start; }
+};
+}
@@ -0,0 +1,323 @@
+#include <boost/test/unit_test.hpp>
+
+#include <boost/test/test_tools.hpp>
+
+#include <random>
+#include <set>
+
+#include <src/calendar_metadata_queue.h>
+#include <src/metadata_kind.h>
+#include <src/metadata_queue.h>
+#include <src/optional_io.h>
+
+using namespace metamix;
+
+METAMIX_METADATA_KIND(CalendarTestKind, calendar_test, calendarTest, "CALTEST", "Calendar Test")
+
+METAMIX_METADATA_KIND_MAP_TO_VALUE(CalendarTestKind, ClockTS)
+
+using CalendarTestMetadata = Metadata<CalendarTestKind>;
+using CalendarTestMetadataQueue = CalendarMetadataQueue<CalendarTestKind>;
+
+static constexpr ClockTS
+nts(float i)
+{
+  return static_cast<ClockTS>(100.0f * i);
+}
+
+static CalendarTestMetadata
+nth(float i, InputId input_id = 0, int order = 0)
+{
+  return CalendarTestMetadata(input_id, nts(i), nts(i), order, std::make_shared<ClockTS>(nts(i)));
+}
+
+static CalendarTestMetadata
+at(TS pts, InputId input_id = 0)
+{
+  return CalendarTestMetadata(input_id, ClockTS(pts), ClockTS(pts), 0, std::make_shared<ClockTS>(pts));
+}
+
+/// Feeds the same entries to heap and calendar queues, and checks they pop the same.
+static void
+check_matches_heap(CalendarTestMetadataQueue &calendar, TS max_jitter)
+{
+  std::mt19937 rng(42);
+  std::uniform_int_distribution<TS> jitter(-300, max_jitter);
+
+  MetadataQueue<CalendarTestKind> heap;
+
+  // Heap queue drops entries colliding with popped one, keep pts unique within each input.
+  std::set<TS> used_pts[4];
+
+  TS now = 0;
+  for (int frame = 0; frame < 1000; frame++) {
+    for (InputId id = 0; id < 4; id++) {
+      TS pts;
+      do {
+        pts = now + jitter(rng);
+      } while (!used_pts[id].insert(pts).second);
+
+      auto m = CalendarTestMetadata(id, ClockTS(pts), ClockTS(now), frame, std::make_shared<ClockTS>());
+      heap.push(m);
+      calendar.push(m);
+    }
+
+    std::vector<CalendarTestMetadata> expected, actual;
+    heap.pop_all(frame % 4, now - 1500, now, std::back_inserter(expected));
+    calendar.pop_all(frame % 4, now - 1500, now, std::back_inserter(actual));
+    BOOST_CHECK_EQUAL_COLLECTIONS(actual.begin(), actual.end(), expected.begin(), expected.end());
+
+    now += 1500;
+  }
+}
+
+BOOST_AUTO_TEST_SUITE(calendar_metadata_queue_test)
+
+BOOST_AUTO_TEST_CASE(empty)
+{
+  CalendarTestMetadataQueue q(100);
+  BOOST_TEST(q.empty());
+  BOOST_TEST(!q.pop(0, nts(0), nts(10)));
+}
+
+BOOST_AUTO_TEST_CASE(pop_middle_second_id)
+{
+  CalendarTestMetadataQueue q(100);
+  q.push(nth(1));
+  q.push(nth(2));
+  q.push(nth(3));
+  q.push(nth(2, 1));
+  BOOST_TEST(q.pop(1, nts(1.5), nts(2.5)) == nth(2, 1));
+  BOOST_TEST(q.size() == 1);
+}
+
+BOOST_AUTO_TEST_CASE(pop_before)
+{
+  CalendarTestMetadataQueue q(100);
+  q.push(nth(1));
+  BOOST_TEST(!q.pop(0, nts(0.25), nts(0.75)));
+  BOOST_TEST(q.size() == 1);
+}
+
+BOOST_AUTO_TEST_CASE(pop_all_drops_other_inputs)
+{
+  std::vector<CalendarTestMetadata> expected;
+  expected.push_back(nth(1, 0));
+  expected.push_back(nth(2, 0));
+  expected.push_back(nth(3, 0));
+
+  CalendarTestMetadataQueue q(100);
+  q.push(nth(4, 0));
+  q.push(nth(4, 2));
+  q.push(nth(3, 0));
+  q.push(nth(2, 0));
+  q.push(nth(1, 2));
+  q.push(nth(1, 0));
+  q.push(nth(2, 1));
+  q.push(nth(3, 2));
+  q.push(nth(0, 0));
+  q.push(nth(0, 1));
+
+  std::vector<CalendarTestMetadata> actual;
+  q.pop_all(0, nts(1), nts(4), std::back_inserter(actual));
+
+  BOOST_CHECK_EQUAL_COLLECTIONS(actual.begin(), actual.end(), expected.begin(), expected.end());
+  BOOST_TEST(q.size() == 2);
+}
+
+BOOST_AUTO_TEST_CASE(pop_keeps_order_within_frame)
+{
+  CalendarTestMetadataQueue q;
+  q.push(nth(1, 0, 1));
+  q.push(nth(1, 1, 0));
+  q.push(nth(1, 0, 0));
+
+  BOOST_TEST(q.pop(0, nts(0), nts(2)) == nth(1, 0, 0));
+  BOOST_TEST(q.pop(0, nts(0), nts(2)) == nth(1, 0, 1));
+  BOOST_TEST(!q.pop(0, nts(0), nts(2)));
+  BOOST_TEST(q.empty());
+}
+
+BOOST_AUTO_TEST_CASE(push_after_watermark_is_dropped)
+{
+  CalendarTestMetadataQueue q(100);
+  std::vector<CalendarTestMetadata> actual;
+  q.pop_all(0, nts(0), nts(2), std::back_inserter(actual));
+  q.push(nth(1));
+  BOOST_TEST(q.empty());
+  BOOST_TEST(q.stats().late_entries == 1);
+}
+
+BOOST_AUTO_TEST_CASE(watermark_follows_clock_back)
+{
+  CalendarTestMetadataQueue q(100);
+  std::vector<CalendarTestMetadata> actual;
+  q.pop_all(0, nts(10), nts(20), std::back_inserter(actual));
+
+  // Output clock restarts
+  q.pop_all(0, nts(0), nts(1), std::back_inserter(actual));
+  q.push(nth(2));
+  BOOST_TEST(q.size() == 1);
+  BOOST_TEST(q.stats().late_entries == 0);
+  BOOST_TEST(q.pop(0, nts(1), nts(3)) == nth(2));
+}
+
+BOOST_AUTO_TEST_CASE(grows_for_far_entries)
+{
+  CalendarTestMetadataQueue q(100, 2);
+  q.push(nth(1));
+  q.push(nth(100));
+  q.push(nth(50));
+  BOOST_TEST(q.pop(0, nts(0), nts(60)) == nth(1));
+  BOOST_TEST(q.pop(0, nts(0), nts(60)) == nth(50));
+  BOOST_TEST(q.pop(0, nts(60), nts(200)) == nth(100));
+  BOOST_TEST(q.empty());
+}
+
+BOOST_AUTO_TEST_CASE(far_entries_wait_in_overflow)
+{
+  CalendarTestMetadataQueue q(100, 2, {}, 4);
+  q.push(nth(1));
+  q.push(nth(1000));
+  q.push(nth(3));
+  q.push(nth(500));
+  q.push(nth(1001));
+  BOOST_TEST(q.size() == 5);
+
+  std::vector<CalendarTestMetadata> snapshot;
+  q.snapshot(std::back_inserter(snapshot));
+  BOOST_TEST(snapshot == std::vector<CalendarTestMetadata>({ nth(1), nth(3), nth(500), nth(1000), nth(1001) }));
+
+  BOOST_TEST(q.pop(0, nts(0), nts(10)) == nth(1));
+  BOOST_TEST(q.pop(0, nts(0), nts(10)) == nth(3));
+  BOOST_TEST(!q.pop(0, nts(10), nts(20)));
+  BOOST_TEST(q.pop(0, nts(499), nts(501)) == nth(500));
+
+  // Entries pushed between window and overflow keep their order
+  q.push(nth(999));
+  BOOST_TEST(q.pop(0, nts(900), nts(2000)) == nth(999));
+  BOOST_TEST(q.pop(0, nts(900), nts(2000)) == nth(1000));
+  BOOST_TEST(q.pop(0, nts(900), nts(2000)) == nth(1001));
+  BOOST_TEST(q.empty());
+}
+
+BOOST_AUTO_TEST_CASE(timestamp_wrap_keeps_both_timelines)
+{
+  constexpr TS WRAP = TS(1) << 33;
+
+  CalendarTestMetadataQueue q(1500, 4, {}, 16);
+  q.push(at(WRAP - 3000));
+  q.push(at(WRAP - 1500));
+
+  // Timestamps wrap, entries far ahead of new ones are kept aside
+  q.push(at(1500));
+  q.push(at(0));
+  BOOST_TEST(q.size() == 4);
+
+  BOOST_TEST(q.pop(0, 0, 3000) == at(0));
+  BOOST_TEST(q.pop(0, 0, 3000) == at(1500));
+  BOOST_TEST(q.pop(0, WRAP - 4500, WRAP) == at(WRAP - 3000));
+  BOOST_TEST(q.pop(0, WRAP - 4500, WRAP) == at(WRAP - 1500));
+  BOOST_TEST(q.empty());
+}
+
+BOOST_AUTO_TEST_CASE(evicting_last_bucketed_entry_moves_window_to_overflow)
+{
+  QueueBudget budget;
+  budget.max_entries = 2;
+
+  CalendarTestMetadataQueue q(100, 2, budget, 4);
+  q.push(nth(1));
+  q.push(nth(1000));
+  q.push(nth(1002));
+  q.push(nth(1001));
+
+  BOOST_TEST(q.stats().evicted_entries == 2);
+  BOOST_TEST(q.pop(0, nts(0), nts(2000)) == nth(1001));
+  BOOST_TEST(q.pop(0, nts(0), nts(2000)) == nth(1002));
+  BOOST_TEST(q.empty());
+}
+
+BOOST_AUTO_TEST_CASE(drop_id)
+{
+  CalendarTestMetadataQueue q(100);
+  q.push(nth(2, 0));
+  q.push(nth(1, 1));
+  q.push(nth(2, 1));
+
+  BOOST_TEST(q.drop_id(1) == 2);
+  BOOST_TEST(q.size() == 1);
+}
+
+BOOST_AUTO_TEST_CASE(drop_id_keeps_entries_pushed_after_drop)
+{
+  CalendarTestMetadataQueue q(100);
+  q.push(nth(1, 1));
+  q.push(nth(2, 1));
+  BOOST_TEST(q.drop_id(1) == 2);
+  BOOST_TEST(q.empty());
+
+  q.push(nth(2, 1));
+  BOOST_TEST(q.size() == 1);
+  BOOST_TEST(q.pop(1, nts(0), nts(3)) == nth(2, 1));
+  BOOST_TEST(q.empty());
+}
+
+BOOST_AUTO_TEST_CASE(budget_drop_oldest)
+{
+  QueueBudget budget;
+  budget.max_entries = 2;
+
+  CalendarTestMetadataQueue q(100, 256, budget);
+  q.push(nth(1));
+  q.push(nth(2));
+  q.push(nth(3));
+
+  BOOST_TEST(q.size() == 2);
+  BOOST_TEST(q.stats().evicted_entries == 1);
+  BOOST_TEST(q.pop(0, nts(0), nts(10)) == nth(2));
+}
+
+BOOST_AUTO_TEST_CASE(budget_input_drop_oldest_skips_dropped)
+{
+  QueueBudget budget;
+  budget.max_input_entries = 1;
+
+  CalendarTestMetadataQueue q(100, 256, budget);
+  q.push(nth(1, 1));
+  q.push(nth(2, 0));
+  q.drop_id(0);
+  q.push(nth(3, 0));
+  q.push(nth(4, 0));
+
+  BOOST_TEST(q.size() == 2);
+  BOOST_TEST(q.stats().evicted_entries == 1);
+  BOOST_TEST(q.pop(0, nts(0), nts(10)) == nth(4, 0));
+}
+
+BOOST_AUTO_TEST_CASE(push_range)
+{
+  std::vector<CalendarTestMetadata> expected{ nth(1, 0, 0), nth(1, 0, 1), nth(2, 0) };
+
+  CalendarTestMetadataQueue q(100);
+  q.push_range(expected.rbegin(), expected.rend());
+
+  std::vector<CalendarTestMetadata> actual;
+  BOOST_TEST(q.pop_all(0, nts(0), nts(3), std::back_inserter(actual)) == 3);
+  BOOST_CHECK_EQUAL_COLLECTIONS(actual.begin(), actual.end(), expected.begin(), expected.end());
+}
+
+BOOST_AUTO_TEST_CASE(matches_heap)
+{
+  CalendarTestMetadataQueue calendar(1500, 4);
+  check_matches_heap(calendar, 3000);
+}
+
+BOOST_AUTO_TEST_CASE(matches_heap_with_overflow)
+{
+  // Entries up to 20 buckets ahead, window of 8 buckets
+  CalendarTestMetadataQueue calendar(1500, 4, {}, 8);
+  check_matches_heap(calendar, 30000);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
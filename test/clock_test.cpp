@@ -22,4 +22,24 @@ BOOST_AUTO_TEST_CASE(negative_increment_is_noop)
   BOOST_TEST(c.now() == 10_clock);
 }
 
+BOOST_AUTO_TEST_CASE(rescaler_resumes_state)
+{
+  auto clock = std::make_shared<Clock>(1'000_clock);
+  TSRescaler::State state{ 900_clock, StreamTS(0) };
+  auto r = TSRescaler::resumed(clock, state, StreamTimeBase(1, SYS_CLOCK_RATE), 500_clock);
+
+  BOOST_TEST(r.rescale_to_clock(StreamTS(300)) == 1'200_clock);
+  BOOST_TEST(r.rescale_to_clock(StreamTS(400)) == 1'300_clock);
+}
+
+BOOST_AUTO_TEST_CASE(rescaler_restarts_on_discontinuity)
+{
+  auto clock = std::make_shared<Clock>(1'000_clock);
+  TSRescaler::State state{ 900_clock, StreamTS(0) };
+  auto r = TSRescaler::resumed(clock, state, StreamTimeBase(1, SYS_CLOCK_RATE), 500_clock);
+
+  BOOST_TEST(r.rescale_to_clock(StreamTS(10'000)) == 1'000_clock);
+  BOOST_TEST(r.rescale_to_clock(StreamTS(10'100)) == 1'100_clock);
+}
+
 BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,134 @@
+#include <boost/test/unit_test.hpp>
+
+#include <boost/test/test_tools.hpp>
+
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+#include <src/ffmpeg.h>
+
+static ff::AVPacketUniquePtr
+make_packet(const std::vector<uint8_t> &data)
+{
+  auto pkt = ff::packet_alloc();
+  BOOST_TEST_REQUIRE(av_new_packet(pkt.get(), static_cast<int>(data.size())) == 0);
+  std::memcpy(pkt->data, data.data(), data.size());
+  return pkt;
+}
+
+static std::vector<uint8_t>
+data_of(const AVPacket &pkt)
+{
+  return std::vector<uint8_t>(pkt.data, pkt.data + pkt.size);
+}
+
+static const std::vector<uint8_t> AU{ 0x00, 0x00, 0x00, 0x02, 0x09, 0xf0, 0x00, 0x00, 0x00, 0x03,
+                                      0x06, 0x01, 0x80, 0x00, 0x00, 0x00, 0x02, 0x65, 0x88 };
+
+BOOST_AUTO_TEST_SUITE(ffmpeg_test)
+
+BOOST_AUTO_TEST_CASE(same_size_range_is_overwritten_in_place)
+{
+  ff::PacketBufferPool pool{};
+  auto pkt = make_packet(AU);
+  const uint8_t *data = pkt->data;
+  const AVBufferRef *buf = pkt->buf;
+
+  std::vector<uint8_t> sei{ 0x00, 0x00, 0x00, 0x03, 0x06, 0x02, 0x80 };
+  BOOST_TEST(ff::splice_packet(*pkt, 6, 13, sei.data(), sei.size(), pool) == sei.size());
+
+  auto expected = AU;
+  std::copy(sei.begin(), sei.end(), expected.begin() + 6);
+  BOOST_TEST(data_of(*pkt) == expected, boost::test_tools::per_element());
+  BOOST_TEST(pkt->data == data);
+  BOOST_TEST(pkt->buf == buf);
+}
+
+BOOST_AUTO_TEST_CASE(shared_buffer_is_copied_to_pooled_one)
+{
+  ff::PacketBufferPool pool{};
+  auto pkt = make_packet(AU);
+  ff::AVPacketRef other(*pkt);
+
+  std::vector<uint8_t> sei{ 0x00, 0x00, 0x00, 0x03, 0x06, 0x02, 0x80 };
+  BOOST_TEST(ff::splice_packet(*pkt, 6, 13, sei.data(), sei.size(), pool) == AU.size());
+
+  auto expected = AU;
+  std::copy(sei.begin(), sei.end(), expected.begin() + 6);
+  BOOST_TEST(data_of(*pkt) == expected, boost::test_tools::per_element());
+
+  // The other reference keeps the original data
+  BOOST_TEST(pkt->data != other->data);
+  BOOST_TEST(data_of(*other) == AU, boost::test_tools::per_element());
+}
+
+BOOST_AUTO_TEST_CASE(range_is_replaced_by_larger_one)
+{
+  ff::PacketBufferPool pool{};
+  auto pkt = make_packet(AU);
+
+  std::vector<uint8_t> sei{ 0x00, 0x00, 0x00, 0x05, 0x06, 0x04, 0x02, 0xaa, 0x80 };
+  BOOST_TEST(ff::splice_packet(*pkt, 6, 13, sei.data(), sei.size(), pool) == AU.size() + 2);
+
+  std::vector<uint8_t> expected(AU.begin(), AU.begin() + 6);
+  expected.insert(expected.end(), sei.begin(), sei.end());
+  expected.insert(expected.end(), AU.begin() + 13, AU.end());
+  BOOST_TEST(data_of(*pkt) == expected, boost::test_tools::per_element());
+
+  // Pooled buffer is padded with zeros
+  for (int i = 0; i < AV_INPUT_BUFFER_PADDING_SIZE; i++) {
+    BOOST_TEST_REQUIRE(pkt->data[pkt->size + i] == 0);
+  }
+}
+
+BOOST_AUTO_TEST_CASE(range_is_removed)
+{
+  ff::PacketBufferPool pool{};
+  auto pkt = make_packet(AU);
+
+  BOOST_TEST(ff::splice_packet(*pkt, 6, 13, nullptr, 0, pool) == AU.size() - 7);
+
+  std::vector<uint8_t> expected(AU.begin(), AU.begin() + 6);
+  expected.insert(expected.end(), AU.begin() + 13, AU.end());
+  BOOST_TEST(data_of(*pkt) == expected, boost::test_tools::per_element());
+}
+
+BOOST_AUTO_TEST_CASE(empty_range_gets_inserted_bytes)
+{
+  ff::PacketBufferPool pool{};
+  std::vector<uint8_t> au(AU.begin(), AU.begin() + 6);
+  au.insert(au.end(), AU.begin() + 13, AU.end());
+  auto pkt = make_packet(au);
+
+  std::vector<uint8_t> sei(AU.begin() + 6, AU.begin() + 13);
+  BOOST_TEST(ff::splice_packet(*pkt, 6, 6, sei.data(), sei.size(), pool) == AU.size());
+  BOOST_TEST(data_of(*pkt) == AU, boost::test_tools::per_element());
+}
+
+BOOST_AUTO_TEST_CASE(pooled_buffers_are_reused_and_grown)
+{
+  ff::PacketBufferPool pool{};
+  std::vector<uint8_t> sei{ 0x00, 0x00, 0x00, 0x05, 0x06, 0x04, 0x02, 0xaa, 0x80 };
+
+  auto pkt = make_packet(AU);
+  ff::splice_packet(*pkt, 6, 13, sei.data(), sei.size(), pool);
+  const uint8_t *pooled = pkt->data;
+  av_packet_unref(pkt.get());
+
+  // Released buffer is handed out again
+  pkt = make_packet(AU);
+  ff::splice_packet(*pkt, 6, 13, sei.data(), sei.size(), pool);
+  BOOST_TEST(pkt->data == pooled);
+
+  // Larger packet than buffers of pool gets a buffer of a new pool, while the old one is still referenced
+  std::vector<uint8_t> large(AU);
+  large.resize(4096, 0x88);
+  auto large_pkt = make_packet(large);
+  ff::splice_packet(*large_pkt, 6, 13, sei.data(), sei.size(), pool);
+  BOOST_TEST(large_pkt->size == 4096 + 2);
+  BOOST_TEST(large_pkt->data[large_pkt->size - 1] == 0x88);
+  BOOST_TEST(data_of(*pkt).size() == AU.size() + 2);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,244 @@
+#include <boost/test/unit_test.hpp>
+
+#include <boost/test/test_tools.hpp>
+
+#include <iterator>
+#include <vector>
+
+#include <src/binary_parser.h>
+#include <src/h264/cc_data.h>
+#include <src/h264/sei_payload.h>
+#include <src/h264/stdseis.h>
+
+using namespace metamix;
+using namespace metamix::h264;
+
+static OwnedSeiPayload
+cc_payload(std::vector<CcTriplet> triplets)
+{
+  return build_cc_data_payload(triplets.data(), triplets.data() + triplets.size());
+}
+
+static std::vector<CcTriplet>
+triplets_of(const SeiPayload &sei)
+{
+  auto cc_data = parse_cc_data(sei);
+  return std::vector<CcTriplet>(cc_data.begin(), cc_data.end());
+}
+
+static const CcTriplet FIELD_1{ true, CcType::NTSC_CC_FIELD_1, 0x94, 0x2c };
+static const CcTriplet FIELD_2{ true, CcType::NTSC_CC_FIELD_2, 0x94, 0xae };
+static const CcTriplet PACKET_START{ true, CcType::DTVCC_PACKET_START, 0x02, 0x21 };
+static const CcTriplet PACKET_DATA{ true, CcType::DTVCC_PACKET_DATA, 0x8f, 0x00 };
+static const CcTriplet PADDING{ false, CcType::DTVCC_PACKET_DATA, 0x00, 0x00 };
+
+BOOST_AUTO_TEST_SUITE(cc_data_test)
+
+BOOST_AUTO_TEST_CASE(standard_seis_are_parsed)
+{
+  auto empty = *build_empty_metadata(0, 0_clock).val;
+  auto reset = *build_cc_reset_metadata(0, 0_clock).val;
+
+  auto empty_triplets = triplets_of(empty);
+  BOOST_TEST_REQUIRE(empty_triplets.size() == 4);
+  BOOST_TEST((empty_triplets[0] == CcTriplet{ true, CcType::NTSC_CC_FIELD_1, 0x80, 0x80 }));
+  BOOST_TEST((empty_triplets[3] == PADDING));
+
+  auto reset_triplets = triplets_of(reset);
+  BOOST_TEST_REQUIRE(reset_triplets.size() == 18);
+  BOOST_TEST((reset_triplets[12] == PACKET_START));
+  BOOST_TEST((reset_triplets[13] == PACKET_DATA));
+}
+
+BOOST_AUTO_TEST_CASE(standard_seis_are_recognized)
+{
+  auto empty = build_empty_metadata(0, 0_clock);
+  auto reset = build_cc_reset_metadata(0, 0_clock);
+
+  BOOST_TEST(is_empty_sei(*empty.val));
+  BOOST_TEST(!is_cc_reset_sei(*empty.val));
+  BOOST_TEST(is_cc_reset_sei(*reset.val));
+  BOOST_TEST(!is_empty_sei(*reset.val));
+
+  // Copies, such as ones read from shared memory queue, are recognized by content
+  BOOST_TEST(is_empty_sei(OwnedSeiPayload(*empty.val)));
+  BOOST_TEST(is_cc_reset_sei(OwnedSeiPayload(*reset.val)));
+  BOOST_TEST(!is_cc_reset_sei(
+    OwnedSeiPayload(SeiType::USER_DATA_UNREGISTERED, reset.val->data(), reset.val->data() + reset.val->size())));
+}
+
+BOOST_AUTO_TEST_CASE(built_payload_is_parsed_back)
+{
+  auto sei = cc_payload({ FIELD_1, PACKET_START, PADDING });
+
+  BOOST_TEST(is_closed_caption(sei));
+  BOOST_TEST(sei.size() == CC_T35_HEADER.size() + 2 + 3 * 3 + 1);
+  BOOST_TEST(sei.back() == 0xff);
+  BOOST_TEST(triplets_of(sei) == std::vector<CcTriplet>({ FIELD_1, PACKET_START, PADDING }));
+}
+
+BOOST_AUTO_TEST_CASE(truncated_cc_data_is_rejected)
+{
+  auto sei = cc_payload({ FIELD_1, FIELD_2 });
+  OwnedSeiPayload truncated(sei.type(), sei.data(), sei.data() + sei.size() - 3);
+
+  BOOST_CHECK_THROW(parse_cc_data(truncated), BinaryParseError);
+}
+
+BOOST_AUTO_TEST_CASE(payloads_of_frame_are_coalesced)
+{
+  CcDataCoalescer coalescer{};
+  OwnedSeiPayload unregistered(SeiType::USER_DATA_UNREGISTERED, { 0x01, 0x02 });
+
+  BOOST_TEST(coalescer.add(cc_payload({ PADDING, PACKET_START })));
+  BOOST_TEST(coalescer.add(cc_payload({ FIELD_1, PACKET_DATA })));
+  BOOST_TEST(coalescer.add(cc_payload({ FIELD_2 })));
+  BOOST_TEST(!coalescer.add(unregistered));
+  BOOST_TEST(coalescer.pending());
+
+  std::vector<OwnedSeiPayload> seis{};
+  coalescer.flush(std::back_inserter(seis));
+
+  BOOST_TEST_REQUIRE(seis.size() == 1);
+  BOOST_TEST(triplets_of(seis[0]) == std::vector<CcTriplet>({ FIELD_1, FIELD_2, PACKET_START, PACKET_DATA }));
+  BOOST_TEST(!coalescer.pending());
+
+  // Nothing is emitted for frame without closed captions
+  coalescer.flush(std::back_inserter(seis));
+  BOOST_TEST(seis.size() == 1);
+}
+
+BOOST_AUTO_TEST_CASE(padding_only_frame_keeps_closed_captions)
+{
+  CcDataCoalescer coalescer{};
+  coalescer.add(cc_payload({ PADDING, PADDING }));
+
+  std::vector<OwnedSeiPayload> seis{};
+  coalescer.flush(std::back_inserter(seis));
+
+  BOOST_TEST_REQUIRE(seis.size() == 1);
+  BOOST_TEST(triplets_of(seis[0]) == std::vector<CcTriplet>({ PADDING }));
+}
+
+BOOST_AUTO_TEST_CASE(dtvcc_packet_terminator_is_kept)
+{
+  CcDataCoalescer coalescer{};
+  coalescer.add(cc_payload({ PADDING, PACKET_START, PACKET_DATA, PADDING, PADDING }));
+  coalescer.add(cc_payload({ FIELD_1, PACKET_DATA }));
+  coalescer.add(cc_payload({ PADDING, PADDING }));
+
+  std::vector<OwnedSeiPayload> seis{};
+  coalescer.flush(std::back_inserter(seis));
+
+  BOOST_TEST_REQUIRE(seis.size() == 1);
+  BOOST_TEST(triplets_of(seis[0]) ==
+             std::vector<CcTriplet>({ FIELD_1, PACKET_START, PACKET_DATA, PADDING, PACKET_DATA, PADDING }));
+}
+
+BOOST_AUTO_TEST_CASE(overflowing_triplets_are_deferred)
+{
+  CcDataCoalescer coalescer{};
+  std::vector<CcTriplet> triplets(20, PACKET_DATA);
+  coalescer.add(cc_payload(triplets));
+  coalescer.add(cc_payload({ FIELD_1 }));
+  coalescer.add(cc_payload(triplets));
+
+  std::vector<OwnedSeiPayload> seis{};
+  coalescer.flush(std::back_inserter(seis));
+
+  BOOST_TEST_REQUIRE(seis.size() == 1);
+  auto first = triplets_of(seis[0]);
+  BOOST_TEST_REQUIRE(first.size() == CcData::MAX_CC_COUNT);
+  BOOST_TEST((first[0] == FIELD_1));
+  BOOST_TEST(coalescer.pending());
+  BOOST_TEST(coalescer.backlog() == 41 - CcData::MAX_CC_COUNT);
+
+  // Deferred triplets go ahead of the next frame's ones
+  coalescer.add(cc_payload({ PACKET_START }));
+  coalescer.flush(std::back_inserter(seis));
+
+  BOOST_TEST_REQUIRE(seis.size() == 2);
+  auto second = triplets_of(seis[1]);
+  BOOST_TEST_REQUIRE(second.size() == 41 - CcData::MAX_CC_COUNT + 1);
+  BOOST_TEST((second.back() == PACKET_START));
+  BOOST_TEST(!coalescer.pending());
+  BOOST_TEST(coalescer.dropped() == 0);
+}
+
+BOOST_AUTO_TEST_CASE(frames_are_limited_by_output_cc_count)
+{
+  // 59.94 fps output, captions of 29.97 fps input arriving with every other frame
+  CcDataCoalescer coalescer{ 10 };
+  std::vector<CcTriplet> triplets{ FIELD_1, PACKET_START };
+  triplets.resize(20, PACKET_DATA);
+  coalescer.add(cc_payload(triplets));
+
+  std::vector<OwnedSeiPayload> seis{};
+  coalescer.flush(std::back_inserter(seis));
+  coalescer.flush(std::back_inserter(seis));
+
+  BOOST_TEST_REQUIRE(seis.size() == 2);
+  auto first = triplets_of(seis[0]);
+  BOOST_TEST_REQUIRE(first.size() == 10);
+  BOOST_TEST((first[0] == FIELD_1));
+  BOOST_TEST((first[1] == PACKET_START));
+  BOOST_TEST(triplets_of(seis[1]) == std::vector<CcTriplet>(10, PACKET_DATA));
+  BOOST_TEST(!coalescer.pending());
+
+  // Limit is lowered once frame rate is known
+  coalescer.set_cc_count(5);
+  std::vector<CcTriplet> full(CcData::MAX_CC_COUNT, PACKET_DATA);
+  coalescer.add(cc_payload(full));
+  coalescer.flush(std::back_inserter(seis));
+  BOOST_TEST(triplets_of(seis.back()).size() == 5);
+  BOOST_TEST(coalescer.backlog() == CcData::MAX_CC_COUNT - 5);
+  BOOST_TEST(coalescer.dropped() == 0);
+}
+
+BOOST_AUTO_TEST_CASE(cea608_pairs_are_deferred_beyond_one_per_field)
+{
+  CcDataCoalescer coalescer{};
+  coalescer.add(cc_payload({ FIELD_1, FIELD_2, PACKET_START }));
+  coalescer.add(cc_payload({ FIELD_1, FIELD_2, PACKET_DATA }));
+  coalescer.add(cc_payload({ FIELD_1 }));
+
+  std::vector<OwnedSeiPayload> seis{};
+  coalescer.flush(std::back_inserter(seis));
+  BOOST_TEST_REQUIRE(seis.size() == 1);
+  BOOST_TEST(triplets_of(seis[0]) == std::vector<CcTriplet>({ FIELD_1, FIELD_2, PACKET_START, PACKET_DATA }));
+  BOOST_TEST(coalescer.backlog() == 3);
+
+  coalescer.flush(std::back_inserter(seis));
+  BOOST_TEST_REQUIRE(seis.size() == 2);
+  BOOST_TEST(triplets_of(seis[1]) == std::vector<CcTriplet>({ FIELD_1, FIELD_2 }));
+
+  coalescer.flush(std::back_inserter(seis));
+  BOOST_TEST_REQUIRE(seis.size() == 3);
+  BOOST_TEST(triplets_of(seis[2]) == std::vector<CcTriplet>({ FIELD_1 }));
+  BOOST_TEST(!coalescer.pending());
+
+  // CEA-608 backlog is bounded per field by deferred frames
+  for (size_t i = 0; i < CcDataCoalescer::MAX_DEFERRED_FRAMES + 3; i++) {
+    coalescer.add(cc_payload({ FIELD_1 }));
+  }
+  coalescer.flush(std::back_inserter(seis));
+  BOOST_TEST(coalescer.backlog() == CcDataCoalescer::MAX_DEFERRED_FRAMES);
+  BOOST_TEST(coalescer.dropped() == 2);
+}
+
+BOOST_AUTO_TEST_CASE(overflowing_backlog_drops_oldest)
+{
+  CcDataCoalescer coalescer{};
+  std::vector<CcTriplet> triplets(CcData::MAX_CC_COUNT, PACKET_DATA);
+  for (size_t i = 0; i < CcDataCoalescer::MAX_DEFERRED_FRAMES + 2; i++) {
+    coalescer.add(cc_payload(triplets));
+  }
+
+  std::vector<OwnedSeiPayload> seis{};
+  coalescer.flush(std::back_inserter(seis));
+
+  BOOST_TEST(coalescer.backlog() == CcDataCoalescer::MAX_DEFERRED_FRAMES * CcData::MAX_CC_COUNT);
+  BOOST_TEST(coalescer.dropped() == CcData::MAX_CC_COUNT);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,231 @@
+#include <boost/test/unit_test.hpp>
+
+#include <boost/test/test_tools.hpp>
+
+#include <algorithm>
+#include <vector>
+
+#include <src/h264/cc_data.h>
+#include <src/h264/cc_pacer.h>
+#include <src/h264/sei_payload.h>
+
+using namespace metamix;
+using namespace metamix::h264;
+
+static OwnedSeiPayload
+cc_payload(std::vector<CcTriplet> triplets)
+{
+  return build_cc_data_payload(triplets.data(), triplets.data() + triplets.size());
+}
+
+/// Closed captions of one frame of 29.97 fps video, fully used.
+static OwnedSeiPayload
+full_frame(uint8_t seq)
+{
+  std::vector<CcTriplet> triplets{
+    { true, CcType::NTSC_CC_FIELD_1, seq, 0x80 },
+    { true, CcType::NTSC_CC_FIELD_2, seq, 0x80 },
+  };
+  for (uint8_t i = 0; i < 18; i++) {
+    triplets.push_back({ true, i == 0 ? CcType::DTVCC_PACKET_START : CcType::DTVCC_PACKET_DATA, seq, i });
+  }
+  return cc_payload(triplets);
+}
+
+static size_t
+count_of(const CcData &cc_data, CcType type, bool valid = true)
+{
+  return std::count_if(cc_data.begin(), cc_data.end(), [&](const CcTriplet &triplet) {
+    return triplet.type == type && triplet.valid == valid;
+  });
+}
+
+BOOST_AUTO_TEST_SUITE(cc_pacer_test)
+
+BOOST_AUTO_TEST_CASE(cc_count_follows_frame_rate)
+{
+  BOOST_TEST(CcPacer(TimeBase(30000, 1001)).cc_count() == 20);
+  BOOST_TEST(CcPacer(TimeBase(30)).cc_count() == 20);
+  BOOST_TEST(CcPacer(TimeBase(60000, 1001)).cc_count() == 10);
+  BOOST_TEST(CcPacer(TimeBase(24000, 1001)).cc_count() == 25);
+  BOOST_TEST(CcPacer(TimeBase(25)).cc_count() == 24);
+  BOOST_TEST(CcPacer(TimeBase(50)).cc_count() == 12);
+  BOOST_TEST(CcPacer(TimeBase(1)).cc_count() == CcData::MAX_CC_COUNT);
+  BOOST_CHECK_THROW(CcPacer(TimeBase(0)), std::invalid_argument);
+}
+
+BOOST_AUTO_TEST_CASE(idle_frame_is_padded)
+{
+  CcPacer pacer(TimeBase(30000, 1001));
+  BOOST_TEST(!pacer.pending());
+
+  BOOST_TEST(pacer.add(cc_payload({ { true, CcType::NTSC_CC_FIELD_1, 0x94, 0x2c } })));
+  BOOST_TEST(pacer.pending());
+
+  auto cc_data = parse_cc_data(pacer.next_frame());
+  BOOST_TEST(cc_data.cc_count == 20);
+  BOOST_TEST(count_of(cc_data, CcType::NTSC_CC_FIELD_1) == 1);
+  BOOST_TEST(count_of(cc_data, CcType::DTVCC_PACKET_DATA, false) == 19);
+  BOOST_TEST(!pacer.pending());
+}
+
+BOOST_AUTO_TEST_CASE(frame_rate_doubling_spreads_captions)
+{
+  CcPacer pacer(TimeBase(60000, 1001));
+  size_t field_1 = 0;
+  size_t dtvcc = 0;
+
+  // Captions of 29.97 fps input arrive with every other frame of 59.94 fps output
+  for (int frame = 0; frame < 60; frame++) {
+    if (frame % 2 == 0) {
+      pacer.add(full_frame(static_cast<uint8_t>(frame)));
+    }
+
+    auto cc_data = parse_cc_data(pacer.next_frame());
+    BOOST_TEST(cc_data.cc_count == 10);
+    BOOST_TEST(count_of(cc_data, CcType::NTSC_CC_FIELD_1) <= 1);
+    BOOST_TEST(count_of(cc_data, CcType::NTSC_CC_FIELD_2) <= 1);
+
+    field_1 += count_of(cc_data, CcType::NTSC_CC_FIELD_1);
+    dtvcc += count_of(cc_data, CcType::DTVCC_PACKET_START) + count_of(cc_data, CcType::DTVCC_PACKET_DATA);
+  }
+
+  // All captions are sent in time
+  BOOST_TEST(field_1 == 30);
+  BOOST_TEST(dtvcc == 30 * 18);
+  BOOST_TEST(pacer.backlog() == 0);
+  BOOST_TEST(pacer.dropped() == 0);
+}
+
+BOOST_AUTO_TEST_CASE(fields_alternate_by_frame_parity_at_high_frame_rate)
+{
+  for (auto frame_rate : { TimeBase(60), TimeBase(60000, 1001), TimeBase(50) }) {
+    CcPacer pacer(frame_rate);
+    size_t field_1 = 0;
+    size_t field_2 = 0;
+
+    // Both fields of 29.97 fps input arrive with every other output frame
+    for (int frame = 0; frame < 60; frame++) {
+      if (frame % 2 == 0 && frame < 40) {
+        pacer.add(full_frame(static_cast<uint8_t>(frame)));
+      }
+
+      auto cc_data = parse_cc_data(pacer.next_frame());
+      size_t frame_field_1 = count_of(cc_data, CcType::NTSC_CC_FIELD_1);
+      size_t frame_field_2 = count_of(cc_data, CcType::NTSC_CC_FIELD_2);
+      BOOST_TEST(frame_field_1 + frame_field_2 <= 1);
+      BOOST_TEST(frame_field_1 == (frame % 2 == 0 ? frame_field_1 : 0));
+      BOOST_TEST(frame_field_2 == (frame % 2 == 1 ? frame_field_2 : 0));
+
+      field_1 += frame_field_1;
+      field_2 += frame_field_2;
+    }
+
+    BOOST_TEST(field_1 == 20);
+    BOOST_TEST(field_2 == 20);
+    BOOST_TEST(pacer.dropped() == 0);
+  }
+}
+
+BOOST_AUTO_TEST_CASE(frame_rate_halving_carries_excess_forward)
+{
+  CcPacer pacer(TimeBase(30000, 1001));
+
+  // Frames of 59.94 fps input carrying 10 DTVCC triplets each, three of which land in one output frame
+  std::vector<CcTriplet> half(10, CcTriplet{ true, CcType::DTVCC_PACKET_DATA, 0x01, 0x02 });
+  pacer.add(cc_payload(half));
+  pacer.add(cc_payload(half));
+  pacer.add(cc_payload(half));
+
+  auto first = parse_cc_data(pacer.next_frame());
+  BOOST_TEST(first.cc_count == 20);
+  BOOST_TEST(count_of(first, CcType::DTVCC_PACKET_DATA) == 20);
+  BOOST_TEST(pacer.backlog() == 10);
+
+  auto second = parse_cc_data(pacer.next_frame());
+  BOOST_TEST(count_of(second, CcType::DTVCC_PACKET_DATA) == 10);
+  BOOST_TEST(count_of(second, CcType::DTVCC_PACKET_DATA, false) == 10);
+  BOOST_TEST(pacer.backlog() == 0);
+}
+
+BOOST_AUTO_TEST_CASE(overflowing_backlog_drops_oldest)
+{
+  CcPacer pacer(TimeBase(30000, 1001));
+  std::vector<CcTriplet> pairs(31, CcTriplet{ true, CcType::NTSC_CC_FIELD_1, 0x94, 0x2c });
+
+  for (int i = 0; i < 3; i++) {
+    pacer.add(cc_payload(pairs));
+  }
+
+  BOOST_TEST(pacer.backlog() == CcPacer::MAX_BACKLOG_SECONDS * 30000 / 1001);
+  BOOST_TEST(pacer.dropped() == 3 * 31 - pacer.backlog());
+}
+
+BOOST_AUTO_TEST_CASE(padding_is_not_buffered)
+{
+  CcPacer pacer(TimeBase(25));
+  std::vector<CcTriplet> idle{
+    { true, CcType::NTSC_CC_FIELD_1, 0x80, 0x80 },
+    { true, CcType::NTSC_CC_FIELD_2, 0x80, 0x80 },
+    { false, CcType::NTSC_CC_FIELD_1, 0x00, 0x00 },
+    { false, CcType::DTVCC_PACKET_DATA, 0x00, 0x00 },
+  };
+
+  // Idle captions of 59.94 fps input would overflow backlog of 25 fps output, if their padding was buffered
+  for (int frame = 0; frame < 1000; frame++) {
+    pacer.add(cc_payload(idle));
+    pacer.add(cc_payload(idle));
+    pacer.add(cc_payload(idle));
+    pacer.next_frame();
+  }
+
+  BOOST_TEST(pacer.backlog() == 0);
+  BOOST_TEST(pacer.dropped() == 0);
+}
+
+BOOST_AUTO_TEST_CASE(dtvcc_packet_terminator_is_kept)
+{
+  CcPacer pacer(TimeBase(60000, 1001));
+  CcTriplet start{ true, CcType::DTVCC_PACKET_START, 0x02, 0x21 };
+  CcTriplet padding{ false, CcType::DTVCC_PACKET_DATA, 0x00, 0x00 };
+  std::vector<CcTriplet> data(9, CcTriplet{ true, CcType::DTVCC_PACKET_DATA, 0x8f, 0x00 });
+
+  // Packet filling paced frame is terminated in the next one
+  std::vector<CcTriplet> packet{ padding, start };
+  packet.insert(packet.end(), data.begin(), data.end());
+  packet.push_back(padding);
+  packet.push_back(padding);
+  pacer.add(cc_payload(packet));
+  BOOST_TEST(pacer.backlog() == 11);
+
+  auto first = parse_cc_data(pacer.next_frame());
+  BOOST_TEST(count_of(first, CcType::DTVCC_PACKET_DATA, false) == 0);
+
+  auto second = parse_cc_data(pacer.next_frame());
+  BOOST_TEST_REQUIRE(second.cc_count == 10);
+  BOOST_TEST((second.triplets[0] == padding));
+}
+
+BOOST_AUTO_TEST_CASE(clear_drops_backlog)
+{
+  CcPacer pacer(TimeBase(30000, 1001));
+  pacer.add(full_frame(1));
+  pacer.add(full_frame(2));
+  BOOST_TEST(pacer.backlog() > 0);
+
+  pacer.clear();
+  BOOST_TEST(!pacer.pending());
+  BOOST_TEST(pacer.backlog() == 0);
+
+  auto cc_data = parse_cc_data(pacer.next_frame());
+  BOOST_TEST(count_of(cc_data, CcType::DTVCC_PACKET_DATA, false) == 20);
+}
+
+BOOST_AUTO_TEST_CASE(other_payloads_are_passed)
+{
+  CcPacer pacer(TimeBase(25));
+  BOOST_TEST(!pacer.add(OwnedSeiPayload(SeiType::USER_DATA_UNREGISTERED, { 0x01, 0x02 })));
+  BOOST_TEST(!pacer.pending());
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,222 @@
+#include <boost/test/unit_test.hpp>
+
+#include <boost/test/test_tools.hpp>
+
+#include <algorithm>
+#include <array>
+#include <deque>
+#include <iterator>
+#include <utility>
+#include <vector>
+
+#include <src/h264/emitter.h>
+#include <src/h264/sei_parser.h>
+#include <src/h264/sei_payload.h>
+#include <src/h264/stdseis.h>
+
+using namespace metamix;
+using namespace metamix::h264;
+
+static std::vector<OwnedSeiPayload>
+payloads()
+{
+  return {
+    OwnedSeiPayload(SeiType::USER_DATA_REGISTERED, { 0xb5, 0x00, 0x00, 0x00, 0x00, 0x01, 0xfc, 0x00, 0x00, 0x03 }),
+    OwnedSeiPayload(SeiType::USER_DATA_UNREGISTERED, { 0x01, 0x02, 0x03 }),
+  };
+}
+
+/// Parses payloads of SEI NALU without length prefix or start code.
+static std::vector<OwnedSeiPayload>
+parse_sei_nalu(const std::vector<uint8_t> &nalu)
+{
+  std::vector<OwnedSeiPayload> seis{};
+  std::vector<uint8_t> scratch{};
+  for_each_sei_payload(nalu.data(), nalu.data() + nalu.size(), 1, scratch, [&](const SeiPayloadView &sei) {
+    seis.emplace_back(sei);
+  });
+  return seis;
+}
+
+/// Emits SEI RBSP of payloads both to byte vector and to generic output iterator, and checks that they match.
+static std::vector<uint8_t>
+emit_rbsp(const std::vector<OwnedSeiPayload> &seis)
+{
+  std::vector<uint8_t> fused{};
+  emit_sei_rbsp(seis.begin(), seis.end(), fused);
+  std::deque<uint8_t> generic{};
+  emit_sei_rbsp(seis.begin(), seis.end(), std::back_inserter(generic));
+
+  BOOST_CHECK_EQUAL_COLLECTIONS(fused.begin(), fused.end(), generic.begin(), generic.end());
+  BOOST_TEST(sei_rbsp_size(seis.begin(), seis.end()) == fused.size());
+  return fused;
+}
+
+BOOST_AUTO_TEST_SUITE(emitter_test)
+
+BOOST_AUTO_TEST_CASE(sei_nalu_length_covers_escaped_payloads)
+{
+  auto seis = payloads();
+
+  std::vector<uint8_t> nalu{};
+  emit_sei_payloads_to_avcc_nalu(seis.begin(), seis.end(), std::back_inserter(nalu));
+
+  uint32_t length = nalu[0] << 24 | nalu[1] << 16 | nalu[2] << 8 | nalu[3];
+  BOOST_TEST(length == nalu.size() - 4);
+  BOOST_TEST(nalu[4] == static_cast<uint8_t>(NaluType::SEI));
+}
+
+BOOST_AUTO_TEST_CASE(single_pass_emission_matches_generic_one)
+{
+  auto seis = payloads();
+
+  std::vector<uint8_t> fused{ 0xff };
+  emit_sei_payloads_to_avcc_nalu(seis.begin(), seis.end(), fused);
+
+  std::deque<uint8_t> generic{ 0xff };
+  emit_sei_payloads_to_avcc_nalu(seis.begin(), seis.end(), std::back_inserter(generic));
+
+  BOOST_CHECK_EQUAL_COLLECTIONS(fused.begin(), fused.end(), generic.begin(), generic.end());
+}
+
+BOOST_AUTO_TEST_CASE(nalu_length_prefix_has_requested_size)
+{
+  auto seis = payloads();
+
+  std::vector<uint8_t> nalu{};
+  emit_sei_payloads_to_avcc_nalu<2>(seis.begin(), seis.end(), std::back_inserter(nalu));
+
+  uint32_t length = nalu[0] << 8 | nalu[1];
+  BOOST_TEST(length == nalu.size() - 2);
+  BOOST_TEST(nalu[2] == static_cast<uint8_t>(NaluType::SEI));
+
+  OwnedNalu slice(std::vector<uint8_t>(300, 0x65));
+  std::vector<uint8_t> out{};
+  BOOST_CHECK_THROW(emit_avcc_nalu<1>(slice, std::back_inserter(out)), std::length_error);
+}
+
+BOOST_AUTO_TEST_CASE(sei_rbsp_ends_with_single_stop_bit)
+{
+  auto rbsp = emit_rbsp({
+    OwnedSeiPayload(SeiType::USER_DATA_UNREGISTERED, { 0x01 }),
+    OwnedSeiPayload(SeiType::USER_DATA_REGISTERED, { 0x02, 0x03 }),
+  });
+
+  std::vector<uint8_t> expected{ 0x05, 0x01, 0x01, 0x04, 0x02, 0x02, 0x03, 0x80 };
+  BOOST_CHECK_EQUAL_COLLECTIONS(rbsp.begin(), rbsp.end(), expected.begin(), expected.end());
+}
+
+BOOST_AUTO_TEST_CASE(emulation_prevention_spans_payload_boundaries)
+{
+  // Trailing zeros of the first payload and type of the second one emulate a start code
+  auto rbsp = emit_rbsp({
+    OwnedSeiPayload(SeiType::USER_DATA_UNREGISTERED, { 0x01, 0x00, 0x00 }),
+    OwnedSeiPayload(SeiType::PIC_TIMING, { 0x07 }),
+  });
+
+  std::vector<uint8_t> expected{ 0x05, 0x03, 0x01, 0x00, 0x00, 0x03, 0x01, 0x01, 0x07, 0x80 };
+  BOOST_CHECK_EQUAL_COLLECTIONS(rbsp.begin(), rbsp.end(), expected.begin(), expected.end());
+}
+
+BOOST_AUTO_TEST_CASE(large_payload_type_and_size_are_coded_by_subtraction)
+{
+  for (auto [value, coded] : std::vector<std::pair<unsigned int, std::vector<uint8_t>>>{
+         { 254, { 0xFE } },
+         { 255, { 0xFF, 0x00 } },
+         { 300, { 0xFF, 0x2D } },
+         { 510, { 0xFF, 0xFF, 0x00 } },
+       }) {
+    auto rbsp = emit_rbsp({ OwnedSeiPayload(static_cast<SeiType>(value), std::vector<uint8_t>(value, 0x11)) });
+
+    std::vector<uint8_t> expected(coded);
+    expected.insert(expected.end(), coded.begin(), coded.end());
+    expected.insert(expected.end(), value, 0x11);
+    expected.push_back(0x80);
+    BOOST_CHECK_EQUAL_COLLECTIONS(rbsp.begin(), rbsp.end(), expected.begin(), expected.end());
+  }
+}
+
+BOOST_AUTO_TEST_CASE(emitted_sei_nalu_is_parsed_back)
+{
+  // Zeros at the end of a payload are followed by a picture timing payload type, which would emulate a start code
+  std::vector<OwnedSeiPayload> seis{
+    OwnedSeiPayload(SeiType::USER_DATA_UNREGISTERED, { 0x01, 0x00, 0x00 }),
+    OwnedSeiPayload(SeiType::PIC_TIMING, { 0x00, 0x00, 0x00, 0x02 }),
+    OwnedSeiPayload(SeiType::USER_DATA_REGISTERED, std::vector<uint8_t>(300, 0xfa)),
+  };
+
+  std::vector<uint8_t> avcc{};
+  emit_sei_payloads_to_avcc_nalu(seis.begin(), seis.end(), avcc);
+  std::deque<uint8_t> generic{};
+  emit_sei_payloads_to_avcc_nalu(seis.begin(), seis.end(), std::back_inserter(generic));
+  std::vector<uint8_t> annexb{};
+  emit_sei_payloads_to_annexb_nalu(seis.begin(), seis.end(), annexb);
+
+  BOOST_CHECK_EQUAL_COLLECTIONS(avcc.begin(), avcc.end(), generic.begin(), generic.end());
+  BOOST_CHECK_EQUAL_COLLECTIONS(avcc.begin() + 4, avcc.end(), annexb.begin() + 4, annexb.end());
+  BOOST_TEST(avcc.back() == 0x80);
+
+  std::vector<uint8_t> nalu(avcc.begin() + 4, avcc.end());
+  BOOST_TEST(h264::detail::find_zero_prefixed(nalu.data(), nalu.data() + nalu.size(), 0x01) == nalu.data() + nalu.size());
+
+  auto parsed = parse_sei_nalu(nalu);
+  BOOST_TEST_REQUIRE(parsed.size() == seis.size());
+  for (size_t i = 0; i < seis.size(); i++) {
+    BOOST_TEST((parsed[i] == seis[i]));
+  }
+}
+
+BOOST_AUTO_TEST_CASE(serialized_message_is_escaped_after_zero_bytes)
+{
+  std::vector<OwnedSeiPayload> seis{
+    OwnedSeiPayload(SeiType::USER_DATA_UNREGISTERED, { 0x01, 0x00, 0x00 }),
+    OwnedSeiPayload(SeiType::PIC_TIMING, { 0x07 }),
+  };
+
+  // Picture timing message starts with a byte, which has to be escaped after zero bytes
+  for (const auto &sei : seis) {
+    BOOST_TEST_REQUIRE((sei.message_header().first != sei.message_header().second));
+  }
+
+  std::vector<uint8_t> expected{ 0x05, 0x03, 0x01, 0x00, 0x00, 0x03, 0x01, 0x01, 0x07, 0x80 };
+  auto actual = emit_rbsp(seis);
+  BOOST_CHECK_EQUAL_COLLECTIONS(actual.begin(), actual.end(), expected.begin(), expected.end());
+}
+
+BOOST_AUTO_TEST_CASE(message_needing_emulation_prevention_is_serialized_when_emitted)
+{
+  std::vector<OwnedSeiPayload> seis{ OwnedSeiPayload(SeiType::USER_DATA_UNREGISTERED, { 0x00, 0x00, 0x01 }) };
+  BOOST_TEST((seis[0].message_header().first == seis[0].message_header().second));
+
+  std::vector<uint8_t> expected{ 0x05, 0x03, 0x00, 0x00, 0x03, 0x01, 0x80 };
+  auto actual = emit_rbsp(seis);
+  BOOST_CHECK_EQUAL_COLLECTIONS(actual.begin(), actual.end(), expected.begin(), expected.end());
+}
+
+BOOST_AUTO_TEST_CASE(static_seis_are_serialized_in_advance)
+{
+  for (const auto &meta : { build_empty_metadata(0, ClockTS(0)), build_cc_reset_metadata(0, ClockTS(0)) }) {
+    const OwnedSeiPayload &sei = *meta.val;
+    std::array<uint8_t, 2> header{ static_cast<uint8_t>(sei.type()), static_cast<uint8_t>(sei.size()) };
+    auto [first, last] = sei.message_header();
+    BOOST_CHECK_EQUAL_COLLECTIONS(first, last, header.begin(), header.end());
+
+    // Copies, such as ones read from shared memory queue, are serialized in advance too
+    OwnedSeiPayload copy(sei.type(), sei.data(), sei.data() + sei.size());
+    BOOST_CHECK_EQUAL_COLLECTIONS(
+      copy.message_header().first, copy.message_header().second, header.begin(), header.end());
+
+    std::vector<OwnedSeiPayload> seis{ OwnedSeiPayload(SeiType::USER_DATA_UNREGISTERED, { 0x01, 0x00 }), sei, copy };
+    auto rbsp = emit_rbsp(seis);
+    auto parsed = parse_sei_nalu([&]() {
+      std::vector<uint8_t> nalu{ 0x06 };
+      nalu.insert(nalu.end(), rbsp.begin(), rbsp.end());
+      return nalu;
+    }());
+    BOOST_TEST_REQUIRE(parsed.size() == seis.size());
+    BOOST_TEST((parsed[1] == sei));
+    BOOST_TEST((parsed[2] == sei));
+  }
+}
+
+BOOST_AUTO_TEST_SUITE_END()
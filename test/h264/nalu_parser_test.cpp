@@ -0,0 +1,180 @@
+#include <boost/test/unit_test.hpp>
+
+#include <boost/test/test_tools.hpp>
+
+#include <iterator>
+#include <random>
+#include <vector>
+
+#include <src/binary_parser.h>
+#include <src/h264/emitter.h>
+#include <src/h264/nalu.h>
+#include <src/h264/nalu_parser.h>
+#include <src/h264/sei_payload.h>
+
+using namespace metamix;
+using namespace metamix::h264;
+
+static OwnedNalu
+annexb_pack([[maybe_unused]] const BinaryParserContext &ctx, const BinaryParserBounds &bounds)
+{
+  return OwnedNalu(std::vector<uint8_t>(bounds.startptr(), bounds.startptr() + annexb_nalu_length(bounds)));
+}
+
+static OwnedNalu
+avcc_pack([[maybe_unused]] const BinaryParserContext &ctx, const BinaryParserBounds &bounds)
+{
+  return OwnedNalu(std::vector<uint8_t>(bounds.startptr(), bounds.startptr() + bounds.length()));
+}
+
+using AnnexBNaluParser =
+  BinaryParser<OwnedNalu, BinaryParserContext, BinaryParserBounds, annexb_nalu_parser_next, annexb_pack>;
+
+template<unsigned int NaluLengthSize>
+using AvccNaluParser =
+  BinaryParser<OwnedNalu, BinaryParserContext, BinaryParserBounds, avcc_nalu_parser_next<NaluLengthSize>, avcc_pack>;
+
+template<class Parser>
+static std::vector<std::vector<uint8_t>>
+parse(const std::vector<uint8_t> &stream)
+{
+  std::vector<std::vector<uint8_t>> nalus{};
+  auto parser = Parser::create(stream.data(), stream.data() + stream.size());
+  while (parser) {
+    OwnedNalu nalu;
+    parser >> nalu;
+    nalus.emplace_back(nalu.cbegin(), nalu.cend());
+  }
+  return nalus;
+}
+
+static std::vector<std::vector<uint8_t>>
+parse_annexb(const std::vector<uint8_t> &stream)
+{
+  return parse<AnnexBNaluParser>(stream);
+}
+
+static std::vector<SimdLevel>
+simd_levels()
+{
+  std::vector<SimdLevel> levels{ SimdLevel::SCALAR };
+  if (simd_level() >= SimdLevel::SSE2) {
+    levels.push_back(SimdLevel::SSE2);
+  }
+  if (simd_level() >= SimdLevel::AVX2) {
+    levels.push_back(SimdLevel::AVX2);
+  }
+  return levels;
+}
+
+BOOST_AUTO_TEST_SUITE(nalu_parser_test)
+
+BOOST_AUTO_TEST_CASE(format_is_detected_from_extradata)
+{
+  std::vector<uint8_t> avcc{ 0x01, 0x64, 0x00, 0x1f, 0xff, 0xe1, 0x00, 0x04, 0x67, 0x64, 0x00, 0x1f };
+  std::vector<uint8_t> avcc_2{ 0x01, 0x64, 0x00, 0x1f, 0xfd, 0xe1, 0x00, 0x04, 0x67, 0x64, 0x00, 0x1f };
+  std::vector<uint8_t> annexb{ 0x00, 0x00, 0x00, 0x01, 0x67, 0x64, 0x00, 0x1f };
+
+  BOOST_TEST((detect_nalu_format(avcc.data(), avcc.size()).framing == NaluFraming::AVCC));
+  BOOST_TEST(detect_nalu_format(avcc.data(), avcc.size()).length_size == 4);
+  BOOST_TEST((detect_nalu_format(avcc_2.data(), avcc_2.size()).framing == NaluFraming::AVCC));
+  BOOST_TEST(detect_nalu_format(avcc_2.data(), avcc_2.size()).length_size == 2);
+  BOOST_TEST((detect_nalu_format(annexb.data(), annexb.size()).framing == NaluFraming::ANNEX_B));
+  BOOST_TEST((detect_nalu_format(nullptr, 0).framing == NaluFraming::ANNEX_B));
+}
+
+BOOST_AUTO_TEST_CASE(avcc_nalus_are_split_on_lengths_of_each_size)
+{
+  std::vector<uint8_t> one{ 0x02, 0x09, 0xf0, 0x03, 0x65, 0x88, 0x84 };
+  std::vector<uint8_t> two{ 0x00, 0x02, 0x09, 0xf0, 0x00, 0x03, 0x65, 0x88, 0x84 };
+  std::vector<uint8_t> four{ 0x00, 0x00, 0x00, 0x02, 0x09, 0xf0, 0x00, 0x00, 0x00, 0x03, 0x65, 0x88, 0x84 };
+  std::vector<std::vector<uint8_t>> expected{ { 0x09, 0xf0 }, { 0x65, 0x88, 0x84 } };
+
+  BOOST_TEST(parse<AvccNaluParser<1>>(one) == expected);
+  BOOST_TEST(parse<AvccNaluParser<2>>(two) == expected);
+  BOOST_TEST(parse<AvccNaluParser<4>>(four) == expected);
+
+  // NALU running past the end of the packet
+  BOOST_CHECK_THROW(parse<AvccNaluParser<2>>(one), BinaryParseError);
+}
+
+BOOST_AUTO_TEST_CASE(annexb_nalus_are_split_on_start_codes)
+{
+  std::vector<uint8_t> stream{
+    0x00, 0x00, 0x00, 0x01, 0x09, 0xf0,                   // AUD after 4-byte start code
+    0x00, 0x00, 0x01, 0x06, 0x05, 0x00, 0x00, 0x03, 0x80, // SEI with escaped zeros
+    0x00, 0x00, 0x00, 0x00, 0x01, 0x65, 0x88,             // IDR slice after trailing zero
+    0x00, 0x00,                                           // trailing_zero_8bits
+  };
+
+  auto nalus = parse_annexb(stream);
+
+  BOOST_TEST_REQUIRE(nalus.size() == 3);
+  BOOST_TEST(nalus[0] == std::vector<uint8_t>({ 0x09, 0xf0 }), boost::test_tools::per_element());
+  BOOST_TEST(nalus[1] == std::vector<uint8_t>({ 0x06, 0x05, 0x00, 0x00, 0x03, 0x80 }),
+             boost::test_tools::per_element());
+  BOOST_TEST(nalus[2] == std::vector<uint8_t>({ 0x65, 0x88 }), boost::test_tools::per_element());
+}
+
+BOOST_AUTO_TEST_CASE(malformed_annexb_stream_is_rejected)
+{
+  std::vector<uint8_t> no_start_code{ 0x09, 0xf0 };
+  std::vector<uint8_t> short_start_code{ 0x00, 0x01, 0x09, 0xf0 };
+  std::vector<uint8_t> empty_nalu{ 0x00, 0x00, 0x01, 0x00, 0x00, 0x01, 0x09, 0xf0 };
+
+  BOOST_CHECK_THROW(parse_annexb(no_start_code), BinaryParseError);
+  BOOST_CHECK_THROW(parse_annexb(short_start_code), BinaryParseError);
+  BOOST_CHECK_THROW(parse_annexb(empty_nalu), BinaryParseError);
+}
+
+BOOST_AUTO_TEST_CASE(emitted_annexb_nalus_are_parsed_back)
+{
+  std::vector<OwnedSeiPayload> seis{
+    OwnedSeiPayload(SeiType::USER_DATA_REGISTERED, { 0xb5, 0x00, 0x00, 0x01, 0xfc, 0x00 }),
+  };
+  OwnedNalu slice{ 0x65, 0x00, 0x00, 0x03, 0x01, 0x88 };
+
+  std::vector<uint8_t> stream{};
+  emit_sei_payloads_to_annexb_nalu(seis.begin(), seis.end(), std::back_inserter(stream));
+  emit_annexb_nalu(slice, std::back_inserter(stream));
+
+  auto nalus = parse_annexb(stream);
+
+  BOOST_TEST_REQUIRE(nalus.size() == 2);
+  BOOST_TEST(nalus[0].front() == static_cast<uint8_t>(NaluType::SEI));
+  BOOST_TEST(nalus[1] == std::vector<uint8_t>(slice.cbegin(), slice.cend()), boost::test_tools::per_element());
+}
+
+BOOST_AUTO_TEST_CASE(vectorized_start_code_search_matches_scalar)
+{
+  std::mt19937 rng(7);
+  std::discrete_distribution<int> pick{ 6, 2, 2 };
+
+  for (auto level : simd_levels()) {
+    for (size_t size = 0; size < 200; size++) {
+      // Dense in zeros and ones, so that start codes and their prefixes fall on every position of vector blocks
+      std::vector<uint8_t> bytes(size);
+      for (auto &byte : bytes) {
+        int choice = pick(rng);
+        byte = choice == 0 ? 0x00 : choice == 1 ? 0x01 : static_cast<uint8_t>(rng());
+      }
+
+      for (size_t offset = 0; offset <= size; offset += 7) {
+        const uint8_t *first = bytes.data() + offset;
+        const uint8_t *last = bytes.data() + size;
+
+        const uint8_t *expected = last;
+        for (const uint8_t *pos = first; pos + 3 <= last; pos++) {
+          if (pos[0] == 0 && pos[1] == 0 && pos[2] == 1) {
+            expected = pos;
+            break;
+          }
+        }
+
+        BOOST_TEST(detail::find_start_code(first, last, level) == expected);
+      }
+    }
+  }
+}
+
+BOOST_AUTO_TEST_SUITE_END()
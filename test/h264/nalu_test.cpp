@@ -1,5 +1,8 @@
 #include <boost/test/unit_test.hpp>
 
+#include <algorithm>
+#include <iterator>
+
 #include <src/h264/nalu.h>
 
 using namespace metamix;
@@ -40,4 +43,33 @@ BOOST_AUTO_TEST_CASE(is_iterable)
   BOOST_TEST(std::all_of(nalu.cbegin(), nalu.cend(), [](auto x) { return x == 0x68; }));
 }
 
+BOOST_AUTO_TEST_CASE(copies_and_moves_refer_to_own_bytes)
+{
+  auto original = sei();
+  OwnedNalu copy(original);
+  BOOST_TEST(copy.data() != original.data());
+  BOOST_TEST(std::equal(copy.cbegin(), copy.cend(), original.cbegin(), original.cend()));
+
+  copy = pps();
+  BOOST_TEST(copy.type() == NaluType::PPS);
+  BOOST_TEST(copy.size() == 5);
+
+  OwnedNalu moved(std::move(original));
+  BOOST_TEST(moved.type() == NaluType::SEI);
+  BOOST_TEST(original.empty());
+
+  original = std::move(moved);
+  BOOST_TEST(original.type() == NaluType::SEI);
+  BOOST_TEST(moved.empty());
+}
+
+BOOST_AUTO_TEST_CASE(view_refers_to_given_bytes)
+{
+  auto owned = sei();
+  NaluView view(owned.data(), owned.size());
+  BOOST_TEST(view.data() == owned.data());
+  BOOST_TEST(view.type() == NaluType::SEI);
+  BOOST_TEST(std::distance(view.cbegin(), view.cend()) == static_cast<std::ptrdiff_t>(owned.size()));
+}
+
 BOOST_AUTO_TEST_SUITE_END()
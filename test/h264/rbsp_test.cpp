@@ -6,6 +6,7 @@
 
 #include <array>
 #include <iostream>
+#include <random>
 #include <vector>
 
 #include <src/byte_vector_io.h>
@@ -77,6 +78,39 @@ int emulation_prevention_bytes_counts[] = {
   2, // sei
 };
 
+std::vector<SimdLevel> simd_levels()
+{
+  std::vector<SimdLevel> levels{ SimdLevel::SCALAR };
+  if (simd_level() >= SimdLevel::SSE2) {
+    levels.push_back(SimdLevel::SSE2);
+  }
+  if (simd_level() >= SimdLevel::AVX2) {
+    levels.push_back(SimdLevel::AVX2);
+  }
+  return levels;
+}
+
+/// Random byte stream dense in zeros and threes, so that escapes fall on every position of vector blocks.
+std::vector<uint8_t>
+random_ebsp(std::mt19937 &rng, size_t size)
+{
+  std::discrete_distribution<int> pick{ 6, 3, 1 };
+  std::vector<uint8_t> ebsp(size);
+  for (auto &byte : ebsp) {
+    switch (pick(rng)) {
+    case 0:
+      byte = 0x00;
+      break;
+    case 1:
+      byte = 0x03;
+      break;
+    default:
+      byte = static_cast<uint8_t>(rng());
+    }
+  }
+  return ebsp;
+}
+
 BOOST_AUTO_TEST_SUITE(rbsp_test)
 
 BOOST_DATA_TEST_CASE(ebsp_to_rbsp, data::make(originals) ^ sodbs, orig, expected_sodb)
@@ -129,4 +163,118 @@ BOOST_DATA_TEST_CASE(emulation_prevention_bytes_counting,
   BOOST_TEST(count_emulation_prevention_bytes(orig.begin(), orig.end()) == count);
 }
 
+BOOST_DATA_TEST_CASE(emulation_prevention_bytes_detection,
+                     data::make(originals) ^ emulation_prevention_bytes_counts,
+                     orig,
+                     count)
+{
+  for (auto level : simd_levels()) {
+    bool found = detail::find_zero_prefixed(orig.data(), orig.data() + orig.size(), 0x03, level) !=
+                 orig.data() + orig.size();
+    BOOST_TEST(found == (count > 0));
+  }
+  BOOST_TEST(has_emulation_prevention_bytes(orig.data(), orig.data() + orig.size()) == (count > 0));
+}
+
+BOOST_AUTO_TEST_CASE(sodb_end_rejects_missing_stop_bit)
+{
+  std::vector<uint8_t> zeros{ 0x00, 0x00 };
+  std::vector<uint8_t> padded{ 0x01, 0x80, 0x00, 0x00 };
+
+  BOOST_CHECK_THROW(sodb_end(zeros.begin(), zeros.end()), std::runtime_error);
+  BOOST_CHECK_THROW(sodb_end(empty.begin(), empty.end()), std::runtime_error);
+  BOOST_TEST((sodb_end(padded.begin(), padded.end()) == padded.begin() + 1));
+}
+
+BOOST_DATA_TEST_CASE(contiguous_ebsp_to_sodb, data::make(originals) ^ sodbs, orig, sodb)
+{
+  std::vector<uint8_t> actual{ 0xff };
+  copy_ebsp_to_sodb(orig.data(), orig.data() + orig.size(), actual);
+
+  BOOST_TEST(actual.front() == 0xff);
+  BOOST_CHECK_EQUAL_COLLECTIONS(actual.begin() + 1, actual.end(), sodb.begin(), sodb.end());
+}
+
+BOOST_DATA_TEST_CASE(contiguous_sodb_to_ebsp, data::make(sodbs) ^ originals, sodb, expected)
+{
+  std::vector<uint8_t> actual{ 0xff };
+  copy_sodb_to_ebsp(sodb.data(), sodb.data() + sodb.size(), actual);
+
+  BOOST_TEST(actual.front() == 0xff);
+  BOOST_CHECK_EQUAL_COLLECTIONS(actual.begin() + 1, actual.end(), expected.begin(), expected.end());
+}
+
+BOOST_AUTO_TEST_CASE(vectorized_ebsp_to_rbsp_matches_scalar)
+{
+  std::mt19937 rng(42);
+
+  for (auto level : simd_levels()) {
+    for (size_t size = 0; size < 300; size++) {
+      auto ebsp = random_ebsp(rng, size);
+
+      std::vector<uint8_t> expected;
+      copy_ebsp_to_rbsp(ebsp.begin(), ebsp.end(), std::back_inserter(expected));
+
+      std::vector<uint8_t> actual(size);
+      auto end = detail::copy_from_ebsp_bytes(ebsp.data(), ebsp.data() + size, actual.data(), level);
+      actual.resize(end - actual.data());
+
+      BOOST_TEST_INFO("level " << static_cast<int>(level) << ", size " << size);
+      BOOST_TEST(actual == expected, boost::test_tools::per_element());
+    }
+  }
+}
+
+BOOST_AUTO_TEST_CASE(vectorized_rbsp_to_ebsp_matches_scalar)
+{
+  std::mt19937 rng(43);
+
+  for (auto level : simd_levels()) {
+    for (size_t size = 0; size < 300; size++) {
+      auto rbsp = random_ebsp(rng, size);
+
+      std::vector<uint8_t> expected;
+      copy_rbsp_to_ebsp(rbsp.begin(), rbsp.end(), std::back_inserter(expected));
+
+      std::vector<uint8_t> actual(size + size / 2);
+      auto end = detail::copy_to_ebsp_bytes(rbsp.data(), rbsp.data() + size, actual.data(), level);
+      actual.resize(end - actual.data());
+
+      BOOST_TEST_INFO("level " << static_cast<int>(level) << ", size " << size);
+      BOOST_TEST(actual == expected, boost::test_tools::per_element());
+      BOOST_TEST(detail::count_ebsp_escapes(rbsp.data(), rbsp.data() + size, level) == expected.size() - size);
+    }
+  }
+}
+
+BOOST_AUTO_TEST_CASE(escaped_rbsp_round_trips)
+{
+  std::mt19937 rng(44);
+
+  for (size_t size = 0; size < 300; size++) {
+    auto rbsp = random_ebsp(rng, size);
+
+    std::vector<uint8_t> ebsp;
+    copy_rbsp_to_ebsp(rbsp.data(), rbsp.data() + rbsp.size(), ebsp);
+    BOOST_TEST(count_emulation_prevention_bytes_needed(rbsp.begin(), rbsp.end()) == ebsp.size() - size);
+    BOOST_TEST(count_emulation_prevention_bytes(ebsp.begin(), ebsp.end()) == ebsp.size() - size);
+
+    std::vector<uint8_t> decoded;
+    copy_ebsp_to_rbsp(ebsp.data(), ebsp.data() + ebsp.size(), decoded);
+
+    BOOST_TEST_INFO("size " << size);
+    BOOST_TEST(decoded == rbsp, boost::test_tools::per_element());
+  }
+}
+
+BOOST_AUTO_TEST_CASE(zero_run_is_escaped_once_per_two_zeros)
+{
+  std::vector<uint8_t> rbsp{ 0x00, 0x00, 0x00, 0x00, 0x00, 0x01 };
+  std::vector<uint8_t> expected{ 0x00, 0x00, 0x03, 0x00, 0x00, 0x03, 0x00, 0x01 };
+
+  std::vector<uint8_t> actual;
+  copy_rbsp_to_ebsp(rbsp.begin(), rbsp.end(), std::back_inserter(actual));
+  BOOST_CHECK_EQUAL_COLLECTIONS(actual.begin(), actual.end(), expected.begin(), expected.end());
+}
+
 BOOST_AUTO_TEST_SUITE_END()
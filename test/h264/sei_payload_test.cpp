@@ -0,0 +1,307 @@
+#include <boost/test/unit_test.hpp>
+
+#include <boost/test/test_tools.hpp>
+
+#include <array>
+#include <iterator>
+#include <utility>
+#include <vector>
+
+#include <src/h264/rbsp.h>
+#include <src/h264/sei_parser.h>
+#include <src/h264/sei_payload.h>
+#include <test/allocation_counter.h>
+
+using namespace metamix;
+using namespace metamix::h264;
+using metamix::test::AllocationCounter;
+
+static std::vector<uint8_t>
+payload_bytes(size_t size)
+{
+  std::vector<uint8_t> bytes(size);
+  for (size_t i = 0; i < size; i++) {
+    bytes[i] = static_cast<uint8_t>(i + 1);
+  }
+  return bytes;
+}
+
+/// SEI NALU holding a closed caption payload, and a user data unregistered one.
+static std::vector<uint8_t>
+sei_nalu()
+{
+  std::vector<uint8_t> nalu{ 0x06, 0x04, 0x60 };
+  auto cc = payload_bytes(0x60);
+  nalu.insert(nalu.end(), cc.begin(), cc.end());
+  nalu.insert(nalu.end(), { 0x05, 0x14 });
+  auto unregistered = payload_bytes(0x14);
+  nalu.insert(nalu.end(), unregistered.begin(), unregistered.end());
+  nalu.push_back(0x80);
+  return nalu;
+}
+
+/// Whether payload points into its own inline storage, rather than to heap or to storage of another payload.
+static bool
+points_inline(const OwnedSeiPayload &sei)
+{
+  auto object = reinterpret_cast<const uint8_t *>(&sei);
+  return object <= sei.data() && sei.data() + sei.size() <= object + sizeof(sei);
+}
+
+BOOST_AUTO_TEST_SUITE(sei_payload_test)
+
+BOOST_AUTO_TEST_CASE(small_payload_is_held_inline)
+{
+  auto bytes = payload_bytes(OwnedSeiPayload::INLINE_CAPACITY);
+  OwnedSeiPayload sei(SeiType::USER_DATA_REGISTERED, bytes.data(), bytes.data() + bytes.size());
+  BOOST_TEST(sei.is_inline());
+
+  // Besides inline storage, payload holds only its type, view of its bytes, heap storage and message header
+  BOOST_TEST(sizeof(OwnedSeiPayload) <= OwnedSeiPayload::INLINE_CAPACITY + 64);
+
+  AllocationCounter counter{};
+  OwnedSeiPayload copy(sei);
+  OwnedSeiPayload moved(std::move(copy));
+  copy = moved;
+  BOOST_TEST(counter.count() == 0);
+
+  BOOST_TEST(moved.type() == SeiType::USER_DATA_REGISTERED);
+  BOOST_TEST(std::vector<uint8_t>(moved.data(), moved.data() + moved.size()) == bytes, boost::test_tools::per_element());
+  BOOST_TEST(std::vector<uint8_t>(copy.data(), copy.data() + copy.size()) == bytes, boost::test_tools::per_element());
+}
+
+BOOST_AUTO_TEST_CASE(large_payload_is_held_on_heap)
+{
+  auto bytes = payload_bytes(OwnedSeiPayload::INLINE_CAPACITY + 1);
+  OwnedSeiPayload sei(SeiType::USER_DATA_REGISTERED, bytes);
+  BOOST_TEST(!sei.is_inline());
+  BOOST_TEST(metadata_value_bytes(sei) == sizeof(sei) + bytes.size());
+
+  AllocationCounter counter{};
+  OwnedSeiPayload copy(sei);
+  BOOST_TEST(counter.count() == 1);
+  BOOST_TEST(copy.data() != sei.data());
+  BOOST_TEST(std::vector<uint8_t>(copy.data(), copy.data() + copy.size()) == bytes, boost::test_tools::per_element());
+
+  const uint8_t *data = copy.data();
+  OwnedSeiPayload moved(std::move(copy));
+  BOOST_TEST(moved.data() == data);
+  BOOST_TEST(copy.empty());
+
+  // Shrinking back to inline storage
+  moved = OwnedSeiPayload(SeiType::USER_DATA_REGISTERED, { 0x01, 0x02 });
+  BOOST_TEST(moved.is_inline());
+  BOOST_TEST(moved.size() == 2);
+  BOOST_TEST(moved[1] == 0x02);
+}
+
+BOOST_AUTO_TEST_CASE(inline_storage_is_pointed_to_after_copy_and_move)
+{
+  auto bytes = payload_bytes(OwnedSeiPayload::INLINE_CAPACITY);
+  OwnedSeiPayload sei(SeiType::USER_DATA_REGISTERED, bytes.data(), bytes.data() + bytes.size());
+  BOOST_TEST(points_inline(sei));
+
+  OwnedSeiPayload copy(sei);
+  BOOST_TEST(points_inline(copy));
+  BOOST_TEST(points_inline(sei));
+
+  OwnedSeiPayload moved(std::move(copy));
+  BOOST_TEST(points_inline(moved));
+  BOOST_TEST(points_inline(copy));
+  BOOST_TEST(copy.empty());
+
+  OwnedSeiPayload assigned(SeiType::USER_DATA_UNREGISTERED, { 0x01 });
+  assigned = sei;
+  BOOST_TEST(points_inline(assigned));
+  BOOST_TEST(assigned.size() == bytes.size());
+
+  OwnedSeiPayload move_assigned(SeiType::USER_DATA_UNREGISTERED, { 0x01 });
+  move_assigned = std::move(moved);
+  BOOST_TEST(points_inline(move_assigned));
+  BOOST_TEST(points_inline(moved));
+  BOOST_TEST(moved.empty());
+
+  auto &self = assigned;
+  assigned = self;
+  BOOST_TEST(points_inline(assigned));
+  BOOST_TEST(std::vector<uint8_t>(assigned.data(), assigned.data() + assigned.size()) == bytes,
+             boost::test_tools::per_element());
+
+  // Elements are moved when vector grows
+  std::vector<OwnedSeiPayload> seis{};
+  for (int i = 0; i < 16; i++) {
+    seis.push_back(sei);
+  }
+  for (const auto &element : seis) {
+    BOOST_TEST(points_inline(element));
+  }
+}
+
+BOOST_AUTO_TEST_CASE(storage_is_switched_between_inline_and_heap)
+{
+  auto small = payload_bytes(OwnedSeiPayload::INLINE_CAPACITY);
+  auto large = payload_bytes(OwnedSeiPayload::INLINE_CAPACITY + 1);
+  OwnedSeiPayload inline_sei(SeiType::USER_DATA_REGISTERED, small);
+  OwnedSeiPayload heap_sei(SeiType::USER_DATA_REGISTERED, large);
+  BOOST_TEST(!points_inline(heap_sei));
+
+  // Inline to heap and back by assignment
+  OwnedSeiPayload sei(inline_sei);
+  sei = heap_sei;
+  BOOST_TEST(!points_inline(sei));
+  BOOST_TEST(sei.data() != heap_sei.data());
+  sei = inline_sei;
+  BOOST_TEST(points_inline(sei));
+  BOOST_TEST(sei.size() == small.size());
+
+  // Inline to heap and back by move assignment, heap storage is taken from moved payload
+  OwnedSeiPayload heap_copy(heap_sei);
+  const uint8_t *heap_data = heap_copy.data();
+  sei = std::move(heap_copy);
+  BOOST_TEST(sei.data() == heap_data);
+  BOOST_TEST(points_inline(heap_copy));
+  BOOST_TEST(heap_copy.empty());
+  sei = OwnedSeiPayload(inline_sei);
+  BOOST_TEST(points_inline(sei));
+
+  // Inline to heap and back by replacing contents
+  sei.assign(large.data(), large.data() + large.size());
+  BOOST_TEST(!points_inline(sei));
+  sei.assign(small.data(), small.data() + small.size());
+  BOOST_TEST(points_inline(sei));
+  BOOST_TEST(std::vector<uint8_t>(sei.data(), sei.data() + sei.size()) == small, boost::test_tools::per_element());
+
+  // Heap payload moved out of leaves moved-from payload pointing inline
+  OwnedSeiPayload moved(std::move(heap_sei));
+  BOOST_TEST(!points_inline(moved));
+  BOOST_TEST(points_inline(heap_sei));
+  BOOST_TEST(heap_sei.empty());
+}
+
+BOOST_AUTO_TEST_CASE(message_header_follows_contents)
+{
+  auto large = payload_bytes(300);
+  OwnedSeiPayload sei(SeiType::USER_DATA_REGISTERED, { 0x01, 0x02 });
+  std::vector<uint8_t> header(sei.message_header().first, sei.message_header().second);
+  BOOST_TEST(header == std::vector<uint8_t>({ 0x04, 0x02 }), boost::test_tools::per_element());
+
+  // Copies carry message header, moved-from payload is left without it
+  OwnedSeiPayload copy(sei);
+  BOOST_TEST(std::vector<uint8_t>(copy.message_header().first, copy.message_header().second) == header,
+             boost::test_tools::per_element());
+  OwnedSeiPayload moved(std::move(copy));
+  BOOST_TEST(std::vector<uint8_t>(moved.message_header().first, moved.message_header().second) == header,
+             boost::test_tools::per_element());
+  BOOST_TEST((copy.message_header().first == copy.message_header().second));
+
+  // Replaced contents are serialized again
+  sei.assign(large.data(), large.data() + large.size());
+  header.assign(sei.message_header().first, sei.message_header().second);
+  BOOST_TEST(header == std::vector<uint8_t>({ 0x04, 0xFF, 0x2D }), boost::test_tools::per_element());
+  sei.assign(large.data(), large.data() + 1);
+  header.assign(sei.message_header().first, sei.message_header().second);
+  BOOST_TEST(header == std::vector<uint8_t>({ 0x04, 0x01 }), boost::test_tools::per_element());
+
+  // Messages which would need emulation prevention even after a non-zero byte are serialized when emitted
+  OwnedSeiPayload escaped(SeiType::USER_DATA_REGISTERED, { 0x00, 0x00, 0x03 });
+  BOOST_TEST((escaped.message_header().first == escaped.message_header().second));
+  OwnedSeiPayload empty(SeiType::USER_DATA_REGISTERED, std::vector<uint8_t>{});
+  BOOST_TEST((empty.message_header().first == empty.message_header().second));
+}
+
+BOOST_AUTO_TEST_CASE(steady_state_extraction_does_not_allocate)
+{
+  auto nalu = sei_nalu();
+  std::vector<uint8_t> sodb{};
+  sodb.reserve(nalu.size());
+  std::array<OwnedSeiPayload, 2> seis{};
+
+  // Extracts SEI payloads from one frame, like SeiExtractor does.
+  auto extract = [&]() {
+    sodb.clear();
+    copy_ebsp_to_sodb(nalu.begin(), nalu.end(), std::back_inserter(sodb));
+
+    size_t count = 0;
+    SeiParser parser = SeiParser::create(sodb.data() + 1, sodb.data() + sodb.size());
+    while (parser) {
+      parser >> seis.at(count++);
+    }
+    return count;
+  };
+
+  BOOST_TEST(extract() == 2);
+
+  AllocationCounter counter{};
+  for (int frame = 0; frame < 100; frame++) {
+    extract();
+  }
+  BOOST_TEST(counter.count() == 0);
+
+  BOOST_TEST(seis[0].type() == SeiType::USER_DATA_REGISTERED);
+  BOOST_TEST(seis[0].size() == 0x60);
+  BOOST_TEST(seis[1].type() == SeiType::USER_DATA_UNREGISTERED);
+  BOOST_TEST(seis[1].size() == 0x14);
+}
+
+BOOST_AUTO_TEST_CASE(closed_captions_are_told_by_t35_header)
+{
+  OwnedSeiPayload cc(SeiType::USER_DATA_REGISTERED, { 0xb5, 0x00, 0x31, 'G', 'A', '9', '4', 0x03, 0x41, 0x00 });
+  OwnedSeiPayload bar_data(SeiType::USER_DATA_REGISTERED, { 0xb5, 0x00, 0x31, 'G', 'A', '9', '4', 0x06, 0x1f });
+  OwnedSeiPayload afd(SeiType::USER_DATA_REGISTERED, { 0xb5, 0x00, 0x31, 'D', 'T', 'G', '1', 0x41 });
+  OwnedSeiPayload truncated(SeiType::USER_DATA_REGISTERED, { 0xb5, 0x00, 0x31, 'G' });
+  OwnedSeiPayload unregistered(SeiType::USER_DATA_UNREGISTERED, cc.data(), cc.data() + cc.size());
+
+  BOOST_TEST(is_closed_caption(cc));
+  BOOST_TEST(!is_closed_caption(bar_data));
+  BOOST_TEST(!is_closed_caption(afd));
+  BOOST_TEST(!is_closed_caption(truncated));
+  BOOST_TEST(!is_closed_caption(unregistered));
+}
+
+BOOST_AUTO_TEST_CASE(sei_nalu_with_closed_captions_is_detected_in_place)
+{
+  std::vector<uint8_t> cc_nalu{ 0x06, 0x04, 0x0a, 0xb5, 0x00, 0x31, 'G', 'A', '9', '4', 0x03, 0x41, 0xff, 0x80 };
+  auto other_nalu = sei_nalu();
+  std::vector<uint8_t> scratch{};
+
+  AllocationCounter counter{};
+  BOOST_TEST(has_closed_captions(cc_nalu.data(), cc_nalu.data() + cc_nalu.size(), 1, scratch));
+  BOOST_TEST(!has_closed_captions(other_nalu.data(), other_nalu.data() + other_nalu.size(), 1, scratch));
+  BOOST_TEST(counter.count() == 0);
+}
+
+BOOST_AUTO_TEST_CASE(unescaped_sei_nalu_is_parsed_in_place)
+{
+  auto nalu = sei_nalu();
+  std::vector<uint8_t> scratch{};
+  std::vector<std::pair<SeiType, const uint8_t *>> seis{};
+
+  for_each_sei_payload(nalu.data(), nalu.data() + nalu.size(), 1, scratch, [&](const SeiPayloadView &sei) {
+    seis.emplace_back(sei.type(), sei.data());
+  });
+
+  BOOST_TEST_REQUIRE(seis.size() == 2);
+  BOOST_TEST(seis[0].first == SeiType::USER_DATA_REGISTERED);
+  BOOST_TEST(seis[0].second == nalu.data() + 3);
+  BOOST_TEST(seis[1].first == SeiType::USER_DATA_UNREGISTERED);
+  BOOST_TEST(scratch.empty());
+}
+
+BOOST_AUTO_TEST_CASE(escaped_sei_nalu_is_parsed_from_sodb)
+{
+  std::vector<uint8_t> nalu{ 0x06, 0x04, 0x04, 0xb5, 0x00, 0x00, 0x03, 0x01, 0x80 };
+  std::vector<uint8_t> scratch{};
+  std::vector<OwnedSeiPayload> seis{};
+
+  for_each_sei_payload(nalu.data(), nalu.data() + nalu.size(), 1, scratch, [&](const SeiPayloadView &sei) {
+    BOOST_TEST(sei.data() >= scratch.data());
+    seis.emplace_back(sei);
+  });
+
+  BOOST_TEST_REQUIRE(seis.size() == 1);
+  BOOST_TEST(seis[0].type() == SeiType::USER_DATA_REGISTERED);
+  std::vector<uint8_t> expected{ 0xb5, 0x00, 0x00, 0x01 };
+  BOOST_TEST(std::vector<uint8_t>(seis[0].cbegin(), seis[0].cend()) == expected, boost::test_tools::per_element());
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,117 @@
+#include <boost/test/unit_test.hpp>
+
+#include <boost/test/test_tools.hpp>
+
+#include <iterator>
+#include <vector>
+
+#include <src/h264/emitter.h>
+#include <src/h264/rbsp.h>
+#include <src/h264/sei_parser.h>
+#include <src/h265/nalu.h>
+#include <src/video_codec.h>
+
+using namespace metamix;
+using namespace metamix::h265;
+using metamix::h264::NaluFraming;
+using metamix::h264::OwnedSeiPayload;
+using metamix::h264::SeiParser;
+using metamix::h264::SeiType;
+
+static OwnedNalu
+vps()
+{
+  return OwnedNalu{ 0x40, 0x01, 0x0c, 0x01, 0xff, 0xff };
+}
+
+static OwnedNalu
+prefix_sei()
+{
+  return OwnedNalu{ 0x4e, 0x01, 0x05, 0x02, 0xaa, 0xbb, 0x80 };
+}
+
+BOOST_AUTO_TEST_SUITE(h265_nalu_test)
+
+BOOST_AUTO_TEST_CASE(is_valid)
+{
+  BOOST_TEST(vps().is_valid());
+  BOOST_TEST(prefix_sei().is_valid());
+  BOOST_TEST(!OwnedNalu{}.is_valid());
+  BOOST_TEST(!OwnedNalu{ 0x4e }.is_valid());
+  BOOST_TEST(!OwnedNalu({ 0xce, 0x01 }).is_valid());
+  BOOST_TEST(!OwnedNalu({ 0x4e, 0x00 }).is_valid());
+}
+
+BOOST_AUTO_TEST_CASE(type)
+{
+  BOOST_TEST(vps().type() == NaluType::VPS);
+  BOOST_TEST(prefix_sei().type() == NaluType::PREFIX_SEI);
+  BOOST_TEST(OwnedNalu({ 0x26, 0x01 }).type() == NaluType::IDR_W_RADL);
+  BOOST_TEST(OwnedNalu({ 0x50, 0x01 }).type() == NaluType::SUFFIX_SEI);
+}
+
+BOOST_AUTO_TEST_CASE(format_is_detected_from_extradata)
+{
+  std::vector<uint8_t> hvcc(23, 0x00);
+  hvcc[0] = 0x01;
+  hvcc[21] = 0x0f;
+  std::vector<uint8_t> annexb{ 0x00, 0x00, 0x00, 0x01, 0x40, 0x01 };
+
+  BOOST_TEST((detect_nalu_format(hvcc.data(), hvcc.size()).framing == NaluFraming::AVCC));
+  BOOST_TEST(detect_nalu_format(hvcc.data(), hvcc.size()).length_size == 4);
+
+  hvcc[21] = 0x0d;
+  BOOST_TEST(detect_nalu_format(hvcc.data(), hvcc.size()).length_size == 2);
+
+  BOOST_TEST((detect_nalu_format(annexb.data(), annexb.size()).framing == NaluFraming::ANNEX_B));
+  BOOST_TEST((detect_nalu_format(nullptr, 0).framing == NaluFraming::ANNEX_B));
+}
+
+BOOST_AUTO_TEST_CASE(prefix_sei_nalu_is_emitted_and_parsed_back)
+{
+  std::vector<OwnedSeiPayload> seis{
+    OwnedSeiPayload(SeiType::USER_DATA_REGISTERED, { 0xb5, 0x00, 0x31, 0x00, 0x00, 0x01 }),
+  };
+
+  std::vector<uint8_t> out{};
+  h264::emit_sei_payloads_to_avcc_nalu(PREFIX_SEI_NALU_HEADER, seis.begin(), seis.end(), std::back_inserter(out));
+
+  OwnedNalu nalu(std::vector<uint8_t>(out.begin() + 4, out.end()));
+  BOOST_TEST(nalu.is_valid());
+  BOOST_TEST(nalu.type() == NaluType::PREFIX_SEI);
+  BOOST_TEST(H265SeiSyntax::is_sei(h264::OwnedNalu(std::vector<uint8_t>(nalu.cbegin(), nalu.cend()))));
+
+  std::vector<uint8_t> sodb{};
+  h264::copy_ebsp_to_sodb(nalu.cbegin(), nalu.cend(), std::back_inserter(sodb));
+
+  auto parser = SeiParser::create(sodb.data() + H265SeiSyntax::NALU_HEADER_SIZE, sodb.data() + sodb.size());
+  OwnedSeiPayload sei;
+  parser >> sei;
+
+  BOOST_TEST(sei.type() == SeiType::USER_DATA_REGISTERED);
+  BOOST_TEST(std::vector<uint8_t>(sei.cbegin(), sei.cend()) == std::vector<uint8_t>(seis[0].cbegin(), seis[0].cend()),
+             boost::test_tools::per_element());
+}
+
+BOOST_AUTO_TEST_CASE(sei_nalu_header_keeps_layer_and_temporal_id_of_access_unit)
+{
+  // TRAIL_R slice with nuh_layer_id 33 and nuh_temporal_id_plus1 3
+  h264::OwnedNalu slice{ 0x03, 0x0b, 0xaf };
+
+  auto header = H265SeiSyntax::sei_nalu_header(slice);
+  BOOST_TEST(is_valid_header(header.data(), header.size()));
+  BOOST_TEST(nalu_type(header[0]) == NaluType::PREFIX_SEI);
+  BOOST_TEST(header[0] == 0x4f);
+  BOOST_TEST(header[1] == 0x0b);
+
+  auto sei = prefix_sei();
+  header = H265SeiSyntax::sei_nalu_header(h264::OwnedNalu(std::vector<uint8_t>(sei.cbegin(), sei.cend())));
+  BOOST_TEST(header[0] == PREFIX_SEI_NALU_HEADER[0]);
+  BOOST_TEST(header[1] == PREFIX_SEI_NALU_HEADER[1]);
+
+  header = H265SeiSyntax::sei_nalu_header(h264::OwnedNalu());
+  BOOST_TEST(header[0] == PREFIX_SEI_NALU_HEADER[0]);
+  BOOST_TEST(header[1] == PREFIX_SEI_NALU_HEADER[1]);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,132 @@
+#include <boost/test/unit_test.hpp>
+
+#include <boost/test/test_tools.hpp>
+
+#include <src/metadata_kind.h>
+#include <src/metadata_log.h>
+#include <src/metadata_queue.h>
+#include <src/optional_io.h>
+
+using namespace metamix;
+
+METAMIX_METADATA_KIND(LogTestKind, log_test, logTest, "LOGTEST", "Log Test")
+
+METAMIX_METADATA_KIND_MAP_TO_VALUE(LogTestKind, ClockTS)
+
+using LogTestMetadata = Metadata<LogTestKind>;
+using LogTestMetadataLog = MetadataLog<LogTestKind>;
+
+static constexpr ClockTS
+nts(float i)
+{
+  return static_cast<ClockTS>(100.0f * i);
+}
+
+static LogTestMetadata
+nth(float i, InputId input_id = 0, int order = 0)
+{
+  return LogTestMetadata(input_id, nts(i), nts(i), order, std::make_shared<ClockTS>(nts(i)));
+}
+
+BOOST_AUTO_TEST_SUITE(metadata_log_test)
+
+BOOST_AUTO_TEST_CASE(empty)
+{
+  LogTestMetadataLog log;
+  BOOST_TEST(log.empty());
+  BOOST_TEST(!log.pop(0, nts(0), nts(10)));
+}
+
+BOOST_AUTO_TEST_CASE(pop_all_drops_other_inputs)
+{
+  std::vector<LogTestMetadata> expected;
+  expected.push_back(nth(1, 0));
+  expected.push_back(nth(2, 0));
+  expected.push_back(nth(3, 0));
+
+  LogTestMetadataLog log;
+  log.push(nth(4, 0));
+  log.push(nth(4, 2));
+  log.push(nth(3, 0));
+  log.push(nth(2, 0));
+  log.push(nth(1, 2));
+  log.push(nth(1, 0));
+  log.push(nth(2, 1));
+  log.push(nth(3, 2));
+  log.push(nth(0, 0));
+  log.push(nth(0, 1));
+
+  std::vector<LogTestMetadata> actual;
+  log.pop_all(0, nts(1), nts(4), std::back_inserter(actual));
+
+  BOOST_CHECK_EQUAL_COLLECTIONS(actual.begin(), actual.end(), expected.begin(), expected.end());
+  BOOST_TEST(log.size() == 2);
+}
+
+BOOST_AUTO_TEST_CASE(pop_keeps_order_within_frame)
+{
+  LogTestMetadataLog log;
+  log.push(nth(1, 0, 1));
+  log.push(nth(1, 0, 0));
+  log.push(nth(1, 1, 0));
+
+  BOOST_TEST(log.pop(0, nts(0), nts(2)) == nth(1, 0, 0));
+  BOOST_TEST(log.pop(0, nts(0), nts(2)) == nth(1, 0, 1));
+  BOOST_TEST(!log.pop(0, nts(0), nts(2)));
+}
+
+BOOST_AUTO_TEST_CASE(pop_reads_only_once)
+{
+  LogTestMetadataLog log;
+  log.push(nth(1));
+  log.push(nth(2));
+
+  BOOST_TEST(log.pop(0, nts(0), nts(3)) == nth(1));
+  BOOST_TEST(log.pop(0, nts(0), nts(3)) == nth(2));
+  BOOST_TEST(!log.pop(0, nts(0), nts(3)));
+}
+
+BOOST_AUTO_TEST_CASE(pop_all_reclaims_passed_entries)
+{
+  LogTestMetadataLog log;
+  log.push(nth(1));
+  log.push(nth(2, 1));
+  log.push(nth(3));
+
+  std::vector<LogTestMetadata> actual;
+  BOOST_TEST(log.pop_all(0, nts(0), nts(3), std::back_inserter(actual)) == 1);
+  BOOST_TEST(log.size() == 1);
+  BOOST_TEST(log.stats().bytes == metadata_footprint(nth(3)));
+}
+
+BOOST_AUTO_TEST_CASE(push_behind_read_position_is_dropped)
+{
+  LogTestMetadataLog log;
+  BOOST_TEST(!log.pop(0, nts(0), nts(2)));
+  log.push(nth(1));
+  BOOST_TEST(log.empty());
+}
+
+BOOST_AUTO_TEST_CASE(drop_id_hides_entries)
+{
+  LogTestMetadataLog log;
+  log.push(nth(1, 1));
+  log.push(nth(2, 1));
+  BOOST_TEST(log.drop_id(1) == 2);
+  BOOST_TEST(log.empty());
+
+  BOOST_TEST(!log.pop(1, nts(0), nts(3)));
+}
+
+BOOST_AUTO_TEST_CASE(variant_dispatch)
+{
+  MetadataQueueVariant<LogTestKind> q(MetadataQueueEngine::LOG);
+  BOOST_TEST(q.engine() == MetadataQueueEngine::LOG);
+
+  q.push(nth(1, 0));
+  q.push(nth(2, 0));
+  BOOST_TEST(q.pop(0, nts(0), nts(2)) == nth(1, 0));
+  BOOST_TEST(q.size() == 1);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -252,6 +252,32 @@ BOOST_AUTO_TEST_CASE(pop_all_drops_other_inputs)
   BOOST_TEST(q.size() == 2);
 }
 
+BOOST_AUTO_TEST_CASE(pop_keeps_order_within_frame)
+{
+  TestMetadataQueue q;
+  q.push(nth(1, 0, 1));
+  q.push(nth(1, 1, 0));
+  q.push(nth(1, 0, 0));
+
+  BOOST_TEST(q.pop(0, nts(0), nts(2)) == nth(1, 0, 0));
+  BOOST_TEST(q.pop(0, nts(0), nts(2)) == nth(1, 0, 1));
+  BOOST_TEST(!q.pop(0, nts(0), nts(2)));
+  BOOST_TEST(q.empty());
+}
+
+BOOST_AUTO_TEST_CASE(pop_all_keeps_order_within_frame)
+{
+  TestMetadataQueue q;
+  std::vector<TestMetadata> batch{ nth(1, 0, 0), nth(1, 0, 1), nth(1, 1, 0), nth(1, 0, 2) };
+  q.push_range(batch.begin(), batch.end());
+
+  std::vector<TestMetadata> expected{ nth(1, 0, 0), nth(1, 0, 1), nth(1, 0, 2) };
+  std::vector<TestMetadata> actual;
+  BOOST_TEST(q.pop_all(0, nts(0), nts(2), std::back_inserter(actual)) == 3);
+  BOOST_CHECK_EQUAL_COLLECTIONS(actual.begin(), actual.end(), expected.begin(), expected.end());
+  BOOST_TEST(q.empty());
+}
+
 BOOST_AUTO_TEST_CASE(drop_id)
 {
   TestMetadataQueue q;
@@ -264,6 +290,208 @@ BOOST_AUTO_TEST_CASE(drop_id)
   BOOST_TEST(q.size() == 1);
 }
 
+BOOST_AUTO_TEST_CASE(drop_id_skips_dropped_entries)
+{
+  TestMetadataQueue q;
+  q.push(nth(1, 1));
+  q.push(nth(2, 1));
+  q.push(nth(3, 0));
+  q.push(nth(3, 1));
+  q.drop_id(1);
+
+  BOOST_TEST(q.size() == 1);
+  BOOST_TEST(q.pop(0, nts(0), nts(4)) == nth(3, 0));
+  BOOST_TEST(q.empty());
+  BOOST_TEST(!q.pop(1, nts(0), nts(4)));
+}
+
+BOOST_AUTO_TEST_CASE(drop_id_keeps_entries_pushed_after_drop)
+{
+  TestMetadataQueue q;
+  q.push(nth(1, 1));
+  q.push(nth(2, 1));
+  BOOST_TEST(q.drop_id(1) == 2);
+
+  // Restarted input pushes the same timestamps again.
+  q.push(nth(1, 1));
+  q.push(nth(2, 1));
+  BOOST_TEST(q.size() == 2);
+
+  std::vector<TestMetadata> actual;
+  BOOST_TEST(q.pop_all(1, nts(0), nts(3), std::back_inserter(actual)) == 2);
+  BOOST_TEST(q.empty());
+  BOOST_TEST(q.drop_id(1) == 0);
+}
+
+static std::vector<TestMetadata>
+pop_all(TestMetadataQueue &q, InputId id)
+{
+  std::vector<TestMetadata> result;
+  q.pop_all(id, nts(0), nts(100), std::back_inserter(result));
+  return result;
+}
+
+BOOST_AUTO_TEST_CASE(budget_drop_oldest)
+{
+  QueueBudget budget;
+  budget.max_entries = 3;
+
+  TestMetadataQueue q(budget);
+  for (int i = 1; i <= 5; i++) {
+    q.push(nth(i));
+  }
+
+  BOOST_TEST(q.size() == 3);
+  BOOST_TEST(q.stats().evicted_entries == 2);
+
+  std::vector<TestMetadata> expected{ nth(3), nth(4), nth(5) };
+  auto actual = pop_all(q, 0);
+  BOOST_CHECK_EQUAL_COLLECTIONS(actual.begin(), actual.end(), expected.begin(), expected.end());
+}
+
+BOOST_AUTO_TEST_CASE(budget_drop_newest)
+{
+  QueueBudget budget;
+  budget.max_entries = 3;
+  budget.policy = EvictionPolicy::DROP_NEWEST;
+
+  TestMetadataQueue q(budget);
+  for (int i = 1; i <= 5; i++) {
+    q.push(nth(i));
+  }
+
+  BOOST_TEST(q.stats().evicted_entries == 2);
+
+  std::vector<TestMetadata> expected{ nth(1), nth(2), nth(3) };
+  auto actual = pop_all(q, 0);
+  BOOST_CHECK_EQUAL_COLLECTIONS(actual.begin(), actual.end(), expected.begin(), expected.end());
+}
+
+BOOST_AUTO_TEST_CASE(budget_input_drop_oldest)
+{
+  QueueBudget budget;
+  budget.max_input_entries = 2;
+
+  TestMetadataQueue q(budget);
+  q.push(nth(1, 1));
+  q.push(nth(1, 0));
+  q.push(nth(2, 0));
+  q.push(nth(3, 0));
+
+  BOOST_TEST(q.size() == 3);
+  BOOST_TEST(q.stats().evicted_entries == 1);
+
+  std::vector<TestMetadata> expected{ nth(2, 0), nth(3, 0) };
+  auto actual = pop_all(q, 0);
+  BOOST_CHECK_EQUAL_COLLECTIONS(actual.begin(), actual.end(), expected.begin(), expected.end());
+}
+
+BOOST_AUTO_TEST_CASE(budget_input_drop_oldest_interleaved)
+{
+  QueueBudget budget;
+  budget.max_input_entries = 2;
+
+  TestMetadataQueue q(budget);
+  for (int i = 1; i <= 50; i++) {
+    q.push(nth(i, 0));
+    q.push(nth(i, 1));
+    q.push(nth(i, 2));
+    if (i == 30) {
+      q.drop_id(2);
+    }
+  }
+
+  BOOST_TEST(q.size() == 6);
+  BOOST_TEST(q.stats().entries == 6);
+
+  std::vector<TestMetadata> expected{ nth(49, 1), nth(50, 1) };
+  auto actual = pop_all(q, 1);
+  BOOST_CHECK_EQUAL_COLLECTIONS(actual.begin(), actual.end(), expected.begin(), expected.end());
+}
+
+BOOST_AUTO_TEST_CASE(budget_input_drop_oldest_after_pop)
+{
+  QueueBudget budget;
+  budget.max_input_entries = 2;
+
+  TestMetadataQueue q(budget);
+  q.push(nth(1, 0));
+  q.push(nth(2, 0));
+  BOOST_TEST(q.pop(0, nts(0.5), nts(1.5)) == nth(1, 0));
+
+  // Popped entry no longer counts towards input limit.
+  q.push(nth(3, 0));
+  BOOST_TEST(q.stats().evicted_entries == 0);
+
+  q.push(nth(4, 0));
+  BOOST_TEST(q.stats().evicted_entries == 1);
+
+  std::vector<TestMetadata> expected{ nth(3, 0), nth(4, 0) };
+  auto actual = pop_all(q, 0);
+  BOOST_CHECK_EQUAL_COLLECTIONS(actual.begin(), actual.end(), expected.begin(), expected.end());
+}
+
+BOOST_AUTO_TEST_CASE(budget_bytes)
+{
+  QueueBudget budget;
+  budget.max_bytes = 2 * metadata_footprint(nth(1));
+
+  TestMetadataQueue q(budget);
+  q.push(nth(1));
+  q.push(nth(2));
+  q.push(nth(3));
+
+  auto stats = q.stats();
+  BOOST_TEST(stats.entries == 2);
+  BOOST_TEST(stats.bytes == budget.max_bytes);
+  BOOST_TEST(stats.evicted_bytes == metadata_footprint(nth(1)));
+}
+
+BOOST_AUTO_TEST_CASE(budget_never_evicts_scte)
+{
+  QueueBudget budget;
+  budget.max_entries = 1;
+
+  BOOST_TEST(budget.for_kind<TestKind>().is_bounded());
+  BOOST_TEST(!budget.for_kind<ScteKind>().is_bounded());
+}
+
+BOOST_AUTO_TEST_CASE(budgets_override_kind)
+{
+  QueueBudgets budgets;
+  budgets.common.max_entries = 1;
+  budgets.override_kind<AltKind>().max_bytes = 100;
+  budgets.override_kind<ScteKind>().policy = EvictionPolicy::DROP_OLDEST;
+
+  BOOST_TEST(budgets.for_kind<TestKind>().max_entries == 1);
+  BOOST_TEST(budgets.for_kind<TestKind>().max_bytes == 0);
+  BOOST_TEST(budgets.for_kind<AltKind>().max_entries == 1);
+  BOOST_TEST(budgets.for_kind<AltKind>().max_bytes == 100);
+  BOOST_TEST(budgets.for_kind<ScteKind>().is_bounded());
+}
+
+BOOST_AUTO_TEST_CASE(push_range)
+{
+  std::vector<TestMetadata> expected{ nth(1, 0), nth(2, 0), nth(3, 0) };
+
+  TestMetadataQueue q;
+  q.push_range(expected.rbegin(), expected.rend());
+  BOOST_TEST(q.size() == 3);
+
+  auto actual = pop_all(q, 0);
+  BOOST_CHECK_EQUAL_COLLECTIONS(actual.begin(), actual.end(), expected.begin(), expected.end());
+}
+
+BOOST_AUTO_TEST_CASE(group_push_range)
+{
+  std::vector<AltMetadata> batch{ nthk<AltKind>(1, 1), nthk<AltKind>(2, 1) };
+
+  TestMetadataQueueGroup q;
+  q.push_range(batch.begin(), batch.end());
+  BOOST_TEST(q.get<TestKind>().size() == 0);
+  BOOST_TEST(q.get<AltKind>().size() == 2);
+}
+
 BOOST_AUTO_TEST_CASE(group_drop_id)
 {
   TestMetadataQueueGroup q;
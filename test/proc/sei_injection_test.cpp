@@ -0,0 +1,207 @@
+#include <boost/test/unit_test.hpp>
+
+#include <boost/test/test_tools.hpp>
+
+#include <cstring>
+#include <memory>
+#include <vector>
+
+#include <src/application_context.h>
+#include <src/clear_input.h>
+#include <src/clock.h>
+#include <src/ffmpeg.h>
+#include <src/h264/cc_data.h>
+#include <src/h264/rbsp.h>
+#include <src/h264/sei_parser.h>
+#include <src/h264/sei_payload.h>
+#include <src/h264/stdseis.h>
+#include <src/log.h>
+#include <src/metadata_queue.h>
+#include <src/proc/sei_injection.h>
+#include <src/program_options.h>
+#include <src/user_defined_input.h>
+#include <src/video_codec.h>
+#include <test/allocation_counter.h>
+
+using namespace metamix;
+using namespace metamix::h264;
+using metamix::proc::SeiInjection;
+using metamix::test::AllocationCounter;
+
+namespace {
+
+/// Application context with heap metadata queues recording metrics, and inputs queried by the test directly.
+struct InjectionContext
+{
+  std::shared_ptr<Clock> clock{ std::make_shared<Clock>(0_clock) };
+  ApplicationContext ctx{
+    std::make_shared<ApplicationMetadataQueueGroup>(MetadataQueueEngine::HEAP, QueueBudgets{}, clock),
+    clock,
+    nullptr,
+    std::make_shared<ProgramOptions>(),
+  };
+
+  ClearInput clear{ 0 };
+  UserDefinedInput user{ InputSpec{ 1, "user" } };
+};
+
+/// Access unit of AUD, SEI NALU and slice, whose SEI NALU holds closed captions and a user data unregistered payload
+/// with zeros, which are escaped.
+std::vector<uint8_t>
+access_unit(const OwnedSeiPayload &cc, const OwnedSeiPayload &unregistered)
+{
+  std::vector<uint8_t> messages{ 0x04, static_cast<uint8_t>(cc.size()) };
+  messages.insert(messages.end(), cc.cbegin(), cc.cend());
+  messages.insert(messages.end(), { 0x05, static_cast<uint8_t>(unregistered.size()) });
+  messages.insert(messages.end(), unregistered.cbegin(), unregistered.cend());
+  std::vector<uint8_t> nalu{ 0x06 };
+  copy_rbsp_to_ebsp(messages.data(), messages.data() + messages.size(), std::back_inserter(nalu));
+  nalu.push_back(0x80);
+
+  std::vector<uint8_t> au{ 0x00, 0x00, 0x00, 0x02, 0x09, 0xf0 };
+  au.insert(au.end(), { 0x00, 0x00, 0x00, static_cast<uint8_t>(nalu.size()) });
+  au.insert(au.end(), nalu.begin(), nalu.end());
+  au.insert(au.end(), { 0x00, 0x00, 0x00, 0x04, 0x65, 0x88, 0x84, 0x21 });
+  return au;
+}
+
+/// Payloads of SEI NALU following the AUD of access unit.
+std::vector<OwnedSeiPayload>
+seis_of(const AVPacket &pkt)
+{
+  size_t length = pkt.data[9];
+  std::vector<uint8_t> sodb{};
+  copy_ebsp_to_sodb(pkt.data + 11, pkt.data + 10 + length, std::back_inserter(sodb));
+
+  std::vector<OwnedSeiPayload> seis{};
+  auto parser = SeiParser::create(sodb.data(), sodb.data() + sodb.size());
+  while (parser) {
+    parser >> seis.emplace_back();
+  }
+  return seis;
+}
+}
+
+BOOST_AUTO_TEST_SUITE(sei_injection_test)
+
+BOOST_AUTO_TEST_CASE(steady_state_injection_does_not_allocate)
+{
+  InjectionContext ic{};
+  SeiInjection injection(VideoCodec::H264, NaluFormat{}, TimeBase(30000, 1001), InjectionMode::DENSE);
+
+  std::vector<CcTriplet> triplets{ { true, CcType::NTSC_CC_FIELD_1, 0x94, 0x2c },
+                                   { true, CcType::DTVCC_PACKET_DATA, 0x01, 0x02 } };
+  auto cc =
+    std::make_shared<OwnedSeiPayload>(build_cc_data_payload(triplets.data(), triplets.data() + triplets.size()));
+  OwnedSeiPayload unregistered(SeiType::USER_DATA_UNREGISTERED, std::vector<uint8_t>(0x14, 0x00));
+  auto au = access_unit(*cc, unregistered);
+
+  // Trace records of queries are filtered out, as they are at the default logging level
+  log::set_filter(boost::log::trivial::info, std::nullopt);
+
+  auto pkt = ff::packet_alloc();
+  size_t allocations = 0;
+
+  // Inputs are switched back and forth, so that closed captions are reset, while the queue of the user input is fed
+  // with closed captions of each frame. Packets are rewritten into pooled buffers, as SEI NALU changes its size.
+  auto inject = [&](int frame) {
+    auto pts = ClockTS(frame * 3003);
+    AbstractInput &input = frame % 50 < 40 ? static_cast<AbstractInput &>(ic.user) : ic.clear;
+    ic.user.push<SeiKind>(pts, pts, 0, cc, ic.ctx);
+
+    BOOST_TEST_REQUIRE(av_new_packet(pkt.get(), static_cast<int>(au.size())) == 0);
+    std::memcpy(pkt->data, au.data(), au.size());
+
+    AllocationCounter counter{};
+    injection.process(*pkt, pts, input, ic.ctx);
+    allocations += frame >= 100 ? counter.count() : 0;
+
+    BOOST_TEST_REQUIRE(pkt->size != static_cast<int>(au.size()));
+    auto seis = seis_of(*pkt);
+    BOOST_TEST_REQUIRE(seis.size() == 2);
+    BOOST_TEST(seis[0].type() == SeiType::USER_DATA_UNREGISTERED);
+    BOOST_TEST(is_closed_caption(seis[1]));
+
+    av_packet_unref(pkt.get());
+  };
+
+  for (int frame = 0; frame < 300; frame++) {
+    inject(frame);
+  }
+
+  log::set_filter(std::nullopt, std::nullopt);
+
+  BOOST_TEST(allocations == 0);
+}
+
+BOOST_AUTO_TEST_CASE(copied_reset_replaces_paced_frame)
+{
+  InjectionContext ic{};
+  SeiInjection injection(VideoCodec::H264, NaluFormat{}, TimeBase(30000, 1001), InjectionMode::DENSE);
+
+  std::vector<CcTriplet> triplets(CcData::MAX_CC_COUNT, { true, CcType::DTVCC_PACKET_DATA, 0x01, 0x02 });
+  auto cc =
+    std::make_shared<OwnedSeiPayload>(build_cc_data_payload(triplets.data(), triplets.data() + triplets.size()));
+  OwnedSeiPayload unregistered(SeiType::USER_DATA_UNREGISTERED, { 0x01 });
+  auto au = access_unit(*cc, unregistered);
+
+  // Reset read from shared memory queue or snapshot is a copy of the static one
+  auto reset = build_cc_reset_metadata(ic.user.spec().id, 0_clock);
+  auto reset_copy = std::make_shared<OwnedSeiPayload>(*reset.val);
+
+  auto pkt = ff::packet_alloc();
+  auto inject = [&](int frame, std::shared_ptr<OwnedSeiPayload> payload) {
+    auto pts = ClockTS(frame * 3003);
+    ic.user.push<SeiKind>(pts, pts, 0, payload, ic.ctx);
+
+    BOOST_TEST_REQUIRE(av_new_packet(pkt.get(), static_cast<int>(au.size())) == 0);
+    std::memcpy(pkt->data, au.data(), au.size());
+    injection.process(*pkt, pts, ic.user, ic.ctx);
+
+    auto seis = seis_of(*pkt);
+    av_packet_unref(pkt.get());
+    return seis;
+  };
+
+  // Captions of the first frame are buffered by pacer, behind the reset of switching to the input
+  inject(0, cc);
+
+  auto seis = inject(1, reset_copy);
+  BOOST_TEST_REQUIRE(seis.size() == 2);
+  BOOST_TEST(is_cc_reset_sei(seis[1]));
+  BOOST_CHECK_EQUAL_COLLECTIONS(seis[1].cbegin(), seis[1].cend(), reset.val->cbegin(), reset.val->cend());
+}
+
+BOOST_AUTO_TEST_CASE(unpaced_captions_are_limited_by_estimated_frame_rate)
+{
+  InjectionContext ic{};
+  SeiInjection injection(VideoCodec::H264, NaluFormat{}, TimeBase(0), InjectionMode::DENSE);
+
+  std::vector<CcTriplet> triplets(CcData::MAX_CC_COUNT, { true, CcType::DTVCC_PACKET_DATA, 0x01, 0x02 });
+  auto cc =
+    std::make_shared<OwnedSeiPayload>(build_cc_data_payload(triplets.data(), triplets.data() + triplets.size()));
+  OwnedSeiPayload unregistered(SeiType::USER_DATA_UNREGISTERED, { 0x01 });
+  auto au = access_unit(*cc, unregistered);
+
+  // Packets of 59.94 fps stream in decode order, frame duration being known from their fourth one on
+  auto pkt = ff::packet_alloc();
+  size_t packets = 0;
+  for (int frame : { 0, 3, 1, 2, 6, 4, 5, 9, 7, 8 }) {
+    auto pts = ClockTS(frame * 1501);
+    ic.user.push<SeiKind>(pts, pts, 0, cc, ic.ctx);
+
+    BOOST_TEST_REQUIRE(av_new_packet(pkt.get(), static_cast<int>(au.size())) == 0);
+    std::memcpy(pkt->data, au.data(), au.size());
+    injection.process(*pkt, pts, ic.user, ic.ctx);
+
+    auto seis = seis_of(*pkt);
+    av_packet_unref(pkt.get());
+    if (++packets < 4) {
+      continue;
+    }
+    BOOST_TEST_REQUIRE(seis.size() == 2);
+    BOOST_TEST(parse_cc_data(seis[1]).cc_count == 10);
+  }
+}
+
+BOOST_AUTO_TEST_SUITE_END()
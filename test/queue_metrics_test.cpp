@@ -0,0 +1,173 @@
+#include <boost/test/unit_test.hpp>
+
+#include <boost/test/data/monomorphic.hpp>
+#include <boost/test/data/test_case.hpp>
+#include <boost/test/test_tools.hpp>
+
+#include <iterator>
+#include <memory>
+#include <vector>
+
+#include <src/metadata_kind.h>
+#include <src/metadata_queue.h>
+#include <src/queue_metrics.h>
+
+namespace data = boost::unit_test::data;
+using namespace metamix;
+
+METAMIX_METADATA_KIND(MetricsKind, metrics, metrics, "METRICS", "Metrics")
+
+METAMIX_METADATA_KIND_MAP_TO_VALUE(MetricsKind, ClockTS)
+
+using MetricsMetadata = Metadata<MetricsKind>;
+
+static constexpr TS MS = SYS_CLOCK_RATE / 1000;
+
+static MetricsMetadata
+meta(InputId input_id, TS pts)
+{
+  return MetricsMetadata(input_id, ClockTS(pts), ClockTS(pts), 0, std::make_shared<ClockTS>(pts));
+}
+
+static const auto ENGINES = data::make(
+  { MetadataQueueEngine::HEAP, MetadataQueueEngine::RING, MetadataQueueEngine::CALENDAR, MetadataQueueEngine::LOG });
+
+struct ClockFixture
+{
+  std::shared_ptr<Clock> clock{ std::make_shared<Clock>() };
+
+  MetadataQueueConfig config(MetadataQueueEngine engine) const { return MetadataQueueConfig{ engine, {}, clock }; }
+};
+
+BOOST_AUTO_TEST_SUITE(queue_metrics_test)
+
+BOOST_AUTO_TEST_CASE(histogram_buckets)
+{
+  BOOST_TEST(LatencyHistogram::bucket_of(0) == 0);
+  BOOST_TEST(LatencyHistogram::bucket_of(1) == 1);
+  BOOST_TEST(LatencyHistogram::bucket_of(MS) == 1);
+  BOOST_TEST(LatencyHistogram::bucket_of(MS + 1) == 2);
+  BOOST_TEST(LatencyHistogram::bucket_of(10'000 * MS) == LatencyHistogram::BOUNDS_MS.size() - 1);
+  BOOST_TEST(LatencyHistogram::bucket_of(10'000 * MS + 1) == LatencyHistogram::BOUNDS_MS.size());
+}
+
+BOOST_AUTO_TEST_CASE(histogram_counts)
+{
+  LatencyHistogram h;
+  h.record(ClockTS(-5));
+  h.record(ClockTS(3 * MS));
+  h.record(ClockTS(3 * MS));
+
+  auto counts = h.counts();
+  BOOST_TEST(counts.count == 3);
+  BOOST_TEST(counts.sum == ClockTS(6 * MS));
+  BOOST_TEST(counts.buckets[0] == 1);
+  BOOST_TEST(counts.buckets[LatencyHistogram::bucket_of(3 * MS)] == 2);
+}
+
+BOOST_AUTO_TEST_CASE(metrics_ignore_untracked_inputs)
+{
+  QueueMetrics metrics;
+  metrics.record_push(QueueMetrics::MAX_INPUTS, ClockTS(1));
+  metrics.record_drop(QueueMetrics::MAX_INPUTS, DropReason::STALE);
+
+  size_t inputs = 0;
+  metrics.for_each_input([&](InputId, const QueueMetrics::InputMetrics &) { inputs++; });
+  BOOST_TEST(inputs == 0);
+}
+
+BOOST_AUTO_TEST_CASE(queue_without_clock_has_no_metrics)
+{
+  MetadataQueueVariant<MetricsKind> q;
+  q.push(meta(1, 100));
+  q.pop(1, 0, 1000);
+
+  BOOST_TEST(!q.has_metrics());
+  BOOST_TEST(!q.metrics().get(1));
+}
+
+BOOST_DATA_TEST_CASE_F(ClockFixture, residency_and_lead, ENGINES, engine)
+{
+  MetadataQueueVariant<MetricsKind> q(config(engine));
+  q.push(meta(1, 100));
+  *clock += ClockTS(4 * MS);
+  q.push(meta(1, 200));
+  *clock += ClockTS(4 * MS);
+
+  std::vector<MetricsMetadata> popped{};
+  BOOST_TEST(q.pop_all(1, 0, 1000, std::back_inserter(popped)) == 2);
+
+  auto metrics = q.metrics().get(1);
+  BOOST_REQUIRE(metrics);
+  BOOST_TEST(*metrics->newest_pts == ClockTS(200));
+  BOOST_TEST(metrics->residency.count == 2);
+  BOOST_TEST(metrics->residency.sum == ClockTS(12 * MS));
+  BOOST_TEST(metrics->residency.buckets[LatencyHistogram::bucket_of(4 * MS)] == 1);
+  BOOST_TEST(metrics->residency.buckets[LatencyHistogram::bucket_of(8 * MS)] == 1);
+}
+
+/// Output iterator recording count of owners of each written payload.
+struct UseCountIterator
+{
+  using iterator_category = std::output_iterator_tag;
+  using value_type = void;
+  using difference_type = void;
+  using pointer = void;
+  using reference = void;
+
+  std::vector<long> *use_counts;
+
+  UseCountIterator &operator*() { return *this; }
+  UseCountIterator &operator++() { return *this; }
+  UseCountIterator &operator++(int) { return *this; }
+
+  UseCountIterator &operator=(MetricsMetadata value)
+  {
+    use_counts->push_back(value.val.use_count());
+    return *this;
+  }
+};
+
+BOOST_DATA_TEST_CASE_F(ClockFixture, pop_all_moves_values, ENGINES, engine)
+{
+  MetadataQueueVariant<MetricsKind> q(config(engine));
+  auto m = meta(1, 100);
+  auto payload = m.val;
+  q.push(std::move(m));
+
+  // Payload is owned by the test and the written value only, popped entry has been moved from.
+  std::vector<long> use_counts{};
+  BOOST_TEST(q.pop_all(1, 0, 1000, UseCountIterator{ &use_counts }) == 1);
+  BOOST_TEST(use_counts == std::vector<long>{ 2 });
+}
+
+BOOST_DATA_TEST_CASE_F(ClockFixture, drop_reasons, ENGINES, engine)
+{
+  MetadataQueueVariant<MetricsKind> q(config(engine));
+  q.push(meta(1, 100));
+  q.push(meta(2, 300));
+  q.push(meta(1, 500));
+  q.push(meta(3, 600));
+
+  auto popped = q.pop(1, 200, 1000);
+  BOOST_REQUIRE(popped);
+  BOOST_TEST(popped->pts == ClockTS(500));
+  BOOST_TEST(q.drop_id(3) == 1);
+
+  auto input1 = q.metrics().get(1);
+  BOOST_REQUIRE(input1);
+  BOOST_TEST(input1->dropped_stale == 1);
+  BOOST_TEST(input1->dropped_foreign_input == 0);
+  BOOST_TEST(input1->residency.count == 1);
+
+  auto input2 = q.metrics().get(2);
+  BOOST_REQUIRE(input2);
+  BOOST_TEST(input2->dropped_stale == 0);
+  BOOST_TEST(input2->dropped_foreign_input == 1);
+
+  auto input3 = q.metrics().get(3);
+  BOOST_REQUIRE(input3);
+  BOOST_TEST(input3->dropped_drop_id == 1);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
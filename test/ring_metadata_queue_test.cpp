@@ -0,0 +1,296 @@
+#include <boost/test/unit_test.hpp>
+
+#include <boost/test/test_tools.hpp>
+
+#include <thread>
+
+#include <src/metadata_kind.h>
+#include <src/metadata_queue.h>
+#include <src/optional_io.h>
+#include <src/ring_metadata_queue.h>
+
+using namespace metamix;
+
+METAMIX_METADATA_KIND(RingTestKind, ring_test, ringTest, "RINGTEST", "Ring Test")
+
+METAMIX_METADATA_KIND_MAP_TO_VALUE(RingTestKind, ClockTS)
+
+using RingTestMetadata = Metadata<RingTestKind>;
+using RingTestMetadataQueue = RingMetadataQueue<RingTestKind>;
+
+static constexpr ClockTS
+nts(float i)
+{
+  return static_cast<ClockTS>(100.0f * i);
+}
+
+static RingTestMetadata
+nth(float i, InputId input_id = 0, int order = 0)
+{
+  return RingTestMetadata(input_id, nts(i), nts(i), order, std::make_shared<ClockTS>(nts(i)));
+}
+
+BOOST_AUTO_TEST_SUITE(ring_metadata_queue_test)
+
+BOOST_AUTO_TEST_CASE(empty)
+{
+  RingTestMetadataQueue q;
+  BOOST_TEST(q.empty());
+  BOOST_TEST(q.size() == 0);
+  BOOST_TEST(!q.pop(0, nts(0), nts(10)));
+}
+
+BOOST_AUTO_TEST_CASE(pop_head)
+{
+  RingTestMetadataQueue q;
+  q.push(nth(1));
+  q.push(nth(2));
+  q.push(nth(3));
+  BOOST_TEST(q.pop(0, nts(0.5), nts(1.5)) == nth(1));
+  BOOST_TEST(q.size() == 2);
+}
+
+BOOST_AUTO_TEST_CASE(pop_drops_stale_items_of_same_input)
+{
+  RingTestMetadataQueue q;
+  q.push(nth(1));
+  q.push(nth(2));
+  q.push(nth(3));
+  BOOST_TEST(q.pop(0, nts(1.5), nts(2.5)) == nth(2));
+  BOOST_TEST(q.size() == 1);
+}
+
+BOOST_AUTO_TEST_CASE(pop_drops_colliding_items_of_other_inputs)
+{
+  RingTestMetadataQueue q;
+  q.push(nth(1, 0));
+  q.push(nth(2, 0));
+  q.push(nth(1, 1));
+  q.push(nth(2, 1));
+  BOOST_TEST(q.pop(1, nts(0.5), nts(1.5)) == nth(1, 1));
+  BOOST_TEST(q.size() == 2);
+}
+
+BOOST_AUTO_TEST_CASE(pop_after)
+{
+  RingTestMetadataQueue q;
+  q.push(nth(1));
+  BOOST_TEST(!q.pop(0, nts(5), nts(6)));
+  BOOST_TEST(q.empty());
+}
+
+BOOST_AUTO_TEST_CASE(pop_all_drops_other_inputs)
+{
+  std::vector<RingTestMetadata> expected;
+  expected.push_back(nth(1, 0));
+  expected.push_back(nth(2, 0));
+  expected.push_back(nth(3, 0));
+
+  RingTestMetadataQueue q;
+  q.push(nth(0, 0));
+  q.push(nth(0, 1));
+
+  q.push(nth(1, 0));
+  q.push(nth(2, 0));
+  q.push(nth(3, 0));
+  q.push(nth(1, 2));
+  q.push(nth(2, 1));
+  q.push(nth(3, 2));
+
+  q.push(nth(4, 0));
+  q.push(nth(4, 2));
+
+  std::vector<RingTestMetadata> actual;
+  q.pop_all(0, nts(1), nts(4), std::back_inserter(actual));
+
+  BOOST_CHECK_EQUAL_COLLECTIONS(actual.begin(), actual.end(), expected.begin(), expected.end());
+  BOOST_TEST(q.size() == 2);
+}
+
+BOOST_AUTO_TEST_CASE(pop_all_keeps_order_within_frame)
+{
+  RingTestMetadataQueue q;
+  q.push(nth(1, 0, 0));
+  q.push(nth(1, 0, 1));
+  q.push(nth(1, 0, 2));
+
+  std::vector<RingTestMetadata> actual;
+  BOOST_TEST(q.pop_all(0, nts(1), nts(2), std::back_inserter(actual)) == 3);
+  BOOST_TEST(actual.at(0).order == 0);
+  BOOST_TEST(actual.at(1).order == 1);
+  BOOST_TEST(actual.at(2).order == 2);
+}
+
+BOOST_AUTO_TEST_CASE(pop_reorders_decode_order)
+{
+  // I0 P3 B1 B2 P6 B4 B5
+  RingTestMetadataQueue q;
+  for (float i : { 0, 3, 1, 2, 6, 4, 5 }) {
+    q.push(nth(i));
+  }
+
+  for (int i = 0; i <= 6; i++) {
+    BOOST_TEST(q.pop(0, nts(i), nts(i + 1)) == nth(i));
+  }
+  BOOST_TEST(q.empty());
+}
+
+BOOST_AUTO_TEST_CASE(pop_all_reorders_decode_order)
+{
+  RingTestMetadataQueue q;
+  for (float i : { 0, 3, 1, 2, 6, 4, 5 }) {
+    q.push(nth(i, 0));
+    q.push(nth(i, 1));
+  }
+
+  std::vector<RingTestMetadata> actual;
+  for (int i = 0; i <= 6; i++) {
+    BOOST_TEST(q.pop_all(0, nts(i), nts(i + 1), std::back_inserter(actual)) == 1);
+  }
+  for (int i = 0; i <= 6; i++) {
+    BOOST_TEST(actual.at(i) == nth(i, 0));
+  }
+  BOOST_TEST(q.empty());
+}
+
+BOOST_AUTO_TEST_CASE(drop_id_of_reordered_entries)
+{
+  RingTestMetadataQueue q;
+  q.push(nth(3));
+  q.push(nth(2));
+  BOOST_TEST(!q.pop(0, nts(0), nts(1)));
+  BOOST_TEST(q.size() == 2);
+
+  BOOST_TEST(q.drop_id(0) == 2);
+  BOOST_TEST(q.empty());
+
+  q.push(nth(4));
+  BOOST_TEST(q.pop(0, nts(0), nts(5)) == nth(4));
+  BOOST_TEST(q.empty());
+}
+
+BOOST_AUTO_TEST_CASE(drop_id)
+{
+  RingTestMetadataQueue q;
+  q.push(nth(2, 0));
+  q.push(nth(1, 1));
+  q.push(nth(2, 1));
+
+  auto dropped = q.drop_id(1);
+  BOOST_TEST(dropped == 2);
+  BOOST_TEST(q.size() == 1);
+
+  // Entries pushed after drop are alive.
+  q.push(nth(3, 1));
+  BOOST_TEST(q.size() == 2);
+  BOOST_TEST(q.pop(1, nts(0), nts(4)) == nth(3, 1));
+}
+
+BOOST_AUTO_TEST_CASE(overflow_drops_newest)
+{
+  RingTestMetadataQueue q(2);
+  q.push(nth(1));
+  q.push(nth(2));
+  q.push(nth(3));
+  BOOST_TEST(q.size() == 2);
+  BOOST_TEST(q.overflow_count() == 1);
+  BOOST_TEST(q.pop(0, nts(0), nts(10)) == nth(1));
+}
+
+BOOST_AUTO_TEST_CASE(never_evict_grows)
+{
+  RingTestMetadataQueue q(2, EvictionPolicy::NEVER_EVICT);
+  for (int i = 1; i <= 9; i++) {
+    q.push(nth(i));
+  }
+  BOOST_TEST(q.size() == 9);
+  BOOST_TEST(q.overflow_count() == 0);
+  BOOST_TEST(q.grow_count() == 2);
+  BOOST_TEST(q.stats().grown_buffers == 2);
+
+  std::vector<RingTestMetadata> actual;
+  BOOST_TEST(q.pop_all(0, nts(0), nts(10), std::back_inserter(actual)) == 9);
+  for (int i = 1; i <= 9; i++) {
+    BOOST_TEST(actual.at(i - 1) == nth(i));
+  }
+  BOOST_TEST(q.empty());
+}
+
+BOOST_AUTO_TEST_CASE(never_evict_drop_id_across_segments)
+{
+  std::vector<RingTestMetadata> batch{ nth(1, 1), nth(2, 1), nth(3, 1), nth(4, 1), nth(5, 1) };
+
+  RingTestMetadataQueue q(2, EvictionPolicy::NEVER_EVICT);
+  q.push_range(batch.begin(), batch.end());
+  BOOST_TEST(q.size() == 5);
+
+  BOOST_TEST(q.drop_id(1) == 5);
+  BOOST_TEST(q.empty());
+
+  q.push(nth(6, 1));
+  BOOST_TEST(q.pop(1, nts(0), nts(7)) == nth(6, 1));
+}
+
+BOOST_AUTO_TEST_CASE(push_range_splits_runs_of_inputs)
+{
+  std::vector<RingTestMetadata> batch{ nth(1, 0), nth(2, 0), nth(3, 0), nth(1, 1), nth(2, 1) };
+
+  RingTestMetadataQueue q(2);
+  q.push_range(batch.begin(), batch.end());
+  BOOST_TEST(q.size() == 4);
+  BOOST_TEST(q.overflow_count() == 1);
+
+  std::vector<RingTestMetadata> actual;
+  BOOST_TEST(q.pop_all(1, nts(0), nts(3), std::back_inserter(actual)) == 2);
+  BOOST_TEST(actual.at(0) == nth(1, 1));
+  BOOST_TEST(actual.at(1) == nth(2, 1));
+}
+
+BOOST_AUTO_TEST_CASE(concurrent_producers)
+{
+  constexpr int COUNT = 10000;
+  constexpr InputId INPUTS = 4;
+
+  RingTestMetadataQueue q(COUNT);
+
+  std::vector<std::thread> producers;
+  for (InputId id = 0; id < INPUTS; id++) {
+    producers.emplace_back([&q, id]() {
+      for (int i = 0; i < COUNT; i++) {
+        q.push(RingTestMetadata(id, ClockTS(i), ClockTS(i), 0, std::make_shared<ClockTS>(i)));
+      }
+    });
+  }
+
+  std::vector<RingTestMetadata> popped;
+  TS since = 0;
+  while (since < COUNT) {
+    q.pop_all(2, since, since + 100, std::back_inserter(popped));
+    if (popped.size() >= static_cast<size_t>(since + 100)) {
+      since += 100;
+    }
+  }
+
+  for (auto &th : producers) {
+    th.join();
+  }
+
+  BOOST_TEST(popped.size() == COUNT);
+  for (int i = 0; i < COUNT; i++) {
+    BOOST_TEST(popped[i].pts == ClockTS(i));
+  }
+}
+
+BOOST_AUTO_TEST_CASE(variant_dispatch)
+{
+  MetadataQueueVariant<RingTestKind> q(MetadataQueueEngine::RING);
+  BOOST_TEST(q.engine() == MetadataQueueEngine::RING);
+  q.push(nth(1, 0));
+  q.push(nth(1, 1));
+  BOOST_TEST(q.size() == 2);
+  BOOST_TEST(q.drop_id(1) == 1);
+  BOOST_TEST(q.pop(0, nts(0), nts(2)) == nth(1, 0));
+  BOOST_TEST(q.empty());
+}
+
+BOOST_AUTO_TEST_SUITE_END()
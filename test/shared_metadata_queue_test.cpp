@@ -0,0 +1,285 @@
+#include <boost/test/unit_test.hpp>
+
+#include <boost/test/test_tools.hpp>
+
+#include <initializer_list>
+#include <iterator>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include <src/h264/sei_payload.h>
+#include <src/metadata_queue.h>
+#include <src/program_options.h>
+#include <src/shared_memory.h>
+#include <src/shared_metadata_queue.h>
+
+using namespace metamix;
+using metamix::h264::OwnedSeiPayload;
+using metamix::h264::SeiType;
+
+using SeiQueue = SharedMetadataQueue<SeiKind>;
+
+static Metadata<SeiKind>
+sei(InputId input_id, TS pts, size_t size = 3)
+{
+  return Metadata<SeiKind>(input_id,
+                           ClockTS(pts),
+                           ClockTS(pts - 10),
+                           0,
+                           std::make_shared<OwnedSeiPayload>(SeiType::USER_DATA_REGISTERED,
+                                                             std::vector<uint8_t>(size, 0xb5)));
+}
+
+static bool
+same_entry(const Metadata<SeiKind> &lhs, const Metadata<SeiKind> &rhs)
+{
+  return lhs.input_id == rhs.input_id && lhs.pts == rhs.pts && lhs.dts == rhs.dts && lhs.order == rhs.order &&
+         lhs.val->type() == rhs.val->type() &&
+         std::vector<uint8_t>(lhs.val->begin(), lhs.val->end()) ==
+           std::vector<uint8_t>(rhs.val->begin(), rhs.val->end());
+}
+
+/// Unique shared memory object name, removed with fixture.
+struct SharedMemoryFixture
+{
+  std::string name{ "/metamix-test-" + std::to_string(::getpid()) };
+
+  SharedMemoryFixture() { SharedMemory::unlink(name); }
+
+  ~SharedMemoryFixture() { SharedMemory::unlink(name); }
+};
+
+/// Runs function in child process, and waits for it to exit.
+template<class F>
+static void
+run_in_child(F &&f)
+{
+  pid_t pid = ::fork();
+  BOOST_REQUIRE(pid >= 0);
+  if (pid == 0) {
+    f();
+    ::_exit(0);
+  }
+  ::waitpid(pid, nullptr, 0);
+}
+
+BOOST_AUTO_TEST_SUITE(shared_metadata_queue_test)
+
+BOOST_FIXTURE_TEST_CASE(entries_pass_between_instances, SharedMemoryFixture)
+{
+  SeiQueue producer(name, 16);
+  SeiQueue consumer(name, 16);
+
+  auto first = sei(1, 100);
+  first.queued_at = ClockTS(42);
+  producer.push(first);
+  std::vector<Metadata<SeiKind>> batch{ sei(1, 200), sei(2, 300) };
+  producer.push_range(batch.begin(), batch.end());
+  BOOST_TEST(consumer.size() == 3);
+
+  auto popped = consumer.pop(1, 0, 1000);
+  BOOST_REQUIRE(popped);
+  BOOST_TEST(same_entry(*popped, first));
+  BOOST_TEST(popped->queued_at == ClockTS(42));
+
+  std::vector<Metadata<SeiKind>> all{};
+  BOOST_TEST(consumer.pop_all(2, 0, 1000, std::back_inserter(all)) == 1);
+  BOOST_TEST(same_entry(all.front(), batch[1]));
+
+  // Entry of input 1 has been passed by pop of input 2.
+  BOOST_TEST(consumer.empty());
+}
+
+BOOST_FIXTURE_TEST_CASE(oversized_and_overflowing_entries_are_rejected, SharedMemoryFixture)
+{
+  SeiQueue q(name, 2, 64);
+  q.push(sei(1, 100, q.value_capacity()));
+  BOOST_TEST(q.size() == 0);
+  BOOST_TEST(q.overflow_count() == 1);
+
+  std::vector<Metadata<SeiKind>> batch{ sei(1, 100), sei(1, 200), sei(1, 300) };
+  q.push_range(batch.begin(), batch.end());
+  BOOST_TEST(q.size() == 2);
+  BOOST_TEST(q.overflow_count() == 2);
+}
+
+BOOST_FIXTURE_TEST_CASE(drop_id_discards_entries, SharedMemoryFixture)
+{
+  SeiQueue q(name, 16);
+  q.push(sei(1, 100));
+  q.push(sei(1, 200));
+  BOOST_TEST(q.drop_id(1) == 2);
+  q.push(sei(1, 300));
+
+  auto popped = q.pop(1, 0, 1000);
+  BOOST_REQUIRE(popped);
+  BOOST_TEST(popped->pts == ClockTS(300));
+}
+
+BOOST_FIXTURE_TEST_CASE(pop_reorders_decode_order, SharedMemoryFixture)
+{
+  SeiQueue producer(name, 16);
+  SeiQueue consumer(name, 16);
+
+  // I0 P3 B1 B2 P6 B4 B5
+  for (TS i : { 0, 3, 1, 2, 6, 4, 5 }) {
+    producer.push(sei(1, i * 100));
+    producer.push(sei(2, i * 100));
+  }
+  BOOST_TEST(consumer.size() == 14);
+
+  for (TS i = 0; i <= 5; i++) {
+    auto popped = consumer.pop(1, i * 100, (i + 1) * 100);
+    BOOST_REQUIRE(popped);
+    BOOST_TEST(same_entry(*popped, sei(1, i * 100)));
+  }
+  BOOST_TEST(consumer.size() == 2);
+
+  std::vector<Metadata<SeiKind>> all{};
+  BOOST_TEST(consumer.pop_all(2, 600, 700, std::back_inserter(all)) == 1);
+  BOOST_TEST(same_entry(all.front(), sei(2, 600)));
+  BOOST_TEST(consumer.empty());
+}
+
+BOOST_FIXTURE_TEST_CASE(drop_id_discards_reordered_entries, SharedMemoryFixture)
+{
+  SeiQueue q(name, 16);
+  q.push(sei(1, 300));
+  q.push(sei(1, 200));
+  BOOST_TEST(!q.pop(1, 0, 100).has_value());
+  BOOST_TEST(q.size() == 2);
+
+  BOOST_TEST(q.drop_id(1) == 2);
+  BOOST_TEST(q.empty());
+
+  q.push(sei(1, 400));
+  auto popped = q.pop(1, 0, 1000);
+  BOOST_REQUIRE(popped);
+  BOOST_TEST(popped->pts == ClockTS(400));
+  BOOST_TEST(q.empty());
+}
+
+BOOST_FIXTURE_TEST_CASE(incompatible_settings_are_rejected, SharedMemoryFixture)
+{
+  SeiQueue q(name, 16);
+  BOOST_CHECK_THROW(SeiQueue(name, 32), std::runtime_error);
+}
+
+BOOST_FIXTURE_TEST_CASE(dead_producer_is_taken_over, SharedMemoryFixture)
+{
+  SeiQueue consumer(name, 16);
+
+  run_in_child([&]() {
+    SeiQueue producer(name, 16);
+    producer.push(sei(1, 100));
+  });
+
+  consumer.push(sei(1, 200));
+
+  std::vector<Metadata<SeiKind>> popped{};
+  BOOST_TEST(consumer.pop_all(1, 0, 1000, std::back_inserter(popped)) == 2);
+}
+
+BOOST_FIXTURE_TEST_CASE(live_producer_is_not_taken_over, SharedMemoryFixture)
+{
+  SeiQueue q(name, 16);
+
+  int ready[2], release[2];
+  BOOST_REQUIRE(::pipe(ready) == 0);
+  BOOST_REQUIRE(::pipe(release) == 0);
+
+  pid_t pid = ::fork();
+  BOOST_REQUIRE(pid >= 0);
+  if (pid == 0) {
+    ::close(release[1]);
+    SeiQueue producer(name, 16);
+    producer.push(sei(1, 100));
+    char c = 0;
+    [[maybe_unused]] auto w = ::write(ready[1], &c, 1);
+    [[maybe_unused]] auto r = ::read(release[0], &c, 1);
+    ::_exit(0);
+  }
+
+  char c = 0;
+  BOOST_REQUIRE(::read(ready[0], &c, 1) == 1);
+  BOOST_CHECK_THROW(q.push(sei(1, 200)), std::runtime_error);
+  BOOST_TEST(q.pop(1, 0, 1000).has_value());
+
+  ::close(release[1]);
+  ::waitpid(pid, nullptr, 0);
+  for (int fd : { ready[0], ready[1], release[0] }) {
+    ::close(fd);
+  }
+}
+
+BOOST_FIXTURE_TEST_CASE(live_instance_of_same_process_is_not_taken_over, SharedMemoryFixture)
+{
+  std::vector<Metadata<SeiKind>> popped{};
+
+  {
+    SeiQueue producer(name, 16);
+    SeiQueue other(name, 16);
+
+    producer.push(sei(1, 100));
+    BOOST_CHECK_THROW(other.push(sei(1, 200)), std::runtime_error);
+
+    other.pop_all(1, 0, 1000, std::back_inserter(popped));
+    BOOST_CHECK_THROW(producer.pop(1, 0, 1000), std::runtime_error);
+  }
+
+  // Ownership is released with instances.
+  SeiQueue successor(name, 16);
+  successor.push(sei(1, 300));
+  BOOST_TEST(successor.pop_all(1, 0, 1000, std::back_inserter(popped)) == 1);
+  BOOST_TEST(popped.size() == 2);
+}
+
+BOOST_FIXTURE_TEST_CASE(lane_count_bounds_input_ids, SharedMemoryFixture)
+{
+  SeiQueue q(name, 16, SharedQueueSpec::DEFAULT_SLOT_SIZE, 2);
+  q.push(sei(1, 100));
+  BOOST_CHECK_THROW(q.push(sei(2, 100)), std::out_of_range);
+  BOOST_TEST(!q.pop(2, 0, 1000).has_value());
+  BOOST_TEST(q.size() == 0);
+
+  BOOST_CHECK_THROW(SeiQueue(name, 16, SharedQueueSpec::DEFAULT_SLOT_SIZE, 3), std::runtime_error);
+}
+
+BOOST_FIXTURE_TEST_CASE(queue_of_different_inputs_is_rejected, SharedMemoryFixture)
+{
+  ProgramOptions options{};
+  options.user_inputs = { InputSpec{ 1, "a" }, InputSpec{ 2, "b" } };
+  auto spec = options.shared_queue_spec();
+  BOOST_TEST(spec.lane_count == 3);
+
+  SeiQueue q(name, 16, spec.slot_size, spec.lane_count, spec.input_fingerprint);
+  BOOST_CHECK_NO_THROW(SeiQueue(name, 16, spec.slot_size, spec.lane_count, spec.input_fingerprint));
+
+  // Swapped inputs would feed each other's rings
+  options.user_inputs = { InputSpec{ 1, "b" }, InputSpec{ 2, "a" } };
+  auto swapped = options.shared_queue_spec();
+  BOOST_TEST(swapped.input_fingerprint != spec.input_fingerprint);
+  BOOST_CHECK_THROW(SeiQueue(name, 16, swapped.slot_size, swapped.lane_count, swapped.input_fingerprint),
+                    std::runtime_error);
+}
+
+BOOST_FIXTURE_TEST_CASE(variant_uses_shared_memory_engine, SharedMemoryFixture)
+{
+  MetadataQueueConfig config{};
+  config.engine = MetadataQueueEngine::SHM;
+  config.shared.name = name;
+
+  MetadataQueueVariant<SeiKind> q(config);
+  BOOST_TEST(!q.supports_snapshot());
+
+  q.push(sei(1, 100));
+  BOOST_TEST(q.pop(1, 0, 1000).has_value());
+
+  SharedMemory::unlink(name + "." + SeiKind::NAME);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,213 @@
+#include <boost/test/unit_test.hpp>
+
+#include <boost/test/data/monomorphic.hpp>
+#include <boost/test/data/test_case.hpp>
+#include <boost/test/test_tools.hpp>
+
+#include <cstdlib>
+#include <iterator>
+#include <string>
+#include <vector>
+
+#include <unistd.h>
+
+#include <src/binary_parser.h>
+#include <src/h264/sei_payload.h>
+#include <src/metadata_queue.h>
+#include <src/scte35/scte35.h>
+#include <src/snapshot.h>
+
+namespace data = boost::unit_test::data;
+namespace s = metamix::scte35;
+using namespace metamix;
+using metamix::h264::OwnedSeiPayload;
+using metamix::h264::SeiType;
+
+static Metadata<SeiKind>
+sei(InputId input_id, TS pts, int order = 0)
+{
+  return Metadata<SeiKind>(input_id,
+                           ClockTS(pts),
+                           ClockTS(pts - 10),
+                           order,
+                           std::make_shared<OwnedSeiPayload>(SeiType::USER_DATA_REGISTERED,
+                                                             std::initializer_list<uint8_t>{ 0xb5, 0x00, 0x31 }));
+}
+
+static Metadata<ScteKind>
+scte(InputId input_id, TS pts)
+{
+  return Metadata<ScteKind>(input_id,
+                            ClockTS(pts),
+                            ClockTS(pts),
+                            0,
+                            std::make_shared<s::SpliceInfoSection>(false, 0, 0, 0, 0xfff, s::SpliceNull{}));
+}
+
+static std::vector<uint8_t>
+payload(uint8_t fill, size_t size)
+{
+  return std::vector<uint8_t>(size, fill);
+}
+
+/// Temporary snapshot file path, removed with fixture.
+struct SnapshotFileFixture
+{
+  std::string path{ "/tmp/metamix-snapshot-test-XXXXXX" };
+
+  SnapshotFileFixture()
+  {
+    int fd = ::mkstemp(path.data());
+    BOOST_REQUIRE(fd >= 0);
+    ::close(fd);
+  }
+
+  ~SnapshotFileFixture() { ::unlink(path.c_str()); }
+};
+
+BOOST_AUTO_TEST_SUITE(snapshot_test)
+
+BOOST_AUTO_TEST_CASE(emit_and_parse)
+{
+  Snapshot snapshot{};
+  snapshot.clock = ClockTS(123'456'789);
+  snapshot.inputs = { { 0, "clear" }, { 1, "cam1" } };
+  snapshot.rescalers = {
+    { "input:cam1/SEICC/pts", TSRescaler::State{ ClockTS(-5), StreamTS(1'000) } },
+    { "output/TS/pts", TSRescaler::State{ ClockTS(42), std::nullopt } },
+  };
+  snapshot.get<SeiKind>() = { sei(1, 100, 0), sei(1, 100, 1), sei(0, -200) };
+  snapshot.get<ScteKind>() = { scte(1, 300) };
+
+  std::vector<uint8_t> buf{};
+  emit_snapshot(snapshot, buf);
+  Snapshot parsed = parse_snapshot(buf.data(), buf.data() + buf.size());
+
+  BOOST_TEST(parsed.clock == snapshot.clock);
+  BOOST_TEST((parsed.inputs == snapshot.inputs));
+  BOOST_TEST((parsed.rescalers == snapshot.rescalers));
+
+  const auto &seis = parsed.get<SeiKind>();
+  BOOST_REQUIRE(seis.size() == 3);
+  for (size_t i = 0; i < seis.size(); i++) {
+    const auto &expected = snapshot.get<SeiKind>()[i];
+    BOOST_TEST(seis[i].input_id == expected.input_id);
+    BOOST_TEST(seis[i].pts == expected.pts);
+    BOOST_TEST(seis[i].dts == expected.dts);
+    BOOST_TEST(seis[i].order == expected.order);
+    BOOST_TEST(seis[i].val->type() == expected.val->type());
+    BOOST_TEST(std::vector<uint8_t>(seis[i].val->begin(), seis[i].val->end()) ==
+                 std::vector<uint8_t>(expected.val->begin(), expected.val->end()),
+               boost::test_tools::per_element());
+  }
+
+  const auto &sctes = parsed.get<ScteKind>();
+  BOOST_REQUIRE(sctes.size() == 1);
+  BOOST_TEST(sctes[0] == snapshot.get<ScteKind>()[0]);
+}
+
+BOOST_AUTO_TEST_CASE(parse_truncated)
+{
+  Snapshot snapshot{};
+  snapshot.get<SeiKind>() = { sei(1, 100) };
+
+  std::vector<uint8_t> buf{};
+  emit_snapshot(snapshot, buf);
+  BOOST_CHECK_THROW(parse_snapshot(buf.data(), buf.data() + buf.size() - 1), BinaryParseError);
+}
+
+BOOST_FIXTURE_TEST_CASE(file_is_empty_initially, SnapshotFileFixture)
+{
+  SnapshotFile file(path, 64);
+  BOOST_TEST(file.slot_capacity() == 64);
+  BOOST_TEST(!file.read());
+}
+
+BOOST_FIXTURE_TEST_CASE(file_reads_latest_write, SnapshotFileFixture)
+{
+  SnapshotFile file(path, 64);
+  BOOST_TEST(file.write(payload(1, 10)));
+  BOOST_TEST(file.write(payload(2, 20)));
+  BOOST_TEST(file.write(payload(3, 30)));
+  BOOST_TEST(*file.read() == payload(3, 30), boost::test_tools::per_element());
+}
+
+BOOST_FIXTURE_TEST_CASE(file_rejects_oversized_payload, SnapshotFileFixture)
+{
+  SnapshotFile file(path, 64);
+  BOOST_TEST(file.write(payload(1, 10)));
+  BOOST_TEST(!file.write(payload(2, 65)));
+  BOOST_TEST(*file.read() == payload(1, 10), boost::test_tools::per_element());
+}
+
+BOOST_FIXTURE_TEST_CASE(file_survives_reopen, SnapshotFileFixture)
+{
+  {
+    SnapshotFile file(path, 64);
+    file.write(payload(1, 10));
+    file.write(payload(2, 20));
+  }
+
+  SnapshotFile file(path, 64);
+  BOOST_TEST(*file.read() == payload(2, 20), boost::test_tools::per_element());
+
+  // Next write must not overwrite the latest snapshot.
+  file.write(payload(3, 30));
+  BOOST_TEST(*file.read() == payload(3, 30), boost::test_tools::per_element());
+}
+
+BOOST_FIXTURE_TEST_CASE(file_falls_back_to_previous_slot_on_torn_write, SnapshotFileFixture)
+{
+  {
+    SnapshotFile file(path, 64);
+    file.write(payload(1, 10)); // slot 0
+    file.write(payload(2, 20)); // slot 1
+  }
+
+  // Corrupt payload of slot 1, as if write was interrupted.
+  {
+    FILE *f = std::fopen(path.c_str(), "r+b");
+    BOOST_REQUIRE(f != nullptr);
+    std::fseek(f, SnapshotFile::SLOT_HEADER_SIZE + 64 + SnapshotFile::SLOT_HEADER_SIZE + 5, SEEK_SET);
+    std::fputc(0xff, f);
+    std::fclose(f);
+  }
+
+  SnapshotFile file(path, 64);
+  BOOST_TEST(*file.read() == payload(1, 10), boost::test_tools::per_element());
+}
+
+BOOST_FIXTURE_TEST_CASE(file_keeps_latest_snapshot_on_resize, SnapshotFileFixture)
+{
+  {
+    SnapshotFile file(path, 64);
+    file.write(payload(1, 10));
+    file.write(payload(2, 20));
+  }
+
+  SnapshotFile file(path, 128);
+  BOOST_TEST(file.slot_capacity() == 128);
+  BOOST_TEST(*file.read() == payload(2, 20), boost::test_tools::per_element());
+}
+
+BOOST_DATA_TEST_CASE(queue_snapshot_is_non_destructive,
+                     data::make({ MetadataQueueEngine::HEAP, MetadataQueueEngine::CALENDAR, MetadataQueueEngine::LOG }),
+                     engine)
+{
+  MetadataQueueVariant<SeiKind> q(engine);
+  q.push(sei(1, 100));
+  q.push(sei(2, 200));
+  q.push(sei(1, 300));
+  q.drop_id(2);
+
+  std::vector<Metadata<SeiKind>> entries{};
+  q.snapshot(std::back_inserter(entries));
+
+  BOOST_TEST(entries.size() == 2);
+  for (const auto &meta : entries) {
+    BOOST_TEST(meta.input_id == 1);
+  }
+  BOOST_TEST(q.size() == 2);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -65,4 +65,14 @@ BOOST_AUTO_TEST_CASE(multiple_consecutive_tickers)
   }
 }
 
+BOOST_AUTO_TEST_CASE(resumed_ticker_continues_clock)
+{
+  auto c = std::make_shared<Clock>(100_clock);
+  TSTicker ts(c, c->now());
+  ts.tick(100_clock);
+  BOOST_TEST(c->now() == 100_clock);
+  ts.tick(120_clock);
+  BOOST_TEST(c->now() == 120_clock);
+}
+
 BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,110 @@
+#include <boost/test/unit_test.hpp>
+
+#include <boost/test/test_tools.hpp>
+
+#include <memory>
+#include <thread>
+#include <vector>
+
+#include <src/h264/sei_payload.h>
+#include <src/value_pool.h>
+#include <test/allocation_counter.h>
+
+using namespace metamix;
+using metamix::h264::OwnedSeiPayload;
+using metamix::h264::SeiType;
+using metamix::test::AllocationCounter;
+
+using SeiPool = ValuePool<OwnedSeiPayload>;
+
+static std::shared_ptr<OwnedSeiPayload>
+make_sei(SeiPool::Producer &producer, uint8_t byte)
+{
+  return producer.make(SeiType::USER_DATA_REGISTERED, std::initializer_list<uint8_t>{ 0xb5, byte });
+}
+
+BOOST_AUTO_TEST_SUITE(value_pool_test)
+
+BOOST_AUTO_TEST_CASE(released_value_memory_is_reused)
+{
+  SeiPool pool{};
+  auto producer = pool.producer();
+
+  auto first = make_sei(producer, 1);
+  const void *addr = first.get();
+  first.reset();
+
+  auto second = make_sei(producer, 2);
+  BOOST_TEST(second.get() == addr);
+  BOOST_TEST((*second)[1] == 2);
+
+  auto stats = pool.stats();
+  BOOST_TEST(stats.capacity == 1);
+  BOOST_TEST(stats.in_use == 1);
+  BOOST_TEST(stats.producers == 1);
+}
+
+BOOST_AUTO_TEST_CASE(values_released_by_consumer_return_to_producer)
+{
+  SeiPool pool{};
+  auto producer = pool.producer();
+
+  std::vector<std::shared_ptr<OwnedSeiPayload>> values{};
+  for (int i = 0; i < 16; i++) {
+    values.push_back(make_sei(producer, i));
+  }
+
+  std::thread consumer([&]() { values.clear(); });
+  consumer.join();
+  BOOST_TEST(pool.stats().in_use == 0);
+
+  std::vector<std::shared_ptr<OwnedSeiPayload>> reused{};
+  reused.reserve(16);
+
+  AllocationCounter counter{};
+  for (int i = 0; i < 16; i++) {
+    reused.push_back(make_sei(producer, i));
+  }
+  BOOST_TEST(counter.count() == 0);
+  BOOST_TEST(pool.stats().capacity == 16);
+  BOOST_TEST(pool.stats().in_use == 16);
+}
+
+BOOST_AUTO_TEST_CASE(shard_is_handed_to_next_producer)
+{
+  SeiPool pool{};
+  std::shared_ptr<OwnedSeiPayload> survivor{};
+
+  {
+    auto producer = pool.producer();
+    survivor = make_sei(producer, 1);
+    make_sei(producer, 2);
+
+    auto other = pool.producer();
+    BOOST_TEST(pool.stats().producers == 2);
+  }
+  BOOST_TEST(pool.stats().producers == 0);
+
+  // Values outlive their producer
+  BOOST_TEST((*survivor)[1] == 1);
+
+  auto producer = pool.producer();
+  make_sei(producer, 3);
+  auto stats = pool.stats();
+  BOOST_TEST(stats.capacity == 2);
+  BOOST_TEST(stats.in_use == 1);
+  BOOST_TEST(stats.producers == 1);
+}
+
+BOOST_AUTO_TEST_CASE(values_outlive_pool)
+{
+  std::shared_ptr<OwnedSeiPayload> value{};
+  {
+    SeiPool pool{};
+    auto producer = pool.producer();
+    value = make_sei(producer, 7);
+  }
+  BOOST_TEST((*value)[1] == 7);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,123 @@
+#include <boost/test/unit_test.hpp>
+
+#include <boost/test/test_tools.hpp>
+
+#include <cstdint>
+#include <vector>
+
+#include <src/h264/nalu_framing.h>
+#include <src/video_codec.h>
+
+using namespace metamix;
+using metamix::h264::AnnexBNaluViewParser;
+using metamix::h264::AvccNaluViewParser;
+
+static void
+append_avcc(std::vector<uint8_t> &au, std::vector<uint8_t> nalu)
+{
+  au.insert(au.end(), { 0x00, 0x00, 0x00, static_cast<uint8_t>(nalu.size()) });
+  au.insert(au.end(), nalu.begin(), nalu.end());
+}
+
+static const std::vector<uint8_t> AUD{ 0x09, 0xf0 };
+static const std::vector<uint8_t> SPS{ 0x67, 0x64, 0x00, 0x28 };
+static const std::vector<uint8_t> SEI{ 0x06, 0x05, 0x01, 0xaa, 0x80 };
+static const std::vector<uint8_t> SLICE{ 0x65, 0x88, 0x84, 0x21 };
+
+BOOST_AUTO_TEST_SUITE(video_codec_test)
+
+BOOST_AUTO_TEST_CASE(avcc_sei_nalu_is_found_after_preceding_nalus)
+{
+  std::vector<uint8_t> au{};
+  append_avcc(au, AUD);
+  append_avcc(au, SPS);
+  size_t begin = au.size();
+  append_avcc(au, SEI);
+  size_t end = au.size();
+  append_avcc(au, SLICE);
+
+  auto range = find_sei_nalu<H264SeiSyntax, AvccNaluViewParser<4>>(au.data(), au.size());
+
+  BOOST_TEST(range.begin == begin);
+  BOOST_TEST(range.end == end);
+  BOOST_TEST(std::vector<uint8_t>(range.nalu.cbegin(), range.nalu.cend()) == SEI, boost::test_tools::per_element());
+  BOOST_TEST(range.anchor.data() == range.nalu.data());
+}
+
+BOOST_AUTO_TEST_CASE(avcc_sei_nalu_is_inserted_before_slice)
+{
+  std::vector<uint8_t> au{};
+  append_avcc(au, AUD);
+  size_t begin = au.size();
+  append_avcc(au, SLICE);
+  append_avcc(au, SEI);
+
+  auto range = find_sei_nalu<H264SeiSyntax, AvccNaluViewParser<4>>(au.data(), au.size());
+
+  // SEI NALU following the slice is not looked for
+  BOOST_TEST(range.begin == begin);
+  BOOST_TEST(range.end == begin);
+  BOOST_TEST(range.nalu.empty());
+  BOOST_TEST(std::vector<uint8_t>(range.anchor.cbegin(), range.anchor.cend()) == SLICE,
+             boost::test_tools::per_element());
+}
+
+BOOST_AUTO_TEST_CASE(annexb_sei_range_covers_start_code_and_trailing_zeros)
+{
+  // AUD followed by trailing zero bytes, SEI NALU with 3-byte start code and slice
+  std::vector<uint8_t> au{ 0x00, 0x00, 0x00, 0x01, 0x09, 0xf0, 0x00, 0x00, 0x00, 0x01 };
+  au.insert(au.end(), SEI.begin(), SEI.end());
+  size_t end = au.size();
+  au.insert(au.end(), { 0x00, 0x00, 0x01 });
+  au.insert(au.end(), SLICE.begin(), SLICE.end());
+
+  auto range = find_sei_nalu<H264SeiSyntax, AnnexBNaluViewParser>(au.data(), au.size());
+
+  BOOST_TEST(range.begin == 6);
+  BOOST_TEST(range.end == end);
+  BOOST_TEST(std::vector<uint8_t>(range.nalu.cbegin(), range.nalu.cend()) == SEI, boost::test_tools::per_element());
+}
+
+BOOST_AUTO_TEST_CASE(annexb_sei_nalu_is_inserted_after_parameter_sets)
+{
+  std::vector<uint8_t> au{ 0x00, 0x00, 0x00, 0x01 };
+  au.insert(au.end(), SPS.begin(), SPS.end());
+  size_t begin = au.size();
+  au.insert(au.end(), { 0x00, 0x00, 0x01 });
+  au.insert(au.end(), SLICE.begin(), SLICE.end());
+
+  auto range = find_sei_nalu<H264SeiSyntax, AnnexBNaluViewParser>(au.data(), au.size());
+
+  BOOST_TEST(range.begin == begin);
+  BOOST_TEST(range.end == begin);
+  BOOST_TEST(range.nalu.empty());
+}
+
+BOOST_AUTO_TEST_CASE(h265_prefix_sei_nalu_is_found)
+{
+  std::vector<uint8_t> au{};
+  append_avcc(au, { 0x46, 0x01, 0x50 });
+  size_t begin = au.size();
+  append_avcc(au, { 0x4e, 0x01, 0x05, 0x01, 0xaa, 0x80 });
+  size_t end = au.size();
+  append_avcc(au, { 0x02, 0x01, 0xd0 });
+
+  auto range = find_sei_nalu<H265SeiSyntax, AvccNaluViewParser<4>>(au.data(), au.size());
+
+  BOOST_TEST(range.begin == begin);
+  BOOST_TEST(range.end == end);
+  BOOST_TEST(H265SeiSyntax::is_sei(range.nalu));
+}
+
+BOOST_AUTO_TEST_CASE(access_unit_without_nalus_gets_sei_nalu_at_start)
+{
+  std::vector<uint8_t> au{};
+
+  auto range = find_sei_nalu<H264SeiSyntax, AnnexBNaluViewParser>(au.data(), au.size());
+
+  BOOST_TEST(range.begin == 0);
+  BOOST_TEST(range.end == 0);
+  BOOST_TEST(range.anchor.empty());
+}
+
+BOOST_AUTO_TEST_SUITE_END()